@@ -0,0 +1,116 @@
+// Microbenchmark de la arena de parseo de libminishell.
+//
+// Parsea repetidamente un conjunto de líneas típicas y cuenta las llamadas a malloc/free por línea:
+//   - "strdup (antes)": las que hacía el parser original (una por argumento y por archivo de redirección)
+//   - "arena nueva":    creando y liberando la arena en cada línea (coste del primer uso)
+//   - "arena reiniciada": reutilizando la arena con arena_reiniciar(), como hace el shell
+//
+// Compilación (desde la raíz del repositorio):
+//   gcc -O2 -o bench_arena bench/bench_arena.c libminishell/minishell.c -lreadline -lhistory
+// Uso:
+//   ./bench_arena [iteraciones]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../libminishell/minishell.h"
+
+// --- Contador de asignaciones ---
+// Se interpone malloc/free sobre las de glibc; strdup y el resto de la libc también pasan por aquí.
+extern void *__libc_malloc(size_t tamano);
+extern void __libc_free(void *ptr);
+
+static unsigned long contador_malloc = 0;
+static unsigned long contador_free = 0;
+
+void *malloc(size_t tamano) {
+    contador_malloc++;
+    return __libc_malloc(tamano);
+}
+
+void free(void *ptr) {
+    if (ptr != NULL) {
+        contador_free++;
+    }
+    __libc_free(ptr);
+}
+
+static const char *lineas_muestra[] = {
+    "ls -la /tmp",
+    "cat archivo.txt | grep -v '^#' | sort | uniq -c > resultado.txt",
+    "grep \"hola mundo\" < entrada.txt >> salida.log",
+    "find . -name '*.c' | xargs wc -l && echo listo",
+    "echo uno dos tres cuatro cinco seis siete ocho nueve diez",
+    "ps aux | grep minishell | head -n 5",
+};
+#define NUM_LINEAS_MUESTRA (sizeof(lineas_muestra) / sizeof(lineas_muestra[0]))
+
+/**
+ * @brief Parsea una línea completa igual que el bucle principal del shell.
+ * @return Número de cadenas que el parser original habría duplicado con strdup.
+ */
+static int parsear_linea_bench(const char *linea, Arena *arena) {
+    int cadenas = 0;
+    LineaParseada *linea_parseada = (LineaParseada *)arena_reservar(arena, sizeof(LineaParseada));
+
+    if (parsear_linea(linea, linea_parseada, arena) != 0) {
+        return 0;
+    }
+    for (int s = 0; s < linea_parseada->num_segmentos; s++) {
+        for (int i = 0; i < linea_parseada->segmentos[s].num_comandos; i++) {
+            ComandoParseado *comando = &linea_parseada->segmentos[s].comandos[i];
+            cadenas += comando->argc;
+            cadenas += (comando->archivo_entrada != NULL) + (comando->archivo_salida != NULL);
+        }
+    }
+    return cadenas;
+}
+
+static double segundos_actuales(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    long iteraciones = argc > 1 ? atol(argv[1]) : 200000;
+    long total_lineas = iteraciones * (long)NUM_LINEAS_MUESTRA;
+    unsigned long cadenas_strdup = 0;
+
+    // 1. Arena nueva en cada línea
+    Arena arena = {NULL, NULL};
+    unsigned long malloc_inicio = contador_malloc;
+    double t0 = segundos_actuales();
+    for (long it = 0; it < iteraciones; it++) {
+        for (size_t l = 0; l < NUM_LINEAS_MUESTRA; l++) {
+            cadenas_strdup += parsear_linea_bench(lineas_muestra[l], &arena);
+            arena_liberar(&arena);
+        }
+    }
+    double t_nueva = segundos_actuales() - t0;
+    unsigned long malloc_nueva = contador_malloc - malloc_inicio;
+
+    // 2. Arena reutilizada con arena_reiniciar (comportamiento del shell)
+    malloc_inicio = contador_malloc;
+    unsigned long free_inicio = contador_free;
+    t0 = segundos_actuales();
+    for (long it = 0; it < iteraciones; it++) {
+        for (size_t l = 0; l < NUM_LINEAS_MUESTRA; l++) {
+            parsear_linea_bench(lineas_muestra[l], &arena);
+            arena_reiniciar(&arena);
+        }
+    }
+    double t_reiniciada = segundos_actuales() - t0;
+    unsigned long malloc_reiniciada = contador_malloc - malloc_inicio;
+    unsigned long free_reiniciada = contador_free - free_inicio;
+    arena_liberar(&arena);
+
+    printf("lineas parseadas por modo: %ld\n", total_lineas);
+    printf("%-20s %14s %12s\n", "modo", "malloc/linea", "ns/linea");
+    printf("%-20s %14.3f %12s\n", "strdup (antes)", (double)cadenas_strdup / total_lineas, "-");
+    printf("%-20s %14.3f %12.1f\n", "arena nueva", (double)malloc_nueva / total_lineas, t_nueva * 1e9 / total_lineas);
+    printf("%-20s %14.3f %12.1f\n", "arena reiniciada", (double)malloc_reiniciada / total_lineas, t_reiniciada * 1e9 / total_lineas);
+    printf("malloc totales en modo reiniciado: %lu (free: %lu)\n", malloc_reiniciada, free_reiniciada);
+    return 0;
+}
@@ -0,0 +1,296 @@
+// Benchmark de fork/exec y de tuberías: minishells frente a bash y dash.
+//
+// Cada shell se lanza como proceso hijo leyendo los comandos de un pipe (como si se escribieran en
+// la terminal). Tras cada comando medido se espera una marca en su salida, producida por
+// `/usr/bin/printf '%s%s\n' MAR CA` (el eco de readline muestra "MAR CA", nunca "MARCA"), así que
+// cada medida incluye todo lo que el shell hace por línea: prompt, parseo, fork, exec y espera.
+// Pruebas:
+//   - spawn:        latencia de un comando externo (p50/p99/media)
+//   - tuberia_N:    N etapas (`true | ... | printf`), N = 1..MAX_COMANDOS y más allá
+//   - rendimiento_K: GB/s de `head -c BYTES /dev/zero | cat | ... (K cats) > /dev/null`
+//   - and_K:        cadenas `true && ... && printf` de K segmentos
+// Antes de medir, cada línea se envía una vez seguida de una segunda marca ("MARCB"): si esta llega
+// sin que antes haya llegado "MARCA", el shell rechazó la línea (por ejemplo, más etapas que
+// MAX_COMANDOS) y la prueba se informa como "error" sin esperar a ningún timeout.
+//
+// Resultados: una línea JSON por medida en stdout (fácil de comparar entre versiones con jq o un
+// script); el progreso va a stderr.
+//
+// Compilación (desde la raíz del repositorio):
+//   gcc -O2 -o bench_ejecucion bench/bench_ejecucion.c
+// Uso:
+//   ./bench_ejecucion [-n iteraciones] [-m MiB] [shell ...]
+//   (por defecto: ./newerminis ./newminis bash dash; los que no existan se omiten)
+
+#define _GNU_SOURCE // memmem
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#define MARCA "MARCA\n"
+#define MARCA_COMPROBACION "MARCB\n"
+#define COMANDO_MARCA "/usr/bin/printf '%s%s\\n' MAR CA"
+#define COMANDO_COMPROBACION "/usr/bin/printf '%s%s\\n' MAR CB\n"
+#define ESPERA_MAXIMA_MS 60000      // Si la marca no llega en este tiempo, la medida es un error
+#define MAX_MUESTRAS 100000
+#define MAX_LINEA_BENCH 4096
+
+// Etapas de las pruebas de tuberías (10 = MAX_COMANDOS de los minishells)
+static const int etapas_tuberia[] = {1, 2, 4, 8, 10, 12, 16};
+static const int cats_rendimiento[] = {1, 4, 8};
+static const int segmentos_and[] = {1, 2, 3, 4, 5, 8};
+
+typedef struct {
+    const char *nombre; // Nombre del shell en los resultados
+    pid_t pid;
+    int fd_entrada;     // Escritura hacia el stdin del shell
+    int fd_salida;      // Lectura de su stdout + stderr
+    char cola[sizeof(MARCA)]; // Últimos bytes leídos (la marca puede llegar partida entre lecturas)
+} Shell;
+
+static double segundos_actuales(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Lanza un shell con stdin/stdout conectados a pipes.
+ * @return 0 si se lanzó, -1 si falló (o si el ejecutable no existe).
+ */
+static int lanzar_shell(Shell *shell, const char *ruta) {
+    int entrada[2], salida[2];
+
+    if (pipe(entrada) == -1 || pipe(salida) == -1) {
+        perror("pipe");
+        return -1;
+    }
+    shell->pid = fork();
+    if (shell->pid == -1) {
+        perror("fork");
+        return -1;
+    }
+    if (shell->pid == 0) {
+        dup2(entrada[0], STDIN_FILENO);
+        dup2(salida[1], STDOUT_FILENO);
+        dup2(salida[1], STDERR_FILENO);
+        close(entrada[0]); close(entrada[1]);
+        close(salida[0]); close(salida[1]);
+        execlp(ruta, ruta, (char *)NULL);
+        _exit(127);
+    }
+    close(entrada[0]);
+    close(salida[1]);
+    shell->nombre = ruta;
+    shell->fd_entrada = entrada[1];
+    shell->fd_salida = salida[0];
+    memset(shell->cola, 0, sizeof(shell->cola));
+    return 0;
+}
+
+static void cerrar_shell(Shell *shell) {
+    close(shell->fd_entrada); // EOF: el shell termina (Ctrl+D)
+    char descarte[4096];
+    while (read(shell->fd_salida, descarte, sizeof(descarte)) > 0) {
+    }
+    close(shell->fd_salida);
+    waitpid(shell->pid, NULL, 0);
+}
+
+/**
+ * @brief Envía una línea al shell y espera a que aparezca `marca_final` en su salida.
+ * @param vio_marca Si no es NULL, indica si apareció MARCA antes de `marca_final` (o junto a ella).
+ * @return Segundos transcurridos, o -1 si la marca no llegó (shell colgado o terminado).
+ */
+static double ejecutar_y_esperar(Shell *shell, const char *linea, const char *marca_final, int *vio_marca) {
+    char buffer[65536];
+    char ventana[sizeof(MARCA) - 1 + sizeof(buffer)];
+    const size_t cola = strlen(MARCA) - 1; // Ambas marcas tienen la misma longitud
+    size_t longitud = strlen(linea);
+    double inicio = segundos_actuales();
+
+    if (vio_marca != NULL) *vio_marca = 0;
+    if (write(shell->fd_entrada, linea, longitud) != (ssize_t)longitud) {
+        return -1;
+    }
+    while (1) {
+        struct pollfd pfd = {shell->fd_salida, POLLIN, 0};
+        int espera = ESPERA_MAXIMA_MS - (int)((segundos_actuales() - inicio) * 1000);
+        if (espera <= 0 || poll(&pfd, 1, espera) <= 0) {
+            return -1;
+        }
+        ssize_t leidos = read(shell->fd_salida, buffer, sizeof(buffer));
+        if (leidos <= 0) {
+            return -1;
+        }
+        // Busca las marcas en la cola de la lectura anterior más lo recién leído
+        memcpy(ventana, shell->cola, cola);
+        memcpy(ventana + cola, buffer, leidos);
+        size_t total = cola + leidos;
+        if (vio_marca != NULL && memmem(ventana, total, MARCA, strlen(MARCA)) != NULL) {
+            *vio_marca = 1;
+        }
+        int encontrada = memmem(ventana, total, marca_final, strlen(marca_final)) != NULL;
+        memcpy(shell->cola, ventana + total - cola, cola);
+        if (encontrada) {
+            memset(shell->cola, 0, sizeof(shell->cola)); // Que la marca no se cuente dos veces
+            return segundos_actuales() - inicio;
+        }
+    }
+}
+
+/**
+ * @brief Ejecuta la línea una vez (calentamiento) y comprueba que el shell la admite.
+ * @return 0 si la línea imprimió la marca, -1 si el shell la rechazó o no respondió.
+ */
+static int comprobar_linea(Shell *shell, const char *linea) {
+    char linea_comprobacion[MAX_LINEA_BENCH + sizeof(COMANDO_COMPROBACION)];
+    int vio_marca;
+
+    snprintf(linea_comprobacion, sizeof(linea_comprobacion), "%s%s", linea, COMANDO_COMPROBACION);
+    if (ejecutar_y_esperar(shell, linea_comprobacion, MARCA_COMPROBACION, &vio_marca) < 0 || !vio_marca) {
+        return -1;
+    }
+    return 0;
+}
+
+static int comparar_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Ejecuta una línea `iteraciones` veces y publica p50/p99/media en microsegundos.
+ * La línea debe terminar en la marca. Si el shell resulta no admitirla, se emite "error".
+ */
+static int medir_latencia(Shell *shell, const char *prueba, const char *linea, int iteraciones) {
+    static double muestras[MAX_MUESTRAS];
+    double suma = 0;
+
+    if (iteraciones > MAX_MUESTRAS) iteraciones = MAX_MUESTRAS;
+    if (comprobar_linea(shell, linea) < 0) {
+        printf("{\"shell\":\"%s\",\"prueba\":\"%s\",\"error\":true}\n", shell->nombre, prueba);
+        return -1;
+    }
+    for (int i = 0; i < iteraciones; i++) {
+        muestras[i] = ejecutar_y_esperar(shell, linea, MARCA, NULL);
+        if (muestras[i] < 0) {
+            printf("{\"shell\":\"%s\",\"prueba\":\"%s\",\"error\":true}\n", shell->nombre, prueba);
+            return -1;
+        }
+        suma += muestras[i];
+    }
+    qsort(muestras, iteraciones, sizeof(double), comparar_double);
+    printf("{\"shell\":\"%s\",\"prueba\":\"%s\",\"iteraciones\":%d,\"p50_us\":%.1f,\"p99_us\":%.1f,\"media_us\":%.1f}\n",
+           shell->nombre, prueba, iteraciones,
+           muestras[iteraciones / 2] * 1e6, muestras[(int)(iteraciones * 0.99)] * 1e6, suma / iteraciones * 1e6);
+    fflush(stdout);
+    return 0;
+}
+
+/**
+ * @brief Ejecuta todas las pruebas sobre un shell ya lanzado.
+ */
+static void ejecutar_pruebas(Shell *shell, int iteraciones, long mib) {
+    char linea[MAX_LINEA_BENCH];
+    char prueba[64];
+
+    // 1. Latencia de un comando externo
+    fprintf(stderr, "[%s] spawn\n", shell->nombre);
+    medir_latencia(shell, "spawn", COMANDO_MARCA "\n", iteraciones);
+
+    // 2. Tuberías de N etapas
+    for (size_t e = 0; e < sizeof(etapas_tuberia) / sizeof(etapas_tuberia[0]); e++) {
+        int n = 0;
+        for (int i = 0; i < etapas_tuberia[e] - 1; i++) {
+            n += snprintf(linea + n, sizeof(linea) - n, "/bin/true | ");
+        }
+        snprintf(linea + n, sizeof(linea) - n, "%s\n", COMANDO_MARCA);
+        snprintf(prueba, sizeof(prueba), "tuberia_%d", etapas_tuberia[e]);
+        fprintf(stderr, "[%s] %s\n", shell->nombre, prueba);
+        medir_latencia(shell, prueba, linea, iteraciones / 4 > 0 ? iteraciones / 4 : 1);
+    }
+
+    // 3. Rendimiento de una cadena de cats (la marca va en una línea aparte)
+    for (size_t c = 0; c < sizeof(cats_rendimiento) / sizeof(cats_rendimiento[0]); c++) {
+        int n = snprintf(linea, sizeof(linea), "head -c %ld /dev/zero", mib * 1024 * 1024);
+        for (int i = 0; i < cats_rendimiento[c]; i++) {
+            n += snprintf(linea + n, sizeof(linea) - n, " | cat");
+        }
+        snprintf(linea + n, sizeof(linea) - n, " > /dev/null\n%s\n", COMANDO_MARCA);
+        snprintf(prueba, sizeof(prueba), "rendimiento_%d", cats_rendimiento[c]);
+        fprintf(stderr, "[%s] %s\n", shell->nombre, prueba);
+        double mejor = -1;
+        for (int r = 0; r < 3 && (r > 0 || comprobar_linea(shell, linea) == 0); r++) { // Calentar y mejor de tres
+            double t = ejecutar_y_esperar(shell, linea, MARCA, NULL);
+            if (t < 0) { mejor = -1; break; }
+            if (mejor < 0 || t < mejor) mejor = t;
+        }
+        if (mejor < 0) {
+            printf("{\"shell\":\"%s\",\"prueba\":\"%s\",\"error\":true}\n", shell->nombre, prueba);
+        } else {
+            printf("{\"shell\":\"%s\",\"prueba\":\"%s\",\"bytes\":%ld,\"segundos\":%.4f,\"gb_s\":%.3f}\n",
+                   shell->nombre, prueba, mib * 1024 * 1024, mejor, mib * 1024.0 * 1024.0 / mejor / 1e9);
+        }
+        fflush(stdout);
+    }
+
+    // 4. Cadenas '&&'
+    for (size_t s = 0; s < sizeof(segmentos_and) / sizeof(segmentos_and[0]); s++) {
+        int n = 0;
+        for (int i = 0; i < segmentos_and[s] - 1; i++) {
+            n += snprintf(linea + n, sizeof(linea) - n, "/bin/true && ");
+        }
+        snprintf(linea + n, sizeof(linea) - n, "%s\n", COMANDO_MARCA);
+        snprintf(prueba, sizeof(prueba), "and_%d", segmentos_and[s]);
+        fprintf(stderr, "[%s] %s\n", shell->nombre, prueba);
+        medir_latencia(shell, prueba, linea, iteraciones / 4 > 0 ? iteraciones / 4 : 1);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    static const char *shells_por_defecto[] = {"./newerminis", "./newminis", "bash", "dash"};
+    const char **shells = shells_por_defecto;
+    int num_shells = sizeof(shells_por_defecto) / sizeof(shells_por_defecto[0]);
+    int iteraciones = 400;
+    long mib = 256;
+    int opcion;
+
+    while ((opcion = getopt(argc, argv, "n:m:")) != -1) {
+        switch (opcion) {
+        case 'n': iteraciones = atoi(optarg); break;
+        case 'm': mib = atol(optarg); break;
+        default:
+            fprintf(stderr, "Uso: %s [-n iteraciones] [-m MiB] [shell ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc) {
+        shells = (const char **)&argv[optind];
+        num_shells = argc - optind;
+    }
+    signal(SIGPIPE, SIG_IGN); // Un shell que termina antes de tiempo no debe matar al benchmark
+
+    for (int i = 0; i < num_shells; i++) {
+        Shell shell;
+        if (lanzar_shell(&shell, shells[i]) == -1) {
+            continue;
+        }
+        // Comprueba que el shell arrancó y responde antes de medir nada
+        if (comprobar_linea(&shell, COMANDO_MARCA "\n") < 0) {
+            fprintf(stderr, "[%s] no responde; se omite\n", shells[i]);
+            printf("{\"shell\":\"%s\",\"prueba\":\"arranque\",\"error\":true}\n", shells[i]);
+            cerrar_shell(&shell);
+            continue;
+        }
+        ejecutar_pruebas(&shell, iteraciones, mib);
+        cerrar_shell(&shell);
+    }
+    return 0;
+}
@@ -0,0 +1,288 @@
+// Microbenchmark del parser de libminishell (parsear_linea y ms_parsear con la caché de planes).
+//
+// Parsea varios corpus de líneas y, para cada uno, mide:
+//   - ns/linea y MB/s (bytes de línea procesados por segundo)
+//   - malloc/linea (se interpone malloc, como en bench_arena.c)
+// Corpus:
+//   - "historial":     comandos extraídos de servidor/server_history.log (uso real del cliente)
+//   - "tipicas":       tuberías, redirecciones y '&&' habituales
+//   - "comillas":      argumentos entre comillas de varios KiB (espacios y operadores dentro)
+//   - "escapes":       palabras con muchos '\\' (cada escape corta el tramo copiado en bloque)
+//   - "redirecciones": tuberías de MAX_COMANDOS etapas, cada una con '<' y '>>'
+//   - "erroneas":      errores de sintaxis (comillas sin cerrar, operadores sueltos, demasiados argumentos)
+// Cada corpus se mide con parsear_linea sobre una arena reiniciada (coste del parseo en frío)
+// y con ms_parsear, primero sin la caché de planes y después con ella (aciertos, como al repetir
+// líneas del historial). Las dos columnas de ms_parsear incluyen lo que añade en cada llamada
+// (reloj, histograma, sondas): la caché se compara con "ns/sin cache", no con "ns/linea". Las
+// líneas con errores de sintaxis y las de más de 4 KiB nunca se guardan en la caché.
+//
+// Compilación (desde la raíz del repositorio):
+//   gcc -O2 -o bench_parser bench/bench_parser.c libminishell/minishell.c -lreadline -lhistory
+// Uso:
+//   ./bench_parser [iteraciones] [historial.log]
+//   ./bench_parser --volcar-corpus DIRECTORIO [historial.log]   # semillas para fuzz_parser
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../libminishell/minishell.h"
+
+// --- Contador de asignaciones ---
+extern void *__libc_malloc(size_t tamano);
+extern void __libc_free(void *ptr);
+
+static unsigned long contador_malloc = 0;
+
+void *malloc(size_t tamano) {
+    contador_malloc++;
+    return __libc_malloc(tamano);
+}
+
+void free(void *ptr) {
+    __libc_free(ptr);
+}
+
+// --- Corpus ---
+#define MAX_LINEAS_CORPUS 256
+
+typedef struct {
+    const char *nombre;
+    char *lineas[MAX_LINEAS_CORPUS];
+    int num_lineas;
+    size_t bytes; // Suma de las longitudes de las líneas
+} Corpus;
+
+static void anadir_linea(Corpus *corpus, const char *linea) {
+    if (corpus->num_lineas >= MAX_LINEAS_CORPUS) {
+        return;
+    }
+    corpus->lineas[corpus->num_lineas++] = strdup(linea);
+    corpus->bytes += strlen(linea);
+}
+
+/**
+ * @brief Extrae los comandos del log del servidor.
+ * El log guarda los comandos del cliente como "[Cliente ... - COMANDO]: <línea>" y, en sesiones
+ * sin formato, como el eco del prompt "... $ <línea>".
+ */
+static void cargar_historial(Corpus *corpus, const char *ruta) {
+    FILE *archivo = fopen(ruta, "r");
+    char linea[4096];
+
+    if (archivo == NULL) {
+        perror(ruta);
+        return;
+    }
+    while (fgets(linea, sizeof(linea), archivo) != NULL) {
+        linea[strcspn(linea, "\r\n")] = '\0';
+        char *comando = strstr(linea, "- COMANDO]: ");
+        if (comando != NULL) {
+            comando += strlen("- COMANDO]: ");
+        } else if (strstr(linea, "MENSAJE SIN FORMATO]: ") != NULL && (comando = strstr(linea, " $ ")) != NULL) {
+            comando += 3;
+        } else {
+            continue;
+        }
+        if (comando[strspn(comando, " \t")] != '\0') {
+            anadir_linea(corpus, comando);
+        }
+    }
+    fclose(archivo);
+}
+
+static void generar_corpus(Corpus corpus[], const char *ruta_historial) {
+    static const char *tipicas[] = {
+        "ls -la /tmp",
+        "cat archivo.txt | grep -v '^#' | sort | uniq -c > resultado.txt",
+        "grep \"hola mundo\" < entrada.txt >> salida.log",
+        "find . -name '*.c' | xargs wc -l && echo listo",
+        "echo uno dos tres cuatro cinco seis siete ocho nueve diez",
+        "ps aux | grep minishell | head -n 5",
+        "make -j8 && ./newerminis",
+        "git log --oneline | head -n 20 | tail -n 5",
+    };
+    char linea[8192];
+
+    cargar_historial(&corpus[0], ruta_historial);
+
+    for (size_t i = 0; i < sizeof(tipicas) / sizeof(tipicas[0]); i++) {
+        anadir_linea(&corpus[1], tipicas[i]);
+    }
+
+    // Comillas largas: 1, 2 y 4 KiB de texto con espacios y operadores entre comillas
+    for (int tamano = 1024; tamano <= 4096; tamano *= 2) {
+        int n = snprintf(linea, sizeof(linea), "echo \"");
+        for (int i = 0; i < tamano; i++) {
+            linea[n++] = "abc def|ghi&&jkl>mno "[i % 21];
+        }
+        snprintf(linea + n, sizeof(linea) - n, "\" 'y otro | argumento' | wc -c");
+        anadir_linea(&corpus[2], linea);
+    }
+
+    // Escapes: palabras donde uno de cada dos caracteres es un escape
+    for (int repeticiones = 16; repeticiones <= 256; repeticiones *= 4) {
+        int n = snprintf(linea, sizeof(linea), "printf");
+        for (int i = 0; i < repeticiones && n < (int)sizeof(linea) - 16; i++) {
+            n += snprintf(linea + n, sizeof(linea) - n, " a\\ b\\|c\\\"d\\&");
+        }
+        anadir_linea(&corpus[3], linea);
+    }
+
+    // Redirecciones: MAX_COMANDOS etapas, cada una con entrada y salida a archivo
+    {
+        int n = 0;
+        for (int i = 0; i < MAX_COMANDOS; i++) {
+            n += snprintf(linea + n, sizeof(linea) - n, "%scat -n < entrada_%d.txt >> salida_%d.log",
+                          i > 0 ? " | " : "", i, i);
+        }
+        anadir_linea(&corpus[4], linea);
+        anadir_linea(&corpus[4], "sort < a > b && sort < c > d && sort < e >> f && sort < g > h");
+    }
+
+    // Erróneas: cada una termina en un error de sintaxis distinto
+    anadir_linea(&corpus[5], "echo \"comilla sin cerrar | wc");
+    anadir_linea(&corpus[5], "ls | | wc");
+    anadir_linea(&corpus[5], "&& ls");
+    anadir_linea(&corpus[5], "ls > ");
+    anadir_linea(&corpus[5], "cat < a < b");
+    anadir_linea(&corpus[5], "ls & echo");
+    {
+        int n = snprintf(linea, sizeof(linea), "echo");
+        for (int i = 0; i < MAX_ARGUMENTOS + 5; i++) {
+            n += snprintf(linea + n, sizeof(linea) - n, " arg%d", i);
+        }
+        anadir_linea(&corpus[5], linea);
+    }
+}
+
+static double segundos_actuales(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Escribe cada línea de los corpus como un archivo semilla para el fuzzer.
+ */
+static int volcar_corpus(Corpus corpus[], int num_corpus, const char *directorio) {
+    char ruta[4096];
+    int escritos = 0;
+
+    for (int c = 0; c < num_corpus; c++) {
+        for (int i = 0; i < corpus[c].num_lineas; i++) {
+            snprintf(ruta, sizeof(ruta), "%s/%s_%03d", directorio, corpus[c].nombre, i);
+            FILE *archivo = fopen(ruta, "w");
+            if (archivo == NULL) {
+                perror(ruta);
+                return 1;
+            }
+            fputs(corpus[c].lineas[i], archivo);
+            fclose(archivo);
+            escritos++;
+        }
+    }
+    printf("%d semillas escritas en %s\n", escritos, directorio);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    Corpus corpus[] = {
+        {"historial", {0}, 0, 0}, {"tipicas", {0}, 0, 0}, {"comillas", {0}, 0, 0},
+        {"escapes", {0}, 0, 0}, {"redirecciones", {0}, 0, 0}, {"erroneas", {0}, 0, 0},
+    };
+    const int num_corpus = sizeof(corpus) / sizeof(corpus[0]);
+    long iteraciones = 20000;
+    const char *ruta_historial = "servidor/server_history.log";
+
+    if (argc > 1 && strcmp(argv[1], "--volcar-corpus") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "Uso: %s --volcar-corpus DIRECTORIO [historial.log]\n", argv[0]);
+            return 1;
+        }
+        generar_corpus(corpus, argc > 3 ? argv[3] : ruta_historial);
+        return volcar_corpus(corpus, num_corpus, argv[2]);
+    }
+    if (argc > 1) iteraciones = atol(argv[1]);
+    if (argc > 2) ruta_historial = argv[2];
+
+    ms_iniciar(NULL);
+    generar_corpus(corpus, ruta_historial);
+
+    // Los errores de sintaxis se imprimen en stderr: se silencian durante la medición
+    int stderr_original = dup(STDERR_FILENO);
+    int nulo = open("/dev/null", O_WRONLY);
+    dup2(nulo, STDERR_FILENO);
+    close(nulo);
+
+    printf("%-14s %7s %10s %12s %10s %14s %13s %12s\n",
+           "corpus", "lineas", "bytes/lin", "ns/linea", "MB/s", "malloc/linea", "ns/sin cache", "ns/cache");
+    Arena arena = {NULL, NULL};
+    for (int c = 0; c < num_corpus; c++) {
+        if (corpus[c].num_lineas == 0) {
+            printf("%-14s %7d (vacío)\n", corpus[c].nombre, 0);
+            continue;
+        }
+        long total_lineas = iteraciones * corpus[c].num_lineas;
+
+        // 1. Parseo en frío con la arena reiniciada (calentamiento previo para no contar sus bloques)
+        for (int i = 0; i < corpus[c].num_lineas; i++) {
+            LineaParseada *lp = (LineaParseada *)arena_reservar(&arena, sizeof(LineaParseada));
+            parsear_linea(corpus[c].lineas[i], lp, &arena);
+            arena_reiniciar(&arena);
+        }
+        unsigned long malloc_inicio = contador_malloc;
+        double t0 = segundos_actuales();
+        for (long it = 0; it < iteraciones; it++) {
+            for (int i = 0; i < corpus[c].num_lineas; i++) {
+                LineaParseada *lp = (LineaParseada *)arena_reservar(&arena, sizeof(LineaParseada));
+                parsear_linea(corpus[c].lineas[i], lp, &arena);
+                arena_reiniciar(&arena);
+            }
+        }
+        double t_frio = segundos_actuales() - t0;
+        unsigned long mallocs = contador_malloc - malloc_inicio;
+
+        // 2. ms_parsear sin caché: el parseo más lo que ms_parsear añade siempre (reloj, histograma,
+        // sondas), la referencia con la que comparar la columna de la caché
+        MsConfiguracion sin_cache = {0, 0, 0, 0};
+        ms_iniciar(&sin_cache);
+        t0 = segundos_actuales();
+        for (long it = 0; it < iteraciones; it++) {
+            for (int i = 0; i < corpus[c].num_lineas; i++) {
+                ms_parsear(corpus[c].lineas[i], &arena);
+                arena_reiniciar(&arena);
+            }
+        }
+        double t_sin_cache = segundos_actuales() - t0;
+        ms_iniciar(NULL);
+
+        // 3. ms_parsear: tras la primera pasada las líneas válidas salen de la caché de planes
+        t0 = segundos_actuales();
+        for (long it = 0; it < iteraciones; it++) {
+            for (int i = 0; i < corpus[c].num_lineas; i++) {
+                ms_parsear(corpus[c].lineas[i], &arena);
+                arena_reiniciar(&arena);
+            }
+        }
+        double t_cache = segundos_actuales() - t0;
+
+        printf("%-14s %7d %10.0f %12.1f %10.1f %14.3f %13.1f %12.1f\n", corpus[c].nombre, corpus[c].num_lineas,
+               (double)corpus[c].bytes / corpus[c].num_lineas,
+               t_frio * 1e9 / total_lineas,
+               (double)corpus[c].bytes * iteraciones / t_frio / 1e6,
+               (double)mallocs / total_lineas,
+               t_sin_cache * 1e9 / total_lineas,
+               t_cache * 1e9 / total_lineas);
+        fflush(stdout);
+    }
+
+    dup2(stderr_original, STDERR_FILENO);
+    close(stderr_original);
+    arena_liberar(&arena);
+    ms_finalizar();
+    return 0;
+}
@@ -0,0 +1,138 @@
+// Harness de fuzzing del lexer y el parser de libminishell (libFuzzer o AFL++).
+//
+// Cada entrada se trata como una línea de comandos: se parsea con parsear_linea y con ms_parsear
+// (caché de planes) y se comprueban los invariantes del resultado. Cualquier violación aborta,
+// igual que los errores que detectan los sanitizers (desbordamientos del buffer de palabras,
+// lecturas fuera de la línea en el escaneo SIMD, etc.).
+//
+// libFuzzer (clang):
+//   clang -g -O1 -fsanitize=fuzzer,address,undefined -o fuzz_parser bench/fuzz_parser.c libminishell/minishell.c -lreadline -lhistory
+//   ./bench_parser --volcar-corpus corpus_fuzz && ./fuzz_parser corpus_fuzz
+// AFL++:
+//   afl-clang-fast -g -O1 -fsanitize=address,undefined -DFUZZ_CON_MAIN -o fuzz_parser bench/fuzz_parser.c libminishell/minishell.c -lreadline -lhistory
+//   afl-fuzz -i corpus_fuzz -o hallazgos -- ./fuzz_parser
+// Sin fuzzer (reproducir un caso o pasar el corpus como regresión):
+//   gcc -g -O1 -fsanitize=address,undefined -DFUZZ_CON_MAIN -o fuzz_parser bench/fuzz_parser.c libminishell/minishell.c -lreadline -lhistory
+//   ./fuzz_parser corpus_fuzz/*
+// MINISHELL_SIMD=escalar|sse2|avx2 fija la implementación del escaneo que se fuzzea.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "../libminishell/minishell.h"
+
+static Arena arena = {NULL, NULL};
+
+/**
+ * @brief Comprueba los invariantes de una línea parseada; aborta si alguno falla.
+ * Las palabras se escriben en un buffer del tamaño de la línea, así que la suma de sus
+ * longitudes (con su '\0') nunca puede superar strlen(linea) + 1.
+ */
+static void comprobar_linea(const LineaParseada *linea_parseada, size_t longitud_linea) {
+    size_t bytes_palabras = 0;
+
+    if (linea_parseada->num_segmentos < 0 || linea_parseada->num_segmentos > MAX_SEGMENTOS_AND) abort();
+    for (int s = 0; s < linea_parseada->num_segmentos; s++) {
+        const Tuberia *tuberia = &linea_parseada->segmentos[s];
+        if (tuberia->num_comandos < 1 || tuberia->num_comandos > MAX_COMANDOS) abort();
+        for (int i = 0; i < tuberia->num_comandos; i++) {
+            const ComandoParseado *comando = &tuberia->comandos[i];
+            if (comando->argc < 0 || comando->argc >= MAX_ARGUMENTOS) abort();
+            if (comando->argv[comando->argc] != NULL) abort(); // argv terminado en NULL para execvp
+            if (comando->argc == 0 && comando->archivo_entrada == NULL && comando->archivo_salida == NULL) abort();
+            for (int a = 0; a < comando->argc; a++) {
+                if (comando->argv[a] == NULL) abort();
+                bytes_palabras += strlen(comando->argv[a]) + 1;
+            }
+            if (comando->archivo_entrada != NULL) bytes_palabras += strlen(comando->archivo_entrada) + 1;
+            if (comando->archivo_salida != NULL) {
+                bytes_palabras += strlen(comando->archivo_salida) + 1;
+                if (comando->tipo_operacion != REDIR_SALIDA_TRUNCAR && comando->tipo_operacion != REDIR_SALIDA_ANEXAR) abort();
+            }
+        }
+    }
+    if (bytes_palabras > longitud_linea + 1) abort();
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *datos, size_t tamano) {
+    static int iniciada = 0;
+    static MsConfiguracion configuraciones[2] = {{0, 1, 0, 0}, {1, 1, 0, 0}};
+
+    if (!iniciada) {
+        ms_iniciar(&configuraciones[0]);
+        iniciada = 1;
+    }
+
+    // Se copia en un buffer exacto para que ASan detecte lecturas más allá del '\0'
+    // (salvo las lecturas alineadas del escaneo SIMD, que nunca cruzan de página).
+    char *linea = (char *)malloc(tamano + 1);
+    if (linea == NULL) return 0;
+    memcpy(linea, datos, tamano);
+    linea[tamano] = '\0';
+    size_t longitud = strlen(linea); // Un '\0' dentro de la entrada termina la línea, como en readline
+
+    LineaParseada *linea_parseada = (LineaParseada *)arena_reservar(&arena, sizeof(LineaParseada));
+    if (linea_parseada != NULL && parsear_linea(linea, linea_parseada, &arena) == 0) {
+        comprobar_linea(linea_parseada, longitud);
+    }
+    arena_reiniciar(&arena);
+
+    // Dos veces por la caché: la segunda llamada debe devolver el mismo plan (acierto)
+    LineaParseada *primera = ms_parsear(linea, &arena);
+    if (primera != NULL) {
+        comprobar_linea(primera, longitud);
+        if (longitud <= MAX_LONGITUD_LINEA_CACHE && ms_parsear(linea, &arena) != primera) abort();
+    }
+    arena_reiniciar(&arena);
+
+    // Alterna la configuración (con y sin '&') según el primer byte de la entrada
+    if (tamano > 0) {
+        ms_iniciar(&configuraciones[datos[0] & 1]);
+    }
+
+    free(linea);
+    return 0;
+}
+
+#ifdef FUZZ_CON_MAIN
+/**
+ * @brief Punto de entrada para AFL++ y para reproducir casos sin libFuzzer.
+ * Ejecuta el harness con cada archivo pasado como argumento, o con la entrada estándar si no hay ninguno.
+ */
+static void ejecutar_archivo(FILE *archivo) {
+    size_t capacidad = 4096, tamano = 0, leidos;
+    uint8_t *datos = (uint8_t *)malloc(capacidad);
+
+    while (datos != NULL && (leidos = fread(datos + tamano, 1, capacidad - tamano, archivo)) > 0) {
+        tamano += leidos;
+        if (tamano == capacidad) {
+            capacidad *= 2;
+            datos = (uint8_t *)realloc(datos, capacidad);
+        }
+    }
+    if (datos != NULL) {
+        LLVMFuzzerTestOneInput(datos, tamano);
+        free(datos);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        ejecutar_archivo(stdin);
+        return 0;
+    }
+    for (int i = 1; i < argc; i++) {
+        FILE *archivo = fopen(argv[i], "rb");
+        if (archivo == NULL) {
+            perror(argv[i]);
+            return 1;
+        }
+        ejecutar_archivo(archivo);
+        fclose(archivo);
+    }
+    printf("%d entradas procesadas sin errores\n", argc - 1);
+    return 0;
+}
+#endif // FUZZ_CON_MAIN
@@ -0,0 +1,3213 @@
+#define _GNU_SOURCE      // Para pipe2 (O_CLOEXEC) en los pipes del reactor
+#include <stdio.h>       // Funciones estándar de entrada/salida (printf, fprintf, perror)
+#include <stdlib.h>      // Funciones de utilidad general (malloc, free, exit, getenv)
+#include <stddef.h>      // Para max_align_t (alineación de las reservas de la arena)
+#include <unistd.h>      // Funciones de sistema POSIX (fork, execvp, pipe, dup2, chdir, gethostname, geteuid)
+#include <string.h>      // Funciones de manipulación de cadenas (strlen, strcmp, strncpy, strspn, strdup, memcpy)
+#include <sys/wait.h>    // Funciones para esperar cambios de estado en procesos hijos (wait, waitpid, WIFEXITED, WEXITSTATUS, WIFSIGNALED, WTERMSIG)
+#include <sys/resource.h> // Para wait4 y struct rusage (uso de recursos de cada hijo recolectado)
+#include <sys/stat.h>    // Para stat y S_ISREG (resolución de ejecutables en PATH)
+#include <errno.h>       // Para manejar códigos de error del sistema (errno, EINTR)
+#include <pwd.h>         // Para obtener información de usuario (getpwuid)
+#include <limits.h>      // Para límites del sistema (PATH_MAX, HOST_NAME_MAX)
+#include <fcntl.h>       // Para open, close, y flags como O_RDONLY, O_WRONLY, O_CREAT, O_APPEND, O_TRUNC
+#include <signal.h>      // Para manejo de señales (signal, sigaction, kill, SIG_IGN, SIG_DFL, SIGCHLD, SIGINT, SIGQUIT, SIGTSTP)
+#include <poll.h>        // Para poll (reactor de salida en streaming)
+#include <stdint.h>      // Para uintptr_t (alineación de los bloques SIMD del lexer) y uint64_t (hash de la caché de planes)
+#include <time.h>        // Para clock_gettime (marcas de tiempo de las trazas y las estadísticas)
+#include <sys/mman.h>    // Para mmap (memoria compartida de las estadísticas con los hijos)
+#include <sys/syscall.h> // Para syscall(SYS_perf_event_open)
+#include <linux/perf_event.h> // Atributos de los contadores hardware (prefijo 'perf')
+#include <termios.h>     // Para tcgetpgrp/tcsetpgrp (terminal del grupo de una tubería con límite de tiempo)
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>   // Intrínsecos SSE2/AVX2 para buscar caracteres especiales en bloque
+#endif
+
+#include <readline/history.h>  // Para el built-in 'history'
+
+#include "minishell.h"
+
+// --- Sondas USDT (bpftrace, perf probe, SystemTap) ---
+// Privadas de la biblioteca: los programas que la usan no ven <sys/sdt.h> ni estas macros, y los
+// front ends disparan linea_leida con ms_sonda_linea_leida().
+// Si al compilar existe <sys/sdt.h> (paquete systemtap-sdt-dev), cada sonda es un NOP más una nota
+// ELF: no cuesta nada mientras nadie la usa y se activa desde fuera sobre un shell en ejecución.
+// Sin el encabezado, o con -DMINISHELL_SIN_SONDAS, las sondas no generan ningún código.
+// Sondas del proveedor "minishell":
+//   linea_leida(linea)                      parseo_inicio(linea)   parseo_fin(linea, num_segmentos o -1)
+//   spawn_inicio(etapa, argv0)              spawn_fin(pid, argv0)  builtin_ejecutado(argv0)
+//   hijo_recolectado(pid, status, struct rusage *, utime_us, stime_us, maxrss_kb)
+#if !defined(MINISHELL_SIN_SONDAS) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define MS_SONDAS_USDT 1
+#endif
+#endif
+
+#ifdef MS_SONDAS_USDT
+#define MS_SONDA1(nombre, a) DTRACE_PROBE1(minishell, nombre, a)
+#define MS_SONDA2(nombre, a, b) DTRACE_PROBE2(minishell, nombre, a, b)
+#define MS_SONDA6(nombre, a, b, c, d, e, f) DTRACE_PROBE6(minishell, nombre, a, b, c, d, e, f)
+#else
+#define MS_SONDA1(nombre, a) ((void)0)
+#define MS_SONDA2(nombre, a, b) ((void)0)
+#define MS_SONDA6(nombre, a, b, c, d, e, f) ((void)0)
+#endif
+
+// --- Caché de planes de ejecución ---
+// Conserva el resultado de parsear las líneas ejecutadas recientemente (tuberías, argv, redirecciones
+// y rutas de los ejecutables ya resueltas en PATH). Volver a ejecutar una línea del historial, o la
+// misma línea dentro de un bucle, salta el parseo y la búsqueda en PATH y va directo a ejecutar la tubería.
+// Cada plan guarda su memoria en su propia arena, que se reutiliza cuando el plan se expulsa (LRU).
+typedef struct PlanCache {
+    char *linea;                          // Línea original (clave de la caché), copiada en la arena del plan
+    size_t longitud;                      // Longitud de la línea (se compara antes que los bytes)
+    uint64_t hash;                        // Hash de la línea (ver hash_linea)
+    LineaParseada linea_parseada;         // Resultado del parseo con rutas resueltas
+    Arena arena;                          // Memoria propia del plan (palabras, comandos, rutas)
+    struct PlanCache *siguiente_cubeta;   // Siguiente plan en la misma cubeta de la tabla hash
+    struct PlanCache *anterior_lru;       // Plan usado más recientemente que este
+    struct PlanCache *siguiente_lru;      // Plan usado menos recientemente que este
+} PlanCache;
+
+typedef struct {
+    PlanCache entradas[TAMANO_CACHE_PLANES];  // Almacenamiento fijo de los planes
+    PlanCache *cubetas[NUM_CUBETAS_CACHE];    // Tabla hash (listas enlazadas por cubeta)
+    PlanCache *mas_reciente;                  // Cabeza de la lista LRU
+    PlanCache *menos_reciente;                // Cola de la lista LRU (candidato a expulsión)
+    PlanCache *libres;                        // Planes sin usar (enlazados por siguiente_lru)
+    int inicializada;                         // 1 cuando la lista de libres ya se construyó
+    int num_entradas;                         // Entradas en uso
+    unsigned long aciertos;                   // Líneas servidas desde la caché
+    unsigned long fallos;                     // Líneas que hubo que parsear
+} CachePlanes;
+
+// Caché global de planes (el built-in 'cache' la consulta y la limpia)
+static CachePlanes cache_planes;
+
+// Configuración activa (ver ms_iniciar)
+static MsConfiguracion configuracion = {0, 1, 0, 0};
+
+// 1 si el front end llamó a ms_configurar_senales_shell(): solo entonces ms_esperar()
+// reenvía Ctrl+C/Ctrl+\ al proceso en primer plano.
+static int senales_shell_configuradas = 0;
+
+// Variable global para almacenar el PID del proceso hijo en primer plano.
+// Es crucial para enviar SIGINT/SIGQUIT al proceso que está activo en el foreground.
+// Se inicializa a 0 y se actualiza al lanzar una tubería en primer plano.
+static volatile pid_t pid_proceso_en_primer_plano = 0; // 'volatile' porque la modifica y la lee un manejador de señales
+
+// PIDs de los procesos lanzados en segundo plano que aún no se han recolectado (0 = hueco libre).
+// El manejador de SIGCHLD solo recolecta estos PIDs: si usara waitpid(-1) podría "robar" el estado
+// de una etapa en primer plano antes de que ms_esperar() la espere.
+static volatile pid_t pids_segundo_plano[MAX_TRABAJOS_SEGUNDO_PLANO];
+
+// Instante del fork de cada proceso en segundo plano (mismo índice que pids_segundo_plano; solo con trazas)
+static long long inicios_segundo_plano[MAX_TRABAJOS_SEGUNDO_PLANO];
+
+// Procesos en segundo plano ya recolectados cuyo span aún no se ha escrito (solo con trazas). La
+// recolección puede ocurrir en el manejador de SIGCHLD, donde snprintf no es seguro: allí solo se
+// copian enteros en un hueco libre ('pendiente' se escribe la última), y el span lo escribe después
+// el flujo normal del shell (ver trazar_segundo_plano_recolectados()).
+typedef struct {
+    sig_atomic_t pendiente; // 1: el hueco tiene un proceso cuyo span falta por escribir
+    pid_t pid;
+    int status;
+    long long inicio_ns;
+    long long fin_ns;
+} FinSegundoPlano;
+static volatile FinSegundoPlano fines_segundo_plano[MAX_TRABAJOS_SEGUNDO_PLANO];
+
+// Archivo de trazas abierto por ms_iniciar() si existe MINISHELL_TRACE (-1: trazas desactivadas).
+// Los hijos heredan el descriptor hasta el exec (O_CLOEXEC) y escriben sus eventos con pid_traza.
+static int fd_traza = -1;
+static pid_t pid_traza = 0; // PID del shell que abrió el archivo (el "proceso" de todos los eventos)
+
+// --- Estadísticas del shell (built-in 'stats') ---
+// Histogramas log-lineales al estilo HDR: 16 subcubetas por cada potencia de 2, así que cualquier
+// percentil tiene un error relativo menor del 6% con memoria fija (unos 5 KiB por histograma).
+#define SUBCUBETAS_HISTOGRAMA 16
+#define MAX_EXPONENTE_HISTOGRAMA 40 // Hasta 2^40 ns (~18 minutos); los valores mayores van a la última cubeta
+#define NUM_CUBETAS_HISTOGRAMA ((MAX_EXPONENTE_HISTOGRAMA - 3) * SUBCUBETAS_HISTOGRAMA)
+
+typedef struct {
+    unsigned long long cubetas[NUM_CUBETAS_HISTOGRAMA];
+    unsigned long long cuenta;   // Valores registrados
+    unsigned long long suma_ns;  // Para la media
+    unsigned long long max_ns;   // Valor exacto más alto
+} Histograma;
+
+typedef struct {
+    Histograma tiempo_comando;  // Cada tubería o built-in de una línea, de principio a fin
+    Histograma latencia_spawn;  // Desde el fork (en el padre) hasta que el hijo llama a exec
+    Histograma tiempo_parseo;   // ms_parsear(), acierte o no en la caché de planes
+    Histograma tiempo_prompt;   // ms_generar_prompt()
+    unsigned long long forks;            // Procesos creados
+    unsigned long long intentos_exec;    // Hijos que llegaron al exec
+    unsigned long long execs_fallidos;   // Hijos cuyo exec falló (exit 127)
+    unsigned long long execs_ruta_cache; // Exec con la ruta ya resuelta en PATH (sin búsqueda en el hijo)
+    unsigned long long errores_sintaxis; // Líneas rechazadas por el parser
+} Estadisticas;
+
+// Las estadísticas viven en una página compartida (ms_iniciar) para que los hijos registren su
+// latencia de spawn y sus exec antes de reemplazarse; hasta entonces, o si mmap falla, en memoria propia.
+static Estadisticas estadisticas_locales;
+static Estadisticas *estadisticas = &estadisticas_locales;
+static pid_t pid_estadisticas = 0; // Proceso que vuelca las estadísticas al salir (no sus hijos)
+
+// --- Prototipos de funciones internas ---
+static void manejador_sigint_quit(int signo); // Manejador para las señales SIGINT (Ctrl+C) y SIGQUIT (Ctrl+\)
+static void manejador_sigchld(int signo);     // Manejador para la señal SIGCHLD (recolecta los procesos en segundo plano)
+static void recolectar_segundo_plano(void);   // Recolecta sin bloquear los procesos en segundo plano que ya terminaron
+static void guardar_fin_segundo_plano(pid_t pid, long long inicio_ns, int status); // Apunta su span (seguro en un manejador)
+static void trazar_segundo_plano_recolectados(void); // Escribe los spans apuntados (fuera de los manejadores)
+static void limpiar_cache_planes(void);       // Vacía la caché de planes (sin liberar la memoria de las arenas)
+static void liberar_cache_planes(void);       // Libera las arenas de todos los planes
+static void abrir_traza(void);                // Abre el archivo de MINISHELL_TRACE (si está definida)
+static void traza_span_hasta(const char *nombre, const char *categoria, long long inicio_ns, long long fin_ns,
+                             pid_t tid, const char *args_json); // Span con instante final explícito
+static void iniciar_estadisticas(void);       // Mueve las estadísticas a memoria compartida y programa su volcado
+static void imprimir_estadisticas(FILE *salida); // Muestra los histogramas y contadores
+static void configurar_cgroups_desde_entorno(void); // Aplica MINISHELL_CGROUP (activación y límites)
+static void ejecutar_builtin_cgroup(const ComandoParseado *comando); // Built-in 'cgroup'
+
+/**
+ * @brief Configura la biblioteca antes de usarla.
+ * Puede llamarse de nuevo para cambiar la configuración; la caché de planes se vacía porque
+ * el parseo de una misma línea depende de ella (por ejemplo, si '&' está permitido).
+ * Si la configuración no fija un límite de tiempo por defecto, se toma de MINISHELL_TIMEOUT, y
+ * MINISHELL_CGROUP puede activar los cgroups de las tuberías y fijar sus límites.
+ *
+ * @param nueva_configuracion Configuración a aplicar, o NULL para usar los valores por defecto.
+ */
+void ms_iniciar(const MsConfiguracion *nueva_configuracion) {
+    if (nueva_configuracion != NULL) {
+        configuracion = *nueva_configuracion;
+    } else {
+        configuracion.permitir_segundo_plano = 0;
+        configuracion.usar_cache_planes = 1;
+        configuracion.limite_por_defecto_ms = 0;
+        configuracion.usar_cgroups = 0;
+    }
+    // Límite de tiempo por defecto desde el entorno (solo si la configuración no fija uno)
+    const char *limite = getenv("MINISHELL_TIMEOUT");
+    if (configuracion.limite_por_defecto_ms == 0 && limite != NULL &&
+        ms_parsear_duracion(limite, &configuracion.limite_por_defecto_ms) != 0) {
+        fprintf(stderr, "MINISHELL_TIMEOUT: duración no válida '%s' (ej: 30, 1.5s, 500ms, 2m, 1h).\n", limite);
+        fflush(stderr);
+    }
+    configurar_cgroups_desde_entorno();
+    inicializar_buscador_especial();
+    limpiar_cache_planes();
+    abrir_traza();
+    iniciar_estadisticas();
+}
+
+/**
+ * @brief Libera la memoria interna de la biblioteca (arenas de la caché de planes).
+ * Los planes devueltos por ms_parsear() dejan de ser válidos.
+ */
+void ms_finalizar(void) {
+    liberar_cache_planes();
+    if (fd_traza != -1 && getpid() == pid_traza) {
+        trazar_segundo_plano_recolectados();
+        // Último evento sin coma y cierre del array JSON
+        char cierre[160];
+        long long ahora_ns = ms_traza_ahora();
+        int n = snprintf(cierre, sizeof(cierre),
+                         "{\"name\":\"fin\",\"cat\":\"shell\",\"ph\":\"i\",\"s\":\"p\",\"ts\":%lld.%03lld,\"pid\":%d,\"tid\":%d}\n]\n",
+                         ahora_ns / 1000, ahora_ns % 1000, (int)pid_traza, (int)pid_traza);
+        if (write(fd_traza, cierre, n) != n) {
+            imprimir_error("MINISHELL_TRACE");
+        }
+        close(fd_traza);
+        fd_traza = -1;
+    }
+}
+
+// --- Trazas ---
+
+/**
+ * @brief Abre el archivo indicado en MINISHELL_TRACE, si está definida y no se abrió ya.
+ * Cada evento se escribe con un único write() en modo O_APPEND terminado en ",\n", de modo que el
+ * shell y sus hijos (antes del exec) pueden añadir eventos al mismo archivo sin mezclarse. El array
+ * JSON se cierra en ms_finalizar(); si el shell termina sin llamarla, Perfetto y chrome://tracing
+ * aceptan igualmente el archivo sin cerrar.
+ */
+static void abrir_traza(void) {
+    const char *ruta = getenv("MINISHELL_TRACE");
+    char cabecera[256];
+
+    if (fd_traza != -1 || ruta == NULL || ruta[0] == '\0') {
+        return;
+    }
+    fd_traza = open(ruta, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_traza == -1) {
+        imprimir_error("MINISHELL_TRACE");
+        return;
+    }
+    pid_traza = getpid();
+    int n = snprintf(cabecera, sizeof(cabecera),
+                     "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+                     (int)pid_traza, (int)pid_traza, program_invocation_short_name);
+    if (n <= 0 || n >= (int)sizeof(cabecera) || write(fd_traza, cabecera, n) != n) {
+        imprimir_error("MINISHELL_TRACE");
+        close(fd_traza);
+        fd_traza = -1;
+    }
+}
+
+/**
+ * @brief Instante actual en nanosegundos (CLOCK_MONOTONIC).
+ */
+static long long reloj_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief Devuelve el instante actual en nanosegundos (reloj monótono) para abrir un span.
+ * @return El instante, o 0 si las trazas están desactivadas (así el coste sin trazas es una comparación).
+ */
+long long ms_traza_ahora(void) {
+    if (fd_traza == -1) {
+        return 0;
+    }
+    return reloj_ns();
+}
+
+/**
+ * @brief Escribe un evento en el archivo de trazas con un solo write().
+ * Los eventos se formatean con snprintf, así que nada de esto puede llamarse desde un manejador de
+ * señales (el de SIGCHLD deja los datos en fines_segundo_plano).
+ */
+static void escribir_evento_traza(const char *evento, int longitud) {
+    if (longitud > 0 && longitud < 1024) {
+        ssize_t escritos = write(fd_traza, evento, longitud);
+        (void)escritos; // Un evento perdido no debe interrumpir el shell
+    }
+}
+
+/**
+ * @brief Registra un span completo ("ph":"X") desde `inicio_ns` hasta ahora.
+ *
+ * @param nombre Nombre del span (se muestra en Perfetto).
+ * @param categoria Categoría del span ("shell", "parser", "ejecucion"...).
+ * @param inicio_ns Valor devuelto por ms_traza_ahora() al empezar (0: no se registra nada).
+ * @param tid Pista del evento: el PID de un hijo, o 0 para la pista del propio shell.
+ * @param args_json Objeto JSON con argumentos del span (ej: "{\"etapa\":1}"), o NULL.
+ */
+void ms_traza_span(const char *nombre, const char *categoria, long long inicio_ns, pid_t tid, const char *args_json) {
+    traza_span_hasta(nombre, categoria, inicio_ns, ms_traza_ahora(), tid, args_json);
+}
+
+/**
+ * @brief Registra un span completo desde `inicio_ns` hasta `fin_ns` (ver ms_traza_span()).
+ */
+static void traza_span_hasta(const char *nombre, const char *categoria, long long inicio_ns, long long fin_ns,
+                             pid_t tid, const char *args_json) {
+    char evento[1024];
+
+    if (fd_traza == -1 || inicio_ns == 0) {
+        return;
+    }
+    long long duracion_ns = fin_ns - inicio_ns;
+    int n = snprintf(evento, sizeof(evento),
+                     "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lld.%03lld,\"dur\":%lld.%03lld,\"pid\":%d,\"tid\":%d%s%s},\n",
+                     nombre, categoria, inicio_ns / 1000, inicio_ns % 1000, duracion_ns / 1000, duracion_ns % 1000,
+                     (int)pid_traza, (int)(tid != 0 ? tid : pid_traza),
+                     args_json != NULL ? ",\"args\":" : "", args_json != NULL ? args_json : "");
+    escribir_evento_traza(evento, n);
+}
+
+/**
+ * @brief Copia `origen` en `destino` como contenido de una cadena JSON (escapa '"' y '\\').
+ */
+static void escapar_json(char *destino, size_t tamano, const char *origen) {
+    size_t j = 0;
+    for (size_t i = 0; origen != NULL && origen[i] != '\0' && j + 3 < tamano; i++) {
+        unsigned char c = (unsigned char)origen[i];
+        if (c == '"' || c == '\\') {
+            destino[j++] = '\\';
+            destino[j++] = (char)c;
+        } else {
+            destino[j++] = c < 0x20 ? '?' : (char)c; // Los caracteres de control no se escapan: se sustituyen
+        }
+    }
+    destino[j] = '\0';
+}
+
+/**
+ * @brief Da nombre (el del comando) a la pista de un hijo en el visor de trazas.
+ * La escribe el propio hijo antes del exec, cuando aún tiene el descriptor de trazas.
+ */
+static void nombrar_pista_traza(pid_t tid, const char *nombre) {
+    char nombre_json[128];
+    char evento[256];
+
+    escapar_json(nombre_json, sizeof(nombre_json), nombre);
+    int n = snprintf(evento, sizeof(evento),
+                     "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+                     (int)pid_traza, (int)tid, nombre_json);
+    escribir_evento_traza(evento, n);
+}
+
+/**
+ * @brief Registra la vida de un hijo, desde su fork (`inicio_ns`) hasta que el shell lo recolectó (`fin_ns`).
+ */
+static void traza_fin_proceso(pid_t pid, long long inicio_ns, long long fin_ns, int status) {
+    char args[64];
+
+    if (fd_traza == -1 || inicio_ns == 0) {
+        return;
+    }
+    snprintf(args, sizeof(args), "{\"estado\":%d}",
+             WIFEXITED(status) ? WEXITSTATUS(status) : WIFSIGNALED(status) ? 128 + WTERMSIG(status) : -1);
+    traza_span_hasta("proceso", "ejecucion", inicio_ns, fin_ns, pid, args);
+}
+
+/**
+ * @brief Dispara la sonda USDT linea_leida con la línea que el front end acaba de leer.
+ */
+void ms_sonda_linea_leida(const char *linea) {
+    MS_SONDA1(linea_leida, linea);
+#ifndef MS_SONDAS_USDT
+    (void)linea;
+#endif
+}
+
+/**
+ * @brief Dispara la sonda USDT hijo_recolectado con el estado y el uso de recursos del hijo.
+ */
+static void sonda_hijo_recolectado(pid_t pid, int status, struct rusage *uso) {
+#ifdef MS_SONDAS_USDT
+    long long utime_us = (long long)uso->ru_utime.tv_sec * 1000000 + uso->ru_utime.tv_usec;
+    long long stime_us = (long long)uso->ru_stime.tv_sec * 1000000 + uso->ru_stime.tv_usec;
+    MS_SONDA6(hijo_recolectado, (int)pid, status, uso, utime_us, stime_us, uso->ru_maxrss);
+#else
+    (void)pid;
+    (void)status;
+    (void)uso;
+#endif
+}
+
+// --- Estadísticas ---
+
+/**
+ * @brief Índice de la cubeta de un valor: exacta por debajo de 16 ns y, a partir de ahí,
+ * 16 subcubetas por potencia de 2.
+ */
+static int cubeta_histograma(unsigned long long valor) {
+    if (valor < SUBCUBETAS_HISTOGRAMA) {
+        return (int)valor;
+    }
+    int exponente = 63 - __builtin_clzll(valor); // >= 4
+    if (exponente >= MAX_EXPONENTE_HISTOGRAMA) {
+        return NUM_CUBETAS_HISTOGRAMA - 1;
+    }
+    return (exponente - 3) * SUBCUBETAS_HISTOGRAMA + (int)((valor >> (exponente - 4)) & (SUBCUBETAS_HISTOGRAMA - 1));
+}
+
+/**
+ * @brief Valor representativo (punto medio) de una cubeta.
+ */
+static unsigned long long valor_cubeta(int cubeta) {
+    if (cubeta < SUBCUBETAS_HISTOGRAMA) {
+        return (unsigned long long)cubeta;
+    }
+    int exponente = cubeta / SUBCUBETAS_HISTOGRAMA + 3;
+    unsigned long long inferior = (unsigned long long)(SUBCUBETAS_HISTOGRAMA + cubeta % SUBCUBETAS_HISTOGRAMA) << (exponente - 4);
+    return inferior + ((1ULL << (exponente - 4)) >> 1);
+}
+
+/**
+ * @brief Registra una duración en un histograma que solo actualiza el shell (comando, parseo, prompt).
+ */
+static void registrar_histograma(Histograma *histograma, long long duracion_ns) {
+    unsigned long long valor = duracion_ns > 0 ? (unsigned long long)duracion_ns : 0;
+
+    histograma->cubetas[cubeta_histograma(valor)]++;
+    histograma->cuenta++;
+    histograma->suma_ns += valor;
+    if (valor > histograma->max_ns) {
+        histograma->max_ns = valor;
+    }
+}
+
+/**
+ * @brief Registra una duración desde un hijo. Usa operaciones atómicas porque varias etapas de
+ * una tubería escriben a la vez en la memoria compartida.
+ */
+static void registrar_histograma_atomico(Histograma *histograma, long long duracion_ns) {
+    unsigned long long valor = duracion_ns > 0 ? (unsigned long long)duracion_ns : 0;
+    unsigned long long maximo = __atomic_load_n(&histograma->max_ns, __ATOMIC_RELAXED);
+
+    __atomic_fetch_add(&histograma->cubetas[cubeta_histograma(valor)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histograma->cuenta, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histograma->suma_ns, valor, __ATOMIC_RELAXED);
+    while (valor > maximo &&
+           !__atomic_compare_exchange_n(&histograma->max_ns, &maximo, valor, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        // Otro proceso actualizó el máximo: se vuelve a comparar con el nuevo valor
+    }
+}
+
+/**
+ * @brief Incrementa un contador que también actualizan los hijos (execs).
+ */
+static void incrementar_contador(unsigned long long *contador) {
+    __atomic_fetch_add(contador, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Valor por debajo del cual queda la fracción `percentil` de las muestras.
+ */
+static unsigned long long percentil_histograma(const Histograma *histograma, double percentil) {
+    unsigned long long objetivo = (unsigned long long)(percentil * histograma->cuenta + 0.5);
+    unsigned long long acumulado = 0;
+
+    if (objetivo == 0) objetivo = 1;
+    for (int i = 0; i < NUM_CUBETAS_HISTOGRAMA; i++) {
+        acumulado += histograma->cubetas[i];
+        if (acumulado >= objetivo) {
+            unsigned long long valor = valor_cubeta(i);
+            return valor < histograma->max_ns ? valor : histograma->max_ns;
+        }
+    }
+    return histograma->max_ns;
+}
+
+/**
+ * @brief Escribe una duración en la unidad más legible (ns, us, ms o s).
+ */
+static void formatear_duracion(char *destino, size_t tamano, unsigned long long ns) {
+    if (ns < 1000ULL) snprintf(destino, tamano, "%lluns", ns);
+    else if (ns < 1000000ULL) snprintf(destino, tamano, "%.1fus", ns / 1e3);
+    else if (ns < 1000000000ULL) snprintf(destino, tamano, "%.2fms", ns / 1e6);
+    else snprintf(destino, tamano, "%.2fs", ns / 1e9);
+}
+
+static void imprimir_histograma(FILE *salida, const char *nombre, const Histograma *histograma) {
+    static const double percentiles[] = {0.50, 0.90, 0.99, 0.999};
+    char texto[16];
+
+    fprintf(salida, "%-16s %8llu", nombre, histograma->cuenta);
+    if (histograma->cuenta == 0) {
+        fprintf(salida, "\n");
+        return;
+    }
+    formatear_duracion(texto, sizeof(texto), histograma->suma_ns / histograma->cuenta);
+    fprintf(salida, " %10s", texto);
+    for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+        formatear_duracion(texto, sizeof(texto), percentil_histograma(histograma, percentiles[i]));
+        fprintf(salida, " %10s", texto);
+    }
+    formatear_duracion(texto, sizeof(texto), histograma->max_ns);
+    fprintf(salida, " %10s\n", texto);
+}
+
+/**
+ * @brief Muestra los histogramas (media, p50, p90, p99, p99.9 y máximo) y los contadores.
+ */
+static void imprimir_estadisticas(FILE *salida) {
+    Estadisticas copia = *estadisticas; // Instantánea: los hijos pueden seguir escribiendo
+
+    fprintf(salida, "%-16s %8s %10s %10s %10s %10s %10s %10s\n", "", "n", "media", "p50", "p90", "p99", "p99.9", "max");
+    imprimir_histograma(salida, "comando", &copia.tiempo_comando);
+    imprimir_histograma(salida, "spawn", &copia.latencia_spawn);
+    imprimir_histograma(salida, "parseo", &copia.tiempo_parseo);
+    imprimir_histograma(salida, "prompt", &copia.tiempo_prompt);
+    fprintf(salida, "forks: %llu  execs: %llu (fallidos: %llu, con ruta resuelta en el plan: %llu)  "
+                    "aciertos caché de planes: %lu  errores de sintaxis: %llu\n",
+            copia.forks, copia.intentos_exec - copia.execs_fallidos, copia.execs_fallidos, copia.execs_ruta_cache,
+            cache_planes.aciertos, copia.errores_sintaxis);
+    fflush(salida);
+}
+
+/**
+ * @brief Vuelca las estadísticas al terminar el shell si MINISHELL_STATS lo pide
+ * ("-" para stderr, o la ruta de un archivo al que se añaden).
+ */
+static void volcar_estadisticas_al_salir(void) {
+    const char *destino = getenv("MINISHELL_STATS");
+
+    if (destino == NULL || destino[0] == '\0' || getpid() != pid_estadisticas) {
+        return; // Los hijos que terminan sin exec (exit 127) también pasan por aquí
+    }
+    if (strcmp(destino, "-") == 0) {
+        imprimir_estadisticas(stderr);
+        return;
+    }
+    FILE *archivo = fopen(destino, "a");
+    if (archivo == NULL) {
+        imprimir_error("MINISHELL_STATS");
+        return;
+    }
+    fprintf(archivo, "--- %s [PID %d] ---\n", program_invocation_short_name, (int)getpid());
+    imprimir_estadisticas(archivo);
+    fclose(archivo);
+}
+
+/**
+ * @brief Mueve las estadísticas a una página compartida con los hijos y programa el volcado al salir.
+ * Solo la primera llamada hace algo (ms_iniciar() puede llamarse varias veces).
+ */
+static void iniciar_estadisticas(void) {
+    if (pid_estadisticas != 0) {
+        return;
+    }
+    Estadisticas *compartidas = (Estadisticas *)mmap(NULL, sizeof(Estadisticas), PROT_READ | PROT_WRITE,
+                                                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (compartidas != MAP_FAILED) {
+        *compartidas = estadisticas_locales;
+        estadisticas = compartidas;
+    }
+    pid_estadisticas = getpid();
+    atexit(volcar_estadisticas_al_salir);
+}
+
+// --- Implementación de funciones auxiliares ---
+
+/**
+ * @brief Imprime un mensaje de bienvenida ASCII art con colores.
+ */
+void ms_imprimir_bienvenida(void) {
+    printf("\033[1;36m"); // Establece el color cian brillante para el texto
+    printf("┏┳┓╻┏┓╻╻┏━┓╻ ╻┏━╸╻  ╻      ┏━╸┏━┓╻ ╻╻┏━┓┏━┓      ┏━┓\n");
+    printf("┃┃┃┃┃┗┫┃┗━┓┣━┫┣╸ ┃  ┃      ┣╸ ┃┓┃┃ ┃┃┣━┛┃ ┃      ┗━┫\n");
+    printf("╹ ╹╹╹ ╹╹┗━┛╹ ╹┗━╸┗━╸┗━╸    ┗━╸┗┻┛┗━┛╹╹  ┗━┛     #┗━┛\n");
+    printf("\033[0m"); // Restablece el color de la terminal a su valor por defecto
+    printf("\n");       // Imprime una nueva línea
+    fflush(stdout);   // Asegura que el mensaje se imprima inmediatamente
+}
+
+/**
+ * @brief Genera y devuelve el string del prompt de la terminal.
+ * El prompt incluye el usuario actual, el nombre del host y el directorio de trabajo actual.
+ * El directorio de trabajo se abrevia con '~' si está dentro del directorio home del usuario.
+ *
+ * @return Un puntero a una cadena de caracteres que contiene el prompt generado.
+ * Esta cadena se asigna dinámicamente y debe ser liberada con `free()` por el llamador.
+ */
+char *ms_generar_prompt(void) {
+    char nombre_host[HOST_NAME_MAX + 1]; // Buffer para el nombre del host
+    char cwd[PATH_MAX + 1];              // Buffer para el directorio de trabajo actual
+    struct passwd *pw;                   // Estructura para almacenar información del usuario
+    char *nombre_usuario = "desconocido"; // Nombre de usuario por defecto
+    char *dir_casa = NULL;               // Directorio home del usuario
+    long long inicio = reloj_ns();       // Tiempo de generación (estadísticas y trazas)
+
+    // Obtener información del usuario actual
+    pw = getpwuid(geteuid());
+    if (pw != NULL) {
+        nombre_usuario = pw->pw_name; // Obtiene el nombre de usuario
+        dir_casa = pw->pw_dir;       // Obtiene el directorio home
+    }
+
+    // Obtener el nombre del host
+    if (gethostname(nombre_host, sizeof(nombre_host)) == -1) {
+        strcpy(nombre_host, "host_desconocido"); // Si falla, usa un nombre por defecto
+    }
+    nombre_host[sizeof(nombre_host) - 1] = '\0'; // Asegura terminación nula
+
+    // Obtener el directorio de trabajo actual
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        imprimir_error("getcwd"); // Imprime un error si getcwd falla
+        strcpy(cwd, "ruta_desconocida"); // Si falla, usa una ruta por defecto
+    }
+
+    char display_cwd[PATH_MAX + 1]; // Buffer para la ruta que se mostrará en el prompt
+    // Si el directorio actual comienza con el directorio home, lo abrevia con '~'
+    if (dir_casa != NULL && strncmp(cwd, dir_casa, strlen(dir_casa)) == 0) {
+        // Verifica si la ruta actual es exactamente el directorio home o un subdirectorio
+        if (strlen(cwd) == strlen(dir_casa) || cwd[strlen(dir_casa)] == '/') {
+            snprintf(display_cwd, sizeof(display_cwd), "~%s", cwd + strlen(dir_casa));
+        } else { // Si es un directorio que empieza igual pero no es subdirectorio, muestra la ruta completa
+            strncpy(display_cwd, cwd, sizeof(display_cwd) - 1);
+            display_cwd[sizeof(display_cwd) - 1] = '\0';
+        }
+    } else { // Si no está dentro del directorio home, muestra la ruta completa
+        strncpy(display_cwd, cwd, sizeof(display_cwd) - 1);
+        display_cwd[sizeof(display_cwd) - 1] = '\0';
+    }
+
+    // Asigna memoria para el string del prompt
+    char *prompt_str = (char *)malloc(MAX_LONGITUD_ENTRADA + HOST_NAME_MAX + PATH_MAX + 10);
+    if (prompt_str == NULL) {
+        imprimir_error("malloc para prompt"); // Error si falla la asignación de memoria
+        return strdup("> "); // Devuelve un prompt simple en caso de error
+    }
+
+    // Formatea el string del prompt con colores ANSI
+    // \033[7;32m: fondo verde, texto blanco
+    // \033[0m: resetea los colores
+    // \033[7;34m: fondo azul, texto blanco
+    snprintf(prompt_str, MAX_LONGITUD_ENTRADA + HOST_NAME_MAX + PATH_MAX + 10, "\033[7;32m%s@%s\033[0m:\033[7;34m%s\033[0m$ ", nombre_usuario, nombre_host, display_cwd);
+    registrar_histograma(&estadisticas->tiempo_prompt, reloj_ns() - inicio);
+    ms_traza_span("prompt", "shell", inicio, 0, NULL);
+
+    return prompt_str; // Devuelve el prompt generado
+}
+
+/**
+ * @brief Convierte una duración a milisegundos: un número (segundos, admite decimales) seguido
+ * opcionalmente de "ms", "s", "m" o "h". Por ejemplo: "30", "1.5s", "500ms", "2m".
+ *
+ * @param texto Duración a convertir.
+ * @param ms Donde se deja el resultado (0 significa "sin límite").
+ * @return 0 si la duración es válida, -1 si no.
+ */
+int ms_parsear_duracion(const char *texto, int *ms) {
+    char *fin;
+    double valor = strtod(texto, &fin);
+    double factor;
+
+    if (fin == texto || valor < 0) {
+        return -1;
+    }
+    if (strcmp(fin, "") == 0 || strcmp(fin, "s") == 0) factor = 1000;
+    else if (strcmp(fin, "ms") == 0) factor = 1;
+    else if (strcmp(fin, "m") == 0) factor = 60 * 1000;
+    else if (strcmp(fin, "h") == 0) factor = 60 * 60 * 1000;
+    else return -1;
+
+    if (valor * factor > INT_MAX) {
+        return -1;
+    }
+    *ms = (int)(valor * factor + 0.5);
+    if (*ms == 0 && valor > 0) {
+        *ms = 1; // Una duración positiva muy pequeña no debe convertirse en "sin límite"
+    }
+    return 0;
+}
+
+/**
+ * @brief Imprime un mensaje de error en la salida de error estándar (stderr).
+ * Utiliza `perror` para imprimir el mensaje de error del sistema asociado a `errno`.
+ * @param mensaje El mensaje de error descriptivo a imprimir antes del error del sistema.
+ */
+void imprimir_error(const char *mensaje) {
+    perror(mensaje); // Imprime el mensaje proporcionado seguido del error de sistema (ej. "Error al abrir archivo: No such file or directory")
+    fflush(stderr);  // Asegura que el mensaje se imprima inmediatamente
+}
+
+/**
+ * @brief Deshabilita el reporte de eventos del ratón en la terminal para permitir el scroll normal.
+ * Envía secuencias de escape ANSI a la terminal para desactivar los modos de reporte del ratón.
+ * Esto es común en terminales para asegurar que las acciones del ratón no interfieran con la interacción del shell.
+ */
+void ms_deshabilitar_reporte_raton(void) {
+    printf("\033[?1000l"); // Deshabilita el reporte de clic del ratón
+    printf("\033[?1002l"); // Deshabilita el reporte de movimiento del ratón
+    printf("\033[?1003l"); // Deshabilita el reporte de arrastre del ratón
+    fflush(stdout);       // Asegura que los códigos de escape se envíen inmediatamente
+}
+
+/**
+ * @brief Reserva un bloque de memoria dentro de la arena.
+ * Si el bloque actual no tiene espacio suficiente se pasa al siguiente bloque ya existente
+ * (reutilizado de líneas anteriores) y, solo si no queda ninguno, se pide uno nuevo con `malloc`.
+ * La memoria devuelta está alineada para cualquier tipo y no debe liberarse individualmente.
+ *
+ * @param arena Arena de la que se reserva la memoria.
+ * @param tamano Número de bytes a reservar.
+ * @return Puntero a la memoria reservada, o NULL si falla `malloc`.
+ */
+void *arena_reservar(Arena *arena, size_t tamano) {
+    const size_t alineacion = _Alignof(max_align_t);
+    tamano = (tamano + alineacion - 1) & ~(alineacion - 1); // Redondea para mantener la alineación de la siguiente reserva
+
+    // Busca, a partir del bloque actual, el primero con espacio suficiente
+    while (arena->actual != NULL && arena->actual->usado + tamano > arena->actual->capacidad) {
+        if (arena->actual->siguiente == NULL) {
+            break; // No hay más bloques reutilizables: hay que pedir uno nuevo
+        }
+        arena->actual = arena->actual->siguiente;
+        arena->actual->usado = 0; // Un bloque recién alcanzado tras un reinicio empieza vacío
+    }
+
+    if (arena->actual == NULL || arena->actual->usado + tamano > arena->actual->capacidad) {
+        size_t capacidad = tamano > TAMANO_BLOQUE_ARENA ? tamano : TAMANO_BLOQUE_ARENA;
+        BloqueArena *bloque = (BloqueArena *)malloc(sizeof(BloqueArena) + capacidad);
+        if (bloque == NULL) {
+            return NULL;
+        }
+        bloque->siguiente = NULL;
+        bloque->capacidad = capacidad;
+        bloque->usado = 0;
+        if (arena->actual == NULL) {
+            arena->primero = bloque; // Primera reserva de la arena
+        } else {
+            arena->actual->siguiente = bloque; // Se encadena al final
+        }
+        arena->actual = bloque;
+    }
+
+    void *memoria = arena->actual->datos + arena->actual->usado;
+    arena->actual->usado += tamano;
+    return memoria;
+}
+
+/**
+ * @brief Copia los primeros `longitud` caracteres de una cadena dentro de la arena, terminándola en '\0'.
+ * Sustituye a `strdup` en el parseo: la copia no se libera por separado sino con `arena_reiniciar()`.
+ *
+ * @param arena Arena donde se copia la cadena.
+ * @param cadena Cadena de origen (no necesita estar terminada en '\0').
+ * @param longitud Número de caracteres a copiar.
+ * @return Puntero a la copia, o NULL si no hubo memoria.
+ */
+char *arena_strndup(Arena *arena, const char *cadena, size_t longitud) {
+    char *copia = (char *)arena_reservar(arena, longitud + 1);
+    if (copia == NULL) {
+        return NULL;
+    }
+    memcpy(copia, cadena, longitud);
+    copia[longitud] = '\0';
+    return copia;
+}
+
+/**
+ * @brief Reinicia la arena después de ejecutar una línea completa.
+ * Todo lo reservado queda invalidado de una sola vez, pero los bloques se conservan para
+ * reutilizarlos en la siguiente línea (por eso en régimen estable no hay llamadas a malloc/free).
+ * @param arena Arena a reiniciar.
+ */
+void arena_reiniciar(Arena *arena) {
+    arena->actual = arena->primero;
+    if (arena->actual != NULL) {
+        arena->actual->usado = 0;
+    }
+}
+
+/**
+ * @brief Libera todos los bloques de la arena y la deja vacía.
+ * @param arena Arena a liberar.
+ */
+void arena_liberar(Arena *arena) {
+    BloqueArena *bloque = arena->primero;
+    while (bloque != NULL) {
+        BloqueArena *siguiente = bloque->siguiente;
+        free(bloque);
+        bloque = siguiente;
+    }
+    arena->primero = NULL;
+    arena->actual = NULL;
+}
+
+// --- Búsqueda del siguiente carácter especial ---
+// Dentro de una palabra casi todos los caracteres se copian tal cual; solo interesan los espacios,
+// comillas, '\\', '<', '>', '|', '&' y el '\0' final. Estas funciones devuelven la posición del
+// siguiente de esos bytes para que el lexer copie de una vez (memcpy) todo el tramo intermedio.
+// Pueden marcar también otros bytes de control (< 0x20): el lexer los trata como caracteres normales.
+
+// Tabla para la versión escalar: 1 si el byte es de interés para el lexer
+static unsigned char tabla_especiales[256];
+
+/**
+ * @brief Versión escalar: recorre byte a byte consultando la tabla de especiales.
+ */
+static const char *buscar_especial_escalar(const char *p) {
+    while (!tabla_especiales[(unsigned char)*p]) p++;
+    return p;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * @brief Versión SSE2: compara 16 bytes por iteración.
+ * Las lecturas son alineadas a 16 bytes, por lo que nunca cruzan a una página no mapeada
+ * aunque lean más allá del '\0' final; los bytes anteriores a `p` se descartan con una máscara.
+ * Esas lecturas fuera de la cadena son intencionadas, por eso no se instrumentan con AddressSanitizer.
+ */
+__attribute__((target("sse2"), no_sanitize_address))
+static const char *buscar_especial_sse2(const char *p) {
+    const __m128i limite_control = _mm_set1_epi8(0x20); // ' ', '\t', '\n', '\0' y demás bytes de control
+    uintptr_t desalineado = (uintptr_t)p & 15;
+    const __m128i *bloque = (const __m128i *)(p - desalineado);
+    unsigned int mascara;
+
+    for (int primero = 1; ; primero = 0, bloque++) {
+        __m128i v = _mm_load_si128(bloque);
+        __m128i r = _mm_cmpeq_epi8(_mm_min_epu8(v, limite_control), v); // v <= 0x20
+        r = _mm_or_si128(r, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+        r = _mm_or_si128(r, _mm_cmpeq_epi8(v, _mm_set1_epi8('\'')));
+        r = _mm_or_si128(r, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+        r = _mm_or_si128(r, _mm_cmpeq_epi8(v, _mm_set1_epi8('<')));
+        r = _mm_or_si128(r, _mm_cmpeq_epi8(v, _mm_set1_epi8('>')));
+        r = _mm_or_si128(r, _mm_cmpeq_epi8(v, _mm_set1_epi8('|')));
+        r = _mm_or_si128(r, _mm_cmpeq_epi8(v, _mm_set1_epi8('&')));
+        mascara = (unsigned int)_mm_movemask_epi8(r);
+        if (primero) {
+            mascara &= ~0u << desalineado; // Ignora los bytes anteriores a p
+        }
+        if (mascara != 0) {
+            return (const char *)bloque + __builtin_ctz(mascara);
+        }
+    }
+}
+
+/**
+ * @brief Versión AVX2: igual que la SSE2 pero con bloques de 32 bytes.
+ */
+__attribute__((target("avx2"), no_sanitize_address))
+static const char *buscar_especial_avx2(const char *p) {
+    const __m256i limite_control = _mm256_set1_epi8(0x20);
+    uintptr_t desalineado = (uintptr_t)p & 31;
+    const __m256i *bloque = (const __m256i *)(p - desalineado);
+    unsigned int mascara;
+
+    for (int primero = 1; ; primero = 0, bloque++) {
+        __m256i v = _mm256_load_si256(bloque);
+        __m256i r = _mm256_cmpeq_epi8(_mm256_min_epu8(v, limite_control), v); // v <= 0x20
+        r = _mm256_or_si256(r, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+        r = _mm256_or_si256(r, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\'')));
+        r = _mm256_or_si256(r, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+        r = _mm256_or_si256(r, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('<')));
+        r = _mm256_or_si256(r, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('>')));
+        r = _mm256_or_si256(r, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('|')));
+        r = _mm256_or_si256(r, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('&')));
+        mascara = (unsigned int)_mm256_movemask_epi8(r);
+        if (primero) {
+            mascara &= ~0u << desalineado;
+        }
+        if (mascara != 0) {
+            return (const char *)bloque + __builtin_ctz(mascara);
+        }
+    }
+}
+#endif
+
+// Implementación elegida por inicializar_buscador_especial() (NULL hasta la primera llamada)
+static const char *(*buscar_especial)(const char *p) = NULL;
+
+/**
+ * @brief Elige la implementación de búsqueda de especiales según la CPU.
+ * Usa AVX2 si está disponible, luego SSE2 y, fuera de x86, la versión escalar.
+ * La variable de entorno MINISHELL_SIMD=escalar|sse2|avx2 fuerza una implementación concreta
+ * (útil para comparar rendimiento); si la CPU no la soporta se ignora.
+ */
+void inicializar_buscador_especial(void) {
+    const char *especiales = " \t\n\"'\\<>|&";
+    memset(tabla_especiales, 0, sizeof(tabla_especiales));
+    tabla_especiales[0] = 1; // El '\0' final siempre detiene la búsqueda
+    for (const char *c = especiales; *c != '\0'; c++) {
+        tabla_especiales[(unsigned char)*c] = 1;
+    }
+
+    const char *forzado = getenv("MINISHELL_SIMD");
+    buscar_especial = buscar_especial_escalar;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (forzado != NULL && strcmp(forzado, "escalar") == 0) {
+        return;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        buscar_especial = buscar_especial_sse2;
+    }
+    if (__builtin_cpu_supports("avx2") && (forzado == NULL || strcmp(forzado, "sse2") != 0)) {
+        buscar_especial = buscar_especial_avx2;
+    }
+#else
+    (void)forzado;
+#endif
+}
+
+/**
+ * @brief Indica si un carácter puede escaparse con '\\' para tomarlo literalmente.
+ * Además de comillas, espacio y tabulador, se admiten los operadores y la propia barra,
+ * de modo que "a\\|b" es una sola palabra.
+ */
+static int es_caracter_escapable(char c) {
+    return c == '\'' || c == '"' || c == ' ' || c == '\t' || c == '\\' ||
+           c == '|' || c == '&' || c == '<' || c == '>';
+}
+
+/**
+ * @brief Extrae el siguiente token de la línea.
+ * El lexer recorre cada carácter una única vez: salta los espacios, reconoce los operadores
+ * ('|', '&&', '&', '<', '>', '>>') y construye las palabras quitando comillas y escapes. Dentro de
+ * comillas los operadores y espacios son texto normal, por lo que 'echo "a|b"' es un solo argumento.
+ *
+ * @param lexer Estado del lexer (se avanza hasta después del token).
+ * @param token Token de salida. En caso de error su tipo es TOKEN_ERROR y `lexer->error` describe el problema.
+ */
+void siguiente_token(Lexer *lexer, Token *token) {
+    const char *p = lexer->pos;
+    token->texto = NULL;
+
+    // Ignora espacios en blanco entre tokens
+    while (*p == ' ' || *p == '\t' || *p == '\n') p++;
+
+    switch (*p) {
+    case '\0':
+        token->tipo = TOKEN_FIN;
+        break;
+    case '|':
+        token->tipo = TOKEN_TUBERIA;
+        p++;
+        break;
+    case '&':
+        if (p[1] == '&') {
+            token->tipo = TOKEN_AND;
+            p += 2;
+        } else if (configuracion.permitir_segundo_plano) { // '&' suelto: ejecución en segundo plano
+            token->tipo = TOKEN_SEGUNDO_PLANO;
+            p++;
+        } else { // Sin segundo plano (newerMiniS, cliente) un '&' suelto es un error
+            lexer->error = "operador '&' no soportado (use '&&')";
+            token->tipo = TOKEN_ERROR;
+        }
+        break;
+    case '<':
+        token->tipo = TOKEN_REDIR_ENTRADA;
+        p++;
+        break;
+    case '>':
+        if (p[1] == '>') { // '>>' es redirección de salida en modo anexar
+            token->tipo = TOKEN_REDIR_ANEXAR;
+            p += 2;
+        } else {
+            token->tipo = TOKEN_REDIR_SALIDA;
+            p++;
+        }
+        break;
+    default: {
+        // Palabra: termina en un espacio o un operador que no esté entre comillas
+        char *inicio = lexer->salida; // La palabra se escribe en el buffer de la arena
+        char *out = inicio;
+        char comilla = '\0'; // Comilla abierta actualmente ('\0' si no hay)
+
+        if (buscar_especial == NULL) {
+            inicializar_buscador_especial();
+        }
+
+        while (1) {
+            // Copia de una vez el tramo sin caracteres especiales (búsqueda SIMD o escalar)
+            const char *especial = buscar_especial(p);
+            memcpy(out, p, especial - p);
+            out += especial - p;
+            p = especial;
+
+            char c = *p;
+            if (c == '\0') {
+                break; // Fin de la línea
+            }
+            if (comilla == '\0' && (c == ' ' || c == '\t' || c == '\n' ||
+                                    c == '|' || c == '&' || c == '<' || c == '>')) {
+                break; // Fin de la palabra
+            }
+            if (c == '\\' && es_caracter_escapable(p[1])) {
+                *out++ = p[1]; // El carácter escapado se toma literalmente, incluso dentro de comillas
+                p += 2;
+            } else if (comilla == '\0' && (c == '\'' || c == '"')) {
+                comilla = c; // Abre comillas (la comilla no forma parte del argumento)
+                p++;
+            } else if (c == comilla) {
+                comilla = '\0'; // Cierra las comillas abiertas
+                p++;
+            } else {
+                *out++ = c; // Carácter normal (o comilla de otro tipo dentro de comillas)
+                p++;
+            }
+        }
+
+        if (comilla != '\0') {
+            lexer->error = "comilla sin cerrar";
+            token->tipo = TOKEN_ERROR;
+            break;
+        }
+        *out++ = '\0';
+        lexer->salida = out;
+        token->tipo = TOKEN_PALABRA;
+        token->texto = inicio;
+        break;
+    }
+    }
+
+    lexer->pos = p;
+}
+
+/**
+ * @brief siguiente_token() acumulando su tiempo para las trazas.
+ * El lexer y el parser trabajan en una sola pasada: en lugar de un span por token (miles de eventos
+ * en líneas largas), el tiempo total del lexer se publica como argumento del span del parseo.
+ */
+static void leer_token(Lexer *lexer, Token *token, long long *ns_lexer) {
+    long long inicio = ms_traza_ahora();
+    siguiente_token(lexer, token);
+    if (inicio != 0) {
+        *ns_lexer += ms_traza_ahora() - inicio;
+    }
+}
+
+/**
+ * @brief Parsea una línea completa en una lista de tuberías separadas por '&&'.
+ * Consume los tokens de `siguiente_token()` en una sola pasada y va rellenando los comandos:
+ * las palabras se añaden a argv, los operadores de redirección toman la palabra siguiente como
+ * nombre de archivo, '|' cierra el comando actual y '&&' cierra la tubería actual. Si la configuración
+ * lo permite, un '&' final marca la tubería para ejecutarse en segundo plano.
+ * Toda la memoria (palabras y arrays de comandos) se reserva en la arena de la línea.
+ *
+ * @param linea La línea leída por readline (no se modifica).
+ * @param linea_parseada Estructura donde se deja el resultado.
+ * @param arena Arena de la línea actual.
+ * @param ns_lexer Acumulador del tiempo pasado en el lexer (trazas).
+ * @return 0 si el parseo fue exitoso, -1 si hubo un error de sintaxis o fallo de memoria.
+ */
+static int parsear_linea_interno(const char *linea, LineaParseada *linea_parseada, Arena *arena, long long *ns_lexer) {
+    Lexer lexer;
+    Token token;
+    Tuberia *tuberia = NULL;          // Tubería en construcción (NULL al inicio de un segmento '&&')
+    ComandoParseado *comando = NULL;  // Comando en construcción (NULL al inicio de un comando)
+
+    linea_parseada->num_segmentos = 0;
+
+    lexer.pos = linea;
+    lexer.error = NULL;
+    lexer.salida = (char *)arena_reservar(arena, strlen(linea) + 1); // Buffer de palabras del tamaño de la línea
+    if (lexer.salida == NULL) {
+        imprimir_error("arena_reservar");
+        return -1;
+    }
+
+    while (1) {
+        leer_token(&lexer, &token, ns_lexer);
+
+        if (token.tipo == TOKEN_ERROR) {
+            fprintf(stderr, "Error de sintaxis: %s.\n", lexer.error);
+            return -1;
+        }
+
+        // '&' marca la tubería actual para ejecutarse en segundo plano: solo puede ir al final de
+        // la tubería, seguido del fin de línea o de '&&'
+        if (token.tipo == TOKEN_SEGUNDO_PLANO) {
+            if (comando == NULL) {
+                fprintf(stderr, "Error de sintaxis: comando vacío o solo con operadores.\n");
+                return -1;
+            }
+            tuberia->segundo_plano = 1;
+            leer_token(&lexer, &token, ns_lexer);
+            if (token.tipo == TOKEN_ERROR) {
+                fprintf(stderr, "Error de sintaxis: %s.\n", lexer.error);
+                return -1;
+            }
+            if (token.tipo != TOKEN_AND && token.tipo != TOKEN_FIN) {
+                fprintf(stderr, "Error de sintaxis: '&' debe ser el último argumento del comando.\n");
+                return -1;
+            }
+        }
+
+        // Operadores que cierran un comando: '|', '&&' y el fin de línea
+        if (token.tipo == TOKEN_TUBERIA || token.tipo == TOKEN_AND || token.tipo == TOKEN_FIN) {
+            if (comando == NULL) {
+                if (token.tipo == TOKEN_FIN && tuberia == NULL && linea_parseada->num_segmentos == 0) {
+                    return 0; // Línea sin ningún comando
+                }
+                fprintf(stderr, "Error de sintaxis: comando vacío o solo con operadores.\n");
+                return -1;
+            }
+            comando = NULL; // El siguiente token empieza un comando nuevo
+            if (token.tipo == TOKEN_AND) {
+                tuberia = NULL; // ... y además una tubería nueva
+            } else if (token.tipo == TOKEN_FIN) {
+                return 0; // Parseo exitoso
+            }
+            continue;
+        }
+
+        // Cualquier otro token pertenece a un comando: lo crea si es el primero
+        if (tuberia == NULL) {
+            if (linea_parseada->num_segmentos >= MAX_SEGMENTOS_AND) {
+                fprintf(stderr, "Demasiados segmentos '&&' (máximo %d).\n", MAX_SEGMENTOS_AND);
+                return -1;
+            }
+            tuberia = &linea_parseada->segmentos[linea_parseada->num_segmentos++];
+            tuberia->num_comandos = 0;
+            tuberia->segundo_plano = 0;
+            tuberia->comandos = (ComandoParseado *)arena_reservar(arena, sizeof(ComandoParseado) * MAX_COMANDOS);
+            if (tuberia->comandos == NULL) {
+                imprimir_error("arena_reservar");
+                return -1;
+            }
+        }
+        if (comando == NULL) {
+            if (tuberia->num_comandos >= MAX_COMANDOS) {
+                fprintf(stderr, "Demasiados comandos en la tubería (máximo %d).\n", MAX_COMANDOS);
+                return -1;
+            }
+            comando = &tuberia->comandos[tuberia->num_comandos++];
+            comando->argc = 0;
+            comando->argv[0] = NULL;
+            comando->archivo_entrada = NULL;
+            comando->archivo_salida = NULL;
+            comando->tipo_operacion = SIN_REDIR;
+            comando->ruta_ejecutable = NULL;
+        }
+
+        if (token.tipo == TOKEN_PALABRA) {
+            // Añade el argumento al array argv del comando (manteniéndolo terminado en NULL para execvp)
+            if (comando->argc >= MAX_ARGUMENTOS - 1) {
+                fprintf(stderr, "Demasiados argumentos para un comando.\n");
+                return -1;
+            }
+            comando->argv[comando->argc++] = token.texto;
+            comando->argv[comando->argc] = NULL;
+            continue;
+        }
+
+        // Redirección: el siguiente token debe ser el nombre del archivo
+        TipoToken tipo_redireccion = token.tipo;
+        leer_token(&lexer, &token, ns_lexer);
+        if (token.tipo == TOKEN_ERROR) {
+            fprintf(stderr, "Error de sintaxis: %s.\n", lexer.error);
+            return -1;
+        }
+        if (token.tipo != TOKEN_PALABRA) {
+            if (tipo_redireccion == TOKEN_REDIR_ENTRADA) {
+                fprintf(stderr, "Error de sintaxis: se esperaba nombre de archivo después de '<'.\n");
+            } else {
+                fprintf(stderr, "Error de sintaxis: se esperaba nombre de archivo después de redirección de salida.\n");
+            }
+            return -1;
+        }
+        if (tipo_redireccion == TOKEN_REDIR_ENTRADA) {
+            if (comando->archivo_entrada != NULL) { // Error si ya hay una redirección de entrada
+                fprintf(stderr, "Error de sintaxis: múltiples redirecciones de entrada.\n");
+                return -1;
+            }
+            comando->archivo_entrada = token.texto;
+        } else {
+            if (comando->archivo_salida != NULL) { // Error si ya hay una redirección de salida
+                fprintf(stderr, "Error de sintaxis: múltiples redirecciones de salida.\n");
+                return -1;
+            }
+            comando->archivo_salida = token.texto;
+            comando->tipo_operacion = (tipo_redireccion == TOKEN_REDIR_ANEXAR) ? REDIR_SALIDA_ANEXAR : REDIR_SALIDA_TRUNCAR;
+        }
+    }
+}
+
+
+/**
+ * @brief Parsea una línea completa en una lista de tuberías separadas por '&&' (ver parsear_linea_interno()).
+ * @return 0 si el parseo fue exitoso, -1 si hubo un error de sintaxis o fallo de memoria.
+ */
+int parsear_linea(const char *linea, LineaParseada *linea_parseada, Arena *arena) {
+    long long inicio_traza = ms_traza_ahora();
+    long long ns_lexer = 0;
+    char args[96];
+
+    int resultado = parsear_linea_interno(linea, linea_parseada, arena, &ns_lexer);
+    if (inicio_traza != 0) {
+        snprintf(args, sizeof(args), "{\"bytes\":%zu,\"lexer_us\":%lld.%03lld,\"error\":%d}",
+                 strlen(linea), ns_lexer / 1000, ns_lexer % 1000, resultado != 0);
+        ms_traza_span("parsear", "parser", inicio_traza, 0, args);
+    }
+    return resultado;
+}
+
+/**
+ * @brief Busca un ejecutable en los directorios de la variable PATH (como haría execvp).
+ * No se resuelven nombres que contienen '/' ni entradas de PATH relativas (vacías o '.'),
+ * porque dependen del directorio actual y podrían cambiar con 'cd' mientras el plan está en caché;
+ * en esos casos se devuelve NULL y el hijo usa execvp.
+ *
+ * @param nombre Nombre del comando (argv[0]).
+ * @param arena Arena donde se copia la ruta encontrada.
+ * @return Ruta completa del ejecutable, o NULL si no se resolvió.
+ */
+static char *buscar_en_path(const char *nombre, Arena *arena) {
+    const char *path = getenv("PATH");
+    char candidata[PATH_MAX];
+    struct stat info;
+
+    if (nombre == NULL || strchr(nombre, '/') != NULL || path == NULL) {
+        return NULL;
+    }
+
+    const char *directorio = path;
+    while (1) {
+        const char *fin = strchr(directorio, ':');
+        size_t longitud = fin != NULL ? (size_t)(fin - directorio) : strlen(directorio);
+
+        if (longitud == 0 || directorio[0] != '/') {
+            return NULL; // Entrada relativa: se deja la búsqueda a execvp en el hijo
+        }
+        if (longitud + 1 + strlen(nombre) < sizeof(candidata)) {
+            memcpy(candidata, directorio, longitud);
+            candidata[longitud] = '/';
+            strcpy(candidata + longitud + 1, nombre);
+            if (stat(candidata, &info) == 0 && S_ISREG(info.st_mode) && access(candidata, X_OK) == 0) {
+                return arena_strndup(arena, candidata, strlen(candidata));
+            }
+        }
+        if (fin == NULL) {
+            return NULL; // No está en ningún directorio de PATH
+        }
+        directorio = fin + 1;
+    }
+}
+
+/**
+ * @brief Busca un ejecutable en los directorios de PATH (ver buscar_en_path()).
+ * @return Ruta completa del ejecutable, o NULL si no se resolvió.
+ */
+char *resolver_ruta_ejecutable(const char *nombre, Arena *arena) {
+    long long inicio_traza = ms_traza_ahora();
+    char nombre_json[128];
+    char args[192];
+
+    char *ruta = buscar_en_path(nombre, arena);
+    if (inicio_traza != 0) {
+        escapar_json(nombre_json, sizeof(nombre_json), nombre);
+        snprintf(args, sizeof(args), "{\"comando\":\"%s\",\"encontrado\":%d}", nombre_json, ruta != NULL);
+        ms_traza_span("buscar_en_path", "parser", inicio_traza, 0, args);
+    }
+    return ruta;
+}
+
+// Acumula en `acumulador` la palabra de 8 bytes en `p` (el paso de XXH3: la palabra más el producto
+// de sus dos mitades mezcladas con una clave)
+static inline uint64_t acumular_palabra(uint64_t acumulador, const char *p, uint64_t clave) {
+    uint64_t palabra;
+    memcpy(&palabra, p, sizeof(palabra)); // Lectura sin alinear (una instrucción en x86 y ARMv8)
+    uint64_t mezcla = palabra ^ clave;
+    return acumulador + palabra + (mezcla & 0xffffffffULL) * (mezcla >> 32);
+}
+
+// Hash de 8 en 8 bytes, con cuatro acumuladores independientes (sus multiplicaciones se solapan)
+static uint64_t hash_bytes(uint64_t hash, const char *datos, size_t longitud) {
+    const uint64_t multiplicador = 0x9e3779b97f4a7c15ULL;
+    uint64_t a0 = longitud, a1 = 0, a2 = 0, a3 = 0;
+    uint64_t palabra;
+    size_t i = 0;
+
+    for (; i + 32 <= longitud; i += 32) {
+        a0 = acumular_palabra(a0, datos + i, 0x9e3779b97f4a7c15ULL);
+        a1 = acumular_palabra(a1, datos + i + 8, 0xc2b2ae3d27d4eb4fULL);
+        a2 = acumular_palabra(a2, datos + i + 16, 0x165667b19e3779f9ULL);
+        a3 = acumular_palabra(a3, datos + i + 24, 0x27d4eb2f165667c5ULL);
+    }
+    uint64_t acumuladores[4] = {a0, a1, a2, a3};
+    for (int c = 0; c < 4; c++) {
+        hash = (hash ^ acumuladores[c]) * multiplicador;
+        hash ^= hash >> 32;
+    }
+    for (; i + sizeof(palabra) <= longitud; i += sizeof(palabra)) {
+        memcpy(&palabra, datos + i, sizeof(palabra));
+        hash = (hash ^ palabra) * multiplicador;
+        hash ^= hash >> 32;
+    }
+    if (i < longitud) {
+        palabra = 0;
+        memcpy(&palabra, datos + i, longitud - i);
+        hash = (hash ^ palabra) * multiplicador;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+/**
+ * @brief Hash de una línea (clave de la caché de planes). Un acierto tiene que costar menos que
+ * parsear la línea, y el lexer la recorre en bloques SIMD: de una línea larga solo se mezclan su
+ * longitud, sus primeros y sus últimos MUESTRA_HASH_LINEA bytes (como hace Lua con las cadenas
+ * largas). Dos líneas que solo difieren en medio caen en la misma cubeta y las separa la
+ * comparación completa (memcmp, también vectorizada).
+ */
+#define MUESTRA_HASH_LINEA 128
+static uint64_t hash_linea(const char *linea, size_t longitud) {
+    uint64_t hash = longitud * 0x9e3779b97f4a7c15ULL;
+    if (longitud <= 2 * MUESTRA_HASH_LINEA) {
+        hash = hash_bytes(hash, linea, longitud);
+    } else {
+        hash = hash_bytes(hash, linea, MUESTRA_HASH_LINEA);
+        hash = hash_bytes(hash, linea + longitud - MUESTRA_HASH_LINEA, MUESTRA_HASH_LINEA);
+    }
+    hash ^= hash >> 29; // Los bits bajos (los de la cubeta) dependen de toda la palabra
+    return hash * 0x9e3779b97f4a7c15ULL ^ (hash >> 32);
+}
+
+/**
+ * @brief Quita un plan de la lista LRU.
+ */
+static void desenlazar_lru(PlanCache *plan) {
+    if (plan->anterior_lru != NULL) plan->anterior_lru->siguiente_lru = plan->siguiente_lru;
+    else cache_planes.mas_reciente = plan->siguiente_lru;
+    if (plan->siguiente_lru != NULL) plan->siguiente_lru->anterior_lru = plan->anterior_lru;
+    else cache_planes.menos_reciente = plan->anterior_lru;
+    plan->anterior_lru = NULL;
+    plan->siguiente_lru = NULL;
+}
+
+/**
+ * @brief Pone un plan al principio de la lista LRU (usado más recientemente).
+ */
+static void enlazar_lru_al_inicio(PlanCache *plan) {
+    plan->anterior_lru = NULL;
+    plan->siguiente_lru = cache_planes.mas_reciente;
+    if (cache_planes.mas_reciente != NULL) cache_planes.mas_reciente->anterior_lru = plan;
+    cache_planes.mas_reciente = plan;
+    if (cache_planes.menos_reciente == NULL) cache_planes.menos_reciente = plan;
+}
+
+/**
+ * @brief Quita un plan de su cubeta de la tabla hash.
+ */
+static void desenlazar_cubeta(PlanCache *plan) {
+    PlanCache **enlace = &cache_planes.cubetas[plan->hash % NUM_CUBETAS_CACHE];
+    while (*enlace != NULL && *enlace != plan) {
+        enlace = &(*enlace)->siguiente_cubeta;
+    }
+    if (*enlace == plan) {
+        *enlace = plan->siguiente_cubeta;
+    }
+    plan->siguiente_cubeta = NULL;
+}
+
+/**
+ * @brief Resuelve en PATH la ruta del ejecutable de cada comando de la línea.
+ */
+static void resolver_rutas_plan(LineaParseada *linea_parseada, Arena *arena) {
+    for (int s = 0; s < linea_parseada->num_segmentos; s++) {
+        for (int i = 0; i < linea_parseada->segmentos[s].num_comandos; i++) {
+            ComandoParseado *comando = &linea_parseada->segmentos[s].comandos[i];
+            comando->ruta_ejecutable = resolver_ruta_ejecutable(comando->argv[0], arena);
+        }
+    }
+}
+
+/**
+ * @brief Parsea una línea y devuelve su plan de ejecución.
+ * Con la caché de planes activada, si la línea está en la caché se devuelve su plan (acierto) y
+ * pasa a ser la más reciente. Si no, se parsea en la arena de un plan libre (o del menos usado,
+ * que se expulsa), se resuelven las rutas de los ejecutables y se guarda. Las líneas demasiado
+ * largas, o todas si la caché está desactivada, se parsean en la arena del llamador y no se guardan.
+ *
+ * @param linea La línea a parsear (no se modifica).
+ * @param arena Arena de la línea actual (solo para líneas que no se guardan en la caché).
+ * @param inicio_traza Instante de inicio para el span de acierto en la caché (0 sin trazas).
+ * @return El plan de la línea, o NULL si hubo un error de sintaxis o de memoria. Es válido hasta
+ *         reiniciar `arena` o hasta la siguiente llamada a ms_parsear(), lo que ocurra antes.
+ */
+static LineaParseada *parsear_con_cache(const char *linea, Arena *arena, long long inicio_traza) {
+    size_t longitud = strlen(linea);
+    uint64_t hash = 0;
+    int cacheable = configuracion.usar_cache_planes && longitud <= MAX_LONGITUD_LINEA_CACHE;
+
+    // 1. Búsqueda en la tabla hash (las líneas demasiado largas no están: ni se calcula su hash ni cuentan como fallo)
+    if (cacheable) {
+        hash = hash_linea(linea, longitud);
+        for (PlanCache *plan = cache_planes.cubetas[hash % NUM_CUBETAS_CACHE]; plan != NULL; plan = plan->siguiente_cubeta) {
+            if (plan->hash == hash && plan->longitud == longitud && memcmp(plan->linea, linea, longitud) == 0) {
+                cache_planes.aciertos++;
+                ms_traza_span("plan_en_cache", "parser", inicio_traza, 0, NULL);
+                desenlazar_lru(plan);
+                enlazar_lru_al_inicio(plan);
+                return &plan->linea_parseada;
+            }
+        }
+        cache_planes.fallos++;
+    }
+
+    // 2. Sin caché o línea demasiado larga: se parsea sin guardarla. Sus rutas no se resuelven: la
+    // búsqueda no se reutilizaría, y el hijo busca en PATH con execvp
+    if (!cacheable) {
+        LineaParseada *linea_parseada = (LineaParseada *)arena_reservar(arena, sizeof(LineaParseada));
+        if (linea_parseada == NULL) {
+            imprimir_error("arena_reservar");
+            return NULL;
+        }
+        if (parsear_linea(linea, linea_parseada, arena) != 0) {
+            return NULL;
+        }
+        return linea_parseada;
+    }
+
+    // 3. Toma un plan libre o expulsa el usado menos recientemente
+    if (!cache_planes.inicializada) {
+        limpiar_cache_planes();
+    }
+    PlanCache *plan = cache_planes.libres;
+    if (plan != NULL) {
+        cache_planes.libres = plan->siguiente_lru;
+        cache_planes.num_entradas++;
+    } else {
+        plan = cache_planes.menos_reciente;
+        desenlazar_lru(plan);
+        desenlazar_cubeta(plan);
+    }
+    arena_reiniciar(&plan->arena); // Reutiliza los bloques del plan expulsado
+
+    plan->linea = arena_strndup(&plan->arena, linea, longitud);
+    if (plan->linea == NULL || parsear_linea(linea, &plan->linea_parseada, &plan->arena) != 0) {
+        if (plan->linea == NULL) {
+            imprimir_error("arena_strndup");
+        }
+        // Los errores no se guardan en la caché: el plan vuelve a la lista de libres
+        plan->siguiente_lru = cache_planes.libres;
+        cache_planes.libres = plan;
+        cache_planes.num_entradas--;
+        return NULL;
+    }
+    resolver_rutas_plan(&plan->linea_parseada, &plan->arena);
+
+    plan->hash = hash;
+    plan->longitud = longitud;
+    plan->siguiente_cubeta = cache_planes.cubetas[hash % NUM_CUBETAS_CACHE];
+    cache_planes.cubetas[hash % NUM_CUBETAS_CACHE] = plan;
+    enlazar_lru_al_inicio(plan);
+    return &plan->linea_parseada;
+}
+
+/**
+ * @brief Devuelve el plan de ejecución de una línea (ver parsear_con_cache()) y registra el
+ * tiempo de parseo y los errores de sintaxis en las estadísticas.
+ * @return El plan de la línea, o NULL si hubo un error de sintaxis o de memoria.
+ */
+LineaParseada *ms_parsear(const char *linea, Arena *arena) {
+    long long inicio = reloj_ns();
+
+    MS_SONDA1(parseo_inicio, linea);
+    LineaParseada *linea_parseada = parsear_con_cache(linea, arena, fd_traza != -1 ? inicio : 0);
+    MS_SONDA2(parseo_fin, linea, linea_parseada != NULL ? linea_parseada->num_segmentos : -1);
+    registrar_histograma(&estadisticas->tiempo_parseo, reloj_ns() - inicio);
+    if (linea_parseada == NULL) {
+        estadisticas->errores_sintaxis++;
+    }
+    return linea_parseada;
+}
+
+/**
+ * @brief Vacía la caché de planes y devuelve todas las entradas a la lista de libres.
+ * Las arenas de los planes no se liberan ni se reinician aquí: la línea que se está ejecutando
+ * puede seguir usando su plan, y la memoria se reutiliza cuando cada entrada vuelva a ocuparse.
+ */
+static void limpiar_cache_planes(void) {
+    memset(cache_planes.cubetas, 0, sizeof(cache_planes.cubetas));
+    cache_planes.mas_reciente = NULL;
+    cache_planes.menos_reciente = NULL;
+    cache_planes.libres = NULL;
+    for (int i = TAMANO_CACHE_PLANES - 1; i >= 0; i--) {
+        cache_planes.entradas[i].siguiente_cubeta = NULL;
+        cache_planes.entradas[i].anterior_lru = NULL;
+        cache_planes.entradas[i].siguiente_lru = cache_planes.libres;
+        cache_planes.libres = &cache_planes.entradas[i];
+    }
+    cache_planes.num_entradas = 0;
+    cache_planes.inicializada = 1;
+}
+
+/**
+ * @brief Libera la memoria de todas las arenas de la caché de planes.
+ */
+static void liberar_cache_planes(void) {
+    limpiar_cache_planes();
+    for (int i = 0; i < TAMANO_CACHE_PLANES; i++) {
+        arena_liberar(&cache_planes.entradas[i].arena);
+    }
+}
+
+
+/**
+ * @brief Maneja la ejecución de comandos internos (built-ins) como 'exit', 'quit', 'history', 'cache', 'stats',
+ * 'cgroup', 'cd' y las formas de 'timeout' que no ejecutan nada ('timeout' y 'timeout -d DURACION').
+ * Solo debe llamarse si el comando es el único de su tubería y no tiene redirecciones
+ * (ms_ejecutar_linea() ya lo comprueba). Los built-ins se ejecutan directamente en el proceso
+ * del shell y escriben en su stdout/stderr: un front end que quiera capturar su salida debe
+ * redirigir esos descriptores antes de llamar a esta función.
+ *
+ * @param comando Puntero a la estructura ComandoParseado que contiene el comando a ejecutar.
+ * @return 1 si el comando era un built-in y fue ejecutado, 0 en caso contrario.
+ */
+static int ejecutar_builtin_interno(ComandoParseado *comando) {
+    if (comando->argc == 0) return 0; // Si no hay argumentos, no es un built-in válido
+
+    // Comando 'exit' o 'quit'
+    if (strcmp(comando->argv[0], "exit") == 0 || strcmp(comando->argv[0], "quit") == 0) {
+        MS_SONDA1(builtin_ejecutado, comando->argv[0]); // No vuelve: la sonda se dispara antes
+        printf("Saliendo del MiniShell.\n");
+        fflush(stdout);
+        exit(0); // Termina el proceso del shell
+    }
+    // Comando 'history'
+    else if (strcmp(comando->argv[0], "history") == 0) {
+        history_set_pos(0); // Establece la posición de lectura del historial al principio
+        HIST_ENTRY *h_entry; // Puntero a una entrada del historial
+        int i = 0;           // Contador para numerar las entradas
+        // Itera y imprime cada entrada del historial
+        while ((h_entry = history_get(i++)) != NULL) {
+            printf("%d: %s\n", i, h_entry->line);
+        }
+        fflush(stdout); // Asegura que el historial se imprima
+        return 1;       // Indica que se ejecutó un built-in
+    }
+    // Comando 'cache': estadísticas de la caché de planes ('cache -c' la vacía)
+    else if (strcmp(comando->argv[0], "cache") == 0) {
+        if (comando->argv[1] != NULL && strcmp(comando->argv[1], "-c") == 0) {
+            limpiar_cache_planes();
+            printf("Caché de planes vaciada.\n");
+        } else {
+            unsigned long consultas = cache_planes.aciertos + cache_planes.fallos;
+            printf("Caché de planes: %d/%d entradas, %lu aciertos, %lu fallos (%.1f%% aciertos)\n",
+                   cache_planes.num_entradas, TAMANO_CACHE_PLANES, cache_planes.aciertos, cache_planes.fallos,
+                   consultas > 0 ? 100.0 * cache_planes.aciertos / consultas : 0.0);
+        }
+        fflush(stdout);
+        return 1; // Indica que se ejecutó un built-in
+    }
+    // Comando 'stats': histogramas de latencia y contadores del shell ('stats -r' los reinicia)
+    else if (strcmp(comando->argv[0], "stats") == 0) {
+        if (comando->argv[1] != NULL && strcmp(comando->argv[1], "-r") == 0) {
+            memset(estadisticas, 0, sizeof(*estadisticas));
+            printf("Estadísticas reiniciadas.\n");
+            fflush(stdout);
+        } else {
+            imprimir_estadisticas(stdout);
+        }
+        return 1; // Indica que se ejecutó un built-in
+    }
+    // Comando 'cgroup': activa los cgroups de las tuberías y fija sus límites
+    else if (strcmp(comando->argv[0], "cgroup") == 0) {
+        ejecutar_builtin_cgroup(comando);
+        return 1; // Indica que se ejecutó un built-in
+    }
+    // Comando 'timeout' sin comando: muestra el límite por defecto o, con '-d', lo fija (0 lo desactiva).
+    // Con comando es un prefijo de la tubería (ver ms_quitar_prefijos())
+    else if (strcmp(comando->argv[0], "timeout") == 0 &&
+             (comando->argc == 1 || (comando->argc == 3 && strcmp(comando->argv[1], "-d") == 0))) {
+        int limite_ms;
+        if (comando->argc == 1) {
+            if (configuracion.limite_por_defecto_ms > 0) {
+                printf("Límite de tiempo por defecto: %d ms\n", configuracion.limite_por_defecto_ms);
+            } else {
+                printf("Sin límite de tiempo por defecto.\n");
+            }
+            fflush(stdout);
+        } else if (ms_parsear_duracion(comando->argv[2], &limite_ms) != 0) {
+            fprintf(stderr, "timeout: duración no válida '%s' (ej: 30, 1.5s, 500ms, 2m, 1h).\n", comando->argv[2]);
+            fflush(stderr);
+        } else {
+            configuracion.limite_por_defecto_ms = limite_ms;
+        }
+        return 1; // Indica que se ejecutó un built-in
+    }
+    // Comando 'cd' (change directory)
+    else if (strcmp(comando->argv[0], "cd") == 0) {
+        if (comando->argv[1] == NULL) { // Si no se proporciona un directorio
+            fprintf(stderr, "Uso: cd <directorio>\n"); // Mensaje de uso
+            fflush(stderr);
+        } else {
+            if (chdir(comando->argv[1]) == -1) { // Intenta cambiar el directorio
+                imprimir_error("Error al cambiar de directorio"); // Error si chdir falla
+            }
+        }
+        return 1; // Indica que se ejecutó un built-in
+    }
+    return 0; // Si no es ninguno de los built-ins reconocidos, devuelve 0
+}
+
+/**
+ * @brief Ejecuta un comando interno si lo es (ver ejecutar_builtin_interno()) y dispara la sonda
+ * builtin_ejecutado.
+ * @return 1 si el comando era un built-in y fue ejecutado, 0 en caso contrario.
+ */
+int ms_ejecutar_builtin(ComandoParseado *comando) {
+    int ejecutado = ejecutar_builtin_interno(comando);
+    if (ejecutado) {
+        MS_SONDA1(builtin_ejecutado, comando->argv[0]);
+    }
+    return ejecutado;
+}
+
+// --- Cgroups v2 de las tuberías ---
+// Con usar_cgroups, cada tubería en primer plano se lanza en un cgroup transitorio hijo del cgroup
+// del shell, con los límites fijados con el built-in 'cgroup' (memory.max, cpu.max, io.max). Al
+// terminar se informa de su pico de memoria y su tiempo de CPU (de toda la tubería, incluidos los
+// procesos que creen sus etapas) y se elimina.
+#define NUM_LIMITES_CGROUP 3
+
+static const char *const archivos_limite_cgroup[NUM_LIMITES_CGROUP] = {"memory.max", "cpu.max", "io.max"};
+static const char *const controladores_cgroup[NUM_LIMITES_CGROUP] = {"memory", "cpu", "io"};
+static char limites_cgroup[NUM_LIMITES_CGROUP][128]; // Valor de cada límite ("" para no fijarlo)
+static int fd_base_cgroup = -1;                      // cgroup del shell, padre de los transitorios
+static char ruta_base_cgroup[PATH_MAX];
+static unsigned long trabajos_cgroup = 0;            // Numeración de los cgroups transitorios
+
+/**
+ * @brief Escribe un valor en un archivo de interfaz de un cgroup.
+ * @return 0 si el kernel lo aceptó, -1 si no (con errno).
+ */
+static int escribir_archivo_cgroup(int fd_directorio, const char *archivo, const char *valor) {
+    int fd = openat(fd_directorio, archivo, O_WRONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    ssize_t escritos = write(fd, valor, strlen(valor));
+    int error = errno;
+    close(fd);
+    errno = error;
+    return escritos == (ssize_t)strlen(valor) ? 0 : -1;
+}
+
+/**
+ * @brief Lee un archivo de interfaz de un cgroup en un buffer terminado en '\0'.
+ * @return 0 si se leyó, -1 si no existe (p. ej., el controlador no está habilitado).
+ */
+static int leer_archivo_cgroup(int fd_directorio, const char *archivo, char *buffer, size_t tamano) {
+    int fd = openat(fd_directorio, archivo, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    ssize_t leidos = read(fd, buffer, tamano - 1);
+    close(fd);
+    if (leidos < 0) {
+        return -1;
+    }
+    buffer[leidos] = '\0';
+    return 0;
+}
+
+/**
+ * @brief Abre el directorio del cgroup del shell (una vez): busca el punto de montaje de cgroup2
+ * en /proc/self/mountinfo y la ruta del shell en /proc/self/cgroup (la línea "0::"). Intenta
+ * habilitar los controladores memory, cpu e io para los hijos; si falla (el cgroup no está delegado,
+ * o tiene procesos y no es la raíz) los cgroups transitorios solo tienen los que ya hubiera.
+ *
+ * @return 0 si el cgroup del shell está abierto, -1 si no (cgroup v2 no disponible).
+ */
+static int abrir_base_cgroup(void) {
+    char linea[4096], montaje[PATH_MAX] = "", ruta[PATH_MAX] = "";
+    FILE *archivo;
+
+    if (fd_base_cgroup != -1) {
+        return 0;
+    }
+    if ((archivo = fopen("/proc/self/mountinfo", "r")) != NULL) {
+        while (fgets(linea, sizeof(linea), archivo) != NULL) {
+            if (strstr(linea, " - cgroup2 ") != NULL && sscanf(linea, "%*s %*s %*s %*s %4095s", montaje) == 1) {
+                break;
+            }
+            montaje[0] = '\0';
+        }
+        fclose(archivo);
+    }
+    if ((archivo = fopen("/proc/self/cgroup", "r")) != NULL) {
+        while (fgets(linea, sizeof(linea), archivo) != NULL) {
+            if (strncmp(linea, "0::", 3) == 0) {
+                linea[strcspn(linea, "\n")] = '\0';
+                snprintf(ruta, sizeof(ruta), "%s", linea + 3);
+                break;
+            }
+        }
+        fclose(archivo);
+    }
+    if (montaje[0] == '\0' || ruta[0] == '\0') {
+        fprintf(stderr, "cgroup: cgroup v2 no está montado; las tuberías se lanzan sin cgroup.\n");
+        fflush(stderr);
+        return -1;
+    }
+
+    snprintf(ruta_base_cgroup, sizeof(ruta_base_cgroup), "%s%s", montaje, strcmp(ruta, "/") == 0 ? "" : ruta);
+    fd_base_cgroup = open(ruta_base_cgroup, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd_base_cgroup == -1) {
+        fprintf(stderr, "cgroup: no se pudo abrir %s: %s\n", ruta_base_cgroup, strerror(errno));
+        fflush(stderr);
+        return -1;
+    }
+    for (int i = 0; i < NUM_LIMITES_CGROUP; i++) {
+        char controlador[16];
+        snprintf(controlador, sizeof(controlador), "+%s", controladores_cgroup[i]);
+        escribir_archivo_cgroup(fd_base_cgroup, "cgroup.subtree_control", controlador); // Si falla, sin ese controlador
+    }
+    return 0;
+}
+
+/**
+ * @brief Crea el cgroup transitorio de una tubería y le aplica los límites configurados.
+ * Un límite cuyo controlador no está disponible se avisa y se ignora: la tubería se lanza igual.
+ *
+ * @param trabajo Trabajo de la tubería (se rellenan fd_cgroup e id_cgroup).
+ * @return Descriptor de su cgroup.procs (O_CLOEXEC), donde cada etapa escribe "0" para entrar
+ *         antes del exec; -1 si no se pudo crear (la tubería se lanza sin cgroup).
+ */
+static int crear_cgroup_trabajo(MsTrabajo *trabajo) {
+    char nombre[64];
+
+    if (abrir_base_cgroup() != 0) {
+        return -1;
+    }
+    trabajo->id_cgroup = ++trabajos_cgroup;
+    snprintf(nombre, sizeof(nombre), "minishell-%d-%lu", (int)getpid(), trabajo->id_cgroup);
+    if (mkdirat(fd_base_cgroup, nombre, 0755) == -1) {
+        fprintf(stderr, "cgroup: no se pudo crear %s/%s: %s\n", ruta_base_cgroup, nombre, strerror(errno));
+        fflush(stderr);
+        return -1;
+    }
+    trabajo->fd_cgroup = openat(fd_base_cgroup, nombre, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int fd_procs = trabajo->fd_cgroup != -1 ? openat(trabajo->fd_cgroup, "cgroup.procs", O_WRONLY | O_CLOEXEC) : -1;
+    if (fd_procs == -1) {
+        fprintf(stderr, "cgroup: no se pudo abrir %s/%s: %s\n", ruta_base_cgroup, nombre, strerror(errno));
+        fflush(stderr);
+        if (trabajo->fd_cgroup != -1) close(trabajo->fd_cgroup);
+        trabajo->fd_cgroup = -1;
+        unlinkat(fd_base_cgroup, nombre, AT_REMOVEDIR);
+        return -1;
+    }
+
+    for (int i = 0; i < NUM_LIMITES_CGROUP; i++) {
+        if (limites_cgroup[i][0] == '\0') {
+            continue;
+        }
+        if (escribir_archivo_cgroup(trabajo->fd_cgroup, archivos_limite_cgroup[i], limites_cgroup[i]) == 0) {
+            continue;
+        }
+        if (errno == ENOENT) {
+            fprintf(stderr, "cgroup: %s no disponible (el controlador '%s' no está habilitado en %s/cgroup.subtree_control).\n",
+                    archivos_limite_cgroup[i], controladores_cgroup[i], ruta_base_cgroup);
+        } else {
+            fprintf(stderr, "cgroup: %s = '%s': %s\n", archivos_limite_cgroup[i], limites_cgroup[i], strerror(errno));
+        }
+        fflush(stderr);
+    }
+    return fd_procs;
+}
+
+/**
+ * @brief Informa del uso de recursos del cgroup de una tubería: pico de memoria (memory.peak),
+ * tiempo de CPU (cpu.stat), veces que cpu.max la frenó y procesos terminados por memory.max.
+ */
+static void informar_cgroup(const MsTrabajo *trabajo) {
+    char buffer[1024];
+    unsigned long long uso_us = 0, usuario_us = 0, sistema_us = 0, frenado = 0, frenado_us = 0, oom = 0;
+
+    fprintf(stderr, "cgroup minishell-%d-%lu: memoria pico ", (int)getpid(), trabajo->id_cgroup);
+    if (leer_archivo_cgroup(trabajo->fd_cgroup, "memory.peak", buffer, sizeof(buffer)) == 0) {
+        fprintf(stderr, "%.1f MiB", strtoull(buffer, NULL, 10) / (1024.0 * 1024.0));
+    } else {
+        fprintf(stderr, "n/d");
+    }
+    if (leer_archivo_cgroup(trabajo->fd_cgroup, "cpu.stat", buffer, sizeof(buffer)) == 0) {
+        // Claves del controlador cpu (nr_throttled, throttled_usec) solo si está habilitado
+        for (char *linea = strtok(buffer, "\n"); linea != NULL; linea = strtok(NULL, "\n")) {
+            sscanf(linea, "usage_usec %llu", &uso_us);
+            sscanf(linea, "user_usec %llu", &usuario_us);
+            sscanf(linea, "system_usec %llu", &sistema_us);
+            sscanf(linea, "nr_throttled %llu", &frenado);
+            sscanf(linea, "throttled_usec %llu", &frenado_us);
+        }
+        fprintf(stderr, ", CPU %.3f s (usuario %.3f s, sistema %.3f s)", uso_us / 1e6, usuario_us / 1e6, sistema_us / 1e6);
+    }
+    if (frenado > 0) {
+        fprintf(stderr, ", frenada por cpu.max %llu veces (%.3f s)", frenado, frenado_us / 1e6);
+    }
+    if (leer_archivo_cgroup(trabajo->fd_cgroup, "memory.events", buffer, sizeof(buffer)) == 0) {
+        char *oom_kill = strstr(buffer, "oom_kill ");
+        if (oom_kill != NULL) {
+            oom = strtoull(oom_kill + strlen("oom_kill "), NULL, 10);
+        }
+    }
+    if (oom > 0) {
+        fprintf(stderr, ", %llu proceso(s) terminados por memory.max", oom);
+    }
+    fprintf(stderr, "\n");
+    fflush(stderr);
+}
+
+/**
+ * @brief Informa del uso del cgroup de una tubería ya recolectada y lo elimina. Si quedan procesos
+ * dentro (los que sus etapas dejaron en segundo plano) el cgroup se conserva.
+ *
+ * @param trabajo Trabajo de la tubería (sin efecto si no tiene cgroup).
+ * @param informar 1 para imprimir el informe de uso antes de eliminarlo.
+ */
+static void finalizar_cgroup(MsTrabajo *trabajo, int informar) {
+    char nombre[64];
+
+    if (trabajo->fd_cgroup == -1) {
+        return;
+    }
+    if (informar) {
+        informar_cgroup(trabajo);
+    }
+    close(trabajo->fd_cgroup);
+    trabajo->fd_cgroup = -1;
+    snprintf(nombre, sizeof(nombre), "minishell-%d-%lu", (int)getpid(), trabajo->id_cgroup);
+    if (unlinkat(fd_base_cgroup, nombre, AT_REMOVEDIR) == -1) {
+        fprintf(stderr, "cgroup: %s/%s no se elimina: %s\n", ruta_base_cgroup, nombre,
+                errno == EBUSY ? "aún tiene procesos" : strerror(errno));
+        fflush(stderr);
+    }
+}
+
+/**
+ * @brief Fija (o quita, con un valor vacío o "-") uno de los límites de los cgroups transitorios.
+ * @return 0 si el nombre es memory.max, cpu.max o io.max; -1 si no.
+ */
+static int establecer_limite_cgroup(const char *archivo, const char *valor) {
+    for (int i = 0; i < NUM_LIMITES_CGROUP; i++) {
+        if (strcmp(archivo, archivos_limite_cgroup[i]) == 0) {
+            snprintf(limites_cgroup[i], sizeof(limites_cgroup[i]), "%s", strcmp(valor, "-") == 0 ? "" : valor);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Aplica MINISHELL_CGROUP: "1" activa los cgroups y "memory.max=512M;cpu.max=50000 100000"
+ * los activa con esos límites (solo si la configuración no los activa ya).
+ */
+static void configurar_cgroups_desde_entorno(void) {
+    const char *valor = getenv("MINISHELL_CGROUP");
+    char copia[512];
+
+    if (valor == NULL || valor[0] == '\0' || strcmp(valor, "0") == 0) {
+        return;
+    }
+    configuracion.usar_cgroups = 1;
+    snprintf(copia, sizeof(copia), "%s", valor);
+    for (char *item = strtok(copia, ";"); item != NULL; item = strtok(NULL, ";")) {
+        char *igual = strchr(item, '=');
+        if (igual == NULL) {
+            if (strcmp(item, "1") != 0) {
+                fprintf(stderr, "MINISHELL_CGROUP: se esperaba '1' o 'archivo=valor', no '%s'.\n", item);
+            }
+            continue;
+        }
+        *igual = '\0';
+        if (establecer_limite_cgroup(item, igual + 1) != 0) {
+            fprintf(stderr, "MINISHELL_CGROUP: límite desconocido '%s' (memory.max, cpu.max o io.max).\n", item);
+        }
+    }
+    fflush(stderr);
+}
+
+/**
+ * @brief Built-in 'cgroup':
+ *   cgroup                      (muestra si está activo, el cgroup del shell y los límites)
+ *   cgroup on | off
+ *   cgroup memory.max 512M      (también cpu.max "50000 100000" e io.max "8:0 rbps=1048576"; "-" lo quita)
+ */
+static void ejecutar_builtin_cgroup(const ComandoParseado *comando) {
+    if (comando->argc == 2 && (strcmp(comando->argv[1], "on") == 0 || strcmp(comando->argv[1], "off") == 0)) {
+        configuracion.usar_cgroups = strcmp(comando->argv[1], "on") == 0;
+        if (configuracion.usar_cgroups && abrir_base_cgroup() != 0) {
+            configuracion.usar_cgroups = 0;
+        }
+        return;
+    }
+    if (comando->argc == 3) {
+        if (establecer_limite_cgroup(comando->argv[1], comando->argv[2]) != 0) {
+            fprintf(stderr, "cgroup: límite desconocido '%s' (memory.max, cpu.max o io.max).\n", comando->argv[1]);
+            fflush(stderr);
+        }
+        return;
+    }
+    if (comando->argc != 1) {
+        fprintf(stderr, "Uso: cgroup [on | off | memory.max|cpu.max|io.max VALOR]\n");
+        fflush(stderr);
+        return;
+    }
+
+    printf("cgroups por tubería: %s", configuracion.usar_cgroups ? "activados" : "desactivados");
+    if (fd_base_cgroup != -1) {
+        char controladores[256] = "";
+        leer_archivo_cgroup(fd_base_cgroup, "cgroup.subtree_control", controladores, sizeof(controladores));
+        controladores[strcspn(controladores, "\n")] = '\0';
+        printf(" (en %s, controladores: %s)", ruta_base_cgroup, controladores[0] != '\0' ? controladores : "ninguno");
+    }
+    printf("\n");
+    for (int i = 0; i < NUM_LIMITES_CGROUP; i++) {
+        printf("  %-11s %s\n", archivos_limite_cgroup[i], limites_cgroup[i][0] != '\0' ? limites_cgroup[i] : "(sin límite)");
+    }
+    fflush(stdout);
+}
+
+// --- Límite de tiempo de las tuberías ---
+
+/**
+ * @brief Da la terminal (stdin) a un grupo de procesos.
+ * SIGTTOU se bloquea durante la llamada: un proceso que no está en el grupo en primer plano
+ * (el shell al recuperar la terminal, o un hijo recién creado) recibiría SIGTTOU y se pararía.
+ */
+static void ceder_terminal_a(pid_t grupo) {
+    sigset_t mascara, anterior;
+
+    sigemptyset(&mascara);
+    sigaddset(&mascara, SIGTTOU);
+    sigprocmask(SIG_BLOCK, &mascara, &anterior);
+    tcsetpgrp(STDIN_FILENO, grupo);
+    sigprocmask(SIG_SETMASK, &anterior, NULL);
+}
+
+/**
+ * @brief Devuelve la terminal al shell si se le había cedido al grupo de una tubería.
+ */
+static void devolver_terminal(MsTrabajo *trabajo) {
+    if (trabajo->terminal_cedida) {
+        ceder_terminal_a(getpgrp());
+        trabajo->terminal_cedida = 0;
+    }
+}
+
+/**
+ * @brief Envía una señal a toda la tubería: a su grupo de procesos o, si no tiene, a cada etapa.
+ * SIGKILL se envía con cgroup.kill si la tubería tiene cgroup.
+ */
+static void senalar_tuberia(const MsTrabajo *trabajo, const int recolectada[], int senal) {
+    if (senal == SIGKILL && trabajo->fd_cgroup != -1 && escribir_archivo_cgroup(trabajo->fd_cgroup, "cgroup.kill", "1") == 0) {
+        return; // Con cgroup (kernel 5.14+) también caen los procesos que salieron del grupo (setsid)
+    }
+    if (trabajo->grupo > 0 && kill(-trabajo->grupo, senal) == 0) {
+        return;
+    }
+    for (int i = 0; i < trabajo->num_procesos; i++) {
+        if (!recolectada[i]) {
+            kill(trabajo->pids[i], senal);
+        }
+    }
+}
+
+/**
+ * @brief Da el paso que toque si venció el plazo de la tubería: al agotarse el límite, SIGTERM (y
+ * SIGCONT, por si alguna etapa estaba parada) y un nuevo plazo de GRACIA_LIMITE_MS; al vencer la
+ * gracia, SIGKILL. El plazo y la señal enviada quedan en el trabajo, así que la escalada sigue
+ * donde la dejó quien la empezara (el front end mientras lee la salida, o ms_esperar()).
+ *
+ * @return Milisegundos hasta el siguiente paso, o -1 si ya no queda ninguno (o no hay límite).
+ */
+static int avanzar_limite(MsTrabajo *trabajo, const int recolectada[], long long ahora) {
+    if (trabajo->limite_ns == 0 || trabajo->limite_ns == LLONG_MAX) {
+        return -1;
+    }
+    if (ahora >= trabajo->limite_ns) {
+        if (trabajo->senal_limite == 0) {
+            fprintf(stderr, "timeout: límite de tiempo agotado, terminando la tubería.\n");
+            fflush(stderr);
+            senalar_tuberia(trabajo, recolectada, SIGTERM);
+            senalar_tuberia(trabajo, recolectada, SIGCONT); // Por si alguna etapa estaba parada
+            trabajo->senal_limite = SIGTERM;
+            trabajo->limite_ns = ahora + (long long)GRACIA_LIMITE_MS * 1000000LL;
+        } else {
+            senalar_tuberia(trabajo, recolectada, SIGKILL);
+            trabajo->senal_limite = SIGKILL;
+            trabajo->limite_ns = LLONG_MAX; // SIGKILL no se puede ignorar: solo queda recolectar
+            return -1;
+        }
+    }
+    long long espera_ms = (trabajo->limite_ns - ahora + 999999) / 1000000;
+    return espera_ms > INT_MAX ? INT_MAX : (int)espera_ms;
+}
+
+/**
+ * @brief Hace cumplir el límite de tiempo de una tubería que aún no se está esperando.
+ * Un front end que lee la salida de la tubería antes de llamar a ms_esperar() la llama en cada
+ * vuelta y usa el resultado como plazo de su poll(): así el límite se cumple aunque una etapa
+ * mantenga abierta su salida. ms_esperar() continúa la escalada donde quedó.
+ *
+ * @param trabajo Trabajo lanzado con ms_lanzar_tuberia() y aún sin esperar.
+ * @return Milisegundos hasta el siguiente paso (SIGTERM o SIGKILL), o -1 si no hay nada que vigilar.
+ */
+int ms_aplicar_limite(MsTrabajo *trabajo) {
+    int recolectada[MAX_COMANDOS] = {0}; // Nada se ha recolectado todavía
+    if (trabajo->num_procesos == 0) {
+        return -1;
+    }
+    return avanzar_limite(trabajo, recolectada, reloj_ns());
+}
+
+/**
+ * @brief Espera las etapas de una tubería con límite de tiempo.
+ * Vigila un pidfd por etapa con poll() (sin procesos auxiliares como timeout(1)). Al agotarse el
+ * límite envía SIGTERM al grupo de la tubería y, si GRACIA_LIMITE_MS después sigue viva, SIGKILL
+ * (ver avanzar_limite()). Si el kernel no tiene pidfd_open (anterior a 5.3), se comprueba cada 10 ms.
+ *
+ * @param trabajo Trabajo con limite_ns distinto de 0.
+ * @param status_ultima Donde se deja el estado (de wait) de la última etapa.
+ * @return 1 si la tubería se terminó por agotar el límite, 0 si terminó sola.
+ */
+static int esperar_con_limite(MsTrabajo *trabajo, int *status_ultima) {
+    int pidfds[MAX_COMANDOS];
+    int recolectada[MAX_COMANDOS] = {0};
+    int pendientes = trabajo->num_procesos;
+
+    for (int i = 0; i < trabajo->num_procesos; i++) {
+        pidfds[i] = (int)syscall(SYS_pidfd_open, trabajo->pids[i], 0);
+    }
+
+    while (pendientes > 0) {
+        // 1. Recolecta las etapas que ya terminaron
+        for (int i = 0; i < trabajo->num_procesos; i++) {
+            int status;
+            struct rusage uso;
+            if (recolectada[i]) {
+                continue;
+            }
+            pid_t resultado = wait4(trabajo->pids[i], &status, WNOHANG, &uso);
+            if (resultado == 0 || (resultado == -1 && errno == EINTR)) {
+                continue;
+            }
+            if (resultado > 0) {
+                sonda_hijo_recolectado(trabajo->pids[i], status, &uso);
+                traza_fin_proceso(trabajo->pids[i], trabajo->inicios_ns[i], ms_traza_ahora(), status);
+                if (i == trabajo->num_procesos - 1) {
+                    *status_ultima = status;
+                }
+            }
+            recolectada[i] = 1;
+            pendientes--;
+            if (pidfds[i] != -1) {
+                close(pidfds[i]);
+                pidfds[i] = -1;
+            }
+        }
+        if (pendientes == 0) {
+            break;
+        }
+
+        // 2. Límite agotado: SIGTERM y, tras la gracia, SIGKILL
+        int espera_ms = avanzar_limite(trabajo, recolectada, reloj_ns());
+
+        // 3. Espera a que termine alguna etapa o a que venza el plazo
+        struct pollfd descriptores[MAX_COMANDOS];
+        int num_descriptores = 0;
+        int sin_pidfd = 0;
+        for (int i = 0; i < trabajo->num_procesos; i++) {
+            if (recolectada[i]) continue;
+            if (pidfds[i] == -1) {
+                sin_pidfd = 1;
+                continue;
+            }
+            descriptores[num_descriptores].fd = pidfds[i];
+            descriptores[num_descriptores].events = POLLIN;
+            descriptores[num_descriptores].revents = 0;
+            num_descriptores++;
+        }
+        if (sin_pidfd && (espera_ms < 0 || espera_ms > 10)) espera_ms = 10;
+        poll(descriptores, num_descriptores, espera_ms); // EINTR (Ctrl+C reenviado): se vuelve a mirar
+    }
+
+    for (int i = 0; i < trabajo->num_procesos; i++) {
+        if (pidfds[i] != -1) close(pidfds[i]);
+    }
+    return trabajo->senal_limite != 0;
+}
+
+// --- Contadores hardware (perf_event_open) ---
+
+// Eventos de cada grupo, en el orden de MsContadores (CONTADOR_*)
+static const struct {
+    unsigned int tipo;
+    unsigned long long configuracion;
+} eventos_perf[NUM_CONTADORES_PERF] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+/**
+ * @brief Abre el grupo de contadores de un hijo que aún no ha hecho exec.
+ * El primer contador que se abre es el líder del grupo: empieza deshabilitado y se habilita en el
+ * exec del hijo (enable_on_exec), arrastrando al resto. Con `inherit` también cuentan los procesos
+ * que cree la etapa. Los contadores que el sistema no ofrece se quedan en -1.
+ *
+ * @return Número de contadores abiertos.
+ */
+static int abrir_contadores(pid_t pid, int fds[NUM_CONTADORES_PERF]) {
+    int lider = -1;
+    int abiertos = 0;
+
+    for (int i = 0; i < NUM_CONTADORES_PERF; i++) {
+        struct perf_event_attr atributos;
+        memset(&atributos, 0, sizeof(atributos));
+        atributos.size = sizeof(atributos);
+        atributos.type = eventos_perf[i].tipo;
+        atributos.config = eventos_perf[i].configuracion;
+        atributos.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        atributos.disabled = (lider == -1);
+        atributos.enable_on_exec = (lider == -1);
+        atributos.inherit = 1;
+        atributos.exclude_kernel = 1;
+        atributos.exclude_hv = 1;
+        fds[i] = (int)syscall(SYS_perf_event_open, &atributos, pid, -1, lider, PERF_FLAG_FD_CLOEXEC);
+        if (fds[i] != -1) {
+            if (lider == -1) lider = fds[i];
+            abiertos++;
+        }
+    }
+    return abiertos;
+}
+
+/**
+ * @brief Cierra los contadores abiertos de un trabajo.
+ */
+static void cerrar_contadores(MsTrabajo *trabajo) {
+    for (int i = 0; i < trabajo->etapas_con_contadores; i++) {
+        for (int c = 0; c < NUM_CONTADORES_PERF; c++) {
+            if (trabajo->fds_contadores[i][c] != -1) {
+                close(trabajo->fds_contadores[i][c]);
+                trabajo->fds_contadores[i][c] = -1;
+            }
+        }
+    }
+    trabajo->etapas_con_contadores = 0;
+}
+
+/**
+ * @brief Lee los contadores de cada etapa de un trabajo lanzado con `medir_contadores` y los cierra.
+ * Debe llamarse después de ms_esperar(): los contadores heredados solo suman los de los procesos
+ * hijos de cada etapa cuando estos terminan.
+ *
+ * @param trabajo Trabajo ya esperado.
+ * @param contadores Array de al menos MAX_COMANDOS elementos donde se dejan los valores.
+ * @return Número de etapas leídas, o -1 si el trabajo no medía contadores.
+ */
+int ms_leer_contadores(MsTrabajo *trabajo, MsContadores contadores[]) {
+    int etapas = trabajo->etapas_con_contadores;
+
+    if (etapas == 0) {
+        return -1;
+    }
+    for (int i = 0; i < etapas; i++) {
+        for (int c = 0; c < NUM_CONTADORES_PERF; c++) {
+            unsigned long long lectura[3]; // Valor, tiempo habilitado y tiempo contando
+            contadores[i].valores[c] = 0;
+            contadores[i].disponible[c] = 0;
+            if (trabajo->fds_contadores[i][c] == -1 ||
+                read(trabajo->fds_contadores[i][c], lectura, sizeof(lectura)) != (ssize_t)sizeof(lectura)) {
+                continue;
+            }
+            // Si el kernel multiplexó el grupo, el valor se extrapola al tiempo total habilitado
+            if (lectura[2] > 0 && lectura[2] < lectura[1]) {
+                lectura[0] = (unsigned long long)((double)lectura[0] * lectura[1] / lectura[2]);
+            }
+            contadores[i].valores[c] = lectura[0];
+            contadores[i].disponible[c] = 1;
+        }
+    }
+    cerrar_contadores(trabajo);
+    return etapas;
+}
+
+/**
+ * @brief Guarda los PIDs de una tubería lanzada en segundo plano para que SIGCHLD los recolecte.
+ * Se llama con SIGCHLD bloqueada, de modo que un hijo que termine enseguida no se pierda.
+ * Si la tabla está llena el proceso no se registra y queda como zombie hasta que termine el shell.
+ */
+static void registrar_segundo_plano(const MsTrabajo *trabajo) {
+    int hueco = 0;
+    for (int i = 0; i < trabajo->num_procesos; i++) {
+        while (hueco < MAX_TRABAJOS_SEGUNDO_PLANO && pids_segundo_plano[hueco] != 0) {
+            hueco++;
+        }
+        if (hueco == MAX_TRABAJOS_SEGUNDO_PLANO) {
+            fprintf(stderr, "Demasiados procesos en segundo plano (máximo %d): [PID %d] no se recolectará.\n",
+                    MAX_TRABAJOS_SEGUNDO_PLANO, (int)trabajo->pids[i]);
+            fflush(stderr);
+            continue;
+        }
+        inicios_segundo_plano[hueco] = trabajo->inicios_ns[i];
+        pids_segundo_plano[hueco] = trabajo->pids[i];
+    }
+}
+
+/**
+ * @brief Recolecta, sin bloquear, los procesos en segundo plano que ya terminaron.
+ * La usa el manejador de SIGCHLD y también ms_lanzar_tuberia() (con SIGCHLD bloqueada), para que
+ * los programas que no instalan los manejadores del shell tampoco acumulen zombies. Solo hace
+ * llamadas seguras en un manejador: los spans de los procesos recolectados quedan pendientes.
+ */
+static void recolectar_segundo_plano(void) {
+    int status;
+    struct rusage uso;
+    for (int i = 0; i < MAX_TRABAJOS_SEGUNDO_PLANO; i++) {
+        pid_t pid = pids_segundo_plano[i];
+        pid_t resultado;
+        if (pid != 0 && (resultado = wait4(pid, &status, WNOHANG, &uso)) != 0) {
+            if (resultado > 0) {
+                sonda_hijo_recolectado(pid, status, &uso);
+                if (fd_traza != -1 && inicios_segundo_plano[i] != 0) {
+                    guardar_fin_segundo_plano(pid, inicios_segundo_plano[i], status);
+                }
+            }
+            pids_segundo_plano[i] = 0; // Terminó (o ya no es hijo nuestro): se libera el hueco
+        }
+    }
+}
+
+/**
+ * @brief Apunta un proceso en segundo plano recolectado para escribir su span más tarde.
+ * Segura en un manejador de señales (clock_gettime lo es). Si no queda hueco, el span se pierde.
+ */
+static void guardar_fin_segundo_plano(pid_t pid, long long inicio_ns, int status) {
+    for (int i = 0; i < MAX_TRABAJOS_SEGUNDO_PLANO; i++) {
+        volatile FinSegundoPlano *fin = &fines_segundo_plano[i];
+        if (!fin->pendiente) {
+            fin->pid = pid;
+            fin->status = status;
+            fin->inicio_ns = inicio_ns;
+            fin->fin_ns = reloj_ns();
+            fin->pendiente = 1;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Escribe los spans de los procesos en segundo plano que se recolectaron desde la última
+ * llamada. Nunca se llama desde un manejador; el de SIGCHLD solo ocupa huecos libres, así que
+ * puede interrumpirla sin pisar el hueco que se está leyendo.
+ */
+static void trazar_segundo_plano_recolectados(void) {
+    for (int i = 0; i < MAX_TRABAJOS_SEGUNDO_PLANO; i++) {
+        volatile FinSegundoPlano *fin = &fines_segundo_plano[i];
+        if (fin->pendiente) {
+            pid_t pid = fin->pid;
+            int status = fin->status;
+            long long inicio_ns = fin->inicio_ns;
+            long long fin_ns = fin->fin_ns;
+            fin->pendiente = 0;
+            traza_fin_proceso(pid, inicio_ns, fin_ns, status);
+        }
+    }
+}
+
+/**
+ * @brief Lanza los procesos de una tubería de comandos externos, sin esperarlos.
+ * Crea las tuberías (pipes) entre etapas y un proceso hijo por comando, con sus redirecciones.
+ * Si `opciones` indica descriptores de captura, la última etapa escribe en ellos su stdout/stderr
+ * (salvo que redirija la salida a un archivo). Las tuberías en segundo plano quedan registradas
+ * para que el shell las recolecte; las demás deben esperarse con ms_esperar().
+ *
+ * @param tuberia Tubería a lanzar (de ms_parsear()).
+ * @param opciones Ganchos de captura de salida, o NULL para heredar stdout/stderr.
+ * @param trabajo Estructura donde se guardan los PIDs lanzados.
+ * @return 0 si se lanzaron todos los procesos, -1 si falló la creación de una tubería o un fork.
+ */
+int ms_lanzar_tuberia(const Tuberia *tuberia, const MsOpcionesEjecucion *opciones, MsTrabajo *trabajo) {
+    int tuberias[MAX_COMANDOS - 1][2]; // Array para almacenar los descriptores de archivo de las tuberías (pipe[0] = lectura, pipe[1] = escritura)
+    const ComandoParseado *comandos_parseados = tuberia->comandos;
+    int num_comandos_tuberia = tuberia->num_comandos;
+    int fd_salida = opciones != NULL ? opciones->fd_salida : -1;
+    int fd_error = opciones != NULL ? opciones->fd_error : -1;
+    const int *fds_error_etapas = opciones != NULL ? opciones->fds_error_etapas : NULL;
+    int medir_contadores = opciones != NULL && opciones->medir_contadores && !tuberia->segundo_plano;
+    int limite_ms = opciones != NULL && opciones->limite_ms != 0 ? opciones->limite_ms : configuracion.limite_por_defecto_ms;
+    sigset_t mascara_sigchld, mascara_anterior;
+
+    trabajo->num_procesos = 0;
+    trabajo->segundo_plano = tuberia->segundo_plano;
+    trabajo->etapas_con_contadores = 0;
+    trabajo->limite_ns = 0;
+    trabajo->senal_limite = 0;
+    trabajo->grupo = 0;
+    trabajo->terminal_cedida = 0;
+    trabajo->fd_cgroup = -1;
+
+    // Con límite de tiempo la tubería va en su propio grupo de procesos, para poder terminarla entera
+    // (incluidos los procesos que creen sus etapas). Si el shell tiene la terminal en primer plano, se
+    // le cede al grupo mientras dura (si no, leer de la terminal pararía la tubería con SIGTTIN).
+    // Las tuberías en segundo plano nadie las espera, así que no tienen límite.
+    int grupo_propio = limite_ms > 0 && !tuberia->segundo_plano;
+    int ceder_terminal = grupo_propio && isatty(STDIN_FILENO) && tcgetpgrp(STDIN_FILENO) == getpgrp();
+    if (grupo_propio) {
+        trabajo->limite_ns = reloj_ns() + (long long)limite_ms * 1000000LL;
+    }
+
+    // Aprovecha para recolectar los procesos en segundo plano ya terminados (con SIGCHLD bloqueada,
+    // para no competir con el manejador por los mismos huecos) y escribir sus spans
+    sigemptyset(&mascara_sigchld);
+    sigaddset(&mascara_sigchld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mascara_sigchld, &mascara_anterior);
+    recolectar_segundo_plano();
+    sigprocmask(SIG_SETMASK, &mascara_anterior, NULL);
+    trazar_segundo_plano_recolectados();
+
+    // Crear tuberías si hay más de un comando en la tubería
+    long long inicio_traza = ms_traza_ahora();
+    for (int i = 0; i < num_comandos_tuberia - 1; i++) {
+        if (pipe(tuberias[i]) == -1) {
+            imprimir_error("Error al crear la tubería");
+            // Cierra las tuberías ya creadas en caso de error
+            for (int k = 0; k < i; k++) {
+                close(tuberias[k][0]);
+                close(tuberias[k][1]);
+            }
+            return -1;
+        }
+    }
+    if (num_comandos_tuberia > 1) {
+        ms_traza_span("crear_pipes", "ejecucion", inicio_traza, 0, NULL);
+    }
+
+    // En segundo plano, SIGCHLD se bloquea hasta registrar los PIDs (un hijo muy rápido podría terminar antes)
+    if (tuberia->segundo_plano) {
+        sigprocmask(SIG_BLOCK, &mascara_sigchld, &mascara_anterior);
+    }
+
+    // Con cgroups, cada etapa entra en el cgroup de la tubería antes del exec (y con ella sus hijos)
+    int fd_procs_cgroup = configuracion.usar_cgroups && !tuberia->segundo_plano ? crear_cgroup_trabajo(trabajo) : -1;
+
+    // Bucle para forkear y ejecutar cada comando en la tubería
+    for (int i = 0; i < num_comandos_tuberia; i++) {
+        // Con contadores, el hijo espera en este pipe a que el padre los abra antes de hacer exec
+        int sincronizacion[2] = {-1, -1};
+        if (medir_contadores && pipe2(sincronizacion, O_CLOEXEC) == -1) {
+            imprimir_error("Error al crear la tubería de sincronización");
+            sincronizacion[0] = sincronizacion[1] = -1; // Esta etapa se lanza sin contadores
+        }
+
+        long long inicio_fork = reloj_ns();
+        MS_SONDA2(spawn_inicio, i, comandos_parseados[i].argv[0]);
+        pid_t pid = fork(); // Crea un nuevo proceso hijo
+        if (pid == -1) { // Error al forkear
+            imprimir_error("Error al crear el proceso hijo");
+            if (sincronizacion[0] != -1) {
+                close(sincronizacion[0]);
+                close(sincronizacion[1]);
+            }
+            cerrar_contadores(trabajo);
+            devolver_terminal(trabajo);
+            // Cierra todas las tuberías abiertas en caso de error
+            for (int j = 0; j < num_comandos_tuberia - 1; j++) {
+                close(tuberias[j][0]);
+                close(tuberias[j][1]);
+            }
+            // Mata y recolecta los procesos hijos que ya pudieron haber sido creados
+            for (int k = 0; k < i; k++) {
+                kill(trabajo->pids[k], SIGKILL);
+                waitpid(trabajo->pids[k], NULL, 0);
+            }
+            trabajo->num_procesos = 0;
+            if (fd_procs_cgroup != -1) {
+                close(fd_procs_cgroup);
+                finalizar_cgroup(trabajo, 0);
+            }
+            if (tuberia->segundo_plano) {
+                sigprocmask(SIG_SETMASK, &mascara_anterior, NULL);
+            }
+            return -1;
+        }
+
+        if (pid == 0) { // CÓDIGO DEL PROCESO HIJO
+            long long inicio_traza_hijo = ms_traza_ahora();
+            if (sincronizacion[0] != -1) {
+                char listo;
+                close(sincronizacion[1]); // Si no, el read nunca vería EOF
+                while (read(sincronizacion[0], &listo, 1) == -1 && errno == EINTR) {
+                    // Se reintenta hasta que el padre haya abierto los contadores (o haya cerrado el pipe)
+                }
+                close(sincronizacion[0]);
+            }
+            if (fd_procs_cgroup != -1) {
+                if (write(fd_procs_cgroup, "0", 1) != 1) { // "0": el proceso que escribe
+                    imprimir_error("Error al entrar en el cgroup de la tubería");
+                }
+                close(fd_procs_cgroup);
+            }
+            if (grupo_propio) {
+                // También lo hace el padre: así el grupo existe sea quien sea el primero en ejecutarse
+                setpgid(0, i == 0 ? 0 : trabajo->grupo);
+                if (i == 0 && ceder_terminal) {
+                    ceder_terminal_a(getpgrp());
+                }
+            }
+            ms_restaurar_senales_hijo(); // Restaura los manejadores de señales a su comportamiento por defecto
+            if (tuberia->segundo_plano) {
+                sigprocmask(SIG_SETMASK, &mascara_anterior, NULL);
+            }
+            int es_ultimo = (i == num_comandos_tuberia - 1);
+
+            // --- Manejo de redirección de entrada ---
+            if (comandos_parseados[i].archivo_entrada != NULL) {
+                // Abre el archivo de entrada en modo lectura
+                int fd_in = open(comandos_parseados[i].archivo_entrada, O_RDONLY);
+                if (fd_in == -1) {
+                    imprimir_error("Error al abrir archivo de entrada");
+                    exit(EXIT_FAILURE); // El hijo termina con fallo
+                }
+                dup2(fd_in, STDIN_FILENO); // Redirige la entrada estándar (stdin) al archivo
+                close(fd_in);              // Cierra el descriptor de archivo original
+            } else if (i > 0) { // Si no hay redirección de entrada y no es el primer comando, usa la tubería anterior como entrada
+                dup2(tuberias[i - 1][0], STDIN_FILENO); // Redirige stdin al extremo de lectura de la tubería anterior
+            }
+
+            // --- Manejo de redirección de salida ---
+            if (comandos_parseados[i].archivo_salida != NULL) {
+                int flags = O_WRONLY | O_CREAT; // Abrir en modo escritura, crear si no existe
+                if (comandos_parseados[i].tipo_operacion == REDIR_SALIDA_ANEXAR) {
+                    flags |= O_APPEND; // Añadir al final (para '>>')
+                } else { // REDIR_SALIDA_TRUNCAR (para '>')
+                    flags |= O_TRUNC;  // Truncar el archivo si ya existe
+                }
+                // Abre el archivo de salida con los permisos 0644 (lectura/escritura para el dueño, lectura para grupo/otros)
+                int fd_out = open(comandos_parseados[i].archivo_salida, flags, 0644);
+                if (fd_out == -1) {
+                    imprimir_error("Error al abrir archivo de salida");
+                    exit(EXIT_FAILURE); // El hijo termina con fallo
+                }
+                dup2(fd_out, STDOUT_FILENO); // Redirige la salida estándar (stdout) al archivo
+                close(fd_out);               // Cierra el descriptor de archivo original
+            } else if (!es_ultimo) { // Si no hay redirección de salida y no es el último comando, usa la tubería para el siguiente comando
+                dup2(tuberias[i][1], STDOUT_FILENO); // Redirige stdout al extremo de escritura de la tubería actual
+            } else if (fd_salida >= 0) { // Último comando con captura de salida
+                dup2(fd_salida, STDOUT_FILENO);
+            }
+            if (fds_error_etapas != NULL && fds_error_etapas[i] >= 0) { // stderr propio de la etapa
+                dup2(fds_error_etapas[i], STDERR_FILENO);
+            } else if (es_ultimo && fd_error >= 0) { // La captura de stderr aplica a la última etapa
+                dup2(fd_error, STDERR_FILENO);
+            }
+
+            // Cierra todos los extremos de las tuberías en el proceso hijo.
+            // Esto es crucial para que los comandos se comporten correctamente (ej. `cat | wc -l` no se quede colgado)
+            for (int j = 0; j < num_comandos_tuberia - 1; j++) {
+                close(tuberias[j][0]); // Cierra los extremos de lectura de todas las tuberías
+                close(tuberias[j][1]); // Cierra los extremos de escritura de todas las tuberías
+            }
+            // ... y los descriptores de captura originales (ya duplicados donde hacía falta)
+            if (fd_salida > STDERR_FILENO) close(fd_salida);
+            if (fd_error > STDERR_FILENO && fd_error != fd_salida) close(fd_error);
+
+            // Preparación del exec (redirecciones y pipes) en la pista del hijo
+            if (inicio_traza_hijo != 0) {
+                nombrar_pista_traza(getpid(), comandos_parseados[i].argv[0]);
+                ms_traza_span("exec", "ejecucion", inicio_traza_hijo, getpid(),
+                              comandos_parseados[i].ruta_ejecutable != NULL ? "{\"ruta_en_cache\":1}" : "{\"ruta_en_cache\":0}");
+            }
+
+            registrar_histograma_atomico(&estadisticas->latencia_spawn, reloj_ns() - inicio_fork);
+            incrementar_contador(&estadisticas->intentos_exec);
+
+            // Si el plan ya trae la ruta resuelta en PATH se ejecuta directamente con execv.
+            // Si falla (por ejemplo, el ejecutable se movió desde que se guardó el plan) se recurre a execvp.
+            if (comandos_parseados[i].ruta_ejecutable != NULL) {
+                incrementar_contador(&estadisticas->execs_ruta_cache);
+                execv(comandos_parseados[i].ruta_ejecutable, comandos_parseados[i].argv);
+            }
+
+            // Ejecuta el comando usando execvp
+            // execvp reemplaza el proceso actual con el nuevo programa.
+            // Si execvp tiene éxito, nunca regresa; si falla, regresa -1.
+            execvp(comandos_parseados[i].argv[0], comandos_parseados[i].argv);
+            incrementar_contador(&estadisticas->execs_fallidos);
+            imprimir_error("Error al ejecutar el comando"); // Solo se ejecuta si execvp falla
+            exit(127); // Convención para "comando no encontrado / no ejecutable"
+        }
+
+        MS_SONDA2(spawn_fin, (int)pid, comandos_parseados[i].argv[0]);
+        if (grupo_propio) {
+            if (i == 0) {
+                trabajo->grupo = pid;
+            }
+            setpgid(pid, trabajo->grupo);
+            if (i == 0 && ceder_terminal) {
+                ceder_terminal_a(trabajo->grupo);
+                trabajo->terminal_cedida = 1;
+            }
+        }
+        if (medir_contadores) {
+            for (int c = 0; c < NUM_CONTADORES_PERF; c++) {
+                trabajo->fds_contadores[i][c] = -1;
+            }
+            trabajo->etapas_con_contadores = i + 1;
+            if (sincronizacion[0] != -1) {
+                abrir_contadores(pid, trabajo->fds_contadores[i]);
+                close(sincronizacion[0]);
+                close(sincronizacion[1]); // El hijo lee EOF y continúa hacia el exec
+            }
+        }
+        trabajo->pids[i] = pid;
+        trabajo->inicios_ns[i] = inicio_fork;
+        trabajo->num_procesos++;
+        estadisticas->forks++;
+        if (fd_traza != -1) {
+            char args[64];
+            snprintf(args, sizeof(args), "{\"etapa\":%d,\"hijo\":%d}", i, (int)pid);
+            ms_traza_span("fork", "ejecucion", inicio_fork, 0, args);
+        }
+    }
+
+    // CÓDIGO DEL PROCESO PADRE
+    if (fd_procs_cgroup != -1) {
+        close(fd_procs_cgroup);
+    }
+    // Cierra todos los descriptores de archivo de las tuberías en el proceso padre.
+    // Esto es importante para que los comandos hijos sepan cuándo la entrada de la tubería se ha cerrado.
+    for (int i = 0; i < num_comandos_tuberia - 1; i++) {
+        close(tuberias[i][0]);
+        close(tuberias[i][1]);
+    }
+
+    if (tuberia->segundo_plano) {
+        registrar_segundo_plano(trabajo);
+        sigprocmask(SIG_SETMASK, &mascara_anterior, NULL);
+    }
+    return 0;
+}
+
+/**
+ * @brief Espera a que terminen todas las etapas de una tubería lanzada con ms_lanzar_tuberia().
+ * En un shell interactivo (ms_configurar_senales_shell()) reenvía Ctrl+C y Ctrl+\ a la última
+ * etapa mientras espera, y vuelve a ignorarlas al terminar. Si la tubería tiene límite de tiempo
+ * y se agota, se termina su grupo de procesos (SIGTERM y luego SIGKILL).
+ *
+ * @param trabajo Trabajo a esperar (no debe estar en segundo plano).
+ * @return El estado de salida de la última etapa (128 + señal si terminó por una señal,
+ *         ESTADO_LIMITE_AGOTADO si se agotó el límite de tiempo).
+ */
+int ms_esperar(MsTrabajo *trabajo) {
+    int estado_salida_final = 1; // Por defecto, se asume fallo (estado de salida distinto de 0)
+
+    if (trabajo->num_procesos == 0) {
+        return estado_salida_final;
+    }
+
+    // El último PID de la tubería es el proceso en primer plano
+    pid_proceso_en_primer_plano = trabajo->pids[trabajo->num_procesos - 1];
+
+    // Restaurar manejadores de SIGINT/SIGQUIT para que el padre pueda reenviar la señal al hijo en foreground.
+    if (senales_shell_configuradas) {
+        signal(SIGINT, manejador_sigint_quit);
+        signal(SIGQUIT, manejador_sigint_quit);
+    }
+
+    int status = 0;
+    struct rusage uso; // Uso de recursos de cada etapa (para la sonda hijo_recolectado)
+    int limite_agotado = 0;
+    if (trabajo->limite_ns != 0) {
+        limite_agotado = esperar_con_limite(trabajo, &status);
+    } else {
+        // El padre espera a que cada uno de sus hijos en la tubería termine
+        for (int i = 0; i < trabajo->num_procesos; i++) {
+            while (wait4(trabajo->pids[i], &status, 0, &uso) == -1 && errno == EINTR) {
+                // Interrumpido por una señal (Ctrl+C reenviado): se vuelve a esperar
+            }
+            sonda_hijo_recolectado(trabajo->pids[i], status, &uso);
+            traza_fin_proceso(trabajo->pids[i], trabajo->inicios_ns[i], ms_traza_ahora(), status);
+        }
+    }
+    // Captura el estado de salida del ÚLTIMO comando de la tubería
+    if (limite_agotado) {
+        estado_salida_final = ESTADO_LIMITE_AGOTADO; // Misma convención que timeout(1)
+    } else if (WIFEXITED(status)) { // Si el proceso terminó normalmente
+        estado_salida_final = WEXITSTATUS(status); // Obtiene el código de salida
+    } else if (WIFSIGNALED(status)) { // Si el proceso fue terminado por una señal
+        estado_salida_final = 128 + WTERMSIG(status); // Convención para terminación por señal
+    }
+    devolver_terminal(trabajo);
+    finalizar_cgroup(trabajo, 1);
+    pid_proceso_en_primer_plano = 0; // Resetea el PID en primer plano cuando la tubería ha terminado
+    trabajo->num_procesos = 0;
+
+    // Restaurar manejadores de SIGINT/SIGQUIT a SIG_IGN (ignorar) para el prompt del shell
+    // Esto previene que Ctrl+C termine el shell cuando no hay un proceso en foreground.
+    if (senales_shell_configuradas) {
+        signal(SIGINT, SIG_IGN);
+        signal(SIGQUIT, SIG_IGN);
+    }
+
+    return estado_salida_final; // Devuelve el estado de salida del último comando ejecutado
+}
+
+/**
+ * @brief Ejecuta una tubería de comandos externos: la lanza y espera su terminación.
+ * Si la tubería termina en '&' no se espera: se informa del PID y se considera exitosa.
+ *
+ * @param tuberia Tubería a ejecutar.
+ * @param opciones Ganchos de captura de salida, o NULL para heredar stdout/stderr.
+ * @return El estado de salida del último comando en la tubería (0 para éxito, >0 para fallo).
+ */
+int ms_ejecutar_tuberia(const Tuberia *tuberia, const MsOpcionesEjecucion *opciones) {
+    MsTrabajo trabajo;
+    long long inicio_traza = ms_traza_ahora();
+    char args[64];
+
+    if (ms_lanzar_tuberia(tuberia, opciones, &trabajo) != 0) {
+        return 1; // Retorna un código de error
+    }
+    if (trabajo.segundo_plano) {
+        printf("Proceso en segundo plano lanzado: [PID %d]\n", (int)trabajo.pids[0]);
+        fflush(stdout);
+        ms_traza_span("ejecutar_tuberia", "ejecucion", inicio_traza, 0, "{\"segundo_plano\":1}");
+        return 0; // Se considera "exitoso" el lanzamiento en segundo plano
+    }
+    int estado = ms_esperar(&trabajo);
+    if (inicio_traza != 0) {
+        snprintf(args, sizeof(args), "{\"etapas\":%d,\"estado\":%d}", tuberia->num_comandos, estado);
+        ms_traza_span("ejecutar_tuberia", "ejecucion", inicio_traza, 0, args);
+    }
+    return estado;
+}
+
+/**
+ * @brief Imprime los contadores de cada etapa (de ms_leer_contadores()): IPC y fallos por cada mil
+ * instrucciones. El prefijo 'perf' los imprime en stderr al terminar la tubería.
+ *
+ * @param salida Donde se imprimen (stderr, o un flujo en memoria para enviarlos a otro sitio).
+ * @param tuberia Tubería medida (sin el prefijo), para el nombre de cada etapa.
+ * @param contadores Contadores de cada etapa.
+ * @param etapas Número de etapas medidas.
+ */
+void ms_imprimir_contadores(FILE *salida, const Tuberia *tuberia, const MsContadores contadores[], int etapas) {
+    static const char *nombres[NUM_CONTADORES_PERF] = {"ciclos", "instr", "f.cache", "f.saltos", "f.pagina"};
+    int alguno_disponible = 0;
+
+    for (int i = 0; i < etapas; i++) {
+        for (int c = 0; c < NUM_CONTADORES_PERF; c++) {
+            alguno_disponible |= contadores[i].disponible[c];
+        }
+    }
+    if (!alguno_disponible) {
+        fprintf(salida, "perf: no se pudo abrir ningún contador (ver /proc/sys/kernel/perf_event_paranoid).\n");
+        fflush(salida);
+        return;
+    }
+
+    // Cabeceras en ASCII: printf alinea por bytes, no por caracteres
+    fprintf(salida, "%-5s %-14s", "etapa", "comando");
+    for (int c = 0; c < NUM_CONTADORES_PERF; c++) {
+        fprintf(salida, " %14s", nombres[c]);
+    }
+    fprintf(salida, " %6s %10s %10s\n", "IPC", "cache/Ki", "saltos/Ki");
+    for (int i = 0; i < etapas; i++) {
+        const MsContadores *etapa = &contadores[i];
+        fprintf(salida, "%-5d %-14.14s", i, tuberia->comandos[i].argv[0]);
+        for (int c = 0; c < NUM_CONTADORES_PERF; c++) {
+            if (etapa->disponible[c]) fprintf(salida, " %14llu", etapa->valores[c]);
+            else fprintf(salida, " %14s", "n/d");
+        }
+        // Ratios: solo si están los dos contadores y hubo instrucciones
+        double instrucciones = (double)etapa->valores[CONTADOR_INSTRUCCIONES];
+        int hay_instrucciones = etapa->disponible[CONTADOR_INSTRUCCIONES] && instrucciones > 0;
+        if (hay_instrucciones && etapa->disponible[CONTADOR_CICLOS] && etapa->valores[CONTADOR_CICLOS] > 0) {
+            fprintf(salida, " %6.2f", instrucciones / etapa->valores[CONTADOR_CICLOS]);
+        } else {
+            fprintf(salida, " %6s", "n/d");
+        }
+        for (int c = CONTADOR_FALLOS_CACHE; c <= CONTADOR_FALLOS_SALTOS; c++) {
+            if (hay_instrucciones && etapa->disponible[c]) {
+                fprintf(salida, " %10.2f", etapa->valores[c] * 1000.0 / instrucciones);
+            } else {
+                fprintf(salida, " %10s", "n/d");
+            }
+        }
+        fprintf(salida, "\n");
+    }
+    fflush(salida);
+}
+
+/**
+ * @brief Copia una tubería quitando las primeras palabras de su primer comando (un prefijo como
+ * 'perf' o 'timeout 5'). No se modifica el original porque el plan puede estar en la caché.
+ *
+ * @param tuberia Tubería original.
+ * @param palabras Número de palabras a quitar (menor que el argc del primer comando).
+ * @param comandos Array de MAX_COMANDOS donde se copian los comandos.
+ * @param sin_prefijo Tubería resultante, que apunta a 'comandos'.
+ */
+static void quitar_prefijo(const Tuberia *tuberia, int palabras, ComandoParseado comandos[], Tuberia *sin_prefijo) {
+    *sin_prefijo = *tuberia;
+    memcpy(comandos, tuberia->comandos, sizeof(ComandoParseado) * tuberia->num_comandos);
+    memmove(&comandos[0].argv[0], &comandos[0].argv[palabras],
+            sizeof(char *) * (comandos[0].argc - palabras + 1)); // Incluye el NULL final
+    comandos[0].argc -= palabras;
+    comandos[0].ruta_ejecutable = NULL; // La ruta resuelta era la del prefijo: el hijo busca con execvp
+    sin_prefijo->comandos = comandos;
+}
+
+/**
+ * @brief Quita de una tubería sus prefijos y traduce cada uno a opciones de ejecución:
+ *   timeout DURACION comando [| comando ...]   (limite_ms; 0 deja el límite por defecto)
+ *   perf comando [| comando ...]               (medir_contadores)
+ *   timeout DURACION perf comando ...          (los dos, en este orden)
+ * El límite se hace cumplir desde el propio shell (sin procesos auxiliares como timeout(1)). Todos
+ * los front ends pasan por aquí, tanto con ms_ejecutar_linea() como si lanzan ellos la tubería.
+ *
+ * @param tuberia Tubería original (no se modifica: el plan puede estar en la caché).
+ * @param opciones Opciones del llamador, que se copian en `opciones_tuberia` (NULL: por defecto).
+ * @param comandos Array de MAX_COMANDOS donde se copian los comandos si hay que quitar un prefijo.
+ * @param sin_prefijo Tubería a lanzar (una copia de la original si no llevaba prefijos).
+ * @param opciones_tuberia Opciones con las que lanzar `sin_prefijo`.
+ * @param error Mensaje de uso si un prefijo está mal escrito (termina en '\n').
+ * @param tamano_error Tamaño de `error`.
+ * @return 0 si `sin_prefijo` se puede lanzar, o -1 si un prefijo está mal escrito.
+ */
+int ms_quitar_prefijos(const Tuberia *tuberia, const MsOpcionesEjecucion *opciones, ComandoParseado comandos[],
+                       Tuberia *sin_prefijo, MsOpcionesEjecucion *opciones_tuberia, char *error, size_t tamano_error) {
+    const ComandoParseado *comando = &tuberia->comandos[0];
+    MsOpcionesEjecucion por_defecto = MS_OPCIONES_EJECUCION_POR_DEFECTO;
+    int palabras = 0;
+
+    *sin_prefijo = *tuberia;
+    *opciones_tuberia = opciones != NULL ? *opciones : por_defecto;
+    error[0] = '\0';
+
+    if (comando->argc > 0 && strcmp(comando->argv[0], "timeout") == 0) {
+        int limite_ms;
+        if (comando->argc < 3) {
+            snprintf(error, tamano_error, "Uso: timeout DURACION <comando> [| <comando> ...]\n       timeout -d DURACION\n");
+            return -1;
+        }
+        if (ms_parsear_duracion(comando->argv[1], &limite_ms) != 0) {
+            snprintf(error, tamano_error, "timeout: duración no válida '%s' (ej: 30, 1.5s, 500ms, 2m, 1h).\n", comando->argv[1]);
+            return -1;
+        }
+        if (tuberia->segundo_plano) {
+            snprintf(error, tamano_error, "timeout: no se admite en segundo plano.\n");
+            return -1;
+        }
+        opciones_tuberia->limite_ms = limite_ms; // 0 ('timeout 0 ...') deja el límite por defecto
+        palabras = 2;
+    }
+    if (comando->argc > palabras && strcmp(comando->argv[palabras], "perf") == 0) {
+        if (comando->argc < palabras + 2) {
+            snprintf(error, tamano_error, "Uso: perf <comando> [| <comando> ...]\n");
+            return -1;
+        }
+        if (tuberia->segundo_plano) {
+            snprintf(error, tamano_error, "perf: no se admite en segundo plano.\n");
+            return -1;
+        }
+        opciones_tuberia->medir_contadores = 1;
+        palabras++;
+    }
+    if (palabras > 0) {
+        quitar_prefijo(tuberia, palabras, comandos, sin_prefijo);
+    }
+    return 0;
+}
+
+/**
+ * @brief Ejecuta una tubería midiendo los contadores de cada etapa entre su exec y su recolección
+ * (prefijo 'perf'), e imprime el resultado en stderr al terminar.
+ *
+ * @return El estado de salida de la tubería.
+ */
+static int ejecutar_con_contadores(const Tuberia *tuberia, const MsOpcionesEjecucion *opciones) {
+    MsContadores contadores[MAX_COMANDOS];
+    MsTrabajo trabajo;
+
+    if (ms_lanzar_tuberia(tuberia, opciones, &trabajo) != 0) {
+        return 1;
+    }
+    int estado = ms_esperar(&trabajo);
+    int etapas = ms_leer_contadores(&trabajo, contadores);
+    if (etapas > 0) {
+        ms_imprimir_contadores(stderr, tuberia, contadores, etapas);
+    }
+    return estado;
+}
+
+/**
+ * @brief Ejecuta una línea parseada: sus tuberías separadas por '&&', en orden.
+ * Una tubería solo se ejecuta si la anterior terminó con estado 0. Un comando único, sin
+ * redirecciones y en primer plano se ejecuta como built-in si lo es.
+ *
+ * @param linea_parseada Línea devuelta por ms_parsear().
+ * @param opciones Ganchos de captura de salida para los comandos externos (NULL para heredar).
+ * @return El estado de salida de la última tubería ejecutada.
+ */
+int ms_ejecutar_linea(LineaParseada *linea_parseada, const MsOpcionesEjecucion *opciones) {
+    int ultimo_estado_salida = 0;
+
+    // Itera sobre cada tubería separada por '&&'
+    for (int s = 0; s < linea_parseada->num_segmentos; s++) {
+        // Si el comando anterior falló (estado de salida distinto de 0) y estamos en un segmento '&&',
+        // se salta el resto de la línea (comportamiento de '&&').
+        if (s > 0 && ultimo_estado_salida != 0) {
+            break;
+        }
+
+        Tuberia *tuberia = &linea_parseada->segmentos[s];
+
+        // --- Manejo de comandos internos (built-ins) ---
+        // Solo se ejecuta un built-in si es un solo comando, sin redirecciones y en primer plano.
+        long long inicio = reloj_ns(); // Tiempo del comando (estadísticas y trazas)
+        if (tuberia->num_comandos == 1 && !tuberia->segundo_plano &&
+            tuberia->comandos[0].archivo_entrada == NULL &&
+            tuberia->comandos[0].archivo_salida == NULL &&
+            ms_ejecutar_builtin(&tuberia->comandos[0])) {
+            registrar_histograma(&estadisticas->tiempo_comando, reloj_ns() - inicio);
+            ms_traza_span("builtin", "ejecucion", inicio, 0, NULL);
+            ultimo_estado_salida = 0; // Considera la ejecución del built-in como exitosa para el '&&'
+            continue;
+        }
+
+        // --- Ejecución de tuberías (o comando único externo), sin sus prefijos 'timeout' y 'perf' ---
+        ComandoParseado comandos[MAX_COMANDOS];
+        Tuberia sin_prefijo;
+        MsOpcionesEjecucion opciones_tuberia;
+        char error[160];
+        if (ms_quitar_prefijos(tuberia, opciones, comandos, &sin_prefijo, &opciones_tuberia, error, sizeof(error)) != 0) {
+            fputs(error, stderr);
+            fflush(stderr);
+            ultimo_estado_salida = 1;
+        } else if (opciones_tuberia.medir_contadores && !sin_prefijo.segundo_plano) {
+            ultimo_estado_salida = ejecutar_con_contadores(&sin_prefijo, &opciones_tuberia);
+        } else {
+            ultimo_estado_salida = ms_ejecutar_tuberia(&sin_prefijo, &opciones_tuberia);
+        }
+        registrar_histograma(&estadisticas->tiempo_comando, reloj_ns() - inicio);
+    }
+    return ultimo_estado_salida;
+}
+
+// --- Reactor de salida en streaming ---
+
+/**
+ * @brief Deja un reactor vacío, listo para lanzar tuberías.
+ * @param reactor Reactor a inicializar (su memoria la gestiona el llamador).
+ */
+void ms_reactor_iniciar(MsReactor *reactor) {
+    for (int i = 0; i < MAX_TUBERIAS_REACTOR; i++) {
+        reactor->tuberias[i].activa = 0;
+        reactor->tuberias[i].fd_salida = -1;
+        reactor->tuberias[i].fd_error = -1;
+    }
+    reactor->num_activas = 0;
+}
+
+/**
+ * @brief Crea un pipe cuyo extremo de lectura es no bloqueante (para el reactor).
+ * Ambos extremos llevan O_CLOEXEC; el de escritura se queda bloqueante porque los hijos lo heredan
+ * duplicado en stdout/stderr y O_NONBLOCK se comparte entre descriptores duplicados.
+ */
+static int crear_pipe_reactor(int extremos[2]) {
+    if (pipe2(extremos, O_CLOEXEC) == -1) {
+        return -1;
+    }
+    if (fcntl(extremos[0], F_SETFL, fcntl(extremos[0], F_GETFL) | O_NONBLOCK) == -1) {
+        close(extremos[0]);
+        close(extremos[1]);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Lanza una tubería cuya salida atenderá el reactor.
+ * La salida de la última etapa (y su stderr, mezclado o por separado según los callbacks) va a
+ * pipes que vigila ms_reactor_procesar(). Las tuberías marcadas con '&' se vigilan igual que las
+ * demás. Los built-ins no pasan por aquí: el reactor solo ejecuta comandos externos.
+ *
+ * @param reactor Reactor que vigilará la tubería.
+ * @param tuberia Tubería a lanzar.
+ * @param callbacks Callbacks de salida y de fin (se copian).
+ * @return Índice de la tubería dentro del reactor, o -1 si no hay hueco o falló el lanzamiento.
+ */
+int ms_reactor_lanzar(MsReactor *reactor, const Tuberia *tuberia, const MsCallbacks *callbacks) {
+    int pipe_salida[2];
+    int pipe_error[2] = {-1, -1};
+    int indice = 0;
+
+    while (indice < MAX_TUBERIAS_REACTOR && reactor->tuberias[indice].activa) {
+        indice++;
+    }
+    if (indice == MAX_TUBERIAS_REACTOR) {
+        fprintf(stderr, "Demasiadas tuberías en el reactor (máximo %d).\n", MAX_TUBERIAS_REACTOR);
+        return -1;
+    }
+
+    if (crear_pipe_reactor(pipe_salida) == -1) {
+        imprimir_error("Error al crear el pipe de salida");
+        return -1;
+    }
+    if (callbacks->separar_stderr && crear_pipe_reactor(pipe_error) == -1) {
+        imprimir_error("Error al crear el pipe de errores");
+        close(pipe_salida[0]);
+        close(pipe_salida[1]);
+        return -1;
+    }
+
+    MsTuberiaReactor *entrada = &reactor->tuberias[indice];
+    // Sin límite de tiempo: el reactor no espera con ms_esperar(), que es quien lo hace cumplir
+    MsOpcionesEjecucion opciones = {pipe_salida[1], callbacks->separar_stderr ? pipe_error[1] : pipe_salida[1], 0, -1, NULL};
+    Tuberia en_primer_plano = *tuberia;
+    en_primer_plano.segundo_plano = 0; // El reactor recolecta los procesos él mismo
+
+    int resultado = ms_lanzar_tuberia(&en_primer_plano, &opciones, &entrada->trabajo);
+    close(pipe_salida[1]); // Solo los hijos escriben: así el EOF llega cuando terminan
+    if (pipe_error[1] != -1) close(pipe_error[1]);
+    if (resultado != 0) {
+        close(pipe_salida[0]);
+        if (pipe_error[0] != -1) close(pipe_error[0]);
+        return -1;
+    }
+
+    entrada->callbacks = *callbacks;
+    entrada->fd_salida = pipe_salida[0];
+    entrada->fd_error = pipe_error[0];
+    entrada->estado = 1;
+    entrada->activa = 1;
+    reactor->num_activas++;
+    return indice;
+}
+
+/**
+ * @brief Lee un trozo de uno de los pipes de una tubería y se lo pasa al callback.
+ * Cierra el descriptor al llegar al fin de archivo (o ante un error de lectura).
+ */
+static void leer_pipe_reactor(MsReactor *reactor, MsTuberiaReactor *entrada, int *fd, int flujo) {
+    ssize_t leidos = read(*fd, reactor->buffer, sizeof(reactor->buffer));
+    if (leidos > 0) {
+        if (entrada->callbacks.al_recibir != NULL) {
+            entrada->callbacks.al_recibir(entrada->callbacks.contexto, flujo, reactor->buffer, (size_t)leidos);
+        }
+        return;
+    }
+    if (leidos == -1 && (errno == EAGAIN || errno == EINTR)) {
+        return; // Nada que leer todavía
+    }
+    if (leidos == -1) {
+        imprimir_error("Error al leer la salida de la tubería");
+    }
+    close(*fd);
+    *fd = -1;
+}
+
+/**
+ * @brief Recolecta sin bloquear las etapas ya terminadas de una tubería del reactor.
+ * @return 1 si ya terminaron todas las etapas, 0 si queda alguna en ejecución.
+ */
+static int recolectar_tuberia_reactor(MsTuberiaReactor *entrada) {
+    MsTrabajo *trabajo = &entrada->trabajo;
+    int pendientes = 0;
+
+    for (int i = 0; i < trabajo->num_procesos; i++) {
+        int status;
+        struct rusage uso;
+        if (trabajo->pids[i] == 0) {
+            continue; // Ya recolectada
+        }
+        pid_t resultado = wait4(trabajo->pids[i], &status, WNOHANG, &uso);
+        if (resultado == 0) {
+            pendientes++;
+            continue;
+        }
+        if (resultado > 0) {
+            sonda_hijo_recolectado(trabajo->pids[i], status, &uso);
+            traza_fin_proceso(trabajo->pids[i], trabajo->inicios_ns[i], ms_traza_ahora(), status);
+        }
+        if (resultado > 0 && i == trabajo->num_procesos - 1) {
+            if (WIFEXITED(status)) {
+                entrada->estado = WEXITSTATUS(status);
+            } else if (WIFSIGNALED(status)) {
+                entrada->estado = 128 + WTERMSIG(status);
+            }
+        }
+        trabajo->pids[i] = 0;
+    }
+    if (pendientes == 0) {
+        finalizar_cgroup(trabajo, 1);
+    }
+    return pendientes == 0;
+}
+
+/**
+ * @brief Atiende los pipes de salida que tengan datos y las tuberías que hayan terminado.
+ * Espera con poll() hasta `espera_ms` milisegundos (-1: sin límite) a que algún pipe esté listo,
+ * lee como mucho un trozo de cada uno (para repartir el tiempo entre tuberías) y llama a los
+ * callbacks. Cuando una tubería cerró su salida y todas sus etapas terminaron, se llama a su
+ * callback de fin y su hueco queda libre.
+ *
+ * @param reactor Reactor a procesar.
+ * @param espera_ms Tiempo máximo de espera en milisegundos (0: no esperar; -1: esperar sin límite).
+ * @return Número de tuberías que siguen activas, o -1 si falló poll().
+ */
+int ms_reactor_procesar(MsReactor *reactor, int espera_ms) {
+    struct pollfd descriptores[MAX_TUBERIAS_REACTOR * 2];
+    int num_descriptores = 0;
+    int esperando_procesos = 0; // Hay tuberías sin salida abierta cuyas etapas aún no terminaron
+
+    for (int i = 0; i < MAX_TUBERIAS_REACTOR; i++) {
+        MsTuberiaReactor *entrada = &reactor->tuberias[i];
+        if (!entrada->activa) continue;
+        if (entrada->fd_salida != -1) {
+            descriptores[num_descriptores].fd = entrada->fd_salida;
+            descriptores[num_descriptores].events = POLLIN;
+            num_descriptores++;
+        }
+        if (entrada->fd_error != -1) {
+            descriptores[num_descriptores].fd = entrada->fd_error;
+            descriptores[num_descriptores].events = POLLIN;
+            num_descriptores++;
+        }
+        if (entrada->fd_salida == -1 && entrada->fd_error == -1) {
+            esperando_procesos = 1;
+        }
+    }
+
+    // Un proceso puede seguir vivo tras cerrar su salida: mientras tanto se revisa cada 10 ms
+    if (esperando_procesos && (espera_ms < 0 || espera_ms > 10)) {
+        espera_ms = 10;
+    }
+    if (num_descriptores > 0 || espera_ms != 0) {
+        if (poll(descriptores, num_descriptores, espera_ms) == -1 && errno != EINTR) {
+            imprimir_error("Error en poll del reactor");
+            return -1;
+        }
+    }
+
+    int d = 0;
+    for (int i = 0; i < MAX_TUBERIAS_REACTOR; i++) {
+        MsTuberiaReactor *entrada = &reactor->tuberias[i];
+        if (!entrada->activa) continue;
+        // Los descriptores se añadieron en este mismo orden
+        if (entrada->fd_salida != -1) {
+            if (descriptores[d++].revents != 0) {
+                leer_pipe_reactor(reactor, entrada, &entrada->fd_salida, MS_FLUJO_SALIDA);
+            }
+        }
+        if (entrada->fd_error != -1) {
+            if (descriptores[d++].revents != 0) {
+                leer_pipe_reactor(reactor, entrada, &entrada->fd_error, MS_FLUJO_ERROR);
+            }
+        }
+        if (entrada->fd_salida == -1 && entrada->fd_error == -1 && recolectar_tuberia_reactor(entrada)) {
+            entrada->activa = 0;
+            reactor->num_activas--;
+            if (entrada->callbacks.al_terminar != NULL) {
+                entrada->callbacks.al_terminar(entrada->callbacks.contexto, entrada->estado);
+            }
+        }
+    }
+    return reactor->num_activas;
+}
+
+// Contexto de ms_ejecutar_tuberia_streaming: envuelve el callback de fin del llamador
+typedef struct {
+    const MsCallbacks *callbacks; // Callbacks originales
+    int estado;                   // Estado de salida recibido en el callback de fin
+} ContextoStreaming;
+
+static void al_recibir_streaming(void *contexto, int flujo, const char *datos, size_t longitud) {
+    ContextoStreaming *streaming = (ContextoStreaming *)contexto;
+    if (streaming->callbacks->al_recibir != NULL) {
+        streaming->callbacks->al_recibir(streaming->callbacks->contexto, flujo, datos, longitud);
+    }
+}
+
+static void al_terminar_streaming(void *contexto, int estado) {
+    ContextoStreaming *streaming = (ContextoStreaming *)contexto;
+    streaming->estado = estado;
+    if (streaming->callbacks->al_terminar != NULL) {
+        streaming->callbacks->al_terminar(streaming->callbacks->contexto, estado);
+    }
+}
+
+/**
+ * @brief Ejecuta una tubería entregando su salida a los callbacks a medida que se produce.
+ * Es la forma sencilla de usar el reactor para una sola tubería: bloquea hasta que termina.
+ *
+ * @param tuberia Tubería a ejecutar.
+ * @param callbacks Callbacks de salida y de fin.
+ * @return El estado de salida de la última etapa, o 1 si no se pudo lanzar.
+ */
+int ms_ejecutar_tuberia_streaming(const Tuberia *tuberia, const MsCallbacks *callbacks) {
+    MsReactor reactor; // ~64 KiB en la pila: la memoria no depende del tamaño de la salida
+    ContextoStreaming streaming = {callbacks, 1};
+    MsCallbacks envoltorio = {al_recibir_streaming, al_terminar_streaming, &streaming, callbacks->separar_stderr};
+
+    ms_reactor_iniciar(&reactor);
+    if (ms_reactor_lanzar(&reactor, tuberia, &envoltorio) == -1) {
+        return 1;
+    }
+    while (ms_reactor_procesar(&reactor, -1) > 0) {
+        // Cada vuelta entrega los trozos disponibles a los callbacks
+    }
+    return streaming.estado;
+}
+
+// --- Implementación de funciones de manejo de señales ---
+
+/**
+ * @brief Configura los manejadores de señales para el proceso de un shell interactivo.
+ * Ignora SIGINT (Ctrl+C), SIGQUIT (Ctrl+\) y SIGTSTP (Ctrl+Z) para que el shell no termine
+ * inesperadamente por estas señales (ms_esperar() las reenvía al proceso en primer plano).
+ * Configura un manejador para SIGCHLD que recolecta los procesos en segundo plano.
+ */
+void ms_configurar_senales_shell(void) {
+    // Ignorar SIGINT (Ctrl+C), SIGQUIT (Ctrl+\), SIGTSTP (Ctrl+Z) para el shell padre
+    signal(SIGINT, SIG_IGN);
+    signal(SIGQUIT, SIG_IGN);
+    signal(SIGTSTP, SIG_IGN);
+
+    // Configurar manejador para SIGCHLD para evitar zombies de los procesos en segundo plano
+    struct sigaction sa;         // Estructura para configurar el manejador de señal
+    memset(&sa, 0, sizeof(sa));  // Inicializa la estructura a ceros
+    sa.sa_handler = manejador_sigchld; // Asigna la función manejadora
+    sigemptyset(&sa.sa_mask);    // Limpia la máscara de señales (no bloquea ninguna señal adicional)
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP; // SA_RESTART: reanuda llamadas al sistema interrumpidas por la señal
+                                              // SA_NOCLDSTOP: no recibe SIGCHLD cuando un hijo se detiene (solo cuando termina)
+    // Instala el manejador de SIGCHLD
+    if (sigaction(SIGCHLD, &sa, NULL) == -1) {
+        imprimir_error("Error al configurar el manejador de SIGCHLD");
+        exit(EXIT_FAILURE); // Error crítico, el shell no debería continuar si no puede manejar SIGCHLD
+    }
+    senales_shell_configuradas = 1;
+}
+
+/**
+ * @brief Restaura los manejadores de señales a su comportamiento por defecto para los procesos hijos.
+ * Esto es crucial para que los hijos respondan a Ctrl+C, Ctrl+\, etc., como programas normales.
+ */
+void ms_restaurar_senales_hijo(void) {
+    signal(SIGINT, SIG_DFL);  // SIG_DFL: comportamiento por defecto (terminar el proceso)
+    signal(SIGQUIT, SIG_DFL); // SIG_DFL: comportamiento por defecto (terminar y generar un coredump)
+    signal(SIGTSTP, SIG_DFL); // SIG_DFL: comportamiento por defecto (detener el proceso)
+    signal(SIGCHLD, SIG_DFL); // Los hijos no necesitan manejar SIGCHLD, por lo que se restaura a por defecto
+}
+
+/**
+ * @brief Manejador de la señal SIGINT (Ctrl+C) y SIGQUIT (Ctrl+\) para el shell padre.
+ * Si hay un proceso hijo en primer plano (foreground), reenvía la señal a ese proceso.
+ * Si no hay un proceso en primer plano, el shell simplemente ignora la señal o imprime un mensaje
+ * para limpiar el prompt, manteniendo el shell en ejecución.
+ * @param signo El número de la señal recibida (SIGINT o SIGQUIT).
+ */
+static void manejador_sigint_quit(int signo) {
+    // Si hay un PID de un proceso en primer plano almacenado en la variable global
+    if (pid_proceso_en_primer_plano > 0) {
+        // Enviar la señal al proceso hijo en primer plano
+        if (kill(pid_proceso_en_primer_plano, signo) == -1) {
+            if (errno != ESRCH) { // ESRCH significa que el proceso no existe (puede haber terminado justo antes)
+                imprimir_error("Error al enviar señal al proceso hijo");
+            }
+        }
+        // Imprimir un mensaje informativo sobre la cancelación/terminación del programa
+        // Se añade un '\n' antes para que el mensaje no se mezcle con el prompt actual
+        if (signo == SIGINT) {
+            printf("\nPrograma cancelado (Ctrl+C).\n");
+            fflush(stdout);
+        } else if (signo == SIGQUIT) {
+            printf("\nPrograma terminado (Ctrl+\\).\n");
+            fflush(stdout);
+        }
+    } else {
+        // Si no hay proceso en primer plano, el shell ignora la señal para no cerrarse
+        // y simplemente imprime una nueva línea para limpiar el prompt.
+        if (signo == SIGINT) {
+            printf("\n"); // Nueva línea para un prompt limpio después de Ctrl+C
+            fflush(stdout);
+        } else if (signo == SIGQUIT) {
+            printf("\n"); // Nueva línea para un prompt limpio
+            fflush(stdout);
+        }
+    }
+}
+
+/**
+ * @brief Manejador de la señal SIGCHLD para el shell padre.
+ * Recolecta, de forma no bloqueante, los procesos en segundo plano que han terminado
+ * (evitando procesos "zombie"). Las etapas en primer plano no se tocan: las espera ms_esperar().
+ * @param signo El número de la señal (SIGCHLD).
+ */
+static void manejador_sigchld(int signo) {
+    (void)signo; // Evita la advertencia de "unused parameter" ya que 'signo' no se usa directamente en el cuerpo.
+    int errno_guardado = errno; // waitpid puede cambiar errno en mitad de otra llamada del shell
+    recolectar_segundo_plano();
+    errno = errno_guardado;
+}
@@ -0,0 +1,259 @@
+#ifndef MINISHELL_H
+#define MINISHELL_H
+
+// libminishell: núcleo común de los minishells (parser, ejecución de tuberías, señales y built-ins).
+//
+// Los front ends (newerMiniS.c, newMiniS.c y servidor/client_minishell.c) solo leen líneas y llaman
+// a esta API; otros programas pueden usarla para ejecutar tuberías dentro de su propio proceso en
+// lugar de lanzar `/bin/sh -c`. Uso típico:
+//
+//     ms_iniciar(NULL);
+//     LineaParseada *linea = ms_parsear("ls -l | wc -l", &arena);
+//     MsTrabajo trabajo;
+//     ms_lanzar_tuberia(&linea->segmentos[0], &opciones, &trabajo);
+//     int estado = ms_esperar(&trabajo);
+//
+// Compilación: se añade libminishell/minishell.c a la línea de gcc del programa (ver README).
+
+#include <stdio.h>       // Para FILE (ms_imprimir_contadores)
+#include <stddef.h>      // Para size_t
+#include <sys/types.h>   // Para pid_t
+
+// --- Definiciones de constantes ---
+#define MAX_COMANDOS 10            // Número máximo de comandos que se pueden encadenar con tuberías
+#define MAX_ARGUMENTOS 40          // Número máximo de argumentos por comando (incluyendo el nombre del comando)
+#define MAX_LONGITUD_ENTRADA 1024  // Tamaño base del buffer del prompt (la línea de readline se parsea sin copiarla ni truncarla)
+#define MAX_SEGMENTOS_AND 5        // Número máximo de segmentos separados por '&&' (ej: cmd1 && cmd2 && cmd3)
+#define TAMANO_BLOQUE_ARENA 8192   // Tamaño mínimo de cada bloque de la arena de parseo (se reutiliza entre líneas)
+#define TAMANO_CACHE_PLANES 64     // Número máximo de líneas parseadas que se conservan en la caché de planes (LRU)
+#define NUM_CUBETAS_CACHE 128      // Número de cubetas de la tabla hash de la caché de planes
+#define MAX_LONGITUD_LINEA_CACHE 4096 // Las líneas más largas no se guardan en la caché (se parsean en la arena de la línea)
+#define MAX_TRABAJOS_SEGUNDO_PLANO 64 // Número máximo de procesos en segundo plano que el shell recolecta con SIGCHLD
+#define GRACIA_LIMITE_MS 2000      // Al agotarse el límite de tiempo de una tubería: espera entre SIGTERM y SIGKILL
+#define ESTADO_LIMITE_AGOTADO 124  // Estado de salida de una tubería terminada por su límite de tiempo (como timeout(1))
+
+// --- ENUM para tipos de redirección ---
+// Define los tipos de operaciones especiales que un comando puede tener
+typedef enum {
+    SIN_REDIR = 0,         // Sin redirección o operador especial
+    REDIR_ENTRADA,         // '<' (redirección de entrada desde un archivo)
+    REDIR_SALIDA_TRUNCAR,  // '>' (redirección de salida, trunca el archivo o lo crea)
+    REDIR_SALIDA_ANEXAR    // '>>' (redirección de salida, añade al final del archivo o lo crea)
+} TipoOperacion;
+
+// --- Estructura para representar un comando parseado ---
+// Almacena la información de un comando individual después de ser analizado
+typedef struct {
+    char *argv[MAX_ARGUMENTOS];  // Array de punteros a cadenas para los argumentos del comando (ej: {"ls", "-l", NULL})
+    int argc;                    // Número de argumentos en argv
+    char *archivo_entrada;       // Nombre del archivo para redirección de entrada (NULL si no hay)
+    char *archivo_salida;        // Nombre del archivo para redirección de salida (NULL si no hay)
+    TipoOperacion tipo_operacion; // Tipo de operación de redirección de salida (si aplica)
+    char *ruta_ejecutable;       // Ruta del ejecutable resuelta en PATH (NULL si no se resolvió: se usa execvp)
+} ComandoParseado;
+
+// --- Tokens del lexer ---
+// El lexer recorre la línea completa una sola vez y produce esta secuencia de tokens.
+typedef enum {
+    TOKEN_PALABRA = 0,     // Argumento o nombre de archivo, ya sin comillas ni escapes
+    TOKEN_TUBERIA,         // '|'
+    TOKEN_AND,             // '&&'
+    TOKEN_SEGUNDO_PLANO,   // '&' (solo si la configuración permite ejecución en segundo plano)
+    TOKEN_REDIR_ENTRADA,   // '<'
+    TOKEN_REDIR_SALIDA,    // '>'
+    TOKEN_REDIR_ANEXAR,    // '>>'
+    TOKEN_FIN,             // Fin de la línea
+    TOKEN_ERROR            // Error léxico (comilla sin cerrar, '&' no permitido...)
+} TipoToken;
+
+typedef struct {
+    TipoToken tipo; // Tipo del token
+    char *texto;    // Texto de la palabra (solo para TOKEN_PALABRA)
+} Token;
+
+// Estado del lexer: posición de lectura en la línea y posición de escritura de las palabras.
+// Las palabras se escriben ya "des-entrecomilladas" en un buffer de la arena del tamaño de la línea,
+// que siempre basta porque una palabra nunca ocupa más que su texto original más un separador.
+typedef struct {
+    const char *pos;    // Siguiente carácter por leer de la línea
+    char *salida;       // Siguiente posición libre del buffer de palabras
+    const char *error;  // Descripción del último error léxico (NULL si no hay)
+} Lexer;
+
+// --- Estructuras de la línea parseada ---
+// Una tubería es una secuencia de comandos unidos por '|'; la línea es una lista de tuberías unidas por '&&'.
+typedef struct {
+    ComandoParseado *comandos; // Comandos de la tubería (array de MAX_COMANDOS reservado en la arena)
+    int num_comandos;          // Número de comandos en la tubería
+    int segundo_plano;         // 1 si la tubería termina en '&' (se lanza sin esperarla)
+} Tuberia;
+
+typedef struct {
+    Tuberia segmentos[MAX_SEGMENTOS_AND]; // Tuberías separadas por '&&'
+    int num_segmentos;                    // Número de tuberías en la línea
+} LineaParseada;
+
+// --- Arena de memoria por línea ---
+// Todo el estado de parseo de una línea (argv, nombres de archivo de redirección y los arrays
+// de ComandoParseado) se reserva en una arena "bump": reservar es solo avanzar un desplazamiento,
+// y al terminar la línea se reinicia de una sola vez. Los bloques se conservan entre líneas,
+// por lo que en régimen estable el parseo no hace ninguna llamada a malloc/free.
+typedef struct BloqueArena {
+    struct BloqueArena *siguiente; // Siguiente bloque de la cadena (NULL si es el último)
+    size_t capacidad;              // Bytes disponibles en 'datos'
+    size_t usado;                  // Bytes ya reservados en 'datos'
+    char datos[];                  // Memoria del bloque (miembro flexible)
+} BloqueArena;
+
+typedef struct {
+    BloqueArena *primero; // Primer bloque de la cadena (se conserva tras reiniciar)
+    BloqueArena *actual;  // Bloque del que se está reservando memoria
+} Arena;
+
+// --- Configuración de la biblioteca ---
+// Cada front end activa lo que necesita; con ms_iniciar(NULL) se usan los valores por defecto
+// (sin segundo plano, con caché de planes, sin límite de tiempo, sin cgroups).
+typedef struct {
+    int permitir_segundo_plano; // 1 para aceptar '&' al final de una tubería (newMiniS)
+    int usar_cache_planes;      // 1 para memorizar el parseo de las líneas recientes (ver ms_parsear)
+    int limite_por_defecto_ms;  // Límite de tiempo de cada tubería en primer plano (0: sin límite, o MINISHELL_TIMEOUT)
+    int usar_cgroups;           // 1 para lanzar cada tubería en primer plano en un cgroup v2 propio (o MINISHELL_CGROUP)
+} MsConfiguracion;
+
+// --- Opciones de ejecución de una tubería ---
+// Ganchos para capturar la salida: si fd_salida/fd_error son >= 0, la última etapa de la tubería
+// (cuando no redirige a un archivo) escribe su stdout/stderr en esos descriptores en lugar de heredar
+// los del proceso. Con fds_error_etapas, cada etapa puede llevar su stderr a su propio descriptor.
+// El llamador debe crear con O_CLOEXEC los extremos que los hijos no deban heredar.
+typedef struct {
+    int fd_salida; // stdout de la última etapa (-1 para heredar el del proceso)
+    int fd_error;  // stderr de la última etapa (-1 para heredar el del proceso)
+    int medir_contadores; // 1: contadores perf_event_open por etapa (leerlos con ms_leer_contadores())
+    int limite_ms;        // Límite de tiempo de la tubería (0: el de la configuración, <0: sin límite)
+    const int *fds_error_etapas; // stderr de cada etapa (NULL, o -1 en una etapa: fd_error en la última, heredado en las demás)
+} MsOpcionesEjecucion;
+
+#define MS_OPCIONES_EJECUCION_POR_DEFECTO {-1, -1, 0, 0, NULL}
+
+// --- Contadores hardware por etapa (prefijo 'perf') ---
+// Cada etapa tiene su grupo de contadores, heredado por los procesos que cree, que empieza a contar
+// en su exec y se lee cuando ya se recolectó. Solo se cuenta el espacio de usuario (así funciona con
+// perf_event_paranoid = 2, el valor por defecto).
+#define NUM_CONTADORES_PERF 5 // Ciclos, instrucciones, fallos de caché, fallos de predicción de saltos y fallos de página
+#define CONTADOR_CICLOS 0
+#define CONTADOR_INSTRUCCIONES 1
+#define CONTADOR_FALLOS_CACHE 2
+#define CONTADOR_FALLOS_SALTOS 3
+#define CONTADOR_FALLOS_PAGINA 4
+
+typedef struct {
+    unsigned long long valores[NUM_CONTADORES_PERF]; // Escalados si el kernel multiplexó los contadores
+    int disponible[NUM_CONTADORES_PERF];             // 0 si el contador no se pudo abrir (p. ej., máquina virtual sin PMU)
+} MsContadores;
+
+// --- Trabajo: procesos lanzados para una tubería ---
+typedef struct {
+    pid_t pids[MAX_COMANDOS]; // PID de cada etapa, en orden
+    int num_procesos;         // Número de etapas lanzadas
+    int segundo_plano;        // 1 si la tubería se lanzó en segundo plano
+    long long inicios_ns[MAX_COMANDOS]; // Instante del fork de cada etapa (trazas y estadísticas)
+    long long limite_ns;                // Siguiente plazo (reloj monótono) de la tubería: SIGTERM y luego SIGKILL (0: sin límite)
+    int senal_limite;                   // Última señal enviada al agotarse el límite (0: ninguna todavía)
+    pid_t grupo;                        // Grupo de procesos propio de la tubería (0: el del shell)
+    int terminal_cedida;                // 1 si el grupo tiene la terminal y hay que devolvérsela al shell
+    int fd_cgroup;                      // Directorio del cgroup transitorio de la tubería (-1: sin cgroup)
+    unsigned long id_cgroup;            // Número del cgroup transitorio (su nombre es minishell-<pid>-<id>)
+    int etapas_con_contadores;          // Etapas con contadores abiertos (0: no se miden)
+    int fds_contadores[MAX_COMANDOS][NUM_CONTADORES_PERF]; // Descriptores perf_event_open (-1: no disponible)
+} MsTrabajo;
+
+// --- Ejecución con salida en streaming ---
+// En lugar de acumular la salida en un buffer, el reactor entrega cada trozo leído de los pipes
+// de salida a un callback y avisa con otro callback cuando la tubería termina. La memoria usada es
+// constante (un buffer de lectura por reactor), sea cual sea el tamaño de la salida.
+#define MS_FLUJO_SALIDA 1              // El trozo viene del stdout de la última etapa
+#define MS_FLUJO_ERROR 2               // El trozo viene del stderr de la última etapa
+#define MAX_TUBERIAS_REACTOR 16        // Tuberías que un reactor puede vigilar a la vez
+#define TAMANO_BUFFER_REACTOR 65536    // Bytes leídos como máximo por llamada (capacidad típica de un pipe)
+
+typedef void (*MsCallbackSalida)(void *contexto, int flujo, const char *datos, size_t longitud); // Trozo de salida (flujo: MS_FLUJO_*)
+typedef void (*MsCallbackFin)(void *contexto, int estado); // Fin de la tubería con el estado de la última etapa
+
+typedef struct {
+    MsCallbackSalida al_recibir; // Se llama con cada trozo de salida (puede ser NULL para descartarla)
+    MsCallbackFin al_terminar;   // Se llama una vez, cuando la salida se cerró y todas las etapas terminaron (puede ser NULL)
+    void *contexto;              // Puntero del llamador que se pasa a ambos callbacks
+    int separar_stderr;          // 1: stderr llega por su propio pipe como MS_FLUJO_ERROR; 0: mezclado con stdout
+} MsCallbacks;
+
+typedef struct {
+    MsTrabajo trabajo;     // Procesos de la tubería
+    MsCallbacks callbacks; // Callbacks registrados
+    int fd_salida;         // Extremo de lectura del stdout (-1 si ya se cerró)
+    int fd_error;          // Extremo de lectura del stderr (-1 si ya se cerró o no se separa)
+    int estado;            // Estado de salida de la última etapa (cuando ya se recolectó)
+    int activa;            // 1 mientras la tubería está en el reactor
+} MsTuberiaReactor;
+
+typedef struct {
+    MsTuberiaReactor tuberias[MAX_TUBERIAS_REACTOR]; // Huecos para las tuberías vigiladas
+    int num_activas;                                 // Tuberías en curso
+    char buffer[TAMANO_BUFFER_REACTOR];              // Buffer de lectura compartido por todas
+} MsReactor;
+
+// --- API principal ---
+void ms_iniciar(const MsConfiguracion *configuracion); // Configura la biblioteca (NULL: valores por defecto)
+void ms_finalizar(void); // Libera la memoria interna (caché de planes)
+LineaParseada *ms_parsear(const char *linea, Arena *arena); // Parsea una línea (o la toma de la caché de planes)
+int ms_lanzar_tuberia(const Tuberia *tuberia, const MsOpcionesEjecucion *opciones, MsTrabajo *trabajo); // Crea los procesos de una tubería sin esperarlos
+int ms_esperar(MsTrabajo *trabajo); // Espera a todas las etapas (aplicando su límite de tiempo) y devuelve el estado de la última
+int ms_aplicar_limite(MsTrabajo *trabajo); // Antes de ms_esperar: aplica el límite vencido y devuelve los ms hasta el próximo paso (-1: ninguno)
+int ms_ejecutar_tuberia(const Tuberia *tuberia, const MsOpcionesEjecucion *opciones); // Lanza y espera (o deja en segundo plano) una tubería
+int ms_ejecutar_builtin(ComandoParseado *comando); // Ejecuta un built-in (1 si lo era, 0 si no)
+int ms_ejecutar_linea(LineaParseada *linea_parseada, const MsOpcionesEjecucion *opciones); // Ejecuta la lista '&&' completa
+int ms_quitar_prefijos(const Tuberia *tuberia, const MsOpcionesEjecucion *opciones, ComandoParseado comandos[],
+                       Tuberia *sin_prefijo, MsOpcionesEjecucion *opciones_tuberia,
+                       char *error, size_t tamano_error); // Traduce 'timeout D' y 'perf' a opciones (-1 y mensaje si están mal escritos)
+int ms_leer_contadores(MsTrabajo *trabajo, MsContadores contadores[]); // Lee y cierra los contadores de cada etapa (tras ms_esperar)
+void ms_imprimir_contadores(FILE *salida, const Tuberia *tuberia, const MsContadores contadores[], int etapas); // Tabla de contadores e IPC de cada etapa
+void ms_reactor_iniciar(MsReactor *reactor); // Deja un reactor vacío
+int ms_reactor_lanzar(MsReactor *reactor, const Tuberia *tuberia, const MsCallbacks *callbacks); // Lanza una tubería vigilada por el reactor
+int ms_reactor_procesar(MsReactor *reactor, int espera_ms); // Atiende los pipes listos; devuelve las tuberías aún activas
+int ms_ejecutar_tuberia_streaming(const Tuberia *tuberia, const MsCallbacks *callbacks); // Lanza y procesa una tubería hasta que termina
+
+// --- Trazas (formato Chrome trace-event, para Perfetto o chrome://tracing) ---
+// Con MINISHELL_TRACE=archivo.json, ms_iniciar() abre el archivo y la biblioteca registra un span por
+// generación del prompt, parseo (con el tiempo del lexer en sus argumentos), búsqueda en PATH,
+// creación de pipes, fork, preparación del exec en el hijo y vida de cada hijo hasta su recolección
+// (cada hijo en su propia pista). Los front ends añaden la espera en readline con ms_traza_span().
+// Sin la variable, ms_traza_ahora() devuelve 0 y ms_traza_span() no hace nada.
+long long ms_traza_ahora(void); // Instante actual en ns (CLOCK_MONOTONIC), o 0 si las trazas están desactivadas
+void ms_traza_span(const char *nombre, const char *categoria, long long inicio_ns, pid_t tid, const char *args_json); // Registra un span [inicio_ns, ahora] (tid 0: el shell; args_json: objeto JSON o NULL)
+
+// --- Sondas USDT (bpftrace, perf probe, SystemTap) ---
+// Las sondas del proveedor "minishell" están dentro de la biblioteca (ver minishell.c); la única que
+// depende del front end, la de cada línea leída, se dispara con esta función.
+void ms_sonda_linea_leida(const char *linea); // Sonda linea_leida(linea) (no hace nada sin <sys/sdt.h>)
+
+// --- Señales (solo para shells interactivos) ---
+void ms_configurar_senales_shell(void); // Ignora Ctrl+C/Ctrl+\/Ctrl+Z en el shell y recolecta los procesos en segundo plano
+void ms_restaurar_senales_hijo(void);   // Restaura los manejadores por defecto (lo usan los hijos antes de exec)
+
+// --- Utilidades de los front ends ---
+int ms_parsear_duracion(const char *texto, int *ms); // "30", "1.5s", "500ms", "2m", "1h" → milisegundos (0 si es válida, -1 si no)
+void imprimir_error(const char *mensaje); // Imprime mensajes de error usando perror
+char *ms_generar_prompt(void); // Genera el string del prompt del shell (ej: usuario@host:~/current_dir$)
+void ms_imprimir_bienvenida(void); // Imprime un mensaje de bienvenida con ASCII art
+void ms_deshabilitar_reporte_raton(void); // Deshabilita el reporte del ratón en la terminal
+
+// --- API de bajo nivel (parser y arena) ---
+void inicializar_buscador_especial(void); // Elige (en tiempo de ejecución) la implementación escalar, SSE2 o AVX2 del escaneo del lexer
+void siguiente_token(Lexer *lexer, Token *token); // Extrae el siguiente token de la línea (respetando comillas y escapes)
+int parsear_linea(const char *linea, LineaParseada *linea_parseada, Arena *arena); // Construye la lista '&&' de tuberías sin pasar por la caché
+char *resolver_ruta_ejecutable(const char *nombre, Arena *arena); // Busca un ejecutable en los directorios de PATH
+void *arena_reservar(Arena *arena, size_t tamano); // Reserva 'tamano' bytes alineados dentro de la arena
+char *arena_strndup(Arena *arena, const char *cadena, size_t longitud); // Copia una cadena dentro de la arena
+void arena_reiniciar(Arena *arena); // Invalida todo lo reservado, conservando los bloques para la siguiente línea
+void arena_liberar(Arena *arena);   // Devuelve todos los bloques al sistema
+
+#endif // MINISHELL_H
@@ -0,0 +1,205 @@
+#define _GNU_SOURCE // Para memfd_create y los sellos (F_ADD_SEALS)
+#include "anillo.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MAGICO_ANILLO 0x4f4c4c494e41534dull // "MSANILLO"
+#define SELLOS_ANILLO (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+
+// Primera página de la memoria; cada contador en su línea de caché, para que productor y consumidor
+// no se la quiten el uno al otro
+struct CabeceraAnillo {
+    uint64_t magico;
+    uint64_t capacidad;
+    _Alignas(64) uint64_t escrito;      // Bytes escritos desde el principio (solo el productor)
+    uint32_t consumidor_esperando;      // 1: el consumidor va a dormir hasta que haya datos
+    _Alignas(64) uint64_t leido;        // Bytes leídos desde el principio (solo el consumidor)
+    uint32_t productor_esperando;       // 1: el productor va a dormir hasta que haya sitio
+};
+
+static size_t tamano_pagina(void) {
+    return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+static void despertar(int evento) {
+    uint64_t uno = 1;
+    if (write(evento, &uno, sizeof(uno)) == -1 && errno != EAGAIN) {
+        perror("Error al despertar al otro lado del anillo");
+    }
+}
+
+/**
+ * @brief Mapea la cabecera y, detrás, los datos dos veces seguidas: datos[i] y datos[i + capacidad]
+ * son el mismo byte. Primero se reserva todo el hueco para que los tres mapeos queden contiguos.
+ */
+static int mapear(Anillo *anillo, int proteccion_datos) {
+    size_t pagina = tamano_pagina();
+    anillo->tamano_mapeo = pagina + 2 * anillo->capacidad;
+    char *reserva = mmap(NULL, anillo->tamano_mapeo, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reserva == MAP_FAILED) return -1;
+    if (mmap(reserva, pagina, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, anillo->fd_memoria, 0) == MAP_FAILED ||
+        mmap(reserva + pagina, anillo->capacidad, proteccion_datos, MAP_SHARED | MAP_FIXED, anillo->fd_memoria, (off_t)pagina) == MAP_FAILED ||
+        mmap(reserva + pagina + anillo->capacidad, anillo->capacidad, proteccion_datos, MAP_SHARED | MAP_FIXED,
+             anillo->fd_memoria, (off_t)pagina) == MAP_FAILED) {
+        int error = errno;
+        munmap(reserva, anillo->tamano_mapeo);
+        errno = error;
+        return -1;
+    }
+    anillo->cabecera = (CabeceraAnillo *)reserva;
+    anillo->datos = reserva + pagina;
+    return 0;
+}
+
+int anillo_crear(Anillo *anillo, size_t capacidad) {
+    memset(anillo, 0, sizeof(*anillo));
+    anillo->fd_memoria = anillo->evento_datos = anillo->evento_espacio = -1;
+    if (capacidad == 0 || capacidad % tamano_pagina() != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    anillo->capacidad = capacidad;
+
+    // Sellada: el servidor puede fiarse de su tamaño mientras la tenga mapeada
+    anillo->fd_memoria = memfd_create("minishell-anillo", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (anillo->fd_memoria == -1 || ftruncate(anillo->fd_memoria, (off_t)(tamano_pagina() + capacidad)) == -1 ||
+        fcntl(anillo->fd_memoria, F_ADD_SEALS, SELLOS_ANILLO) == -1) {
+        goto fallo;
+    }
+    anillo->evento_datos = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    anillo->evento_espacio = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (anillo->evento_datos == -1 || anillo->evento_espacio == -1 || mapear(anillo, PROT_READ | PROT_WRITE) == -1) {
+        goto fallo;
+    }
+    anillo->cabecera->capacidad = capacidad;
+    anillo->cabecera->magico = MAGICO_ANILLO;
+    return 0;
+
+fallo:;
+    int error = errno;
+    anillo_cerrar(anillo);
+    errno = error;
+    return -1;
+}
+
+/**
+ * @brief Mapea el anillo que envía un cliente, solo si está sellado y su tamaño es el de un anillo:
+ * el servidor lee los datos (mapeados de solo lectura) mientras el cliente los escribe.
+ */
+int anillo_abrir(Anillo *anillo, int fd_memoria, int evento_datos, int evento_espacio) {
+    memset(anillo, 0, sizeof(*anillo));
+    anillo->fd_memoria = fd_memoria;
+    anillo->evento_datos = evento_datos;
+    anillo->evento_espacio = evento_espacio;
+
+    struct stat informacion;
+    int sellos = fcntl(fd_memoria, F_GET_SEALS);
+    size_t pagina = tamano_pagina();
+    if (sellos == -1 || (sellos & (F_SEAL_SHRINK | F_SEAL_GROW)) != (F_SEAL_SHRINK | F_SEAL_GROW) ||
+        fstat(fd_memoria, &informacion) == -1 || (size_t)informacion.st_size <= pagina ||
+        (size_t)informacion.st_size - pagina > MAX_TAMANO_ANILLO || ((size_t)informacion.st_size - pagina) % pagina != 0) {
+        errno = EINVAL;
+        goto fallo;
+    }
+    anillo->capacidad = (size_t)informacion.st_size - pagina;
+    if (mapear(anillo, PROT_READ) == -1) goto fallo;
+    if (anillo->cabecera->magico != MAGICO_ANILLO || anillo->cabecera->capacidad != anillo->capacidad ||
+        __atomic_load_n(&anillo->cabecera->leido, __ATOMIC_ACQUIRE) != 0) {
+        errno = EINVAL;
+        goto fallo;
+    }
+    return 0;
+
+fallo:;
+    int error = errno;
+    anillo_cerrar(anillo);
+    errno = error;
+    return -1;
+}
+
+void anillo_cerrar(Anillo *anillo) {
+    if (anillo->cabecera != NULL) munmap(anillo->cabecera, anillo->tamano_mapeo);
+    if (anillo->fd_memoria != -1) close(anillo->fd_memoria);
+    if (anillo->evento_datos != -1) close(anillo->evento_datos);
+    if (anillo->evento_espacio != -1) close(anillo->evento_espacio);
+    anillo->cabecera = NULL;
+    anillo->datos = NULL;
+    anillo->fd_memoria = anillo->evento_datos = anillo->evento_espacio = -1;
+}
+
+/**
+ * @brief Copia en el anillo lo que quepa de los iovecs. Si no cabe nada, anuncia que espera sitio y
+ * vuelve a mirar (el consumidor puede haber leído entretanto): la misma pareja de barreras que en el
+ * otro sentido, así que ningún aviso se pierde.
+ */
+ssize_t anillo_escribir(Anillo *anillo, const struct iovec *iov, int num_iov) {
+    CabeceraAnillo *cabecera = anillo->cabecera;
+    uint64_t leido = __atomic_load_n(&cabecera->leido, __ATOMIC_ACQUIRE);
+    if (anillo->posicion - leido > anillo->capacidad) return -1;
+    size_t libre = anillo->capacidad - (size_t)(anillo->posicion - leido);
+    if (libre == 0) {
+        __atomic_store_n(&cabecera->productor_esperando, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        leido = __atomic_load_n(&cabecera->leido, __ATOMIC_ACQUIRE);
+        if (anillo->posicion - leido > anillo->capacidad) return -1;
+        libre = anillo->capacidad - (size_t)(anillo->posicion - leido);
+        if (libre == 0) return 0;
+        __atomic_store_n(&cabecera->productor_esperando, 0, __ATOMIC_SEQ_CST);
+    }
+
+    char *destino = anillo->datos + anillo->posicion % anillo->capacidad; // Contiguo: el mapeo doble
+    size_t copiados = 0;
+    for (int i = 0; i < num_iov && copiados < libre; i++) {
+        size_t n = iov[i].iov_len < libre - copiados ? iov[i].iov_len : libre - copiados;
+        memcpy(destino + copiados, iov[i].iov_base, n);
+        copiados += n;
+    }
+    anillo->posicion += copiados;
+    __atomic_store_n(&cabecera->escrito, anillo->posicion, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&cabecera->consumidor_esperando, __ATOMIC_SEQ_CST)) {
+        __atomic_store_n(&cabecera->consumidor_esperando, 0, __ATOMIC_SEQ_CST);
+        despertar(anillo->evento_datos);
+    }
+    return (ssize_t)copiados;
+}
+
+/**
+ * @brief Datos pendientes de leer, como mucho `maximo`, sin copiarlos. El contador del productor
+ * viene de otro proceso: si es imposible (más datos que el anillo), se devuelve -1.
+ */
+ssize_t anillo_leer(Anillo *anillo, const char **datos, size_t maximo) {
+    CabeceraAnillo *cabecera = anillo->cabecera;
+    uint64_t escrito = __atomic_load_n(&cabecera->escrito, __ATOMIC_ACQUIRE);
+    if (escrito - anillo->posicion > anillo->capacidad) return -1;
+    if (escrito == anillo->posicion) {
+        __atomic_store_n(&cabecera->consumidor_esperando, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        escrito = __atomic_load_n(&cabecera->escrito, __ATOMIC_ACQUIRE);
+        if (escrito - anillo->posicion > anillo->capacidad) return -1;
+        if (escrito == anillo->posicion) return 0;
+        __atomic_store_n(&cabecera->consumidor_esperando, 0, __ATOMIC_SEQ_CST);
+    }
+    size_t disponibles = (size_t)(escrito - anillo->posicion);
+    *datos = anillo->datos + anillo->posicion % anillo->capacidad;
+    return (ssize_t)(disponibles < maximo ? disponibles : maximo);
+}
+
+void anillo_consumir(Anillo *anillo, size_t longitud) {
+    CabeceraAnillo *cabecera = anillo->cabecera;
+    anillo->posicion += longitud;
+    __atomic_store_n(&cabecera->leido, anillo->posicion, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&cabecera->productor_esperando, __ATOMIC_SEQ_CST)) {
+        __atomic_store_n(&cabecera->productor_esperando, 0, __ATOMIC_SEQ_CST);
+        despertar(anillo->evento_espacio);
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef ANILLO_H
+#define ANILLO_H
+
+// anillo: cola circular en memoria compartida, de un productor (el hilo emisor del cliente) a un
+// consumidor (el servidor), para cuando los dos están en la misma máquina.
+//
+// El cliente crea la memoria con memfd_create, sellada para que no cambie de tamaño (el servidor no
+// puede recibir un SIGBUS), y la pasa al servidor con dos eventfd por el socket local (SCM_RIGHTS).
+// Los datos se mapean dos veces seguidas: lo que da la vuelta al final se lee y se escribe de una
+// vez, sin partirlo. Escribir y leer son copias en memoria y dos contadores; solo se hace una
+// llamada al sistema para despertar al otro lado cuando está dormido (eventfd), así que un lote
+// grande no cuesta un send y un recv por trozo.
+//
+//     Anillo anillo;                                    // Cliente
+//     anillo_crear(&anillo, TAMANO_ANILLO);            // Y se pasan anillo.fd_memoria, anillo.evento_datos y anillo.evento_espacio
+//     ssize_t escritos = anillo_escribir(&anillo, iov, n); // 0: lleno (esperar a anillo.evento_espacio)
+//
+//     anillo_abrir(&anillo, fds[0], fds[1], fds[2]);    // Servidor
+//     const char *datos;
+//     ssize_t n = anillo_leer(&anillo, &datos, maximo); // 0: vacío (esperar a anillo.evento_datos)
+//     ...
+//     anillo_consumir(&anillo, n);
+
+#include <stddef.h>    // Para size_t
+#include <stdint.h>    // Para uint64_t
+#include <sys/types.h> // Para ssize_t
+#include <sys/uio.h>   // Para struct iovec
+
+#define TAMANO_ANILLO (4 * 1024 * 1024)        // Bytes de datos del anillo (múltiplo del tamaño de página)
+#define MAX_TAMANO_ANILLO (64 * 1024 * 1024)   // Lo más que el servidor acepta mapear
+
+typedef struct CabeceraAnillo CabeceraAnillo; // En la memoria compartida (ver anillo.c)
+
+typedef struct {
+    CabeceraAnillo *cabecera;
+    char *datos;            // `capacidad` bytes, mapeados dos veces seguidas
+    size_t capacidad;
+    size_t tamano_mapeo;
+    uint64_t posicion;      // Copia local de lo escrito (productor) o de lo leído (consumidor)
+    int fd_memoria;
+    int evento_datos;       // El productor avisa al consumidor dormido de que hay datos
+    int evento_espacio;     // El consumidor avisa al productor dormido de que hay sitio
+} Anillo;
+
+int anillo_crear(Anillo *anillo, size_t capacidad);  // 0 si va bien, -1 si no (errno)
+int anillo_abrir(Anillo *anillo, int fd_memoria, int evento_datos, int evento_espacio); // Comprueba la memoria del cliente y la mapea (se queda con los fds)
+void anillo_cerrar(Anillo *anillo);                  // Desmapea y cierra los fds
+
+ssize_t anillo_escribir(Anillo *anillo, const struct iovec *iov, int num_iov); // Bytes copiados (0: lleno, se avisará por evento_espacio; -1: contadores imposibles)
+ssize_t anillo_leer(Anillo *anillo, const char **datos, size_t maximo);         // Bytes contiguos para leer (0: vacío, se avisará por evento_datos; -1: contadores imposibles)
+void anillo_consumir(Anillo *anillo, size_t longitud);                          // Libera lo leído
+
+#endif // ANILLO_H
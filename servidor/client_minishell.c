@@ -1,188 +1,83 @@
+#define _GNU_SOURCE // Para pipe2 y splice
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
-#include <sys/wait.h>
 #include <errno.h>
-#include <pwd.h>
-#include <limits.h>
 #include <fcntl.h>
-#include <signal.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
 #include <time.h>
+#include <poll.h>
 
 #include <readline/readline.h>
 #include <readline/history.h>
 
+#include "../libminishell/minishell.h"
+#include "envio.h"
+#include "transporte.h"
+
 // --- Constantes de configuración de red ---
 #define SERVER_IP "127.0.0.1" // Cambia esto a la IP de tu servidor si no es local
 #define SERVER_PORT 1666      // Puerto del servidor
-#define CONNECT_RETRIES 5     // Número de reintentos de conexión
-#define RETRY_DELAY_SEC 2     // Retardo entre reintentos en segundos
-
-// --- Definiciones de constantes del shell ---
-#define MAX_COMANDOS 10
-#define MAX_ARGUMENTOS 40
-#define MAX_LONGITUD_ENTRADA 1024
-#define MAX_SEGMENTOS_AND 5
+#define ESPERA_FIN_ENVIO_MS 2000 // Al salir, tiempo máximo para que el servidor confirme lo pendiente (el resto queda en el spool)
+
+// --- Definiciones de constantes del cliente ---
 #define BUFFER_SIZE 4096 // Tamaño del buffer para comunicación de socket
+#define CABECERA_SIN_MEMORIA "[COMANDO]: (sin memoria para el comando)\n" // Si no se pudo construir la cabecera
 
-typedef enum {
-    SIN_REDIR = 0,
-    REDIR_ENTRADA,
-    REDIR_SALIDA_TRUNCAR,
-    REDIR_SALIDA_ANEXAR
-} TipoOperacion;
-
-typedef struct {
-    char *argv[MAX_ARGUMENTOS];
-    int argc;
-    char *archivo_entrada;
-    char *archivo_salida;
-    TipoOperacion tipo_operacion;
-} ComandoParseado;
-
-volatile pid_t pid_proceso_en_primer_plano = 0;
-
-// --- Prototipos de funciones auxiliares y de manejo de señales ---
-void imprimir_error(const char *mensaje);
-int dividir_cadena(char *cadena, char *delimitador, char *tokens[]);
-char *generar_prompt();
-void imprimir_bienvenida();
-void deshabilitar_reporte_raton();
-void configurar_senales_padre();
-void restaurar_senales_hijo();
-void manejador_sigint_quit(int signo);
-void manejador_sigchld(int signo);
-// Modificamos estos prototipos para incluir el client_sockfd
-int ejecutar_comando_interno(ComandoParseado *comando, int client_sockfd);
-int ejecutar_tuberia(ComandoParseado comandos_parseados[], int num_comandos_tuberia, int client_sockfd);
-int parsear_argumentos_comando(char *cadena_comando, ComandoParseado *comando_parseado);
-void liberar_comando_parseado(ComandoParseado *comando_parseado);
+// --- Prototipos de funciones del cliente ---
+// El parseo, la ejecución de tuberías, las señales y los built-ins vienen de libminishell.
+int ejecutar_comando_interno(ComandoParseado *comando);
+int ejecutar_tuberia(const Tuberia *tuberia_original);
 void get_os_name(char *os_name, size_t size);
-void build_command_string(char *dest, size_t dest_size, ComandoParseado *comando); // Agregado el prototipo
+char *build_command_message(const ComandoParseado comandos[], int num_comandos);
 
 int main() {
-    int client_sockfd;
-    struct sockaddr_in server_addr;
     char client_os[256];
     char server_response[BUFFER_SIZE];
     ssize_t bytes_received;
 
-    // 1. Configuración de la conexión al servidor
-    client_sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (client_sockfd == -1) {
-        perror("Error al crear el socket del cliente");
-        return 1;
-    }
-
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(SERVER_PORT);
-
-    if (inet_pton(AF_INET, SERVER_IP, &server_addr.sin_addr) <= 0) {
-        perror("Dirección IP inválida/no soportada");
-        close(client_sockfd);
-        return 1;
-    }
-
-    int connected = 0;
-    for (int i = 0; i < CONNECT_RETRIES; i++) {
-        printf("Intentando conectar con el servidor en %s:%d (Intento %d/%d)...\n", SERVER_IP, SERVER_PORT, i + 1, CONNECT_RETRIES);
-        if (connect(client_sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) == 0) {
-            printf("Conexión establecida con el servidor.\n");
-            connected = 1;
-            break;
-        }
-        perror("Error al conectar");
-        sleep(RETRY_DELAY_SEC); // Espera antes de reintentar
-    }
-
-    if (!connected) {
-        fprintf(stderr, "No se pudo conectar al servidor después de %d intentos.\n", CONNECT_RETRIES);
-        close(client_sockfd);
-        return 1;
-    }
-
-// 2. Intercambio de saludos con el servidor
     get_os_name(client_os, sizeof(client_os));
-    char client_hello[BUFFER_SIZE];
-    snprintf(client_hello, sizeof(client_hello), "HOLA_CLIENTE:%s", client_os);
-
-    // --- AGREGAR ESTO PARA EL TIMEOUT ---
-    struct timeval timeout;
-    timeout.tv_sec = 3;  // 3 segundos de timeout para el saludo
-    timeout.tv_usec = 0;
-
-    if (setsockopt(client_sockfd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout)) < 0) {
-        perror("Error al establecer timeout de recepción");
-        // No es crítico, el programa puede continuar, pero es bueno reportarlo
-    }
-    // --- FIN DE AGREGADO ---
-
-    if (send(client_sockfd, client_hello, strlen(client_hello), 0) == -1) {
-        perror("Error al enviar saludo al servidor");
-        close(client_sockfd);
-        return 1;
-    }
-
-    bytes_received = recv(client_sockfd, server_response, sizeof(server_response) - 1, 0);
-
-    // --- MODIFICAR LA LÓGICA DE MANEJO DE LA RESPUESTA ---
-    if (bytes_received > 0) {
-        server_response[bytes_received] = '\0';
-        if (strncmp(server_response, "HOLA_SERVIDOR:", 14) == 0) {
-            printf("Servidor dice: %s\n", server_response + 14);
-        } else {
-            // Recibió algo, pero no el saludo esperado
-            printf("Respuesta inesperada del servidor (%s). Asumiendo servidor sin saludo.\n", server_response);
-            // No se cierra la conexión, se asume que se puede continuar.
-        }
-    } else if (bytes_received == 0) {
-        // Servidor cerró la conexión durante el saludo (o justo después de enviarlo)
-        printf("Servidor desconectado o no respondió el saludo. Asumiendo servidor sin saludo.\n");
-        // Aquí podrías decidir si quieres cerrar y salir, o intentar continuar.
-        // Por la descripción, parece que quieres continuar.
-    } else { // bytes_received < 0
-        // Error en recv o timeout
-        if (errno == EWOULDBLOCK || errno == EAGAIN) {
-            printf("Timeout al recibir saludo del servidor. Asumiendo servidor sin saludo.\n");
-        } else {
-            perror("Error al recibir saludo del servidor. Asumiendo servidor sin saludo.");
-        }
-        // No se cierra la conexión, se asume que se puede continuar.
-    }
 
-    // --- RESTAURAR EL TIMEOUT SI ES NECESARIO (o establecer uno más largo para comandos) ---
-    // Si quieres que las operaciones de recv posteriores (para comandos) también tengan un timeout
-    // o que sean bloqueantes nuevamente, podrías restaurarlo aquí.
-    // Para ahora, lo dejaremos sin restaurar, lo que significa que el timeout de 3 segundos
-    // aplicará a todas las operaciones de recv en este socket. Si prefieres que solo
-    // el saludo tenga timeout, podrías poner timeout.tv_sec = 0; para hacerlo bloqueante de nuevo.
-    // O un timeout más largo para comandos:
-    timeout.tv_sec = 60; // Por ejemplo, 60 segundos para los comandos normales
-    if (setsockopt(client_sockfd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout)) < 0) {
-        perror("Error al restaurar timeout de recepción para comandos");
-    }
-    // --- FIN DE RESTAURACIÓN ---
-
-
-    // 3. Bucle principal del minishell, enviando salida al socket
-    char linea_original[MAX_LONGITUD_ENTRADA];
-    char *segmentos_and[MAX_SEGMENTOS_AND];
-    int num_segmentos_and;
+    // Bucle principal del minishell, enviando la salida al servidor
     char *linea_entrada;
     char *prompt_actual;
     int ultimo_estado_salida = 0;
-
-    configurar_senales_padre();
-    deshabilitar_reporte_raton();
-    imprimir_bienvenida();
+    Arena arena_linea = {NULL, NULL};
+    MsConfiguracion configuracion = {0, 1, 0, 0}; // Sin segundo plano: la salida de cada tubería se envía al servidor
+
+    ms_iniciar(&configuracion);
+
+    // Conexión y envío asíncrono al servidor a través del spool (se reconecta solo);
+    // MINISHELL_DESBORDE elige qué hacer si el servidor no da abasto
+    PoliticaDesborde politica = ENVIO_POLITICA_POR_DEFECTO;
+    const char *desborde = getenv("MINISHELL_DESBORDE");
+    if (desborde != NULL && envio_parsear_politica(desborde, &politica) == -1) {
+        fprintf(stderr, "MINISHELL_DESBORDE inválido: '%s' (bloquear, descartar o disco); se usa 'disco'\n", desborde);
+    }
+    // MINISHELL_RECORTE limita la salida de cada comando que se envía (la terminal la recibe entera)
+    RecorteSalida recorte = ENVIO_RECORTE_POR_DEFECTO;
+    const char *texto_recorte = getenv("MINISHELL_RECORTE");
+    if (texto_recorte != NULL && envio_parsear_recorte(texto_recorte, &recorte) == -1) {
+        fprintf(stderr, "MINISHELL_RECORTE inválido: '%s' (no o <cabeza KiB>:<cola KiB>[:<muestreo>]); se usa 1024:256\n", texto_recorte);
+    }
+    envio_configurar_recorte(&recorte);
+    // MINISHELL_SERVIDOR elige el servidor: "<ip>:<puerto>" o, en la misma máquina, "unix:<ruta>" o "unix:@<nombre>"
+    char servidor[MAX_TEXTO_DIRECCION];
+    const char *texto_servidor = getenv("MINISHELL_SERVIDOR");
+    if (texto_servidor != NULL && texto_servidor[0] != '\0') {
+        snprintf(servidor, sizeof(servidor), "%s", texto_servidor);
+    } else {
+        snprintf(servidor, sizeof(servidor), "%s:%d", SERVER_IP, SERVER_PORT);
+    }
+    if (envio_iniciar(servidor, client_os, politica) == -1) {
+        fprintf(stderr, "No se pudo iniciar el envío al servidor; la sesión no se observará.\n");
+    }
+    ms_configurar_senales_shell();
+    ms_deshabilitar_reporte_raton();
+    ms_imprimir_bienvenida();
 
     // Recibir el mensaje de bienvenida y el primer prompt del servidor
-    while ((bytes_received = recv(client_sockfd, server_response, sizeof(server_response) - 1, MSG_DONTWAIT)) > 0) {
+    while ((bytes_received = envio_leer_respuesta(server_response, sizeof(server_response) - 1)) > 0) {
         server_response[bytes_received] = '\0';
         // Evita imprimir el prompt del servidor varias veces
         if (strstr(server_response, "\n\033[7;32mremote_shell@server:~$ ") == NULL) {
@@ -195,13 +90,15 @@ int main() {
 
 
     while (1) {
-        prompt_actual = generar_prompt();
+        prompt_actual = ms_generar_prompt();
+        long long inicio_traza = ms_traza_ahora();
         linea_entrada = readline(prompt_actual);
+        ms_traza_span("readline", "entrada", inicio_traza, 0, NULL);
         free(prompt_actual);
 
         if (linea_entrada == NULL) { // Ctrl+D
             printf("Saliendo del MiniShell.\n");
-            send(client_sockfd, "[CLIENTE_MINISHELL_EVENTO]: MINISHELL_EOF\n", strlen("[CLIENTE_MINISHELL_EVENTO]: MINISHELL_EOF\n"), 0); // Notificar al servidor
+            envio_mensaje("[CLIENTE_MINISHELL_EVENTO]: MINISHELL_EOF\n"); // Notificar al servidor
             fflush(stdout);
             break;
         }
@@ -212,91 +109,64 @@ int main() {
         }
 
         add_history(linea_entrada);
-
-        strncpy(linea_original, linea_entrada, sizeof(linea_original) - 1);
-        linea_original[sizeof(linea_original) - 1] = '\0';
+        ms_sonda_linea_leida(linea_entrada);
+
+        LineaParseada *linea_parseada = ms_parsear(linea_entrada, &arena_linea);
+        if (linea_parseada == NULL) {
+            // Cabecera y error con la línea entera: un recorte perdería el '\n' que cierra la cabecera
+            char *err_msg = NULL;
+            if (asprintf(&err_msg, "[COMANDO]: %s\n", linea_entrada) != -1) {
+                envio_mensaje(err_msg);
+                free(err_msg);
+            } else {
+                envio_mensaje(CABECERA_SIN_MEMORIA);
+            }
+            int n = asprintf(&err_msg, "Error de sintaxis en el comando '%s'.\n", linea_entrada);
+            if (n != -1) {
+                envio_trozo(0, 1, err_msg, (size_t)n);
+                free(err_msg);
+            }
+            envio_mensaje("[FIN]: 2\n");
+            free(linea_entrada);
+            arena_reiniciar(&arena_linea);
+            continue;
+        }
         free(linea_entrada);
-
-        num_segmentos_and = dividir_cadena(linea_original, "&&", segmentos_and);
         ultimo_estado_salida = 0;
 
-        for (int s = 0; s < num_segmentos_and; s++) {
+        for (int s = 0; s < linea_parseada->num_segmentos; s++) {
             if (s > 0 && ultimo_estado_salida != 0) {
-                continue;
+                break;
             }
 
-            char *comandos_str[MAX_COMANDOS];
-            ComandoParseado comandos_parseados[MAX_COMANDOS];
-            int num_comandos_tuberia;
-
-            num_comandos_tuberia = dividir_cadena(segmentos_and[s], "|", comandos_str);
-
-            if (num_comandos_tuberia < 1 || comandos_str[0] == NULL || strlen(comandos_str[0]) == 0) {
-                char err_msg[BUFFER_SIZE];
-                snprintf(err_msg, sizeof(err_msg), "[COMANDO]: (Error de parseo)\n[SALIDA]: Error: Comando inválido en segmento '&&'.\n");
-                send(client_sockfd, err_msg, strlen(err_msg), 0);
-                ultimo_estado_salida = 1;
-                continue;
-            }
-
-            int error_parseo = 0;
-            for (int i = 0; i < num_comandos_tuberia; i++) {
-                comandos_parseados[i].argc = 0;
-                comandos_parseados[i].archivo_entrada = NULL;
-                comandos_parseados[i].archivo_salida = NULL;
-                comandos_parseados[i].tipo_operacion = SIN_REDIR;
-
-                if (parsear_argumentos_comando(comandos_str[i], &comandos_parseados[i]) != 0) {
-                    char err_msg[BUFFER_SIZE];
-                    snprintf(err_msg, sizeof(err_msg), "[COMANDO]: %s\n[SALIDA]: Error de sintaxis en el comando '%s'.\n", comandos_str[i], comandos_str[i]);
-                    send(client_sockfd, err_msg, strlen(err_msg), 0);
-                    error_parseo = 1;
-                    for (int k = 0; k <= i; k++) {
-                        liberar_comando_parseado(&comandos_parseados[k]);
-                    }
-                    ultimo_estado_salida = 1;
-                    break;
-                }
-            }
-
-            if (error_parseo) {
-                continue;
-            }
+            Tuberia *tuberia = &linea_parseada->segmentos[s];
 
             // --- Manejo de comandos internos (built-ins) ---
-            if (num_comandos_tuberia == 1 &&
-                comandos_parseados[0].archivo_entrada == NULL &&
-                comandos_parseados[0].archivo_salida == NULL) {
-                if (ejecutar_comando_interno(&comandos_parseados[0], client_sockfd)) {
+            if (tuberia->num_comandos == 1 &&
+                tuberia->comandos[0].archivo_entrada == NULL &&
+                tuberia->comandos[0].archivo_salida == NULL) {
+                if (ejecutar_comando_interno(&tuberia->comandos[0])) {
                     ultimo_estado_salida = 0;
                     // Si el comando interno fue 'exit' o 'quit', salir del bucle principal
-                    if (strcmp(comandos_parseados[0].argv[0], "exit") == 0 ||
-                        strcmp(comandos_parseados[0].argv[0], "quit") == 0) {
-                        liberar_comando_parseado(&comandos_parseados[0]);
+                    if (strcmp(tuberia->comandos[0].argv[0], "exit") == 0 ||
+                        strcmp(tuberia->comandos[0].argv[0], "quit") == 0) {
                         goto end_session;
                     }
-                    liberar_comando_parseado(&comandos_parseados[0]);
                     continue;
                 }
             }
 
             // --- Ejecución de tuberías (o comando único externo) ---
-            ultimo_estado_salida = ejecutar_tuberia(comandos_parseados, num_comandos_tuberia, client_sockfd);
-
-            for (int i = 0; i < num_comandos_tuberia; i++) {
-                liberar_comando_parseado(&comandos_parseados[i]);
-            }
+            ultimo_estado_salida = ejecutar_tuberia(tuberia);
 
             // Después de cada comando/tubería, verificar si el servidor envió un mensaje especial
             // o la salida del comando ejecutado en el servidor, o el prompt del servidor.
             // Loop para asegurar que leemos todo lo que el servidor envió
-            int prompt_received = 0;
-            while ((bytes_received = recv(client_sockfd, server_response, sizeof(server_response) - 1, MSG_DONTWAIT)) > 0) {
+            while ((bytes_received = envio_leer_respuesta(server_response, sizeof(server_response) - 1)) > 0) {
                 server_response[bytes_received] = '\0';
 
                 // Detectar el prompt del servidor para saber cuándo hemos terminado de leer la salida
                 if (strstr(server_response, "\n\033[7;32mremote_shell@server:~$ ") != NULL) {
-                    prompt_received = 1;
                     // Imprimir solo la parte antes del prompt si hay algo
                     char *prompt_start = strstr(server_response, "\n\033[7;32mremote_shell@server:~$ ");
                     if (prompt_start != server_response) {
@@ -314,651 +184,356 @@ int main() {
                     goto end_session;
                 }
             }
-
-            // Si el servidor no envió su prompt, podría ser un error o una desconexión.
-            if (!prompt_received && bytes_received == 0) {
-                printf("Servidor desconectado inesperadamente.\n");
-                goto end_session;
-            } else if (bytes_received == -1 && errno != EWOULDBLOCK && errno != EAGAIN) {
-                perror("Error al recibir del servidor");
-                goto end_session;
-            }
+            // Una desconexión no termina la sesión: el hilo de envío reconecta y reenvía desde el spool
         }
+        arena_reiniciar(&arena_linea);
     }
 
 end_session:
-    close(client_sockfd);
+    envio_finalizar(ESPERA_FIN_ENVIO_MS);
+    arena_liberar(&arena_linea);
+    ms_finalizar();
     return 0;
 }
 
 // --- Implementación de funciones auxiliares ---
 
-void imprimir_bienvenida() {
-    printf("\033[1;36m");
-    printf("┏┳┓╻┏┓╻╻┏━┓╻ ╻┏━╸╻  ╻      ┏━╸┏━┓╻ ╻╻┏━┓┏━┓      ┏━┓\n");
-    printf("┃┃┃┃┃┗┫┃┗━┓┣━┫┣╸ ┃  ┃      ┣╸ ┃┓┃┃ ┃┃┣━┛┃ ┃      ┗━┫\n");
-    printf("╹ ╹╹╹ ╹╹┗━┛╹ ╹┗━╸┗━╸┗━╸    ┗━╸┗┻┛┗━┛╹╹  ┗━┛     #┗━┛\n");
-    printf("\033[0m");
-    printf("\n");
-    fflush(stdout);
-}
-
-char *generar_prompt() {
-    char nombre_host[HOST_NAME_MAX + 1];
-    char cwd[PATH_MAX + 1];
-    struct passwd *pw;
-    char *nombre_usuario = "desconocido";
-    char *dir_casa = NULL;
-
-    pw = getpwuid(geteuid());
-    if (pw != NULL) {
-        nombre_usuario = pw->pw_name;
-        dir_casa = pw->pw_dir;
-    }
-
-    if (gethostname(nombre_host, sizeof(nombre_host)) == -1) {
-        strcpy(nombre_host, "host_desconocido");
-    }
-    nombre_host[sizeof(nombre_host) - 1] = '\0';
-
-    if (getcwd(cwd, sizeof(cwd)) == NULL) {
-        imprimir_error("getcwd");
-        strcpy(cwd, "ruta_desconocida");
-    }
-
-    char display_cwd[PATH_MAX + 1];
-    if (dir_casa != NULL && strncmp(cwd, dir_casa, strlen(dir_casa)) == 0) {
-        if (strlen(cwd) == strlen(dir_casa) || cwd[strlen(dir_casa)] == '/') {
-            snprintf(display_cwd, sizeof(display_cwd), "~%s", cwd + strlen(dir_casa));
-        } else {
-            strncpy(display_cwd, cwd, sizeof(display_cwd) - 1);
-            display_cwd[sizeof(display_cwd) - 1] = '\0';
-        }
-    } else {
-        strncpy(display_cwd, cwd, sizeof(display_cwd) - 1);
-        display_cwd[sizeof(display_cwd) - 1] = '\0';
-    }
-
-    char *prompt_str = (char *)malloc(MAX_LONGITUD_ENTRADA + HOST_NAME_MAX + PATH_MAX + 10);
-    if (prompt_str == NULL) {
-        imprimir_error("malloc para prompt");
-        return strdup("> ");
-    }
-
-    snprintf(prompt_str, MAX_LONGITUD_ENTRADA + HOST_NAME_MAX + PATH_MAX + 10, "\033[7;32m%s@%s\033[0m:\033[7;34m%s\033[0m$ ", nombre_usuario, nombre_host, display_cwd);
-
-    return prompt_str;
-}
-
-void imprimir_error(const char *mensaje) {
-    perror(mensaje);
-    fflush(stderr);
-}
-
-int dividir_cadena(char *cadena, char *delimitador, char *tokens[]) {
-    int contador = 0;
-    char *token;
-    char *saveptr;
-
-    token = strtok_r(cadena, delimitador, &saveptr);
-    while (token != NULL && contador < MAX_COMANDOS) {
-        while (*token == ' ' || *token == '\t' || *token == '\n') token++;
-        char *fin = token + strlen(token) - 1;
-        while (fin > token && (*fin == ' ' || *fin == '\t' || *fin == '\n')) fin--;
-        *(fin + 1) = '\0';
-
-        if (strlen(token) > 0) {
-            tokens[contador++] = token;
-        }
-        token = strtok_r(NULL, delimitador, &saveptr);
-    }
-    tokens[contador] = NULL;
-    return contador;
-}
-
-void deshabilitar_reporte_raton() {
-    printf("\033[?1000l");
-    printf("\033[?1002l");
-    printf("\033[?1003l");
-    fflush(stdout);
-}
-
-void liberar_comando_parseado(ComandoParseado *comando_parseado) {
-    for (int i = 0; i < comando_parseado->argc; i++) {
-        free(comando_parseado->argv[i]);
-        comando_parseado->argv[i] = NULL;
-    }
-    if (comando_parseado->archivo_entrada) {
-        free(comando_parseado->archivo_entrada);
-        comando_parseado->archivo_entrada = NULL;
-    }
-    if (comando_parseado->archivo_salida) {
-        free(comando_parseado->archivo_salida);
-        comando_parseado->archivo_salida = NULL;
-    }
-}
-
-int parsear_argumentos_comando(char *cadena_comando, ComandoParseado *comando_parseado) {
-    comando_parseado->argc = 0;
-    comando_parseado->archivo_entrada = NULL;
-    comando_parseado->archivo_salida = NULL;
-    comando_parseado->tipo_operacion = SIN_REDIR;
-
-    char *current_char = cadena_comando;
-    char *arg_start = NULL;
-    char quote_char = '\0';
-    int i = 0;
-    char temp_arg_buffer[MAX_LONGITUD_ENTRADA];
-
-    while (*current_char != '\0') {
-        if (quote_char == '\0' && (*current_char == ' ' || *current_char == '\t' || *current_char == '\n')) {
-            if (arg_start != NULL) {
-                temp_arg_buffer[i] = '\0';
-                if (comando_parseado->argc < MAX_ARGUMENTOS - 1) {
-                    comando_parseado->argv[comando_parseado->argc++] = strdup(temp_arg_buffer);
-                    if (comando_parseado->argv[comando_parseado->argc - 1] == NULL) {
-                        imprimir_error("strdup");
-                        return -1;
-                    }
-                } else {
-                    fprintf(stderr, "Demasiados argumentos para un comando.\n");
-                    return -1;
-                }
-                arg_start = NULL;
-                i = 0;
-            }
-        }
-        else if (*current_char == '\'' || *current_char == '"') {
-            if (quote_char == '\0') {
-                quote_char = *current_char;
-                if (arg_start == NULL) {
-                    arg_start = current_char;
-                }
-            } else if (quote_char == *current_char) {
-                quote_char = '\0';
-            } else {
-                if (arg_start == NULL) {
-                    arg_start = current_char;
-                }
-                temp_arg_buffer[i++] = *current_char;
-            }
-        }
-        else if (*current_char == '\\' && (current_char[1] == '\'' || current_char[1] == '"' || current_char[1] == ' ' || current_char[1] == '\t')) {
-            if (arg_start == NULL) {
-                arg_start = current_char;
-            }
-            current_char++;
-            temp_arg_buffer[i++] = *current_char;
-        }
-        else if (*current_char == '<' && quote_char == '\0') {
-            if (arg_start != NULL) {
-                temp_arg_buffer[i] = '\0';
-                if (comando_parseado->argc < MAX_ARGUMENTOS - 1) {
-                    comando_parseado->argv[comando_parseado->argc++] = strdup(temp_arg_buffer);
-                    if (comando_parseado->argv[comando_parseado->argc - 1] == NULL) {
-                        imprimir_error("strdup");
-                        return -1;
-                    }
-                } else {
-                    fprintf(stderr, "Demasiados argumentos para un comando.\n");
-                    return -1;
-                }
-                arg_start = NULL;
-                i = 0;
-            }
-            current_char++;
-            while (*current_char == ' ' || *current_char == '\t') current_char++;
-            char *file_start = current_char;
-            while (*current_char != '\0' && *current_char != ' ' && *current_char != '\t' && *current_char != '>' && *current_char != '<') {
-                current_char++;
-            }
-            if (file_start == current_char) {
-                fprintf(stderr, "Error de sintaxis: se esperaba nombre de archivo después de '<'.\n");
-                return -1;
-            }
-            char temp_file_name[PATH_MAX];
-            strncpy(temp_file_name, file_start, current_char - file_start);
-            temp_file_name[current_char - file_start] = '\0';
-            if (comando_parseado->archivo_entrada != NULL) {
-                fprintf(stderr, "Error de sintaxis: múltiples redirecciones de entrada.\n");
-                return -1;
-            }
-            comando_parseado->archivo_entrada = strdup(temp_file_name);
-            if (comando_parseado->archivo_entrada == NULL) {
-                imprimir_error("strdup");
-                return -1;
-            }
-            current_char--;
-        }
-        else if (*current_char == '>' && quote_char == '\0') {
-            if (arg_start != NULL) {
-                temp_arg_buffer[i] = '\0';
-                if (comando_parseado->argc < MAX_ARGUMENTOS - 1) {
-                    comando_parseado->argv[comando_parseado->argc++] = strdup(temp_arg_buffer);
-                    if (comando_parseado->argv[comando_parseado->argc - 1] == NULL) {
-                        imprimir_error("strdup");
-                        return -1;
-                    }
-                } else {
-                    fprintf(stderr, "Demasiados argumentos para un comando.\n");
-                    return -1;
-                }
-                arg_start = NULL;
-                i = 0;
-            }
-            current_char++;
-            TipoOperacion op = REDIR_SALIDA_TRUNCAR;
-            if (*current_char == '>') {
-                op = REDIR_SALIDA_ANEXAR;
-                current_char++;
-            }
-            while (*current_char == ' ' || *current_char == '\t') current_char++;
-            char *file_start = current_char;
-            while (*current_char != '\0' && *current_char != ' ' && *current_char != '\t' && *current_char != '>' && *current_char != '<') {
-                current_char++;
-            }
-            if (file_start == current_char) {
-                fprintf(stderr, "Error de sintaxis: se esperaba nombre de archivo después de redirección de salida.\n");
-                return -1;
-            }
-            char temp_file_name[PATH_MAX];
-            strncpy(temp_file_name, file_start, current_char - file_start);
-            temp_file_name[current_char - file_start] = '\0';
-            if (comando_parseado->archivo_salida != NULL) {
-                fprintf(stderr, "Error de sintaxis: múltiples redirecciones de salida.\n");
-                return -1;
-            }
-            comando_parseado->archivo_salida = strdup(temp_file_name);
-            if (comando_parseado->archivo_salida == NULL) {
-                imprimir_error("strdup");
-                return -1;
-            }
-            comando_parseado->tipo_operacion = op;
-            current_char--;
-        }
-        else {
-            if (arg_start == NULL) {
-                arg_start = current_char;
-            }
-            temp_arg_buffer[i++] = *current_char;
-            if (i >= MAX_LONGITUD_ENTRADA) {
-                fprintf(stderr, "Argumento demasiado largo.\n");
-                return -1;
-            }
-        }
-        current_char++;
-    }
-
-    if (arg_start != NULL && i > 0) {
-        if (quote_char != '\0') {
-            fprintf(stderr, "Error de sintaxis: comilla sin cerrar.\n");
-            return -1;
-        }
-        temp_arg_buffer[i] = '\0';
-        if (comando_parseado->argc < MAX_ARGUMENTOS - 1) {
-            comando_parseado->argv[comando_parseado->argc++] = strdup(temp_arg_buffer);
-            if (comando_parseado->argv[comando_parseado->argc - 1] == NULL) {
-                imprimir_error("strdup");
-                return -1;
-            }
-        } else {
-            fprintf(stderr, "Demasiados argumentos para un comando.\n");
-            return -1;
-        }
-    } else if (quote_char != '\0') {
-        fprintf(stderr, "Error de sintaxis: comilla sin cerrar al final del comando.\n");
-        return -1;
-    }
-
-    comando_parseado->argv[comando_parseado->argc] = NULL;
-
-    if (comando_parseado->argc == 0 && comando_parseado->archivo_entrada == NULL && comando_parseado->archivo_salida == NULL) {
-        fprintf(stderr, "Error de sintaxis: comando vacío o solo con operadores.\n");
-        return -1;
-    }
-
-    return 0;
-}
-
-// Nueva función auxiliar para construir la cadena del comando
-void build_command_string(char *dest, size_t dest_size, ComandoParseado *comando) {
-    dest[0] = '\0'; // Asegurarse de que esté vacío al inicio
+// Escribe un comando (argumentos y redirecciones) tal como se envía al servidor
+static void write_command_string(FILE *dest, const ComandoParseado *comando) {
     for (int i = 0; i < comando->argc; i++) {
-        strncat(dest, comando->argv[i], dest_size - strlen(dest) - 1);
+        fputs(comando->argv[i], dest);
         if (i < comando->argc - 1) {
-            strncat(dest, " ", dest_size - strlen(dest) - 1);
+            fputc(' ', dest);
         }
     }
     if (comando->archivo_entrada) {
-        strncat(dest, " < ", dest_size - strlen(dest) - 1);
-        strncat(dest, comando->archivo_entrada, dest_size - strlen(dest) - 1);
+        fprintf(dest, " < %s", comando->archivo_entrada);
     }
     if (comando->archivo_salida) {
-        if (comando->tipo_operacion == REDIR_SALIDA_ANEXAR) {
-            strncat(dest, " >> ", dest_size - strlen(dest) - 1);
-        } else {
-            strncat(dest, " > ", dest_size - strlen(dest) - 1);
-        }
-        strncat(dest, comando->archivo_salida, dest_size - strlen(dest) - 1);
+        fprintf(dest, comando->tipo_operacion == REDIR_SALIDA_ANEXAR ? " >> %s" : " > %s", comando->archivo_salida);
     }
 }
 
+// Construye el mensaje "[COMANDO]: cmd1 | cmd2 | ...\n" de una tubería, sin recortar el comando: las
+// líneas no tienen límite, y el '\n' final es lo que separa la cabecera del registro siguiente en
+// el servidor. Devuelve memoria de malloc, o NULL si no hay memoria (ver CABECERA_SIN_MEMORIA)
+char *build_command_message(const ComandoParseado comandos[], int num_comandos) {
+    char *mensaje = NULL;
+    size_t longitud = 0;
+    FILE *dest = open_memstream(&mensaje, &longitud);
+    if (dest == NULL) {
+        perror("open_memstream para el mensaje del comando");
+        return NULL;
+    }
+    fputs("[COMANDO]: ", dest);
+    for (int i = 0; i < num_comandos; i++) {
+        write_command_string(dest, &comandos[i]);
+        if (i < num_comandos - 1) {
+            fputs(" | ", dest);
+        }
+    }
+    fputc('\n', dest);
+    if (ferror(dest)) {
+        fclose(dest);
+        free(mensaje);
+        return NULL;
+    }
+    fclose(dest);
+    return mensaje;
+}
 
-int ejecutar_comando_interno(ComandoParseado *comando, int client_sockfd) {
+// Ejecuta un built-in capturando lo que escribe en stdout/stderr para enviarlo al servidor.
+// 'exit' y 'quit' se tratan aquí: hay que avisar al servidor antes de cerrar la sesión.
+int ejecutar_comando_interno(ComandoParseado *comando) {
     if (comando->argc == 0) return 0;
 
-    char output_buffer[BUFFER_SIZE];
-    int original_stdout = dup(STDOUT_FILENO);
-    int original_stderr = dup(STDERR_FILENO);
-    int pipefd[2];
-
-    if (pipe(pipefd) == -1) {
-        perror("pipe for built-in output");
-        return 1;
-    }
-
-    dup2(pipefd[1], STDOUT_FILENO);
-    dup2(pipefd[1], STDERR_FILENO);
-    close(pipefd[1]);
-
-    int handled = 0;
-    char command_str_full[MAX_LONGITUD_ENTRADA];
-    build_command_string(command_str_full, sizeof(command_str_full), comando);
-
     if (strcmp(comando->argv[0], "exit") == 0 || strcmp(comando->argv[0], "quit") == 0) {
         printf("Saliendo del MiniShell.\n");
         fflush(stdout);
-        char message_to_server[BUFFER_SIZE];
-        snprintf(message_to_server, sizeof(message_to_server), "[COMANDO]: %s\n[SALIDA]: Saliendo del MiniShell.\n[CLIENTE_MINISHELL_EVENTO]: MINISHELL_QUIT\n", command_str_full);
-        send(client_sockfd, message_to_server, strlen(message_to_server), 0);
-        handled = 1;
+        char *message_to_server = build_command_message(comando, 1);
+        envio_mensaje(message_to_server != NULL ? message_to_server : CABECERA_SIN_MEMORIA);
+        free(message_to_server);
+        envio_trozo(0, 0, "Saliendo del MiniShell.\n", strlen("Saliendo del MiniShell.\n"));
+        envio_mensaje("[FIN]: 0\n");
+        envio_mensaje("[CLIENTE_MINISHELL_EVENTO]: MINISHELL_QUIT\n");
+        return 1;
     }
-    else if (strcmp(comando->argv[0], "history") == 0) {
-        printf("[COMANDO]: %s\n", command_str_full); // Imprimir el comando localmente antes de enviar la salida
-        history_set_pos(0);
-        HIST_ENTRY *h_entry;
-        int i = 0;
-        char history_output[BUFFER_SIZE];
-        history_output[0] = '\0'; // Reiniciar buffer
-
-        while ((h_entry = history_get(i++)) != NULL) {
-            char line_buf[256];
-            snprintf(line_buf, sizeof(line_buf), "%d: %s\n", i, h_entry->line);
-            strncat(history_output, line_buf, sizeof(history_output) - strlen(history_output) - 1);
-        }
-        printf("%s", history_output); // Imprimir localmente
-        fflush(stdout);
 
-        char message_to_server[BUFFER_SIZE + MAX_LONGITUD_ENTRADA];
-        snprintf(message_to_server, sizeof(message_to_server), "[COMANDO]: %s\n[SALIDA]: %s", command_str_full, history_output);
-        send(client_sockfd, message_to_server, strlen(message_to_server), 0);
-        handled = 1;
-    }
-    else if (strcmp(comando->argv[0], "cd") == 0) {
-        printf("[COMANDO]: %s\n", command_str_full); // Imprimir el comando localmente
-        if (comando->argv[1] == NULL) {
-            fprintf(stderr, "Uso: cd <directorio>\n");
-        } else {
-            if (chdir(comando->argv[1]) == -1) {
-                perror("Error al cambiar de directorio");
-            }
-        }
-        fflush(stdout);
-        fflush(stderr); // Asegura que los errores/mensajes de cd se capturen
-
-        // Capturar la salida/error y enviarla al servidor
-        ssize_t bytes_read = read(pipefd[0], output_buffer, sizeof(output_buffer) - 1);
-        if (bytes_read > 0) {
-            output_buffer[bytes_read] = '\0';
-            char message_to_server[BUFFER_SIZE + MAX_LONGITUD_ENTRADA];
-            snprintf(message_to_server, sizeof(message_to_server), "[COMANDO]: %s\n[SALIDA]: %s", command_str_full, output_buffer);
-            send(client_sockfd, message_to_server, strlen(message_to_server), 0);
-        } else {
-            // Si no hay salida, enviar solo el comando
-            char message_to_server[BUFFER_SIZE + MAX_LONGITUD_ENTRADA];
-            snprintf(message_to_server, sizeof(message_to_server), "[COMANDO]: %s\n[SALIDA]: (Sin salida visible)\n", command_str_full);
-            send(client_sockfd, message_to_server, strlen(message_to_server), 0);
-        }
-        handled = 1;
+    // La salida del built-in se captura en un archivo temporal (un pipe se bloquearía con salidas
+    // de más de 64 KiB, porque nadie lo lee mientras el built-in escribe)
+    FILE *captura = tmpfile();
+    if (captura == NULL) {
+        perror("tmpfile para la salida del built-in");
+        return 0;
     }
+    fflush(stdout);
+    fflush(stderr);
+    int original_stdout = dup(STDOUT_FILENO);
+    int original_stderr = dup(STDERR_FILENO);
+    dup2(fileno(captura), STDOUT_FILENO);
+    dup2(fileno(captura), STDERR_FILENO);
+
+    int handled = ms_ejecutar_builtin(comando);
+    fflush(stdout);
+    fflush(stderr);
 
     // Restaurar stdout y stderr
     dup2(original_stdout, STDOUT_FILENO);
     dup2(original_stderr, STDERR_FILENO);
     close(original_stdout);
     close(original_stderr);
-    close(pipefd[0]);
 
+    if (handled) {
+        char *message_to_server = build_command_message(comando, 1);
+        envio_mensaje(message_to_server != NULL ? message_to_server : CABECERA_SIN_MEMORIA);
+        free(message_to_server);
+        char output_buffer[BUFFER_SIZE];
+        size_t bytes_read;
+        rewind(captura);
+        while ((bytes_read = fread(output_buffer, 1, sizeof(output_buffer), captura)) > 0) {
+            envio_trozo(0, 0, output_buffer, bytes_read);
+        }
+        envio_mensaje("[FIN]: 0\n");
+    }
+    fclose(captura);
     return handled;
 }
 
-int ejecutar_tuberia(ComandoParseado comandos_parseados[], int num_comandos_tuberia, int client_sockfd) {
-    int tuberias[MAX_COMANDOS - 1][2];
-    pid_t pids[MAX_COMANDOS];
-    int estado_salida_final = 1;
-
-    // Construir la cadena de comando completa para la tubería
-    char full_command_line[MAX_LONGITUD_ENTRADA * MAX_COMANDOS]; // Suficientemente grande
-    full_command_line[0] = '\0';
-    for(int i = 0; i < num_comandos_tuberia; i++) {
-        char cmd_part[MAX_LONGITUD_ENTRADA];
-        build_command_string(cmd_part, sizeof(cmd_part), &comandos_parseados[i]);
-        strncat(full_command_line, cmd_part, sizeof(full_command_line) - strlen(full_command_line) - 1);
-        if (i < num_comandos_tuberia - 1) {
-            strncat(full_command_line, " | ", sizeof(full_command_line) - strlen(full_command_line) - 1);
-        }
+// --- Reenvío de la salida ---
+// La salida de una tubería se reparte entre la terminal y el servidor mientras se ejecuta. El
+// servidor la recibe en trozos etiquetados con la etapa y el flujo ("[TROZO]: <etapa> <salida|error>
+// <bytes>\n" seguido de los bytes), y la tubería termina con "[FIN]: <estado>\n":
+//   - stdout de la última etapa: sin pasar por buffers del proceso. envio_duplicar_salida lo duplica
+//     con tee(2) hacia el servidor y splice(2) mueve el original a la terminal.
+//   - stderr de cada etapa: un pipe por etapa, leído con read() (suele ser poco) y copiado a la
+//     terminal (stderr) y a la cola de envío.
+// El envío al servidor es asíncrono (ver envio.h): un servidor lento no frena la tubería salvo con
+// la política de desborde "bloquear".
+
+static int terminal_sin_splice = 0; // 1 si stdout no admite splice (una terminal real): read/write
+
+// Escribe todo el buffer en un descriptor de la terminal (lo que no se pueda escribir se descarta)
+static void escribir_en_terminal(int fd, const char *datos, size_t longitud) {
+    while (longitud > 0) {
+        ssize_t escritos = write(fd, datos, longitud);
+        if (escritos == -1 && errno == EINTR) continue;
+        if (escritos <= 0) return; // Sin terminal (p. ej., stdout cerrado)
+        datos += escritos;
+        longitud -= escritos;
     }
+}
 
-    // Preparar mensaje inicial del comando
-    char initial_command_message[BUFFER_SIZE + MAX_LONGITUD_ENTRADA];
-    snprintf(initial_command_message, sizeof(initial_command_message), "[COMANDO]: %s\n", full_command_line);
-    // No enviar la salida aquí, se capturará después de la ejecución.
-
-    for (int i = 0; i < num_comandos_tuberia - 1; i++) {
-        if (pipe(tuberias[i]) == -1) {
-            imprimir_error("Error al crear la tubería");
-            for (int k = 0; k < i; k++) {
-                close(tuberias[k][0]);
-                close(tuberias[k][1]);
+/**
+ * @brief Mueve exactamente `longitud` bytes del pipe de stdout a la terminal. Si stdout no admite
+ * splice (una terminal real), se copian con read/write.
+ */
+static void mover_a_terminal(int fd_salida, size_t longitud) {
+    static char buffer[BUFFER_SIZE * 16];
+
+    while (longitud > 0) {
+        ssize_t movidos;
+        if (!terminal_sin_splice) {
+            movidos = splice(fd_salida, NULL, STDOUT_FILENO, NULL, longitud, SPLICE_F_MOVE);
+            if (movidos == -1 && errno == EINVAL) {
+                terminal_sin_splice = 1;
+                continue;
+            }
+        } else {
+            movidos = read(fd_salida, buffer, longitud < sizeof(buffer) ? longitud : sizeof(buffer));
+            if (movidos > 0) {
+                escribir_en_terminal(STDOUT_FILENO, buffer, (size_t)movidos);
             }
-            char err_msg[BUFFER_SIZE];
-            snprintf(err_msg, sizeof(err_msg), "[SALIDA]: Error: No se pudo crear la tubería para el comando '%s'.\n", full_command_line);
-            send(client_sockfd, initial_command_message, strlen(initial_command_message), 0); // Enviar el comando incluso si falló el pipe
-            send(client_sockfd, err_msg, strlen(err_msg), 0);
-            return 1;
         }
-    }
-
-    // Pipe para capturar la salida final de la tubería
-    int output_pipe[2];
-    if (pipe(output_pipe) == -1) {
-        perror("Error al crear pipe para salida final");
-        for (int j = 0; j < num_comandos_tuberia - 1; j++) {
-            close(tuberias[j][0]);
-            close(tuberias[j][1]);
+        if (movidos > 0) {
+            longitud -= movidos;
+        } else if (!(movidos == -1 && errno == EINTR)) {
+            return; // No debería ocurrir: los bytes ya estaban en el pipe
         }
-        char err_msg[BUFFER_SIZE];
-        snprintf(err_msg, sizeof(err_msg), "[SALIDA]: Error: No se pudo crear el pipe de salida final para el comando '%s'.\n", full_command_line);
-        send(client_sockfd, initial_command_message, strlen(initial_command_message), 0); // Enviar el comando incluso si falló el pipe
-        send(client_sockfd, err_msg, strlen(err_msg), 0);
-        return 1;
     }
+}
 
-    for (int i = 0; i < num_comandos_tuberia; i++) {
-        pids[i] = fork();
-        if (pids[i] == -1) {
-            imprimir_error("Error al crear el proceso hijo");
-            for (int j = 0; j < num_comandos_tuberia - 1; j++) {
-                close(tuberias[j][0]);
-                close(tuberias[j][1]);
-            }
-            close(output_pipe[0]);
-            close(output_pipe[1]);
-            for (int k = 0; k < i; k++) {
-                if (pids[k] > 0) kill(pids[k], SIGKILL);
-            }
-            char err_msg[BUFFER_SIZE];
-            snprintf(err_msg, sizeof(err_msg), "[SALIDA]: Error: No se pudo forkear para el comando '%s'.\n", full_command_line);
-            send(client_sockfd, initial_command_message, strlen(initial_command_message), 0); // Enviar el comando incluso si falló el fork
-            send(client_sockfd, err_msg, strlen(err_msg), 0);
-            return 1;
-        }
-
-        if (pids[i] == 0) { // CÓDIGO DEL PROCESO HIJO
-            restaurar_senales_hijo();
-
-            if (comandos_parseados[i].archivo_entrada != NULL) {
-                int fd_in = open(comandos_parseados[i].archivo_entrada, O_RDONLY);
-                if (fd_in == -1) {
-                    fprintf(stderr, "minishell: no such file or directory: %s\n", comandos_parseados[i].archivo_entrada);
-                    exit(1); // Usar exit(1) para indicar un error específico
-                }
-                dup2(fd_in, STDIN_FILENO);
-                close(fd_in);
-            } else if (i > 0) {
-                dup2(tuberias[i - 1][0], STDIN_FILENO);
-            }
-
-            if (comandos_parseados[i].archivo_salida != NULL) {
-                int flags = O_WRONLY | O_CREAT;
-                if (comandos_parseados[i].tipo_operacion == REDIR_SALIDA_ANEXAR) {
-                    flags |= O_APPEND;
-                } else {
-                    flags |= O_TRUNC;
-                }
-                int fd_out = open(comandos_parseados[i].archivo_salida, flags, 0644);
-                if (fd_out == -1) {
-                    perror("minishell: Error al abrir archivo de salida");
-                    exit(1);
-                }
-                dup2(fd_out, STDOUT_FILENO);
-                close(fd_out);
-            } else if (i < num_comandos_tuberia - 1) {
-                dup2(tuberias[i][1], STDOUT_FILENO);
-            } else { // Si es el último comando y no hay redirección a archivo, redirige a output_pipe
-                dup2(output_pipe[1], STDOUT_FILENO);
-                dup2(output_pipe[1], STDERR_FILENO); // También redirigir stderr
-            }
+/**
+ * @brief Reenvía lo que haya en el pipe de stdout de la última etapa a la terminal y al servidor.
+ * @return Bytes reenviados (0 en el fin de archivo).
+ */
+static size_t reenviar_salida(int fd_salida, int etapa) {
+    size_t duplicados = envio_duplicar_salida(fd_salida, etapa);
+    if (duplicados > 0) {
+        mover_a_terminal(fd_salida, duplicados);
+    }
+    return duplicados;
+}
 
-            for (int j = 0; j < num_comandos_tuberia - 1; j++) {
-                close(tuberias[j][0]);
-                close(tuberias[j][1]);
-            }
-            close(output_pipe[0]);
-            close(output_pipe[1]);
+/**
+ * @brief Reenvía un trozo del stderr de una etapa a la terminal y, etiquetado, al servidor.
+ * @return Bytes leídos (0 en el fin de archivo).
+ */
+static size_t reenviar_error(int fd_error, int etapa) {
+    char buffer[BUFFER_SIZE];
+    ssize_t leidos;
 
-            execvp(comandos_parseados[i].argv[0], comandos_parseados[i].argv);
-            // Si execvp falla, imprimir error y salir
-            perror("minishell"); // Imprime el error real de execvp (ej. "command not found")
-            exit(127); // Convención para comando no encontrado
-        }
+    while ((leidos = read(fd_error, buffer, sizeof(buffer))) == -1 && errno == EINTR) {
     }
-
-    // CÓDIGO DEL PROCESO PADRE
-    for (int i = 0; i < num_comandos_tuberia - 1; i++) {
-        close(tuberias[i][0]);
-        close(tuberias[i][1]);
+    if (leidos <= 0) {
+        return 0; // Fin de archivo (o error de lectura: se trata igual)
     }
-    close(output_pipe[1]);
+    escribir_en_terminal(STDERR_FILENO, buffer, (size_t)leidos);
+    envio_trozo(etapa, 1, buffer, (size_t)leidos);
+    return (size_t)leidos;
+}
 
-    pid_proceso_en_primer_plano = pids[num_comandos_tuberia - 1];
+// Cierra los pipes de stderr de las etapas que sigan abiertos
+static void cerrar_pipes_error(int pipes_error[][2], int num_etapas) {
+    for (int i = 0; i < num_etapas; i++) {
+        if (pipes_error[i][0] != -1) close(pipes_error[i][0]);
+        if (pipes_error[i][1] != -1) close(pipes_error[i][1]);
+    }
+}
 
-    signal(SIGINT, manejador_sigint_quit);
-    signal(SIGQUIT, manejador_sigint_quit);
+// Muestra en la terminal los contadores del prefijo 'perf' y los envía al servidor como stderr de
+// la última etapa (antes del [FIN] de la tubería)
+static void enviar_contadores(const Tuberia *tuberia, MsTrabajo *trabajo) {
+    MsContadores contadores[MAX_COMANDOS];
+    char *texto = NULL;
+    size_t longitud = 0;
 
-    int status;
-    for (int i = 0; i < num_comandos_tuberia; i++) {
-        waitpid(pids[i], &status, 0);
-        if (i == num_comandos_tuberia - 1) { // Capturar el estado de salida del último comando
-            if (WIFEXITED(status)) {
-                estado_salida_final = WEXITSTATUS(status);
-            } else if (WIFSIGNALED(status)) {
-                estado_salida_final = 128 + WTERMSIG(status);
-            }
-        }
+    int etapas = ms_leer_contadores(trabajo, contadores);
+    if (etapas <= 0) {
+        return;
     }
-    pid_proceso_en_primer_plano = 0;
-
-    signal(SIGINT, SIG_IGN);
-    signal(SIGQUIT, SIG_IGN);
-
-    // Leer la salida capturada y enviarla al servidor
-    char command_output_buffer[BUFFER_SIZE * 2]; // Suficientemente grande para toda la salida
-    ssize_t bytes_read;
-    command_output_buffer[0] = '\0';
-    
-    // Leer toda la salida disponible del pipe
-    while ((bytes_read = read(output_pipe[0], command_output_buffer + strlen(command_output_buffer), sizeof(command_output_buffer) - strlen(command_output_buffer) - 1)) > 0) {
-        command_output_buffer[strlen(command_output_buffer)] = '\0';
+    FILE *tabla = open_memstream(&texto, &longitud);
+    if (tabla == NULL) {
+        ms_imprimir_contadores(stderr, tuberia, contadores, etapas); // Al menos en la terminal
+        return;
     }
-    close(output_pipe[0]);
+    ms_imprimir_contadores(tabla, tuberia, contadores, etapas);
+    fclose(tabla);
+    escribir_en_terminal(STDERR_FILENO, texto, longitud);
+    envio_trozo(tuberia->num_comandos - 1, 1, texto, longitud);
+    free(texto);
+}
 
-    // Enviar el comando y la salida al servidor en un solo mensaje si es posible
-    char full_message_to_server[BUFFER_SIZE * 3]; // Puede ser más grande
-    snprintf(full_message_to_server, sizeof(full_message_to_server), "[COMANDO]: %s\n[SALIDA]: %s%s",
-             full_command_line,
-             strlen(command_output_buffer) > 0 ? command_output_buffer : "(Sin salida visible)\n",
-             (strlen(command_output_buffer) > 0 && command_output_buffer[strlen(command_output_buffer)-1] != '\n') ? "\n" : "");
-    send(client_sockfd, full_message_to_server, strlen(full_message_to_server), 0);
+// Ejecuta una tubería con libminishell y envía su salida (stdout de la última etapa y stderr de
+// todas) a la terminal y al servidor a medida que se produce. Los prefijos 'timeout' y 'perf' se
+// quitan como en los demás front ends (ms_quitar_prefijos): el límite y los contadores los
+// aplica la biblioteca, y al servidor se le envía la línea tal como se escribió
+int ejecutar_tuberia(const Tuberia *tuberia_original) {
+    // Mensaje inicial con la tubería completa (tal como se escribió, con sus prefijos)
+    char *initial_command_message = build_command_message(tuberia_original->comandos, tuberia_original->num_comandos);
+    const char *cabecera = initial_command_message != NULL ? initial_command_message : CABECERA_SIN_MEMORIA;
+
+    ComandoParseado comandos[MAX_COMANDOS];
+    Tuberia sin_prefijo;
+    MsOpcionesEjecucion opciones;
+    char error[BUFFER_SIZE];
+    if (ms_quitar_prefijos(tuberia_original, NULL, comandos, &sin_prefijo, &opciones, error, sizeof(error)) != 0) {
+        envio_mensaje(cabecera);
+        free(initial_command_message);
+        fputs(error, stderr);
+        fflush(stderr);
+        envio_trozo(0, 1, error, strlen(error));
+        envio_mensaje("[FIN]: 1\n");
+        return 1;
+    }
+    const Tuberia *tuberia = &sin_prefijo;
+    int num_etapas = tuberia->num_comandos;
 
-    return estado_salida_final;
-}
+    // Pipes de la tubería (O_CLOEXEC: los hijos solo heredan el duplicado): stdout de la última
+    // etapa y stderr de cada etapa
+    int output_pipe[2];
+    int pipes_error[MAX_COMANDOS][2];
+    int fds_error_etapas[MAX_COMANDOS];
 
-void configurar_senales_padre() {
-    signal(SIGINT, SIG_IGN);
-    signal(SIGQUIT, SIG_IGN);
-    signal(SIGTSTP, SIG_IGN);
-
-    struct sigaction sa;
-    memset(&sa, 0, sizeof(sa));
-    sa.sa_handler = manejador_sigchld;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
-    if (sigaction(SIGCHLD, &sa, NULL) == -1) {
-        imprimir_error("Error al configurar el manejador de SIGCHLD");
-        exit(EXIT_FAILURE);
+    if (pipe2(output_pipe, O_CLOEXEC) == -1) {
+        perror("Error al crear pipe para salida final");
+        free(initial_command_message);
+        return 1;
+    }
+    for (int i = 0; i < num_etapas; i++) {
+        if (pipe2(pipes_error[i], O_CLOEXEC) == -1) {
+            perror("Error al crear el pipe de errores de una etapa");
+            pipes_error[i][0] = pipes_error[i][1] = -1; // Esa etapa hereda el stderr del cliente
+        }
+        fds_error_etapas[i] = pipes_error[i][1];
     }
-}
 
-void restaurar_senales_hijo() {
-    signal(SIGINT, SIG_DFL);
-    signal(SIGQUIT, SIG_DFL);
-    signal(SIGTSTP, SIG_DFL);
-    signal(SIGCHLD, SIG_DFL);
-}
+    opciones.fd_salida = output_pipe[1];
+    opciones.fds_error_etapas = fds_error_etapas;
+    MsTrabajo trabajo;
+    int lanzada = ms_lanzar_tuberia(tuberia, &opciones, &trabajo) == 0;
+    close(output_pipe[1]);
+    for (int i = 0; i < num_etapas; i++) {
+        if (pipes_error[i][1] != -1) {
+            close(pipes_error[i][1]);
+            pipes_error[i][1] = -1;
+        }
+    }
 
-void manejador_sigint_quit(int signo) {
-    if (pid_proceso_en_primer_plano > 0) {
-        if (kill(pid_proceso_en_primer_plano, signo) == -1) {
-            if (errno != ESRCH) {
-                imprimir_error("Error al enviar señal al proceso hijo");
+    envio_mensaje(cabecera);
+    fflush(stdout); // La salida de la tubería se escribe con splice/write: antes, lo pendiente de stdio
+    fflush(stderr);
+    int estado_salida_final = 1;
+    if (lanzada) {
+        // Multiplexa stdout de la última etapa y el stderr de cada etapa hasta que todos los pipes
+        // de la tubería llegan al fin de archivo. El plazo de poll es el del límite de tiempo de la
+        // tubería: al vencer, ms_aplicar_limite() la termina (SIGTERM y, tras la gracia, SIGKILL)
+        // aunque una etapa mantenga abierta su salida, y ms_esperar() sigue la escalada
+        int fd_salida = output_pipe[0];
+        int abiertos = 1;
+        for (int i = 0; i < num_etapas; i++) {
+            abiertos += pipes_error[i][0] != -1;
+        }
+        while (abiertos > 0) {
+            struct pollfd descriptores[MAX_COMANDOS + 1];
+            descriptores[0].fd = fd_salida; // -1: poll lo ignora
+            descriptores[0].events = POLLIN;
+            for (int i = 0; i < num_etapas; i++) {
+                descriptores[1 + i].fd = pipes_error[i][0];
+                descriptores[1 + i].events = POLLIN;
+            }
+            if (poll(descriptores, num_etapas + 1, ms_aplicar_limite(&trabajo)) == -1) {
+                if (errno == EINTR) continue;
+                perror("Error en poll de la salida");
+                break;
+            }
+
+            if (fd_salida != -1 && descriptores[0].revents != 0 && reenviar_salida(fd_salida, num_etapas - 1) == 0) {
+                close(fd_salida);
+                fd_salida = -1;
+                abiertos--;
+            }
+            for (int i = 0; i < num_etapas; i++) {
+                if (pipes_error[i][0] != -1 && descriptores[1 + i].revents != 0 && reenviar_error(pipes_error[i][0], i) == 0) {
+                    close(pipes_error[i][0]);
+                    pipes_error[i][0] = -1;
+                    abiertos--;
+                }
             }
         }
-        if (signo == SIGINT) {
-            printf("\nPrograma cancelado (Ctrl+C).\n");
-            fflush(stdout);
-        } else if (signo == SIGQUIT) {
-            printf("\nPrograma terminado (Ctrl+\\).\n");
-            fflush(stdout);
+        if (fd_salida != -1) close(fd_salida);
+        estado_salida_final = ms_esperar(&trabajo);
+        if (opciones.medir_contadores) {
+            enviar_contadores(tuberia, &trabajo);
         }
     } else {
-        if (signo == SIGINT) {
-            printf("\n");
-            fflush(stdout);
-        } else if (signo == SIGQUIT) {
-            printf("\n");
-            fflush(stdout);
-        }
-    }
-}
-
-void manejador_sigchld(int signo) {
-    (void)signo;
-    pid_t pid;
-    int status;
-    while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0) {
-        // No imprimir nada para evitar interferir con la salida del shell o del servidor
-    }
+        close(output_pipe[0]);
+        // El comando es la cabecera sin "[COMANDO]: " ni el '\n' final
+        const char *comando = cabecera + strlen("[COMANDO]: ");
+        char *err_msg = NULL;
+        int n = asprintf(&err_msg, "Error: No se pudo lanzar la tubería para el comando '%.*s'.\n",
+                         (int)(strlen(comando) - 1), comando);
+        if (n != -1) {
+            envio_trozo(0, 1, err_msg, (size_t)n);
+            free(err_msg);
+        }
+    }
+    cerrar_pipes_error(pipes_error, num_etapas);
+    free(initial_command_message);
+
+    char fin[32];
+    snprintf(fin, sizeof(fin), "[FIN]: %d\n", estado_salida_final);
+    envio_mensaje(fin);
+    return estado_salida_final;
 }
 
 // Función para obtener el nombre de la distribución (igual que en el servidor)
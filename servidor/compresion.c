@@ -0,0 +1,261 @@
+#include "compresion.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// Formato de un bloque (el de los bloques de LZ4): secuencias de
+//   [token] [literales] [distancia: 2 bytes, little endian] [longitud extra de la coincidencia]
+// El token lleva en el nibble alto cuántos literales siguen y en el bajo la longitud de la coincidencia
+// menos COINCIDENCIA_MINIMA; un 15 continúa en bytes de 255 hasta el primero menor. La última secuencia
+// solo tiene literales.
+#define VENTANA_COMPRESION 65535   // Distancia máxima de una coincidencia (cabe en 2 bytes)
+#define CAPACIDAD_VENTANA (VENTANA_COMPRESION + TAMANO_BLOQUE_COMPRESION)
+#define COINCIDENCIA_MINIMA 4
+#define LITERALES_FINALES 5        // Los últimos bytes de un bloque siempre van como literales
+#define MARGEN_COINCIDENCIA 12     // Una coincidencia empieza como tarde 12 bytes antes del final
+#define BITS_TABLA 14
+
+struct Compresor {
+    char datos[CAPACIDAD_VENTANA]; // Los últimos bytes del flujo y, detrás, el bloque en curso
+    size_t usados;
+    uint32_t base;                 // Posición en el flujo de datos[0] (módulo 2^32)
+    uint32_t tabla[1 << BITS_TABLA]; // Última posición en el flujo de cada hash de 4 bytes
+};
+
+struct Descompresor {
+    char datos[CAPACIDAD_VENTANA];
+    size_t usados;
+};
+
+static uint32_t leer32(const char *p) {
+    uint32_t valor;
+    memcpy(&valor, p, sizeof(valor));
+    return valor;
+}
+
+static uint32_t hash32(uint32_t valor) {
+    return (valor * 2654435761u) >> (32 - BITS_TABLA);
+}
+
+/**
+ * @brief Hace sitio para un bloque de `longitud` bytes conservando los VENTANA_COMPRESION anteriores.
+ * Compresor y descompresor la llaman con las mismas longitudes, así que sus ventanas coinciden.
+ * @return Bytes que se han quitado del principio.
+ */
+static size_t deslizar_ventana(char *datos, size_t *usados, size_t longitud) {
+    if (*usados + longitud <= CAPACIDAD_VENTANA) {
+        return 0;
+    }
+    size_t quitar = *usados - VENTANA_COMPRESION;
+    memmove(datos, datos + quitar, VENTANA_COMPRESION);
+    *usados = VENTANA_COMPRESION;
+    return quitar;
+}
+
+// Escribe una longitud que no cupo en el token (255, 255, ..., resto)
+static char *escribir_longitud(char *salida, size_t longitud) {
+    while (longitud >= 255) {
+        *salida++ = (char)255;
+        longitud -= 255;
+    }
+    *salida++ = (char)longitud;
+    return salida;
+}
+
+// Escribe una secuencia: los literales y, si `coincidencia` > 0, la coincidencia a `distancia`
+static char *escribir_secuencia(char *salida, const char *literales, size_t num_literales, size_t distancia, size_t coincidencia) {
+    char *token = salida++;
+    *token = (char)((num_literales >= 15 ? 15 : num_literales) << 4);
+    if (num_literales >= 15) {
+        salida = escribir_longitud(salida, num_literales - 15);
+    }
+    memcpy(salida, literales, num_literales);
+    salida += num_literales;
+    if (coincidencia == 0) {
+        return salida;
+    }
+    *salida++ = (char)(distancia & 0xff);
+    *salida++ = (char)(distancia >> 8);
+    size_t extra = coincidencia - COINCIDENCIA_MINIMA;
+    *token |= (char)(extra >= 15 ? 15 : extra);
+    if (extra >= 15) {
+        salida = escribir_longitud(salida, extra - 15);
+    }
+    return salida;
+}
+
+Compresor *compresor_crear(void) {
+    Compresor *compresor = malloc(sizeof(Compresor));
+    if (compresor != NULL) {
+        compresor_reiniciar(compresor);
+    }
+    return compresor;
+}
+
+void compresor_destruir(Compresor *compresor) {
+    free(compresor);
+}
+
+void compresor_reiniciar(Compresor *compresor) {
+    compresor->usados = 0;
+    compresor->base = 0;
+    // Las entradas vacías quedan lejos de cualquier posición cercana al principio del flujo
+    memset(compresor->tabla, 0x80, sizeof(compresor->tabla));
+}
+
+/**
+ * @brief Comprime los primeros bytes de los iovecs (como mucho TAMANO_BLOQUE_COMPRESION) en `salida`,
+ * que debe tener sitio para COTA_COMPRESION(TAMANO_BLOQUE_COMPRESION) bytes. Búsqueda voraz con una
+ * tabla hash de posiciones: como en LZ4, se prima la velocidad sobre el último punto de compresión.
+ * @param originales Bytes de los iovecs que van en el bloque.
+ * @return Bytes del bloque; si es igual a *originales, el bloque son los bytes originales tal cual.
+ */
+size_t compresor_comprimir(Compresor *compresor, const struct iovec *iov, int num_iov, char *salida, size_t *originales) {
+    size_t total = 0;
+    for (int i = 0; i < num_iov && total < TAMANO_BLOQUE_COMPRESION; i++) {
+        total += iov[i].iov_len;
+    }
+    if (total > TAMANO_BLOQUE_COMPRESION) total = TAMANO_BLOQUE_COMPRESION;
+
+    compresor->base += (uint32_t)deslizar_ventana(compresor->datos, &compresor->usados, total);
+    const char *datos = compresor->datos;
+    size_t inicio = compresor->usados;
+    size_t copiados = 0;
+    for (int i = 0; copiados < total; i++) {
+        size_t n = iov[i].iov_len < total - copiados ? iov[i].iov_len : total - copiados;
+        memcpy(compresor->datos + inicio + copiados, iov[i].iov_base, n);
+        copiados += n;
+    }
+    compresor->usados += total;
+    *originales = total;
+
+    size_t fin = inicio + total;
+    size_t ancla = inicio;   // Primer literal aún sin escribir
+    size_t posicion = inicio;
+    char *escrito = salida;
+    if (total > MARGEN_COINCIDENCIA) {
+        size_t limite = fin - MARGEN_COINCIDENCIA;
+        while (posicion < limite) {
+            uint32_t valor = leer32(datos + posicion);
+            uint32_t *entrada = &compresor->tabla[hash32(valor)];
+            uint32_t distancia = compresor->base + (uint32_t)posicion - *entrada;
+            *entrada = compresor->base + (uint32_t)posicion;
+            if (distancia == 0 || distancia > VENTANA_COMPRESION || distancia > posicion ||
+                leer32(datos + posicion - distancia) != valor) {
+                posicion += 1 + ((posicion - ancla) >> 6); // Sin coincidencias, se avanza cada vez más deprisa
+                continue;
+            }
+
+            size_t origen = posicion - distancia;
+            while (posicion > ancla && origen > 0 && datos[posicion - 1] == datos[origen - 1]) {
+                posicion--;
+                origen--;
+            }
+            size_t longitud = COINCIDENCIA_MINIMA;
+            while (posicion + longitud < fin - LITERALES_FINALES && datos[posicion + longitud] == datos[origen + longitud]) {
+                longitud++;
+            }
+            escrito = escribir_secuencia(escrito, datos + ancla, posicion - ancla, distancia, longitud);
+            posicion += longitud;
+            ancla = posicion;
+            if (posicion < limite) {
+                compresor->tabla[hash32(leer32(datos + posicion - 2))] = compresor->base + (uint32_t)(posicion - 2);
+            }
+        }
+    }
+    escrito = escribir_secuencia(escrito, datos + ancla, fin - ancla, 0, 0);
+
+    size_t comprimidos = (size_t)(escrito - salida);
+    if (comprimidos >= total) {
+        // No sale a cuenta: el bloque va tal cual (la ventana es la misma en los dos casos)
+        memcpy(salida, datos + inicio, total);
+        return total;
+    }
+    return comprimidos;
+}
+
+Descompresor *descompresor_crear(void) {
+    Descompresor *descompresor = malloc(sizeof(Descompresor));
+    if (descompresor != NULL) {
+        descompresor_reiniciar(descompresor);
+    }
+    return descompresor;
+}
+
+void descompresor_destruir(Descompresor *descompresor) {
+    free(descompresor);
+}
+
+void descompresor_reiniciar(Descompresor *descompresor) {
+    descompresor->usados = 0;
+}
+
+/**
+ * @brief Descomprime un bloque a continuación de la ventana. Comprueba cada longitud y cada distancia:
+ * un bloque mal formado (o de otra ventana) se rechaza sin leer ni escribir fuera del buffer.
+ * @param salida Los `originales` bytes del bloque (válidos hasta la siguiente llamada).
+ */
+int descompresor_bloque(Descompresor *descompresor, const char *entrada, size_t longitud, size_t originales, const char **salida) {
+    if (originales > TAMANO_BLOQUE_COMPRESION || longitud > originales) {
+        return -1;
+    }
+    deslizar_ventana(descompresor->datos, &descompresor->usados, originales);
+    char *datos = descompresor->datos;
+    size_t posicion = descompresor->usados;
+    size_t fin = posicion + originales;
+    *salida = datos + posicion;
+
+    if (longitud == originales) {
+        memcpy(datos + posicion, entrada, longitud); // Bloque sin comprimir
+        descompresor->usados = fin;
+        return 0;
+    }
+
+    const unsigned char *leido = (const unsigned char *)entrada;
+    const unsigned char *fin_entrada = leido + longitud;
+    while (leido < fin_entrada) {
+        unsigned token = *leido++;
+        size_t literales = token >> 4;
+        if (literales == 15) {
+            unsigned byte;
+            do {
+                if (leido == fin_entrada) return -1;
+                byte = *leido++;
+                literales += byte;
+            } while (byte == 255);
+        }
+        if (literales > (size_t)(fin_entrada - leido) || literales > fin - posicion) return -1;
+        memcpy(datos + posicion, leido, literales);
+        posicion += literales;
+        leido += literales;
+        if (leido == fin_entrada) break; // Última secuencia: solo literales
+
+        if (fin_entrada - leido < 2) return -1;
+        size_t distancia = (size_t)leido[0] | ((size_t)leido[1] << 8);
+        leido += 2;
+        size_t coincidencia = token & 15;
+        if (coincidencia == 15) {
+            unsigned byte;
+            do {
+                if (leido == fin_entrada) return -1;
+                byte = *leido++;
+                coincidencia += byte;
+            } while (byte == 255);
+        }
+        coincidencia += COINCIDENCIA_MINIMA;
+        if (distancia == 0 || distancia > posicion || coincidencia > fin - posicion) return -1;
+        const char *origen = datos + posicion - distancia;
+        if (distancia >= coincidencia) {
+            memcpy(datos + posicion, origen, coincidencia);
+        } else {
+            for (size_t i = 0; i < coincidencia; i++) { // Se solapa con lo que escribe: byte a byte
+                datos[posicion + i] = origen[i];
+            }
+        }
+        posicion += coincidencia;
+    }
+    if (posicion != fin) return -1;
+    descompresor->usados = fin;
+    return 0;
+}
@@ -0,0 +1,38 @@
+#ifndef COMPRESION_H
+#define COMPRESION_H
+
+// compresion: códec de bloques con el formato de LZ4, sin dependencias, para el flujo del cliente al servidor.
+//
+// El cliente comprime cada lote de registros en un bloque de como mucho TAMANO_BLOQUE_COMPRESION bytes
+// originales. Las coincidencias pueden apuntar a los 64 KiB anteriores del flujo, no solo al bloque:
+// compresor y descompresor guardan esa ventana (el diccionario de la conexión), así que las líneas que
+// se repiten de un comando a otro se comprimen aunque lleguen en lotes distintos. Los bloques se
+// descomprimen en el orden en que se comprimieron; al reconectar, los dos lados empiezan de cero.
+//
+//     size_t originales;
+//     size_t n = compresor_comprimir(compresor, iov, num_iov, trama, &originales);
+//     // n == originales: el bloque va sin comprimir (no salía a cuenta)
+//     ...
+//     const char *datos;
+//     if (descompresor_bloque(descompresor, trama, n, originales, &datos) == 0) { ... }
+
+#include <stddef.h>    // Para size_t
+#include <sys/uio.h>   // Para struct iovec
+
+#define TAMANO_BLOQUE_COMPRESION (64 * 1024)  // Bytes originales de un bloque como mucho
+#define COTA_COMPRESION(n) ((n) + (n) / 255 + 16) // Bytes que puede ocupar un bloque de n bytes comprimido
+
+typedef struct Compresor Compresor;
+typedef struct Descompresor Descompresor;
+
+Compresor *compresor_crear(void);             // NULL si no hay memoria
+void compresor_destruir(Compresor *compresor);
+void compresor_reiniciar(Compresor *compresor); // Olvida la ventana (nueva conexión)
+size_t compresor_comprimir(Compresor *compresor, const struct iovec *iov, int num_iov, char *salida, size_t *originales); // Bloque con los primeros bytes de iov (ver arriba)
+
+Descompresor *descompresor_crear(void);
+void descompresor_destruir(Descompresor *descompresor);
+void descompresor_reiniciar(Descompresor *descompresor);
+int descompresor_bloque(Descompresor *descompresor, const char *entrada, size_t longitud, size_t originales, const char **salida); // 0 si el bloque es válido, -1 si no
+
+#endif // COMPRESION_H
@@ -0,0 +1,189 @@
+#include "delta.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// Formato: operaciones seguidas, con los números en varint (7 bits por byte, el bit alto indica que sigue)
+//   OPERACION_COPIA    <desplazamiento en la base> <longitud>
+//   OPERACION_LITERAL  <longitud> <bytes>
+#define OPERACION_COPIA 0
+#define OPERACION_LITERAL 1
+#define MAX_VARINT 10
+#define COPIA_MINIMA 8 // Una línea más corta que esto (y que no sigue a la copia anterior) va como literal
+
+typedef struct {
+    char *escrito;
+    char *fin;
+    int lleno; // 1 si no cupo algo
+} SalidaDelta;
+
+static void escribir_varint(SalidaDelta *salida, uint64_t valor) {
+    if (salida->fin - salida->escrito < MAX_VARINT) {
+        salida->lleno = 1;
+        return;
+    }
+    while (valor >= 0x80) {
+        *salida->escrito++ = (char)(valor | 0x80);
+        valor >>= 7;
+    }
+    *salida->escrito++ = (char)valor;
+}
+
+static void escribir_copia(SalidaDelta *salida, size_t desplazamiento, size_t longitud) {
+    if (longitud == 0 || salida->lleno) return;
+    if (salida->escrito == salida->fin) {
+        salida->lleno = 1;
+        return;
+    }
+    *salida->escrito++ = OPERACION_COPIA;
+    escribir_varint(salida, desplazamiento);
+    escribir_varint(salida, longitud);
+}
+
+static void escribir_literal(SalidaDelta *salida, const char *datos, size_t longitud) {
+    if (longitud == 0 || salida->lleno) return;
+    if (salida->escrito == salida->fin) {
+        salida->lleno = 1;
+        return;
+    }
+    *salida->escrito++ = OPERACION_LITERAL;
+    escribir_varint(salida, longitud);
+    if (salida->lleno || (size_t)(salida->fin - salida->escrito) < longitud) {
+        salida->lleno = 1;
+        return;
+    }
+    memcpy(salida->escrito, datos, longitud);
+    salida->escrito += longitud;
+}
+
+// FNV-1a de 64 bits de una línea
+static uint64_t hash_linea(const char *datos, size_t longitud) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < longitud; i++) {
+        hash = (hash ^ (unsigned char)datos[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Longitud de la línea que empieza en `datos` (con su '\n', si lo tiene)
+static size_t longitud_linea(const char *datos, size_t disponibles) {
+    const char *fin = memchr(datos, '\n', disponibles);
+    return fin != NULL ? (size_t)(fin - datos) + 1 : disponibles;
+}
+
+/**
+ * @brief Codifica `salida` como delta de `base`: cada línea se busca en la base (primero justo
+ * detrás de la copia anterior, después en una tabla hash de las líneas de la base) y las copias
+ * contiguas se unen en una sola operación.
+ * @return Bytes escritos en `delta`, o 0 si no caben en `maximo` (o no hay memoria).
+ */
+size_t delta_codificar(const char *base, size_t longitud_base, const char *salida, size_t longitud, char *delta, size_t maximo) {
+    size_t lineas = 0;
+    for (size_t i = 0; i < longitud_base; i += longitud_linea(base + i, longitud_base - i)) {
+        lineas++;
+    }
+    size_t tamano_tabla = 16;
+    while (tamano_tabla < lineas * 2) {
+        tamano_tabla *= 2;
+    }
+    // Inicio de cada línea de la base más uno (0: vacía); con direccionamiento abierto
+    uint32_t *tabla = calloc(tamano_tabla, sizeof(uint32_t));
+    if (tabla == NULL) return 0;
+    for (size_t i = 0; i < longitud_base;) {
+        size_t n = longitud_linea(base + i, longitud_base - i);
+        size_t hueco = hash_linea(base + i, n) & (tamano_tabla - 1);
+        while (tabla[hueco] != 0) {
+            hueco = (hueco + 1) & (tamano_tabla - 1);
+        }
+        tabla[hueco] = (uint32_t)i + 1;
+        i += n;
+    }
+
+    SalidaDelta escritura = {delta, delta + maximo, 0};
+    size_t copia_inicio = 0, copia_longitud = 0;   // Copia pendiente de escribir
+    size_t literal_inicio = 0, literal_longitud = 0; // Literales pendientes (contiguos en la salida)
+    size_t siguiente = SIZE_MAX;                   // En la base, detrás de la última copia
+
+    for (size_t i = 0; i < longitud && !escritura.lleno;) {
+        size_t n = longitud_linea(salida + i, longitud - i);
+        size_t encontrada = SIZE_MAX;
+        if (siguiente != SIZE_MAX && siguiente + n <= longitud_base && memcmp(base + siguiente, salida + i, n) == 0) {
+            encontrada = siguiente;
+        } else if (n >= COPIA_MINIMA) {
+            size_t hueco = hash_linea(salida + i, n) & (tamano_tabla - 1);
+            for (; tabla[hueco] != 0; hueco = (hueco + 1) & (tamano_tabla - 1)) {
+                size_t candidata = tabla[hueco] - 1;
+                if (candidata + n <= longitud_base && memcmp(base + candidata, salida + i, n) == 0) {
+                    encontrada = candidata;
+                    break;
+                }
+            }
+        }
+
+        if (encontrada == SIZE_MAX) {
+            escribir_copia(&escritura, copia_inicio, copia_longitud);
+            copia_longitud = 0;
+            if (literal_longitud == 0) literal_inicio = i;
+            literal_longitud += n;
+        } else {
+            escribir_literal(&escritura, salida + literal_inicio, literal_longitud);
+            literal_longitud = 0;
+            if (copia_longitud > 0 && copia_inicio + copia_longitud == encontrada) {
+                copia_longitud += n;
+            } else {
+                escribir_copia(&escritura, copia_inicio, copia_longitud);
+                copia_inicio = encontrada;
+                copia_longitud = n;
+            }
+            siguiente = encontrada + n;
+        }
+        i += n;
+    }
+    escribir_copia(&escritura, copia_inicio, copia_longitud);
+    escribir_literal(&escritura, salida + literal_inicio, literal_longitud);
+    free(tabla);
+    return escritura.lleno ? 0 : (size_t)(escritura.escrito - delta);
+}
+
+static int leer_varint(const unsigned char **leido, const unsigned char *fin, uint64_t *valor) {
+    *valor = 0;
+    for (int desplazamiento = 0; desplazamiento < 64; desplazamiento += 7) {
+        if (*leido == fin) return -1;
+        unsigned byte = *(*leido)++;
+        *valor |= (uint64_t)(byte & 0x7f) << desplazamiento;
+        if ((byte & 0x80) == 0) return 0;
+    }
+    return -1;
+}
+
+/**
+ * @brief Reconstruye una salida a partir de su base y su delta. Comprueba cada operación: una delta
+ * mal formada (o de otra base) se rechaza sin leer ni escribir fuera de los buffers.
+ */
+int delta_aplicar(const char *base, size_t longitud_base, const char *delta, size_t longitud_delta, char *salida, size_t longitud) {
+    const unsigned char *leido = (const unsigned char *)delta;
+    const unsigned char *fin = leido + longitud_delta;
+    size_t escritos = 0;
+
+    while (leido < fin) {
+        unsigned operacion = *leido++;
+        uint64_t desplazamiento = 0, n;
+        if (operacion == OPERACION_COPIA) {
+            if (leer_varint(&leido, fin, &desplazamiento) == -1) return -1;
+        } else if (operacion != OPERACION_LITERAL) {
+            return -1;
+        }
+        if (leer_varint(&leido, fin, &n) == -1 || n > longitud - escritos) return -1;
+        if (operacion == OPERACION_COPIA) {
+            if (desplazamiento > longitud_base || n > longitud_base - desplazamiento) return -1;
+            memcpy(salida + escritos, base + desplazamiento, n);
+        } else {
+            if (n > (uint64_t)(fin - leido)) return -1;
+            memcpy(salida + escritos, leido, n);
+            leido += n;
+        }
+        escritos += n;
+    }
+    return escritos == longitud ? 0 : -1;
+}
@@ -0,0 +1,23 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+// delta: diferencias entre la salida de un comando y la de una ejecución anterior, por líneas.
+//
+// Una delta es una secuencia de operaciones: copiar un tramo de la salida anterior (la base) o
+// insertar bytes nuevos. Con comandos que se repiten (ps, df, ls en un bucle) casi todas las líneas
+// están en la base y la delta ocupa una fracción de la salida.
+//
+//     size_t n = delta_codificar(base, longitud_base, salida, longitud, delta, longitud / 2);
+//     // n == 0: la delta no cabe en el máximo (mejor enviar la salida)
+//     ...
+//     if (delta_aplicar(base, longitud_base, delta, n, salida, longitud) == 0) { ... }
+
+#include <stddef.h> // Para size_t
+
+#define MAX_BASES_DELTA 16              // Salidas anteriores que el cliente y el servidor recuerdan por conexión
+#define MAX_SALIDA_DELTA (1024 * 1024)  // Salida máxima de un comando que se recuerda como base
+
+size_t delta_codificar(const char *base, size_t longitud_base, const char *salida, size_t longitud, char *delta, size_t maximo); // Bytes de la delta (0 si no cabe en `maximo`)
+int delta_aplicar(const char *base, size_t longitud_base, const char *delta, size_t longitud_delta, char *salida, size_t longitud); // 0 si reconstruye exactamente `longitud` bytes, -1 si no
+
+#endif // DELTA_H
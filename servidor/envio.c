@@ -0,0 +1,1451 @@
+#define _GNU_SOURCE // Para pipe2, tee, memmem, memrchr y F_SETPIPE_SZ
+#include "envio.h"
+#include "spool.h"
+#include "compresion.h"
+#include "delta.h"
+#include "transporte.h"
+#include "anillo.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+// Cada registro del spool es un mensaje precedido de "[SEQ]: <secuencia>\n". El hilo emisor envía los
+// registros tal cual, así que el servidor ve la secuencia de cada mensaje y confirma la última que ha
+// procesado con "[ACK]: <secuencia>\n"; al reconectar, el saludo le dice al cliente desde dónde seguir.
+//
+// Los mensajes se agrupan en lotes: un comando produce varios registros pequeños seguidos
+// ("[COMANDO]", sus trozos, "[FIN]"), así que al ver registros nuevos el hilo emisor espera hasta
+// ESPERA_LOTE_MS a que se acumulen TAMANO_LOTE bytes y los envía con un solo sendmsg. Con el lote
+// hecho en el proceso, Nagle solo retrasaría el envío: el socket va con TCP_NODELAY, y MSG_MORE
+// marca los sendmsg que no caben en un lote y siguen enseguida.
+//
+// Si el servidor acepta compresión (el cliente pide "COMPRESION:lz4" en el saludo y el servidor la
+// confirma), cada lote sale como una trama "[COMPRIMIDO]: <bytes> <originales>\n" seguida del bloque
+// (compresion.h), con la ventana de la conexión como diccionario. El servidor puede guardar las
+// tramas tal cual. MINISHELL_COMPRESION=no desactiva la compresión.
+//
+// Con "DELTA:1" en los dos saludos, el hilo emisor recuerda la salida de los últimos comandos de la
+// conexión. Si un comando se repite (ps, df, ls en un bucle), espera a tener su "[FIN]" y, en lugar
+// de sus trozos de stdout, envía "[IGUAL]: <etapa> <base> <bytes>" o "[DELTA]: <etapa> <base> <bytes>
+// <bytes de la delta>" (delta.h) con la secuencia del último trozo; "[BASE]: <n>" tras el "[FIN]" le
+// dice al servidor que guarde esa salida en el hueco n. Un comando cuyo "[FIN]" llega en otro lote
+// (la primera vez que se ejecuta, o uno repetido que tarda) sale tal cual, pero su salida se junta
+// según se envía y su "[FIN]" también deja base. El spool guarda siempre la salida entera: al
+// reconectar, los dos lados olvidan sus bases. MINISHELL_DELTA=no lo desactiva.
+//
+// Por un socket local, el cliente crea además un anillo de memoria compartida (anillo.h) y pasa sus
+// descriptores con el saludo ("ANILLO:1\n"). Si el servidor lo acepta, los lotes (o las tramas) se
+// escriben en el anillo en lugar de en el socket: sin una llamada al sistema por lote mientras el
+// servidor esté leyendo. Las confirmaciones siguen llegando por el socket, y cerrarlo es el final de
+// la conexión. MINISHELL_ANILLO=no lo desactiva.
+#define MAX_IOV_ENVIO 256         // Registros por sendmsg (como mucho IOV_MAX)
+#define TAMANO_LOTE (64 * 1024)   // Bytes a partir de los que un lote se envía sin esperar
+#define ESPERA_LOTE_MS 2          // Espera máxima de los registros de un lote incompleto
+#define ESPERA_REPETIDO_MS 500    // Espera máxima del "[FIN]" de un comando repetido antes de enviarlo tal cual
+#define MAX_CABECERA_TRAMA 64     // Longitud máxima de "[COMPRIMIDO]: ...\n"
+#define MAX_ETIQUETA 96           // Longitud máxima de "[SEQ]: ...\n[TROZO]: ...\n" y "[DESCARTADO]: ...\n"
+#define BUFFER_DESCARTE_ENVIO 4096
+#define BUFFER_RESPUESTA_ENVIO 4096
+#define ESPERA_CONEXION_MS 3000   // Para connect y para el saludo del servidor
+#define RECONEXION_INICIAL_MS 1000
+#define RECONEXION_MAXIMA_MS 60000
+#define MAX_INSTANCIAS_SPOOL 8    // Clientes a la vez con el mismo directorio de spool (cada uno usa el suyo)
+
+#define MAX_FLUJOS_RECORTE 32     // Flujos de un comando (stdout y stderr de cada etapa) con recorte propio
+#define MAX_LINEA_MUESTRA 1024    // Bytes de una línea de muestra como mucho
+#define TAMANO_TROZO_RECORTE (64 * 1024) // Bytes de lo recortado que se leen o se envían de una vez
+
+static const char prefijo_ack[] = "[ACK]: ";
+#define LONGITUD_PREFIJO_ACK (sizeof(prefijo_ack) - 1)
+
+static struct {
+    DireccionServidor servidor;  // TCP o socket local (transporte.h)
+    char os[256];
+    PoliticaDesborde politica;
+    int sockfd;                 // -1 sin conexión (solo lo usa el hilo emisor una vez arrancado)
+    int conectado;              // Copia atómica de sockfd != -1 para el shell
+    int confirma;               // 1 si el servidor confirma lo recibido (respondió "ULTIMA:" al saludo)
+    int comprime;               // 1 si en esta conexión los lotes van en tramas comprimidas
+    Compresor *compresor;       // NULL si la compresión está desactivada
+    char *trama;                // Trama comprimida en curso: cabecera y bloque
+    size_t longitud_trama;
+    size_t enviado_trama;       // Bytes de la trama ya enviados
+    const char *datos_trama;    // Lo que se envía: la trama comprimida o un tramo de `transformado`
+    int pide_delta;             // 0 con MINISHELL_DELTA=no
+    int pide_anillo;            // 0 con MINISHELL_ANILLO=no
+    int usa_anillo;             // 1 si en esta conexión los datos van por `anillo`
+    Anillo anillo;
+    int delta;                  // 1 si en esta conexión las salidas repetidas van como delta
+    struct {
+        char *comando;          // Línea del comando (NULL: hueco libre)
+        char *salida;           // Su última salida (stdout), la misma que guarda el servidor
+        size_t longitud;
+        unsigned long long uso; // Para reemplazar la usada hace más tiempo
+    } bases[MAX_BASES_DELTA];
+    unsigned long long usos;
+    char *transformado;         // Registros ya transformados (con delta), pendientes de enviar
+    size_t longitud_transformado;
+    size_t capacidad_transformado;
+    size_t enviado_transformado;
+    long long inicio_retencion; // Desde cuándo se espera el "[FIN]" de un comando repetido (0: no se espera)
+    unsigned long long confirmada;  // Última secuencia confirmada por el servidor (hilo emisor)
+    unsigned long long escrita;     // Última secuencia escrita en el spool (la publica el shell)
+    int intermedio[2];          // Pipe donde tee(2) deja cada trozo de stdout antes de pasarlo al spool
+    int respuestas[2];          // Pipe con el texto del servidor que no es una confirmación (para el shell)
+    int evento_datos;           // eventfd: hay registros nuevos o hay que terminar (despierta al hilo emisor)
+    int evento_espacio;         // eventfd: se envió algo o se perdió la conexión (despierta al shell)
+    int evento_fin;             // eventfd: el hilo emisor terminó
+    int emisor_dormido;         // 1 mientras el hilo emisor espera registros nuevos
+    int shell_esperando;        // 1 mientras el shell espera a que se envíe lo pendiente (ENVIO_BLOQUEAR)
+    int terminar;               // 1: salir cuando el servidor lo haya confirmado todo; 2: salir ya
+    unsigned long long descartados; // Bytes de salida descartados aún sin notificar (shell)
+    char entrada[BUFFER_RESPUESTA_ENVIO]; // Lo recibido del servidor aún sin procesar (hilo emisor)
+    size_t usados_entrada;
+    pthread_t hilo;
+    int activo;
+} envio = {{0}, "", ENVIO_POLITICA_POR_DEFECTO, -1, 0, 0, 0, NULL, NULL, 0, 0, NULL, 1, 1, 0, {NULL, NULL, 0, 0, 0, -1, -1, -1},
+           0, {{NULL, NULL, 0, 0}}, 0,
+           NULL, 0, 0, 0, 0, 0, 0, {-1, -1}, {-1, -1}, -1, -1, -1, 0, 0, 0, 0,
+           "", 0, (pthread_t)0, 0};
+
+// Comando de las deltas cuyo "[COMANDO]" salió sin su "[FIN]": su stdout se junta según sale (hilo emisor)
+static struct {
+    char *comando;              // NULL: ninguno en curso
+    size_t longitud_comando;
+    char *salida;
+    size_t longitud;
+    size_t capacidad;
+    int etapa;                  // Etapa de su stdout (-1: aún ninguna)
+    int comparable;             // 0 si hay salida de varias etapas, recortada o de más de MAX_SALIDA_DELTA
+} comando_en_curso = {NULL, 0, NULL, 0, 0, -1, 0};
+
+// --- Utilidades ---
+
+static void avisar(int evento) {
+    uint64_t uno = 1;
+    if (write(evento, &uno, sizeof(uno)) == -1 && errno != EAGAIN) {
+        perror("Error al avisar al hilo de envío");
+    }
+}
+
+// Espera a que se avise el evento (o a que pase `espera_ms`, -1: sin límite) y lo consume
+static int esperar_evento(int evento, int espera_ms) {
+    struct pollfd descriptor = {evento, POLLIN, 0};
+    int listos = poll(&descriptor, 1, espera_ms);
+    if (listos > 0) {
+        uint64_t avisos;
+        if (read(evento, &avisos, sizeof(avisos)) == -1 && errno != EAGAIN) {
+            perror("Error al leer un evento del hilo de envío");
+        }
+    }
+    return listos;
+}
+
+static int bytes_en_pipe(int fd) {
+    int pendientes = 0;
+    if (ioctl(fd, FIONREAD, &pendientes) == -1) {
+        return 0;
+    }
+    return pendientes;
+}
+
+// Descarta `longitud` bytes de un pipe
+static void descartar_de_pipe(int fd, size_t longitud) {
+    char descarte[BUFFER_DESCARTE_ENVIO];
+    while (longitud > 0) {
+        ssize_t leidos = read(fd, descarte, longitud < sizeof(descarte) ? longitud : sizeof(descarte));
+        if (leidos == -1 && errno == EINTR) continue;
+        if (leidos <= 0) return;
+        longitud -= leidos;
+    }
+}
+
+static long long ahora_ms(void) {
+    struct timespec ahora;
+    clock_gettime(CLOCK_MONOTONIC, &ahora);
+    return (long long)ahora.tv_sec * 1000 + ahora.tv_nsec / 1000000;
+}
+
+// Espera a que el descriptor esté listo para `eventos`, como mucho `espera_ms`
+static int esperar_descriptor(int fd, short eventos, int espera_ms) {
+    struct pollfd descriptor = {fd, eventos, 0};
+    int listos;
+    while ((listos = poll(&descriptor, 1, espera_ms)) == -1 && errno == EINTR) {
+    }
+    return listos;
+}
+
+// Olvida el comando en curso de las deltas
+static void olvidar_comando_en_curso(void) {
+    free(comando_en_curso.comando);
+    free(comando_en_curso.salida);
+    comando_en_curso.comando = comando_en_curso.salida = NULL;
+    comando_en_curso.longitud_comando = comando_en_curso.longitud = comando_en_curso.capacidad = 0;
+    comando_en_curso.etapa = -1;
+    comando_en_curso.comparable = 0;
+}
+
+// Olvida las salidas recordadas para las deltas
+static void olvidar_bases(void) {
+    olvidar_comando_en_curso();
+    for (int i = 0; i < MAX_BASES_DELTA; i++) {
+        free(envio.bases[i].comando);
+        free(envio.bases[i].salida);
+        envio.bases[i].comando = envio.bases[i].salida = NULL;
+        envio.bases[i].longitud = 0;
+    }
+}
+
+// --- Conexión ---
+
+/**
+ * @brief Conecta con el servidor e intercambia el saludo: el cliente envía su sistema y su
+ * identificador ("HOLA_CLIENTE:<os>\nID:<id>\n", más "COMPRESION:lz4\n", "DELTA:1\n" y "ANILLO:1\n"
+ * si los pide) y el servidor responde con el suyo, la última secuencia que tiene de este cliente y lo
+ * que acepta ("HOLA_SERVIDOR:<os>\nULTIMA:<n>\nCOMPRESION:lz4\nDELTA:1\nANILLO:1\n"). Coloca el
+ * lector del spool en el primer registro que el servidor no tiene.
+ * @param anunciar 1 para informar en la terminal de cada paso (primera conexión).
+ * @return 0 si hay conexión, -1 si no (errno indica por qué).
+ */
+static int conectar(int anunciar) {
+    int con_anillo = 0; // 1 si este saludo ofrece un anillo
+    // No bloqueante desde el principio: connect y el saludo tienen un límite de tiempo
+    int fd = socket(envio.servidor.familia, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0); // Los comandos no heredan la conexión
+    if (fd == -1) return -1;
+    if (anunciar) {
+        printf("Intentando conectar con el servidor en %s...\n", envio.servidor.texto);
+    }
+    // Un socket local sin sitio en la cola de escucha da EAGAIN: como un servidor TCP que no responde
+    if (connect(fd, (struct sockaddr *)&envio.servidor.direccion, envio.servidor.longitud) == -1 &&
+        errno != EINPROGRESS) {
+        goto fallo;
+    }
+    if (esperar_descriptor(fd, POLLOUT, ESPERA_CONEXION_MS) <= 0) {
+        errno = ETIMEDOUT;
+        goto fallo;
+    }
+    int error = 0;
+    socklen_t longitud_error = sizeof(error);
+    getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &longitud_error);
+    if (error != 0) {
+        errno = error;
+        goto fallo;
+    }
+    if (anunciar) {
+        printf("Conexión establecida con el servidor.\n");
+    }
+    if (envio.servidor.familia == AF_INET) {
+        int sin_retraso = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &sin_retraso, sizeof(sin_retraso)); // Los lotes ya agrupan (ver arriba)
+    }
+
+    // Un anillo nuevo en cada conexión: lo que quedara en el anterior se reenvía desde el spool
+    con_anillo = envio.servidor.familia == AF_UNIX && envio.pide_anillo && anillo_crear(&envio.anillo, TAMANO_ANILLO) == 0;
+    char saludo[512];
+    int n = snprintf(saludo, sizeof(saludo), "HOLA_CLIENTE:%s\nID:%s\n%s%s%s", envio.os, spool_id(),
+                     envio.compresor != NULL ? "COMPRESION:lz4\n" : "", envio.pide_delta ? "DELTA:1\n" : "",
+                     con_anillo ? "ANILLO:1\n" : "");
+    // Por un socket local, el saludo lleva las credenciales del cliente (el servidor sabe quién es) y los descriptores del anillo
+    int fds_anillo[] = {envio.anillo.fd_memoria, envio.anillo.evento_datos, envio.anillo.evento_espacio};
+    ssize_t enviados = envio.servidor.familia == AF_UNIX
+                           ? transporte_enviar_credenciales(fd, saludo, (size_t)n, fds_anillo, con_anillo ? 3 : 0)
+                           : send(fd, saludo, (size_t)n, MSG_NOSIGNAL);
+    if (enviados != n) {
+        goto fallo;
+    }
+    char respuesta[BUFFER_RESPUESTA_ENVIO];
+    ssize_t recibidos = -1;
+    if (esperar_descriptor(fd, POLLIN, ESPERA_CONEXION_MS) > 0) {
+        recibidos = recv(fd, respuesta, sizeof(respuesta) - 1, 0);
+    }
+    if (recibidos <= 0) {
+        errno = recibidos == 0 ? ECONNRESET : ETIMEDOUT; // Un servidor ocupado con otro cliente no responde
+        goto fallo;
+    }
+    respuesta[recibidos] = '\0';
+
+    unsigned long long ultima = 0;
+    const char *linea_ultima = strstr(respuesta, "\nULTIMA:");
+    envio.confirma = linea_ultima != NULL && sscanf(linea_ultima + 8, "%llu", &ultima) == 1;
+    envio.comprime = envio.compresor != NULL && strstr(respuesta, "\nCOMPRESION:lz4\n") != NULL;
+    envio.delta = envio.pide_delta && strstr(respuesta, "\nDELTA:1\n") != NULL;
+    envio.usa_anillo = con_anillo && strstr(respuesta, "\nANILLO:1\n") != NULL;
+    if (con_anillo && !envio.usa_anillo) {
+        anillo_cerrar(&envio.anillo); // Un servidor sin anillo: todo por el socket
+    }
+    if (anunciar) {
+        if (strncmp(respuesta, "HOLA_SERVIDOR:", 14) == 0) {
+            printf("Servidor dice: %.*s\n", (int)strcspn(respuesta + 14, "\n"), respuesta + 14);
+            if (envio.comprime) {
+                printf("El envío al servidor va comprimido (lz4).\n");
+            }
+            if (envio.usa_anillo) {
+                printf("El envío al servidor va por memoria compartida.\n");
+            }
+        } else {
+            printf("Respuesta inesperada del servidor (%s). Asumiendo servidor sin saludo.\n", respuesta);
+        }
+    }
+
+    // Se reenvía todo lo que el servidor no tiene, aunque sea de una sesión anterior
+    if (ultima > envio.confirmada) {
+        envio.confirmada = ultima;
+    }
+    spool_lector_buscar(envio.confirmada);
+    if (envio.comprime) {
+        compresor_reiniciar(envio.compresor); // El diccionario es de la conexión
+    }
+    olvidar_bases(); // Como el diccionario: el servidor empieza sin bases
+    envio.longitud_trama = envio.enviado_trama = 0;
+    envio.longitud_transformado = envio.enviado_transformado = 0;
+    envio.inicio_retencion = 0;
+    envio.usados_entrada = 0;
+    envio.sockfd = fd;
+    __atomic_store_n(&envio.conectado, 1, __ATOMIC_SEQ_CST);
+    return 0;
+
+fallo:
+    error = errno;
+    close(fd);
+    if (con_anillo) {
+        anillo_cerrar(&envio.anillo);
+    }
+    errno = error;
+    return -1;
+}
+
+// Cierra la conexión; lo que el servidor no confirmó sigue en el spool y se reenviará
+static void desconectar(const char *motivo) {
+    close(envio.sockfd);
+    envio.sockfd = -1;
+    if (envio.usa_anillo) {
+        anillo_cerrar(&envio.anillo);
+        envio.usa_anillo = 0;
+    }
+    __atomic_store_n(&envio.conectado, 0, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&envio.terminar, __ATOMIC_SEQ_CST) == 0) {
+        fprintf(stderr, "\n[envío] Conexión con el servidor perdida (%s). La sesión se guarda en %s y se reenviará.\n",
+                motivo, spool_directorio());
+    }
+    avisar(envio.evento_espacio); // El shell no espera a un servidor que no está
+}
+
+// --- Hilo emisor ---
+
+/**
+ * @brief Procesa lo recibido del servidor: las confirmaciones ("[ACK]: <n>\n") liberan el spool y
+ * el resto del texto pasa al shell por el pipe de respuestas.
+ */
+static void procesar_entrada(void) {
+    size_t inicio = 0;
+
+    while (inicio < envio.usados_entrada) {
+        char *resto = envio.entrada + inicio;
+        size_t disponibles = envio.usados_entrada - inicio;
+        size_t comparar = disponibles < LONGITUD_PREFIJO_ACK ? disponibles : LONGITUD_PREFIJO_ACK;
+
+        if (memcmp(resto, prefijo_ack, comparar) == 0) {
+            char *fin_linea = memchr(resto, '\n', disponibles);
+            if (fin_linea == NULL) {
+                if (inicio == 0 && envio.usados_entrada == sizeof(envio.entrada)) {
+                    inicio = envio.usados_entrada; // Línea imposible: se descarta
+                }
+                break; // Confirmación incompleta
+            }
+            unsigned long long secuencia = strtoull(resto + LONGITUD_PREFIJO_ACK, NULL, 10);
+            if (secuencia > envio.confirmada) {
+                envio.confirmada = secuencia;
+                spool_confirmar(secuencia);
+            }
+            inicio += (size_t)(fin_linea - resto) + 1;
+            continue;
+        }
+
+        // Texto para el shell hasta la siguiente confirmación (o hasta un posible principio de una al final)
+        const char *siguiente = memmem(resto + 1, disponibles - 1, prefijo_ack, LONGITUD_PREFIJO_ACK);
+        size_t n = siguiente != NULL ? (size_t)(siguiente - resto) : disponibles;
+        if (siguiente == NULL) {
+            const char *corchete = memrchr(resto + 1, '[', disponibles - 1);
+            size_t cola = corchete != NULL ? disponibles - (size_t)(corchete - resto) : 0;
+            if (corchete != NULL && cola < LONGITUD_PREFIJO_ACK && memcmp(corchete, prefijo_ack, cola) == 0) {
+                n = (size_t)(corchete - resto);
+            }
+        }
+        if (write(envio.respuestas[1], resto, n) == -1 && errno != EAGAIN) {
+            perror("Error al pasar la respuesta del servidor al shell");
+        }
+        inicio += n;
+    }
+    memmove(envio.entrada, envio.entrada + inicio, envio.usados_entrada - inicio);
+    envio.usados_entrada -= inicio;
+}
+
+static void atender_servidor(void) {
+    while (envio.sockfd != -1) {
+        ssize_t leidos = recv(envio.sockfd, envio.entrada + envio.usados_entrada,
+                              sizeof(envio.entrada) - envio.usados_entrada, MSG_DONTWAIT);
+        if (leidos == 0) {
+            desconectar("el servidor cerró la conexión");
+            return;
+        }
+        if (leidos == -1) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                desconectar(strerror(errno));
+            }
+            return;
+        }
+        envio.usados_entrada += (size_t)leidos;
+        procesar_entrada();
+    }
+}
+
+// Espera a que haya registros nuevos, lo que envíe el servidor o (con `escribir`) sitio en el socket o en el anillo
+static void esperar(int escribir, int espera_ms) {
+    int sitio_en_anillo = escribir && envio.usa_anillo;
+    struct pollfd descriptores[3] = {{envio.evento_datos, POLLIN, 0},
+                                     {envio.sockfd, (short)(POLLIN | (escribir && !sitio_en_anillo ? POLLOUT : 0)), 0},
+                                     {sitio_en_anillo ? envio.anillo.evento_espacio : -1, POLLIN, 0}};
+    int num = envio.sockfd == -1 ? 1 : 3;
+
+    if (poll(descriptores, num, espera_ms) == -1) {
+        if (errno != EINTR) perror("Error en poll del hilo de envío");
+        return;
+    }
+    if (descriptores[0].revents != 0) {
+        esperar_evento(envio.evento_datos, 0);
+    }
+    if (num == 3 && descriptores[2].revents != 0) {
+        esperar_evento(envio.anillo.evento_espacio, 0);
+    }
+    if (num == 3 && (descriptores[1].revents & (POLLIN | POLLHUP | POLLERR)) != 0) {
+        atender_servidor();
+    }
+}
+
+// Espera `espera_ms` antes de reintentar la conexión (menos si hay que terminar)
+static void esperar_reintento(int espera_ms) {
+    long long limite = ahora_ms() + espera_ms;
+    while (__atomic_load_n(&envio.terminar, __ATOMIC_SEQ_CST) == 0) {
+        long long resto = limite - ahora_ms();
+        if (resto <= 0) break;
+        esperar_evento(envio.evento_datos, (int)resto);
+    }
+}
+
+// Tras enviar algo, despierta al shell si espera sitio
+static void avisar_envio(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // Pareja de la del shell en hacer_sitio
+    if (__atomic_load_n(&envio.shell_esperando, __ATOMIC_SEQ_CST)) {
+        avisar(envio.evento_espacio);
+    }
+}
+
+/**
+ * @brief Envía los iovecs con un solo sendmsg (el writev de los sockets, con MSG_NOSIGNAL) o, si la
+ * conexión tiene anillo, los copia en él. Devuelve lo enviado, o -1 con errno como sendmsg (EAGAIN:
+ * no cabe nada).
+ * @param mas 1 si hay más datos listos detrás (MSG_MORE: el kernel no cierra aún el segmento TCP).
+ */
+static ssize_t enviar_iov(struct iovec *iov, int n, int mas) {
+    if (envio.usa_anillo) {
+        ssize_t escritos = anillo_escribir(&envio.anillo, iov, n);
+        if (escritos <= 0) {
+            errno = escritos == 0 ? EAGAIN : EPROTO; // -1: el servidor dejó el anillo en un estado imposible
+            return -1;
+        }
+        return escritos;
+    }
+    struct msghdr mensaje;
+    memset(&mensaje, 0, sizeof(mensaje));
+    mensaje.msg_iov = iov;
+    mensaje.msg_iovlen = n;
+    return sendmsg(envio.sockfd, &mensaje, MSG_NOSIGNAL | MSG_DONTWAIT | (mas ? MSG_MORE : 0));
+}
+
+// Envía registros del spool: los iovecs apuntan al mapeo del spool, sin copias (salvo al anillo)
+static void enviar_registros(struct iovec *iov, int n, int mas) {
+    ssize_t enviados = enviar_iov(iov, n, mas);
+    if (enviados == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            esperar(1, -1);
+        } else if (errno != EINTR) {
+            desconectar(strerror(errno));
+        }
+        return;
+    }
+    spool_lector_avanzar((size_t)enviados);
+    avisar_envio();
+}
+
+// Comprime en una trama los primeros bytes de los iovecs (como mucho un bloque); devuelve cuántos
+static size_t construir_trama(const struct iovec *iov, int n) {
+    size_t originales;
+    size_t comprimidos = compresor_comprimir(envio.compresor, iov, n, envio.trama + MAX_CABECERA_TRAMA, &originales);
+    char cabecera[MAX_CABECERA_TRAMA];
+    int longitud = snprintf(cabecera, sizeof(cabecera), "[COMPRIMIDO]: %zu %zu\n", comprimidos, originales);
+
+    // La cabecera se pone justo delante del bloque para enviarlo todo de una vez
+    envio.datos_trama = envio.trama;
+    envio.enviado_trama = MAX_CABECERA_TRAMA - (size_t)longitud;
+    memcpy(envio.trama + envio.enviado_trama, cabecera, (size_t)longitud);
+    envio.longitud_trama = MAX_CABECERA_TRAMA + comprimidos;
+    return originales;
+}
+
+/**
+ * @brief Comprime en una trama los registros preparados (los que quepan en un bloque) y los da por
+ * leídos del spool: si la conexión se pierde antes de enviarla, el lector vuelve atrás al reconectar.
+ */
+static void preparar_trama(struct iovec *iov, int n) {
+    spool_lector_avanzar(construir_trama(iov, n));
+}
+
+// Siguiente tramo de lo transformado: comprimido en una trama o, sin compresión, tal cual
+static void preparar_trama_transformada(void) {
+    struct iovec resto = {envio.transformado + envio.enviado_transformado,
+                          envio.longitud_transformado - envio.enviado_transformado};
+    if (envio.comprime) {
+        envio.enviado_transformado += construir_trama(&resto, 1);
+        return;
+    }
+    envio.datos_trama = resto.iov_base;
+    envio.enviado_trama = 0;
+    envio.longitud_trama = resto.iov_len;
+    envio.enviado_transformado = envio.longitud_transformado;
+}
+
+// Envía lo que quede de la trama en curso
+static void enviar_trama(int mas) {
+    struct iovec resto = {(void *)(envio.datos_trama + envio.enviado_trama), envio.longitud_trama - envio.enviado_trama};
+    ssize_t enviados = enviar_iov(&resto, 1, mas);
+    if (enviados == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            esperar(1, -1);
+        } else if (errno != EINTR) {
+            desconectar(strerror(errno));
+        }
+        return;
+    }
+    envio.enviado_trama += (size_t)enviados;
+    if (envio.enviado_trama == envio.longitud_trama) {
+        envio.longitud_trama = envio.enviado_trama = 0;
+    }
+    avisar_envio();
+}
+
+// Bytes de los iovecs preparados
+static size_t bytes_preparados(const struct iovec *iov, int n) {
+    size_t total = 0;
+    for (int i = 0; i < n; i++) {
+        total += iov[i].iov_len;
+    }
+    return total;
+}
+
+// --- Deltas de las salidas repetidas ---
+
+typedef enum { REGISTRO_COMANDO, REGISTRO_SALIDA, REGISTRO_FIN, REGISTRO_RECORTE, REGISTRO_OTRO } TipoRegistro;
+
+typedef struct {
+    TipoRegistro tipo;
+    unsigned long long secuencia;
+    const char *texto;          // Comando (REGISTRO_COMANDO) o bytes del trozo (REGISTRO_SALIDA)
+    size_t longitud;
+    int etapa;
+} Registro;
+
+// Reconoce un registro del spool: "[SEQ]: <n>\n" y un mensaje (los registros no acaban en '\0')
+static void analizar_registro(const struct iovec *iov, Registro *registro) {
+    const char *datos = iov->iov_base;
+    char linea[MAX_ETIQUETA];
+    size_t bytes;
+    char tipo[16];
+
+    memset(registro, 0, sizeof(*registro));
+    registro->tipo = REGISTRO_OTRO;
+    const char *fin_secuencia = memchr(datos, '\n', iov->iov_len);
+    if (fin_secuencia == NULL) return;
+    size_t n = (size_t)(fin_secuencia - datos) < sizeof(linea) - 1 ? (size_t)(fin_secuencia - datos) : sizeof(linea) - 1;
+    memcpy(linea, datos, n);
+    linea[n] = '\0';
+    if (sscanf(linea, "[SEQ]: %llu", &registro->secuencia) != 1) return;
+
+    const char *mensaje = fin_secuencia + 1;
+    size_t resto = iov->iov_len - (size_t)(mensaje - datos);
+    const char *fin_mensaje = memchr(mensaje, '\n', resto);
+    if (fin_mensaje == NULL) return;
+    if (resto >= 11 && memcmp(mensaje, "[COMANDO]: ", 11) == 0) {
+        registro->tipo = REGISTRO_COMANDO;
+        registro->texto = mensaje + 11;
+        registro->longitud = (size_t)(fin_mensaje - registro->texto);
+    } else if (resto >= 7 && memcmp(mensaje, "[FIN]: ", 7) == 0) {
+        registro->tipo = REGISTRO_FIN;
+    } else if (resto >= 11 && memcmp(mensaje, "[RECORTE]: ", 11) == 0) {
+        registro->tipo = REGISTRO_RECORTE;
+    } else if (resto >= 9 && memcmp(mensaje, "[TROZO]: ", 9) == 0) {
+        n = (size_t)(fin_mensaje - mensaje) < sizeof(linea) - 1 ? (size_t)(fin_mensaje - mensaje) : sizeof(linea) - 1;
+        memcpy(linea, mensaje, n);
+        linea[n] = '\0';
+        if (sscanf(linea, "[TROZO]: %d %15s %zu", &registro->etapa, tipo, &bytes) == 3 && strcmp(tipo, "salida") == 0 &&
+            bytes == resto - (size_t)(fin_mensaje + 1 - mensaje)) {
+            registro->tipo = REGISTRO_SALIDA;
+            registro->texto = fin_mensaje + 1;
+            registro->longitud = bytes;
+        }
+    }
+}
+
+static int anadir_transformado(const char *datos, size_t longitud) {
+    if (envio.longitud_transformado + longitud > envio.capacidad_transformado) {
+        size_t capacidad = envio.capacidad_transformado > 0 ? envio.capacidad_transformado : TAMANO_LOTE;
+        while (capacidad < envio.longitud_transformado + longitud) {
+            capacidad *= 2;
+        }
+        char *nuevo = realloc(envio.transformado, capacidad);
+        if (nuevo == NULL) return -1;
+        envio.transformado = nuevo;
+        envio.capacidad_transformado = capacidad;
+    }
+    memcpy(envio.transformado + envio.longitud_transformado, datos, longitud);
+    envio.longitud_transformado += longitud;
+    return 0;
+}
+
+// Hueco de la base del comando (-1 si no se recuerda)
+static int buscar_base(const char *comando, size_t longitud) {
+    for (int i = 0; i < MAX_BASES_DELTA; i++) {
+        if (envio.bases[i].comando != NULL && strlen(envio.bases[i].comando) == longitud &&
+            memcmp(envio.bases[i].comando, comando, longitud) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Hueco para una base nueva: uno libre o el usado hace más tiempo
+static int hueco_para_base(void) {
+    int elegido = 0;
+    for (int i = 0; i < MAX_BASES_DELTA; i++) {
+        if (envio.bases[i].comando == NULL) return i;
+        if (envio.bases[i].uso < envio.bases[elegido].uso) elegido = i;
+    }
+    return elegido;
+}
+
+/**
+ * @brief Recuerda `salida` (pasa a ser de la base) como la base del comando y añade "[BASE]: <n>".
+ * @param base Hueco de la base del comando (-1: el suyo si lo tiene o uno nuevo).
+ * @return 0 si va bien, -1 si no hay memoria.
+ */
+static int registrar_base(const char *comando, size_t longitud_comando, int base, char *salida, size_t longitud) {
+    if (base == -1) base = buscar_base(comando, longitud_comando);
+    if (base == -1) {
+        base = hueco_para_base();
+        free(envio.bases[base].comando);
+        free(envio.bases[base].salida);
+        envio.bases[base].salida = NULL;
+        if ((envio.bases[base].comando = strndup(comando, longitud_comando)) == NULL) {
+            free(salida);
+            return -1;
+        }
+    }
+    free(envio.bases[base].salida);
+    envio.bases[base].salida = salida;
+    envio.bases[base].longitud = longitud;
+    envio.bases[base].uso = ++envio.usos;
+    char aviso[32];
+    int longitud_aviso = snprintf(aviso, sizeof(aviso), "[BASE]: %d\n", base);
+    return anadir_transformado(aviso, (size_t)longitud_aviso);
+}
+
+/**
+ * @brief Transforma un comando completo (de su "[COMANDO]" a su "[FIN]"): si su salida es igual a
+ * la base o la delta ocupa menos de la mitad, sus trozos de stdout se sustituyen por "[IGUAL]" o
+ * "[DELTA]"; después, su salida pasa a ser la base del comando ("[BASE]").
+ * @param base Hueco de la base del comando (-1 si no tiene).
+ * @return 0 si va bien, -1 si no hay memoria.
+ */
+static int transformar_comando(const struct iovec *iov, int n, int base, size_t total) {
+    Registro registro;
+    int ultimo_trozo = -1, etapa = -1, comparable = 1; // 0 si hay salida de varias etapas o recortada
+    for (int i = 0; i < n; i++) {
+        analizar_registro(&iov[i], &registro);
+        if (registro.tipo == REGISTRO_SALIDA) {
+            if (etapa != -1 && registro.etapa != etapa) comparable = 0;
+            etapa = registro.etapa;
+            ultimo_trozo = i;
+        } else if (registro.tipo == REGISTRO_RECORTE) {
+            comparable = 0;
+        }
+    }
+    char *salida = NULL;
+    if (ultimo_trozo != -1 && comparable && total <= MAX_SALIDA_DELTA && (salida = malloc(total)) != NULL) {
+        size_t copiados = 0;
+        for (int i = 0; i < n; i++) {
+            analizar_registro(&iov[i], &registro);
+            if (registro.tipo == REGISTRO_SALIDA) {
+                memcpy(salida + copiados, registro.texto, registro.longitud);
+                copiados += registro.longitud;
+            }
+        }
+    }
+
+    char cabecera[MAX_ETIQUETA];
+    int longitud_cabecera = 0;
+    char *delta = NULL;
+    size_t longitud_delta = 0;
+    if (salida != NULL && base != -1) {
+        if (envio.bases[base].longitud == total && memcmp(envio.bases[base].salida, salida, total) == 0) {
+            longitud_cabecera = snprintf(cabecera, sizeof(cabecera), "[IGUAL]: %d %d %zu\n", etapa, base, total);
+        } else if ((delta = malloc(total / 2 + 1)) != NULL &&
+                   (longitud_delta = delta_codificar(envio.bases[base].salida, envio.bases[base].longitud, salida, total,
+                                                     delta, total / 2)) > 0) {
+            longitud_cabecera = snprintf(cabecera, sizeof(cabecera), "[DELTA]: %d %d %zu %zu\n", etapa, base, total, longitud_delta);
+        }
+    }
+
+    int resultado = 0;
+    for (int i = 0; i < n && resultado == 0; i++) {
+        analizar_registro(&iov[i], &registro);
+        if (registro.tipo != REGISTRO_SALIDA || longitud_cabecera == 0) {
+            resultado = anadir_transformado(iov[i].iov_base, iov[i].iov_len);
+        } else if (i == ultimo_trozo) {
+            // Con la secuencia del último trozo: el servidor da por recibidos los anteriores
+            char secuencia[32];
+            int longitud_secuencia = snprintf(secuencia, sizeof(secuencia), "[SEQ]: %llu\n", registro.secuencia);
+            resultado = anadir_transformado(secuencia, (size_t)longitud_secuencia);
+            if (resultado == 0) resultado = anadir_transformado(cabecera, (size_t)longitud_cabecera);
+            if (resultado == 0) resultado = anadir_transformado(delta, longitud_delta);
+        }
+    }
+    free(delta);
+
+    if (salida != NULL && resultado == 0) {
+        analizar_registro(&iov[0], &registro);
+        return registrar_base(registro.texto, registro.longitud, base, salida, total);
+    }
+    free(salida);
+    return resultado;
+}
+
+/**
+ * @brief Sigue el comando en curso con un registro que ha salido tal cual: su "[COMANDO]" lo empieza,
+ * sus trozos de stdout se juntan y, tras su "[FIN]", su salida pasa a ser la base del comando.
+ * @return 0 si va bien, -1 si no hay memoria.
+ */
+static int seguir_comando_en_curso(const Registro *registro) {
+    switch (registro->tipo) {
+    case REGISTRO_COMANDO:
+        olvidar_comando_en_curso();
+        if ((comando_en_curso.comando = strndup(registro->texto, registro->longitud)) == NULL) return -1;
+        comando_en_curso.longitud_comando = registro->longitud;
+        comando_en_curso.comparable = 1;
+        return 0;
+    case REGISTRO_SALIDA:
+        if (comando_en_curso.comando == NULL || !comando_en_curso.comparable) return 0;
+        if ((comando_en_curso.etapa != -1 && registro->etapa != comando_en_curso.etapa) ||
+            comando_en_curso.longitud + registro->longitud > MAX_SALIDA_DELTA) {
+            comando_en_curso.comparable = 0;
+            return 0;
+        }
+        comando_en_curso.etapa = registro->etapa;
+        if (comando_en_curso.longitud + registro->longitud > comando_en_curso.capacidad) {
+            size_t capacidad = comando_en_curso.capacidad == 0 ? 4096 : comando_en_curso.capacidad;
+            while (capacidad < comando_en_curso.longitud + registro->longitud) capacidad *= 2;
+            char *salida = realloc(comando_en_curso.salida, capacidad);
+            if (salida == NULL) return -1;
+            comando_en_curso.salida = salida;
+            comando_en_curso.capacidad = capacidad;
+        }
+        memcpy(comando_en_curso.salida + comando_en_curso.longitud, registro->texto, registro->longitud);
+        comando_en_curso.longitud += registro->longitud;
+        return 0;
+    case REGISTRO_RECORTE:
+        comando_en_curso.comparable = 0;
+        return 0;
+    case REGISTRO_FIN: {
+        // Sin salida comparable no hay "[BASE]": la base anterior sigue valiendo en los dos lados
+        int resultado = 0;
+        if (comando_en_curso.comando != NULL && comando_en_curso.comparable && comando_en_curso.etapa != -1) {
+            resultado = registrar_base(comando_en_curso.comando, comando_en_curso.longitud_comando, -1,
+                                       comando_en_curso.salida, comando_en_curso.longitud);
+            comando_en_curso.salida = NULL;
+        }
+        olvidar_comando_en_curso();
+        return resultado;
+    }
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Pasa registros preparados a `transformado`, con los comandos repetidos como delta, y los da
+ * por leídos del spool. Un comando repetido cuyo "[FIN]" aún no está escrito se retiene (como mucho
+ * ESPERA_REPETIDO_MS y mientras el shell no espere sitio); si no llega, va tal cual y se sigue como
+ * comando en curso, igual que uno sin base, para que su "[FIN]" renueve la base.
+ * @return Registros transformados; 0 si se retiene un comando repetido.
+ */
+static int transformar_registros(const struct iovec *iov, int n, int terminar) {
+    size_t consumidos = 0;
+    int i = 0;
+    Registro registro;
+
+    envio.longitud_transformado = envio.enviado_transformado = 0;
+    while (i < n && envio.longitud_transformado < TAMANO_LOTE) {
+        analizar_registro(&iov[i], &registro);
+        int fin = -1;
+        size_t total = 0;
+        if (registro.tipo == REGISTRO_COMANDO) {
+            for (int j = i + 1; j < n && total <= MAX_SALIDA_DELTA; j++) {
+                Registro siguiente;
+                analizar_registro(&iov[j], &siguiente);
+                if (siguiente.tipo == REGISTRO_SALIDA) total += siguiente.longitud;
+                if (siguiente.tipo == REGISTRO_FIN || siguiente.tipo == REGISTRO_COMANDO) {
+                    fin = siguiente.tipo == REGISTRO_FIN ? j : -1;
+                    break;
+                }
+            }
+        }
+        int base = registro.tipo == REGISTRO_COMANDO ? buscar_base(registro.texto, registro.longitud) : -1;
+
+        if (registro.tipo == REGISTRO_COMANDO && fin == -1 && base != -1) {
+            int esperar_fin = total <= MAX_SALIDA_DELTA && n < MAX_IOV_ENVIO && !terminar &&
+                              !__atomic_load_n(&envio.shell_esperando, __ATOMIC_SEQ_CST);
+            if (esperar_fin && i > 0) break; // Primero lo anterior; el comando se retiene en la siguiente vuelta
+            if (esperar_fin) {
+                if (envio.inicio_retencion == 0) envio.inicio_retencion = ahora_ms();
+                if (ahora_ms() - envio.inicio_retencion < ESPERA_REPETIDO_MS) return 0;
+            }
+        }
+        if (registro.tipo == REGISTRO_COMANDO) {
+            envio.inicio_retencion = 0;
+        }
+
+        int num = fin != -1 ? fin - i + 1 : 1;
+        int resultado;
+        if (fin != -1) {
+            olvidar_comando_en_curso();
+            resultado = transformar_comando(iov + i, num, base, total);
+        } else {
+            resultado = anadir_transformado(iov[i].iov_base, iov[i].iov_len);
+            if (resultado == 0) resultado = seguir_comando_en_curso(&registro);
+        }
+        if (resultado == -1) {
+            // Sin memoria: se sigue sin deltas (lo transformado de esta vuelta se descarta)
+            fprintf(stderr, "\n[envío] Sin memoria para las deltas; se envían las salidas enteras.\n");
+            olvidar_comando_en_curso();
+            envio.delta = 0;
+            envio.longitud_transformado = 0;
+            return 0;
+        }
+        for (int j = i; j < i + num; j++) {
+            consumidos += iov[j].iov_len;
+        }
+        i += num;
+    }
+    spool_lector_avanzar(consumidos);
+    return i;
+}
+
+/**
+ * @brief Duerme hasta que el shell escriba algo después de `escrita`, el servidor envíe algo, haya
+ * que terminar o pasen `espera_ms` (-1: sin límite).
+ */
+static void dormir(unsigned long long escrita, int terminar, int espera_ms) {
+    __atomic_store_n(&envio.emisor_dormido, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&envio.escrita, __ATOMIC_SEQ_CST) == escrita &&
+        __atomic_load_n(&envio.terminar, __ATOMIC_SEQ_CST) == terminar) {
+        esperar(0, espera_ms);
+    }
+    __atomic_store_n(&envio.emisor_dormido, 0, __ATOMIC_SEQ_CST);
+}
+
+static void *hilo_emisor(void *argumento) {
+    struct iovec iov[MAX_IOV_ENVIO];
+    int espera_ms = RECONEXION_INICIAL_MS;
+    long long inicio_lote = 0; // Cuándo se vio el primer registro del lote en curso (0: ninguno)
+    (void)argumento;
+
+    for (;;) {
+        int terminar = __atomic_load_n(&envio.terminar, __ATOMIC_SEQ_CST);
+        if (terminar == 2) break;
+
+        if (envio.sockfd == -1) {
+            if (terminar) break; // Al salir no se reintenta: lo pendiente queda en el spool
+            esperar_reintento(espera_ms);
+            if (__atomic_load_n(&envio.terminar, __ATOMIC_SEQ_CST)) break;
+            if (conectar(0) == 0) {
+                fprintf(stderr, "\n[envío] Conexión con el servidor recuperada; se reenvía desde la secuencia %llu.\n",
+                        envio.confirmada + 1);
+                espera_ms = RECONEXION_INICIAL_MS;
+            } else {
+                espera_ms = espera_ms * 2 < RECONEXION_MAXIMA_MS ? espera_ms * 2 : RECONEXION_MAXIMA_MS;
+            }
+            continue;
+        }
+
+        if (envio.longitud_trama > 0) {
+            enviar_trama(0);
+            continue;
+        }
+        if (envio.enviado_transformado < envio.longitud_transformado) {
+            preparar_trama_transformada();
+            enviar_trama(envio.enviado_transformado < envio.longitud_transformado);
+            continue;
+        }
+
+        unsigned long long escrita = __atomic_load_n(&envio.escrita, __ATOMIC_SEQ_CST);
+        int n = spool_lector_preparar(iov, MAX_IOV_ENVIO);
+        if (n > 0) {
+            // Lote incompleto: se espera un poco a que el shell añada más (el shell no avisa mientras
+            // tanto; envio_finalizar sí, y entonces se envía ya)
+            if (n < MAX_IOV_ENVIO && !terminar && bytes_preparados(iov, n) < TAMANO_LOTE) {
+                long long ahora = ahora_ms();
+                if (inicio_lote == 0) inicio_lote = ahora;
+                if (ahora - inicio_lote < ESPERA_LOTE_MS) {
+                    esperar_evento(envio.evento_datos, (int)(inicio_lote + ESPERA_LOTE_MS - ahora));
+                    continue;
+                }
+            }
+            inicio_lote = 0;
+            if (envio.delta) {
+                if (transformar_registros(iov, n, terminar) == 0 && envio.delta) {
+                    // Comando repetido sin su "[FIN]": se espera a que el shell lo escriba
+                    long long resto = envio.inicio_retencion + ESPERA_REPETIDO_MS - ahora_ms();
+                    dormir(escrita, terminar, resto > 0 ? (int)resto : 0);
+                }
+            } else if (envio.comprime) {
+                preparar_trama(iov, n);
+                enviar_trama(n == MAX_IOV_ENVIO || bytes_preparados(iov, n) > TAMANO_BLOQUE_COMPRESION);
+            } else {
+                enviar_registros(iov, n, n == MAX_IOV_ENVIO);
+            }
+            continue;
+        }
+        if (!envio.confirma && escrita > envio.confirmada) {
+            // Un servidor sin confirmaciones: lo enviado se da por recibido
+            envio.confirmada = escrita;
+            spool_confirmar(escrita);
+        }
+        if (terminar == 1 && envio.confirmada >= escrita) break;
+
+        dormir(escrita, terminar, -1); // Nada que enviar
+    }
+    avisar(envio.evento_fin);
+    return NULL;
+}
+
+// --- Lado del shell ---
+
+typedef struct {
+    int etapa;
+    int error;                  // 1 si es stderr
+    size_t enviados;            // Bytes de la cabeza ya enviados
+    int recortado;              // 1 si ya se anunció el recorte ("[RECORTE]")
+    unsigned long long omitidos;
+    unsigned long long lineas;  // Líneas omitidas (saltos de línea)
+    uint64_t hash;              // FNV-1a de lo omitido
+    char *cola;                 // Los últimos bytes del flujo (circular, configuracion.cola bytes)
+    size_t inicio_cola;
+    size_t longitud_cola;
+    char muestra[MAX_LINEA_MUESTRA]; // Línea de muestra en curso
+    size_t longitud_muestra;
+    int en_muestra;             // 1 si la línea omitida en curso va de muestra
+} FlujoRecortado;
+
+// Publica lo escrito en el spool y despierta al hilo emisor si duerme
+static void publicar_escrito(void) {
+    __atomic_store_n(&envio.escrita, spool_ultima_secuencia(), __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&envio.emisor_dormido, __ATOMIC_SEQ_CST)) {
+        avisar(envio.evento_datos);
+    }
+}
+
+// Añade un registro al spool: "[SEQ]: <n>\n" seguido de las dos partes del mensaje
+static void anadir_registro(const char *a, size_t longitud_a, const char *b, size_t longitud_b) {
+    char secuencia[32];
+    int n = snprintf(secuencia, sizeof(secuencia), "[SEQ]: %llu\n", spool_ultima_secuencia() + 1);
+    const char *partes[] = {secuencia, a, b};
+    size_t longitudes[] = {(size_t)n, longitud_a, longitud_b};
+    if (spool_anadir(partes, longitudes, 3) == 0) {
+        publicar_escrito();
+    }
+}
+
+/**
+ * @brief Aplica la política de desborde cuando lo pendiente de enviar supera TAMANO_COLA_ENVIO.
+ * Sin conexión nunca se espera: el spool guarda lo que haga falta.
+ * @return 0 si el mensaje se añade al spool, -1 si se descarta.
+ */
+static int hacer_sitio(size_t longitud, int esencial) {
+    int esperando = 0;
+
+    while (spool_pendiente() >= TAMANO_COLA_ENVIO) {
+        if (envio.politica == ENVIO_DESCARTAR && !esencial) {
+            envio.descartados += longitud;
+            return -1;
+        }
+        if (envio.politica != ENVIO_BLOQUEAR || !__atomic_load_n(&envio.conectado, __ATOMIC_SEQ_CST)) break;
+        if (!esperando) {
+            // Primero se anuncia la espera y se vuelve a mirar: el hilo emisor puede haber enviado entretanto
+            __atomic_store_n(&envio.shell_esperando, 1, __ATOMIC_SEQ_CST);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            esperando = 1;
+            continue;
+        }
+        esperar_evento(envio.evento_espacio, -1);
+    }
+    if (esperando) {
+        __atomic_store_n(&envio.shell_esperando, 0, __ATOMIC_SEQ_CST);
+    }
+    return 0;
+}
+
+// Si se descartó salida, se avisa al servidor ("[DESCARTADO]: <bytes>")
+static void notificar_descartados(void) {
+    if (envio.descartados == 0) return;
+
+    char aviso[MAX_ETIQUETA];
+    int n = snprintf(aviso, sizeof(aviso), "[DESCARTADO]: %llu\n", envio.descartados);
+    anadir_registro(aviso, (size_t)n, NULL, 0);
+    envio.descartados = 0;
+}
+
+/**
+ * @brief Añade un mensaje (dos partes contiguas en el flujo) al spool. Los esenciales (cabeceras y
+ * eventos) nunca se descartan.
+ */
+static void encolar(const char *a, size_t longitud_a, const char *b, size_t longitud_b, int esencial) {
+    if (!envio.activo) return;
+    if (hacer_sitio(longitud_a + longitud_b, esencial) == -1) return;
+    if (esencial) {
+        notificar_descartados(); // Un aviso por comando (antes de "[FIN]"), no uno por trozo
+    }
+    anadir_registro(a, longitud_a, b, longitud_b);
+}
+
+static void encolar_trozo(int etapa, int error, const char *datos, size_t longitud) {
+    char etiqueta[MAX_ETIQUETA];
+    int n = snprintf(etiqueta, sizeof(etiqueta), "[TROZO]: %d %s %zu\n", etapa, error ? "error" : "salida", longitud);
+    encolar(etiqueta, (size_t)n, datos, longitud, 0);
+}
+
+// --- Recorte de la salida ---
+// Cada flujo de un comando (stdout o stderr de una etapa) envía su cabeza según llega. Lo que sigue
+// pasa por una cola circular con los últimos bytes; lo que sale de la cola es lo omitido, del que se
+// llevan la cuenta, el hash y las líneas de muestra. Con el "[FIN]" se envían el resumen de lo
+// omitido ("[OMITIDO]: <etapa> <flujo> <bytes> <líneas> <hash>") y la cola. El primer byte omitido
+// se anuncia con "[RECORTE]: <etapa> <flujo> <cabeza> <muestreo>": lo que llega después hasta el
+// "[OMITIDO]" son líneas de muestra.
+
+static struct {
+    RecorteSalida configuracion;
+    FlujoRecortado flujos[MAX_FLUJOS_RECORTE];
+    int num_flujos;
+} recorte = {ENVIO_RECORTE_POR_DEFECTO, {{0, 0, 0, 0, 0, 0, 0, NULL, 0, 0, "", 0, 0}}, 0};
+
+// Estado del recorte de un flujo del comando en curso (NULL: se envía todo)
+static FlujoRecortado *flujo_recortado(int etapa, int error) {
+    if (!recorte.configuracion.activo) return NULL;
+    for (int i = 0; i < recorte.num_flujos; i++) {
+        if (recorte.flujos[i].etapa == etapa && recorte.flujos[i].error == error) {
+            return &recorte.flujos[i];
+        }
+    }
+    if (recorte.num_flujos == MAX_FLUJOS_RECORTE) return NULL;
+    FlujoRecortado *flujo = &recorte.flujos[recorte.num_flujos++];
+    memset(flujo, 0, sizeof(*flujo));
+    flujo->etapa = etapa;
+    flujo->error = error;
+    flujo->hash = 14695981039346656037ull; // FNV-1a de 64 bits
+    flujo->en_muestra = recorte.configuracion.muestreo > 0;
+    return flujo;
+}
+
+// Bytes del principio de `longitud` que aún caben en la cabeza del flujo (y los cuenta como enviados)
+static size_t bytes_de_cabeza(FlujoRecortado *flujo, size_t longitud) {
+    size_t caben = recorte.configuracion.cabeza - flujo->enviados;
+    if (caben > longitud) caben = longitud;
+    flujo->enviados += caben;
+    return caben;
+}
+
+// Lo omitido: se cuenta, entra en el hash y, con muestreo, se envía 1 de cada n líneas
+static void omitir(FlujoRecortado *flujo, const char *datos, size_t longitud) {
+    if (!flujo->recortado) {
+        char aviso[MAX_ETIQUETA];
+        int n = snprintf(aviso, sizeof(aviso), "[RECORTE]: %d %s %zu %d\n", flujo->etapa,
+                         flujo->error ? "error" : "salida", recorte.configuracion.cabeza, recorte.configuracion.muestreo);
+        encolar(aviso, (size_t)n, NULL, 0, 1);
+        flujo->recortado = 1;
+    }
+    flujo->omitidos += longitud;
+    for (size_t i = 0; i < longitud; i++) {
+        flujo->hash = (flujo->hash ^ (unsigned char)datos[i]) * 1099511628211ull;
+    }
+
+    for (size_t i = 0; i < longitud;) {
+        const char *salto = memchr(datos + i, '\n', longitud - i);
+        size_t fin = salto != NULL ? (size_t)(salto - datos) + 1 : longitud;
+        if (flujo->en_muestra) {
+            // Una línea de muestra demasiado larga se corta (y acaba en '\n')
+            size_t caben = MAX_LINEA_MUESTRA - 1 - flujo->longitud_muestra;
+            size_t n = fin - i < caben ? fin - i : caben;
+            memcpy(flujo->muestra + flujo->longitud_muestra, datos + i, n);
+            flujo->longitud_muestra += n;
+        }
+        if (salto != NULL) {
+            if (flujo->en_muestra) {
+                if (flujo->muestra[flujo->longitud_muestra - 1] != '\n') {
+                    flujo->muestra[flujo->longitud_muestra++] = '\n';
+                }
+                encolar_trozo(flujo->etapa, flujo->error, flujo->muestra, flujo->longitud_muestra);
+                flujo->longitud_muestra = 0;
+            }
+            flujo->lineas++;
+            flujo->en_muestra = recorte.configuracion.muestreo > 0 && flujo->lineas % recorte.configuracion.muestreo == 0;
+        }
+        i = fin;
+    }
+}
+
+// Pasa a lo omitido los `longitud` bytes más antiguos de la cola
+static void sacar_de_cola(FlujoRecortado *flujo, size_t longitud) {
+    size_t capacidad = recorte.configuracion.cola;
+    while (longitud > 0) {
+        size_t n = capacidad - flujo->inicio_cola < longitud ? capacidad - flujo->inicio_cola : longitud;
+        omitir(flujo, flujo->cola + flujo->inicio_cola, n);
+        flujo->inicio_cola = (flujo->inicio_cola + n) % capacidad;
+        flujo->longitud_cola -= n;
+        longitud -= n;
+    }
+}
+
+// Lo que sigue a la cabeza: entra en la cola, y lo que ya no cabe en ella queda omitido
+static void guardar_en_cola(FlujoRecortado *flujo, const char *datos, size_t longitud) {
+    size_t capacidad = recorte.configuracion.cola;
+    if (flujo->cola == NULL && capacidad > 0) {
+        flujo->cola = malloc(capacidad);
+    }
+    if (flujo->cola == NULL) {
+        omitir(flujo, datos, longitud); // Sin cola (o sin memoria para ella)
+        return;
+    }
+
+    if (flujo->longitud_cola + longitud > capacidad) {
+        size_t sobran = flujo->longitud_cola + longitud - capacidad;
+        sacar_de_cola(flujo, sobran < flujo->longitud_cola ? sobran : flujo->longitud_cola);
+    }
+    if (longitud > capacidad) {
+        omitir(flujo, datos, longitud - capacidad);
+        datos += longitud - capacidad;
+        longitud = capacidad;
+    }
+    while (longitud > 0) {
+        size_t final = (flujo->inicio_cola + flujo->longitud_cola) % capacidad;
+        size_t n = capacidad - final < longitud ? capacidad - final : longitud;
+        memcpy(flujo->cola + final, datos, n);
+        flujo->longitud_cola += n;
+        datos += n;
+        longitud -= n;
+    }
+}
+
+// Fin del comando: de cada flujo recortado, el resumen de lo omitido y la cola; después se olvidan
+static void terminar_recortes(void) {
+    for (int i = 0; i < recorte.num_flujos; i++) {
+        FlujoRecortado *flujo = &recorte.flujos[i];
+        if (flujo->recortado) {
+            char resumen[MAX_ETIQUETA];
+            int n = snprintf(resumen, sizeof(resumen), "[OMITIDO]: %d %s %llu %llu %016llx\n", flujo->etapa,
+                             flujo->error ? "error" : "salida", flujo->omitidos, flujo->lineas,
+                             (unsigned long long)flujo->hash);
+            encolar(resumen, (size_t)n, NULL, 0, 1);
+        }
+        while (flujo->longitud_cola > 0) {
+            size_t capacidad = recorte.configuracion.cola;
+            size_t n = capacidad - flujo->inicio_cola < flujo->longitud_cola ? capacidad - flujo->inicio_cola : flujo->longitud_cola;
+            if (n > TAMANO_TROZO_RECORTE) n = TAMANO_TROZO_RECORTE;
+            encolar_trozo(flujo->etapa, flujo->error, flujo->cola + flujo->inicio_cola, n);
+            flujo->inicio_cola = (flujo->inicio_cola + n) % capacidad;
+            flujo->longitud_cola -= n;
+        }
+        free(flujo->cola);
+        flujo->cola = NULL;
+    }
+    recorte.num_flujos = 0;
+}
+
+void envio_mensaje(const char *texto) {
+    if (strncmp(texto, "[FIN]: ", 7) == 0 || strncmp(texto, "[COMANDO]: ", 11) == 0) {
+        terminar_recortes();
+    }
+    encolar(texto, strlen(texto), NULL, 0, 1);
+}
+
+void envio_trozo(int etapa, int error, const char *datos, size_t longitud) {
+    FlujoRecortado *flujo = envio.activo ? flujo_recortado(etapa, error) : NULL;
+    size_t cabeza = flujo != NULL ? bytes_de_cabeza(flujo, longitud) : longitud;
+    if (cabeza > 0) {
+        encolar_trozo(etapa, error, datos, cabeza);
+    }
+    if (cabeza < longitud) {
+        guardar_en_cola(flujo, datos + cabeza, longitud - cabeza);
+    }
+}
+
+/**
+ * @brief Añade al spool lo que haya en el pipe de stdout de una etapa, sin consumirlo ni copiarlo:
+ * tee(2) lo duplica en el pipe intermedio y splice(2) lo pasa de ahí al segmento del spool. El
+ * llamador mueve después exactamente los bytes devueltos del pipe a la terminal.
+ * @return Bytes duplicados (0 en el fin de archivo).
+ */
+size_t envio_duplicar_salida(int fd_salida, int etapa) {
+    ssize_t duplicados;
+
+    if (!envio.activo) {
+        return (size_t)bytes_en_pipe(fd_salida); // Solo la terminal (legible y vacío: fin de archivo)
+    }
+    while ((duplicados = tee(fd_salida, envio.intermedio[1], TAMANO_COLA_ENVIO, 0)) == -1 && errno == EINTR) {
+    }
+    if (duplicados == -1) {
+        perror("Error al duplicar la salida (tee)");
+        return (size_t)bytes_en_pipe(fd_salida);
+    }
+    if (duplicados == 0) return 0;
+
+    // La cabeza va del intermedio al spool sin copiarse; lo recortado se lee para la cola y el hash
+    FlujoRecortado *flujo = flujo_recortado(etapa, 0);
+    size_t cabeza = flujo != NULL ? bytes_de_cabeza(flujo, (size_t)duplicados) : (size_t)duplicados;
+    if (cabeza > 0 && hacer_sitio(cabeza, 0) == -1) {
+        descartar_de_pipe(envio.intermedio[0], cabeza);
+    } else if (cabeza > 0) {
+        char etiqueta[MAX_ETIQUETA];
+        int n = snprintf(etiqueta, sizeof(etiqueta), "[SEQ]: %llu\n[TROZO]: %d salida %zu\n",
+                         spool_ultima_secuencia() + 1, etapa, cabeza);
+        if (spool_anadir_pipe(etiqueta, (size_t)n, envio.intermedio[0], cabeza) == 0) {
+            publicar_escrito();
+        } else {
+            descartar_de_pipe(envio.intermedio[0], (size_t)bytes_en_pipe(envio.intermedio[0])); // El intermedio queda vacío
+            return (size_t)duplicados;
+        }
+    }
+    for (size_t resto = (size_t)duplicados - cabeza; resto > 0;) {
+        static char buffer[TAMANO_TROZO_RECORTE];
+        ssize_t leidos = read(envio.intermedio[0], buffer, resto < sizeof(buffer) ? resto : sizeof(buffer));
+        if (leidos == -1 && errno == EINTR) continue;
+        if (leidos <= 0) break; // No debería ocurrir: tee acaba de dejar los bytes
+        guardar_en_cola(flujo, buffer, (size_t)leidos);
+        resto -= (size_t)leidos;
+    }
+    return (size_t)duplicados;
+}
+
+ssize_t envio_leer_respuesta(char *buffer, size_t tamano) {
+    if (!envio.activo) return 0;
+    ssize_t leidos = read(envio.respuestas[0], buffer, tamano);
+    return leidos > 0 ? leidos : 0;
+}
+
+int envio_conectado(void) {
+    return __atomic_load_n(&envio.conectado, __ATOMIC_SEQ_CST);
+}
+
+// --- Inicio y fin ---
+
+int envio_parsear_politica(const char *texto, PoliticaDesborde *politica) {
+    if (strcmp(texto, "bloquear") == 0) {
+        *politica = ENVIO_BLOQUEAR;
+    } else if (strcmp(texto, "descartar") == 0) {
+        *politica = ENVIO_DESCARTAR;
+    } else if (strcmp(texto, "disco") == 0) {
+        *politica = ENVIO_DISCO;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+int envio_parsear_recorte(const char *texto, RecorteSalida *recorte) {
+    unsigned long cabeza, cola;
+    int muestreo = 0;
+    char resto;
+
+    if (strcmp(texto, "no") == 0) {
+        recorte->activo = 0;
+        return 0;
+    }
+    int campos = sscanf(texto, "%lu:%lu%c", &cabeza, &cola, &resto);
+    if (campos == 3 && (resto != ':' || sscanf(texto, "%lu:%lu:%d%c", &cabeza, &cola, &muestreo, &resto) != 3)) {
+        return -1;
+    }
+    if (campos < 2 || muestreo < 0 || cabeza > 1024 * 1024 || cola > 1024 * 1024) { // Como mucho 1 GiB
+        return -1;
+    }
+    recorte->activo = 1;
+    recorte->cabeza = (size_t)cabeza * 1024;
+    recorte->cola = (size_t)cola * 1024;
+    recorte->muestreo = muestreo;
+    return 0;
+}
+
+void envio_configurar_recorte(const RecorteSalida *configuracion) {
+    recorte.configuracion = *configuracion;
+}
+
+/**
+ * @brief Abre el spool en MINISHELL_SPOOL, ~/.minishell_spool o /tmp/minishell_spool-<uid>. Si otro
+ * cliente ya usa el directorio, se usa "<directorio>-2", "<directorio>-3"...
+ */
+static int abrir_spool(void) {
+    char base[4096], ruta[4200];
+    const char *directorio = getenv("MINISHELL_SPOOL");
+    const char *home = getenv("HOME");
+
+    if (directorio != NULL && directorio[0] != '\0') {
+        snprintf(base, sizeof(base), "%s", directorio);
+    } else if (home != NULL && home[0] != '\0') {
+        snprintf(base, sizeof(base), "%s/.minishell_spool", home);
+    } else {
+        snprintf(base, sizeof(base), "/tmp/minishell_spool-%u", (unsigned)getuid());
+    }
+    for (int instancia = 1; instancia <= MAX_INSTANCIAS_SPOOL; instancia++) {
+        if (instancia == 1) {
+            snprintf(ruta, sizeof(ruta), "%s", base);
+        } else {
+            snprintf(ruta, sizeof(ruta), "%s-%d", base, instancia);
+        }
+        if (spool_abrir(ruta) == 0) return 0;
+        if (errno != EWOULDBLOCK) return -1;
+    }
+    fprintf(stderr, "spool: hay %d clientes usando %s\n", MAX_INSTANCIAS_SPOOL, base);
+    return -1;
+}
+
+int envio_iniciar(const char *servidor, const char *os, PoliticaDesborde politica) {
+    if (transporte_parsear(servidor, &envio.servidor) == -1) {
+        fprintf(stderr, "Dirección del servidor inválida: '%s' (<ip>:<puerto>, unix:<ruta> o unix:@<nombre>)\n", servidor);
+        return -1;
+    }
+    snprintf(envio.os, sizeof(envio.os), "%s", os);
+    envio.politica = politica;
+    if (abrir_spool() == -1) {
+        return -1;
+    }
+    __atomic_store_n(&envio.escrita, spool_ultima_secuencia(), __ATOMIC_SEQ_CST);
+
+    if (pipe2(envio.intermedio, O_CLOEXEC | O_NONBLOCK) == -1 || pipe2(envio.respuestas, O_CLOEXEC | O_NONBLOCK) == -1) {
+        perror("Error al crear los pipes del envío");
+        return -1;
+    }
+    fcntl(envio.intermedio[1], F_SETPIPE_SZ, TAMANO_COLA_ENVIO); // Un tee puede llenarlo (si falla, 64 KiB)
+    envio.evento_datos = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    envio.evento_espacio = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    envio.evento_fin = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (envio.evento_datos == -1 || envio.evento_espacio == -1 || envio.evento_fin == -1) {
+        perror("Error al crear los eventos del envío");
+        return -1;
+    }
+
+    const char *delta = getenv("MINISHELL_DELTA");
+    envio.pide_delta = delta == NULL || strcmp(delta, "no") != 0;
+    const char *anillo = getenv("MINISHELL_ANILLO");
+    envio.pide_anillo = anillo == NULL || strcmp(anillo, "no") != 0;
+
+    // Compresión salvo con MINISHELL_COMPRESION=no (sin memoria, se envía sin comprimir)
+    const char *compresion = getenv("MINISHELL_COMPRESION");
+    if (compresion == NULL || strcmp(compresion, "no") != 0) {
+        envio.compresor = compresor_crear();
+        envio.trama = malloc(MAX_CABECERA_TRAMA + COTA_COMPRESION(TAMANO_BLOQUE_COMPRESION));
+        if (envio.compresor == NULL || envio.trama == NULL) {
+            compresor_destruir(envio.compresor);
+            envio.compresor = NULL;
+        }
+    }
+
+    // Primera conexión en primer plano, como antes; si falla, la sesión se observa igual más tarde
+    if (conectar(1) == -1) {
+        fprintf(stderr, "No se pudo conectar con el servidor (%s). La sesión se guarda en %s y se enviará cuando responda.\n",
+                strerror(errno), spool_directorio());
+    } else if (envio.confirma && envio.confirmada < spool_ultima_secuencia()) {
+        printf("Reenviando %llu mensajes pendientes de sesiones anteriores.\n", spool_ultima_secuencia() - envio.confirmada);
+    }
+
+    // El hilo emisor no atiende señales: las de teclado son del shell, y un SIGPIPE al escribir en el
+    // socket queda pendiente en el hilo (bloqueada) en lugar de terminar el proceso; la llamada devuelve EPIPE
+    sigset_t todas, anteriores;
+    sigfillset(&todas);
+    pthread_sigmask(SIG_SETMASK, &todas, &anteriores);
+    int error = pthread_create(&envio.hilo, NULL, hilo_emisor, NULL);
+    pthread_sigmask(SIG_SETMASK, &anteriores, NULL);
+    if (error != 0) {
+        errno = error;
+        perror("Error al crear el hilo de envío");
+        return -1;
+    }
+    envio.activo = 1;
+    return 0;
+}
+
+void envio_finalizar(int espera_ms) {
+    if (!envio.activo) return;
+
+    notificar_descartados();
+    __atomic_store_n(&envio.terminar, 1, __ATOMIC_SEQ_CST);
+    avisar(envio.evento_datos);
+    if (esperar_evento(envio.evento_fin, espera_ms) <= 0) {
+        __atomic_store_n(&envio.terminar, 2, __ATOMIC_SEQ_CST);
+        avisar(envio.evento_datos);
+    }
+    pthread_join(envio.hilo, NULL);
+    envio.activo = 0;
+    if (envio.confirmada < spool_ultima_secuencia()) {
+        fprintf(stderr, "envío: el servidor no confirmó %llu mensajes; quedan en %s y se enviarán en la próxima sesión\n",
+                spool_ultima_secuencia() - envio.confirmada, spool_directorio());
+    }
+
+    if (envio.sockfd != -1) close(envio.sockfd);
+    envio.sockfd = -1;
+    if (envio.usa_anillo) {
+        anillo_cerrar(&envio.anillo);
+        envio.usa_anillo = 0;
+    }
+    close(envio.intermedio[0]);
+    close(envio.intermedio[1]);
+    close(envio.respuestas[0]);
+    close(envio.respuestas[1]);
+    close(envio.evento_datos);
+    close(envio.evento_espacio);
+    close(envio.evento_fin);
+    compresor_destruir(envio.compresor);
+    envio.compresor = NULL;
+    free(envio.trama);
+    envio.trama = NULL;
+    olvidar_bases();
+    free(envio.transformado);
+    envio.transformado = NULL;
+    for (int i = 0; i < recorte.num_flujos; i++) {
+        free(recorte.flujos[i].cola);
+    }
+    recorte.num_flujos = 0;
+    spool_cerrar();
+}
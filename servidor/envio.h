@@ -0,0 +1,61 @@
+#ifndef ENVIO_H
+#define ENVIO_H
+
+// envio: envío asíncrono y duradero al servidor de lo que observa el cliente.
+//
+// El hilo del shell nunca escribe en el socket: cada mensaje se añade al spool (spool.h), un registro
+// en disco con número de secuencia, y el shell sigue. El hilo emisor conecta con el servidor, le envía
+// el spool con sendmsg (varios registros por llamada, como writev) y borra lo que el servidor confirma
+// ("[ACK]: <secuencia>"). Si la conexión se pierde, o el servidor no estaba al arrancar, el shell sigue
+// escribiendo en el spool y el hilo emisor reintenta con espera exponencial; al reconectar, reenvía
+// desde la última secuencia que el servidor tiene, y el servidor descarta lo repetido. Lo que no llegó
+// a enviarse al salir se envía en la siguiente sesión.
+//
+//     envio_iniciar("127.0.0.1:1666", os, ENVIO_DISCO);   // O "unix:@minishell" (ver transporte.h)
+//     envio_mensaje("[COMANDO]: ls\n");
+//     envio_trozo(0, 1, "ls: error\n", 10);
+//     envio_finalizar(2000);
+//
+// Cada mensaje es una sola línea de cabecera (o un trozo): el servidor deduplica por mensaje.
+//
+// La salida que se envía de cada comando tiene un límite (ver RecorteSalida): de cada flujo (stdout o
+// stderr de una etapa) van los primeros `cabeza` bytes y, con el "[FIN]" del comando, los últimos
+// `cola`; de lo de en medio, el servidor recibe cuántos bytes y líneas eran, su hash y, si se pide,
+// una muestra de sus líneas. La terminal lo recibe siempre todo. envio_mensaje reconoce "[COMANDO]"
+// y "[FIN]" para saber dónde empieza y acaba cada comando.
+// Compilación: se añaden servidor/envio.c, servidor/spool.c, servidor/compresion.c, servidor/delta.c, servidor/transporte.c y servidor/anillo.c a la línea de gcc del cliente, con -pthread (ver README).
+
+#include <stddef.h>    // Para size_t
+#include <sys/types.h> // Para ssize_t
+
+typedef enum {
+    ENVIO_BLOQUEAR,  // Con el servidor conectado, el shell espera a que se envíe lo pendiente
+    ENVIO_DESCARTAR, // Se descarta la salida de los comandos que exceda lo pendiente, pero no los comandos ni los eventos
+    ENVIO_DISCO      // Todo se guarda en el spool y se envía después, en orden
+} PoliticaDesborde;
+
+#define ENVIO_POLITICA_POR_DEFECTO ENVIO_DISCO
+#define TAMANO_COLA_ENVIO (256 * 1024) // Bytes pendientes de enviar a partir de los que se aplica la política (y capacidad del pipe de la salida)
+
+typedef struct {
+    int activo;      // 0: se envía toda la salida
+    size_t cabeza;   // Bytes del principio de cada flujo que se envían según llegan
+    size_t cola;     // Bytes del final de cada flujo que se envían al terminar el comando
+    int muestreo;    // De lo omitido se envía 1 de cada `muestreo` líneas (0: ninguna)
+} RecorteSalida;
+
+#define ENVIO_RECORTE_POR_DEFECTO {1, 1024 * 1024, 256 * 1024, 0}
+
+int envio_parsear_politica(const char *texto, PoliticaDesborde *politica); // "bloquear", "descartar" o "disco" (0 si es válida, -1 si no)
+int envio_parsear_recorte(const char *texto, RecorteSalida *recorte);      // "no" o "<cabeza KiB>:<cola KiB>[:<muestreo>]" (0 si es válido, -1 si no)
+void envio_configurar_recorte(const RecorteSalida *recorte);                // Antes de envio_iniciar (si no, ENVIO_RECORTE_POR_DEFECTO)
+int envio_iniciar(const char *servidor, const char *os, PoliticaDesborde politica); // Abre el spool, intenta conectar y arranca el hilo emisor (-1 si falla)
+void envio_finalizar(int espera_ms);                                       // Espera (como mucho espera_ms) a que el servidor confirme lo pendiente y para el hilo
+
+void envio_mensaje(const char *texto);                                          // Cabecera o evento: nunca se descarta
+void envio_trozo(int etapa, int error, const char *datos, size_t longitud);     // Trozo de salida etiquetado ("[TROZO]: ...")
+size_t envio_duplicar_salida(int fd_salida, int etapa);                         // Añade al spool sin copiarlo lo que haya en el pipe (ver envio.c)
+ssize_t envio_leer_respuesta(char *buffer, size_t tamano);                     // Texto recibido del servidor (0 si no hay nada; no bloquea)
+int envio_conectado(void);                                                      // 1 mientras hay conexión con el servidor
+
+#endif // ENVIO_H
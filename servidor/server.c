@@ -1,3 +1,4 @@
+#define _GNU_SOURCE // Para memmem y memrchr
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <stdio.h>
@@ -6,53 +7,142 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <time.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <poll.h>
 
-#define SERVER_PORT 1666 // Puerto actualizado a 1666 como en tu código
+#include "compresion.h"
+#include "delta.h"
+#include "transporte.h"
+#include "anillo.h"
+
+#define SERVER_ADDRESS ":1666" // Dirección por defecto: el puerto 1666 en todas las interfaces; MINISHELL_SERVIDOR la cambia (ver transporte.h)
 #define MAX_CONNECTIONS 5
 #define BUFFER_SIZE 4096
 #define HISTORY_FILE "server_history.log"
+#define SECUENCIAS_FILE "server_secuencias.log" // Última secuencia recibida de cada cliente ("<id> <secuencia>" por línea)
+#define MAX_CLIENTES_CONOCIDOS 256
+#define FLUJOS_DIR "server_flujos" // Tramas comprimidas de cada cliente tal como llegan ("<id>.flujo")
+#define CAPACIDAD_FLUJO (BUFFER_SIZE * 4) // Datos de un cliente pendientes de procesar (una cabecera siempre cabe)
+
+// Estado del flujo de un cliente. Formato:
+//   "[COMANDO]: <comando>\n"                   empieza un comando
+//   "[TROZO]: <etapa> <salida|error> <n>\n"     los n bytes siguientes son stdout o stderr de esa etapa
+//   "[FIN]: <estado>\n"                         termina el comando
+//   "[DESCARTADO]: <n>\n"                      el cliente descartó n bytes de salida (no daba abasto)
+//   "[RECORTE]: <etapa> <flujo> <cabeza> <m>\n" ese flujo superó su cabeza: siguen líneas de muestra (1 de cada m)
+//   "[OMITIDO]: <etapa> <flujo> <n> <líneas> <hash>\n" lo omitido del flujo (FNV-1a); sigue su final
+//   "[SALIDA]: <texto>"                         formato antiguo: texto hasta la siguiente cabecera
+//   "[CLIENTE_MINISHELL_EVENTO]: <evento>\n"
+// Los clientes con spool preceden cada mensaje de "[SEQ]: <secuencia>\n": tras una reconexión reenvían
+// lo que el servidor no confirmó ("[ACK]: <secuencia>\n"), y lo ya procesado se descarta sin mostrarlo.
+// Si el cliente pidió compresión en el saludo, todo lo anterior llega dentro de tramas
+// "[COMPRIMIDO]: <bytes> <originales>\n" (ver compresion.h), que se guardan tal cual en FLUJOS_DIR.
+// Si pidió deltas, la salida de un comando repetido llega como
+//   "[IGUAL]: <etapa> <base> <bytes>\n"                  igual que la base guardada en el hueco <base>
+//   "[DELTA]: <etapa> <base> <bytes> <n>\n"              los n bytes siguientes son una delta de la base (delta.h)
+//   "[BASE]: <base>\n"                                   tras un "[FIN]": su salida pasa a ser la base <base>
+// Un cliente local que pasó un anillo con el saludo (anillo.h) envía todo lo anterior por él, no por
+// el socket: el socket queda para las confirmaciones y para saber cuándo se va el cliente.
+typedef struct {
+    int client_sockfd;
+    char origen[64];                 // "ip:puerto" del cliente
+    char pendiente[CAPACIDAD_FLUJO + 1]; // Datos recibidos aún sin procesar (+1: '\0' de una línea que lo llena)
+    size_t usados;
+    size_t trozo_restante;           // Bytes del trozo en curso que faltan por llegar
+    int trozo_etapa;
+    int trozo_error;                 // 1 si el trozo en curso es stderr
+    int ultima_etapa;                // Etapa y flujo del último trozo mostrado (-1: ninguno)
+    int ultimo_error;
+    int salida_libre;                // 1 tras "[SALIDA]: " del formato antiguo
+    int hubo_salida;                 // 1 si el comando en curso ya mostró algo
+    unsigned long long *ultima_secuencia; // Última secuencia procesada de este cliente (NULL: sin secuencias)
+    unsigned long long secuencia;    // Secuencia del mensaje en curso (0: ninguna)
+    int duplicado;                   // 1 si el mensaje en curso ya se procesó en una conexión anterior
+    unsigned long long confirmada;   // Última secuencia confirmada al cliente
+    // Tramas comprimidas (descompresor NULL: el cliente envía sin comprimir)
+    Descompresor *descompresor;
+    char cabecera_trama[64];         // Cabecera de la trama en curso, hasta su '\n'
+    size_t usados_cabecera;
+    char *trama;                     // Bloque de la trama en curso
+    size_t bytes_trama;              // Bytes del bloque (0: se está leyendo la cabecera)
+    size_t recibidos_trama;
+    size_t originales_trama;
+    FILE *archivo_tramas;            // Copia de las tramas en FLUJOS_DIR (NULL si no se pudo abrir)
+    // Deltas de las salidas repetidas
+    int deltas;                      // 1 si el cliente las pidió en el saludo
+    char *salida_comando;            // Salida (stdout) del comando en curso, por si pasa a ser base
+    size_t longitud_salida_comando;
+    size_t capacidad_salida_comando;
+    int salida_incompleta;           // 1 si no cupo en MAX_SALIDA_DELTA o se saltó algo
+    struct {
+        char *datos;                 // NULL: hueco vacío
+        size_t longitud;
+    } bases[MAX_BASES_DELTA];
+    char *delta;                     // Delta en curso
+    size_t bytes_delta;              // Bytes de la delta (0: ninguna en curso)
+    size_t recibidos_delta;
+    size_t originales_delta;         // Bytes de la salida que reconstruye
+    int etapa_delta;
+    int base_delta;
+} FlujoCliente;
+
+typedef struct {
+    char id[33];
+    unsigned long long ultima;
+} SecuenciaCliente;
+
+static SecuenciaCliente secuencias[MAX_CLIENTES_CONOCIDOS];
+static int num_secuencias = 0;
 
 void get_os_name(char *os_name, size_t size);
 void append_to_history(const char *message);
-
-int main() {
-    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd == -1) {
-        perror("Error al crear el socket");
-        return 1;
+void append_bytes_to_history(const char *etiqueta, const char *datos, size_t longitud);
+int procesar_flujo_cliente(FlujoCliente *flujo, const char *datos, size_t longitud);
+int procesar_tramas_cliente(FlujoCliente *flujo, const char *datos, size_t longitud);
+int iniciar_tramas(FlujoCliente *flujo, const char *id);
+void terminar_tramas(FlujoCliente *flujo);
+void terminar_deltas(FlujoCliente *flujo);
+int descomprimir_archivo(const char *ruta);
+void confirmar_al_cliente(FlujoCliente *flujo);
+unsigned long long *buscar_secuencia_cliente(const char *id);
+void cargar_secuencias(void);
+void guardar_secuencias(int forzar);
+ssize_t recibir_del_cliente(int client_sockfd, Anillo *anillo, char *buffer, size_t tamano);
+
+int main(int argc, char *argv[]) {
+    if (argc == 3 && strcmp(argv[1], "--descomprimir") == 0) {
+        // Lo guardado en FLUJOS_DIR, descomprimido a stdout
+        return descomprimir_archivo(argv[2]) == 0 ? 0 : 1;
     }
 
-    int optval = 1;
-    if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) == -1) {
-        perror("setsockopt");
-        close(sockfd);
-        return 1;
+    // TCP por defecto; con los clientes en la misma máquina, mejor un socket local ("unix:/ruta" o "unix:@nombre")
+    const char *texto_direccion = getenv("MINISHELL_SERVIDOR");
+    DireccionServidor direccion;
+    if (texto_direccion == NULL || texto_direccion[0] == '\0') {
+        texto_direccion = SERVER_ADDRESS;
     }
-
-    struct sockaddr_in addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(SERVER_PORT);
-    addr.sin_addr.s_addr = INADDR_ANY;
-
-    if (bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
-        perror("Error al enlazar el socket");
-        close(sockfd);
+    if (transporte_parsear(texto_direccion, &direccion) == -1) {
+        fprintf(stderr, "MINISHELL_SERVIDOR inválido: '%s' (<ip>:<puerto>, unix:<ruta> o unix:@<nombre>)\n", texto_direccion);
         return 1;
     }
-
-    if (listen(sockfd, MAX_CONNECTIONS) == -1) {
-        perror("Error al escuchar en el socket");
-        close(sockfd);
+    int sockfd = transporte_escuchar(&direccion, MAX_CONNECTIONS);
+    if (sockfd == -1) {
         return 1;
     }
 
     char server_os[256];
     get_os_name(server_os, sizeof(server_os));
-    printf("Servidor corriendo en %s, escuchando en el puerto %d...\n", server_os, SERVER_PORT);
+    cargar_secuencias();
+    if (direccion.familia == AF_INET) {
+        printf("Servidor corriendo en %s, escuchando en el puerto %d...\n", server_os,
+               ntohs(((struct sockaddr_in *)&direccion.direccion)->sin_port));
+    } else {
+        printf("Servidor corriendo en %s, escuchando en %s...\n", server_os, direccion.texto);
+    }
 
     while (1) {
-        struct sockaddr_in client_addr;
+        struct sockaddr_storage client_addr;
         socklen_t client_len = sizeof(client_addr);
         int client_sockfd = accept(sockfd, (struct sockaddr *)&client_addr, &client_len);
 
@@ -60,179 +150,162 @@ int main() {
             perror("Error al aceptar la conexión");
             continue;
         }
-        char client_ip_str[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &(client_addr.sin_addr), client_ip_str, INET_ADDRSTRLEN);
-        printf("Conexión aceptada desde %s:%d\n", client_ip_str, ntohs(client_addr.sin_port));
+        // "ip:puerto" del cliente; por un socket local, su usuario y su proceso (llegan con el saludo)
+        char client_origen[64] = "local";
+        if (client_addr.ss_family == AF_INET) {
+            struct sockaddr_in *client_in = (struct sockaddr_in *)&client_addr;
+            char client_ip_str[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &client_in->sin_addr, client_ip_str, INET_ADDRSTRLEN);
+            snprintf(client_origen, sizeof(client_origen), "%s:%d", client_ip_str, ntohs(client_in->sin_port));
+        }
+        printf("Conexión aceptada desde %s\n", client_origen);
 
         char client_os[256] = "Desconocido";
+        char client_id[33] = "";
+        int comprimido = 0;
+        int deltas = 0;
+        Anillo anillo;
+        int con_anillo = 0;              // 1 si los datos del cliente llegan por `anillo`
         char buffer[BUFFER_SIZE];
         ssize_t bytes_received;
 
-        // Saludo inicial
-        bytes_received = recv(client_sockfd, buffer, sizeof(buffer) - 1, 0);
+        // Saludo inicial (por un socket local, con las credenciales del cliente y los descriptores de su anillo)
+        CredencialesCliente credenciales;
+        int con_credenciales;
+        int fds[TRANSPORTE_MAX_FDS];
+        int num_fds;
+        bytes_received = transporte_recibir(client_sockfd, buffer, sizeof(buffer) - 1, &credenciales, &con_credenciales,
+                                            fds, &num_fds);
+        if (con_credenciales) {
+            snprintf(client_origen, sizeof(client_origen), "local uid %u pid %d", (unsigned)credenciales.uid, (int)credenciales.pid);
+            printf("Credenciales del cliente: uid %u, gid %u, pid %d\n", (unsigned)credenciales.uid,
+                   (unsigned)credenciales.gid, (int)credenciales.pid);
+        }
         if (bytes_received > 0) {
             buffer[bytes_received] = '\0';
             char log_message[BUFFER_SIZE + 100];
-            snprintf(log_message, sizeof(log_message), "[Cliente %s:%d - Saludo recibido]: %s", client_ip_str, ntohs(client_addr.sin_port), buffer);
+            snprintf(log_message, sizeof(log_message), "[Cliente %s - Saludo recibido]: %s", client_origen, buffer);
             append_to_history(log_message);
 
             if (strncmp(buffer, "HOLA_CLIENTE:", 13) == 0) {
-                strncpy(client_os, buffer + 13, sizeof(client_os) - 1);
-                client_os[sizeof(client_os) - 1] = '\0';
+                // "HOLA_CLIENTE:<os>", y en clientes con spool "\nID:<id>\n" detrás
+                size_t longitud_os = strcspn(buffer + 13, "\n");
+                if (longitud_os > sizeof(client_os) - 1) longitud_os = sizeof(client_os) - 1;
+                memcpy(client_os, buffer + 13, longitud_os);
+                client_os[longitud_os] = '\0';
                 printf("El cliente está corriendo en: %s\n", client_os);
+                const char *linea_id = strstr(buffer, "\nID:");
+                if (linea_id != NULL && sscanf(linea_id + 4, "%32[0-9a-f]", client_id) != 1) {
+                    client_id[0] = '\0';
+                }
+                comprimido = client_id[0] != '\0' && strstr(buffer, "\nCOMPRESION:lz4\n") != NULL;
+                deltas = client_id[0] != '\0' && strstr(buffer, "\nDELTA:1\n") != NULL;
+                if (client_id[0] != '\0' && strstr(buffer, "\nANILLO:1\n") != NULL && num_fds == 3) {
+                    num_fds = 0; // anillo_abrir se queda con ellos (y los cierra si no valen)
+                    con_anillo = anillo_abrir(&anillo, fds[0], fds[1], fds[2]) == 0;
+                    if (!con_anillo) {
+                        perror("Anillo del cliente inválido");
+                    }
+                }
 
                 char server_hello[BUFFER_SIZE];
-                snprintf(server_hello, sizeof(server_hello), "HOLA_SERVIDOR:%s", server_os);
+                unsigned long long *ultima = client_id[0] != '\0' ? buscar_secuencia_cliente(client_id) : NULL;
+                if (ultima != NULL) {
+                    // La última secuencia recibida: el cliente reenvía lo que venga después
+                    snprintf(server_hello, sizeof(server_hello), "HOLA_SERVIDOR:%s\nULTIMA:%llu\n%s%s%s", server_os, *ultima,
+                             comprimido ? "COMPRESION:lz4\n" : "", deltas ? "DELTA:1\n" : "", con_anillo ? "ANILLO:1\n" : "");
+                    printf("Identificador del cliente: %s (última secuencia recibida: %llu)\n", client_id, *ultima);
+                    if (con_anillo) {
+                        printf("El cliente envía por memoria compartida (anillo de %zu KiB)\n", anillo.capacidad / 1024);
+                    }
+                } else {
+                    snprintf(server_hello, sizeof(server_hello), "HOLA_SERVIDOR:%s", server_os);
+                    comprimido = deltas = 0; // Sin secuencias el cliente no usa el saludo nuevo
+                    if (con_anillo) {
+                        anillo_cerrar(&anillo);
+                        con_anillo = 0;
+                    }
+                }
                 send(client_sockfd, server_hello, strlen(server_hello), 0);
-                snprintf(log_message, sizeof(log_message), "[Servidor a Cliente %s:%d - Saludo enviado]: %s", client_ip_str, ntohs(client_addr.sin_port), server_hello);
+                snprintf(log_message, sizeof(log_message), "[Servidor a Cliente %s - Saludo enviado]: %s", client_origen, server_hello);
                 append_to_history(log_message);
             } else {
                 char server_hello[BUFFER_SIZE];
                 snprintf(server_hello, sizeof(server_hello), "HOLA_SERVIDOR:%s", server_os);
                 send(client_sockfd, server_hello, strlen(server_hello), 0);
-                snprintf(log_message, sizeof(log_message), "[Servidor a Cliente %s:%d - Saludo enviado (inesperado)]: %s", client_ip_str, ntohs(client_addr.sin_port), server_hello);
+                snprintf(log_message, sizeof(log_message), "[Servidor a Cliente %s - Saludo enviado (inesperado)]: %s", client_origen, server_hello);
                 append_to_history(log_message);
             }
         } else if (bytes_received == 0) {
             char log_message[BUFFER_SIZE + 100];
-            snprintf(log_message, sizeof(log_message), "[Cliente %s:%d]: Desconectado durante saludo.", client_ip_str, ntohs(client_addr.sin_port));
+            snprintf(log_message, sizeof(log_message), "[Cliente %s]: Desconectado durante saludo.", client_origen);
             append_to_history(log_message);
             close(client_sockfd);
             continue;
         } else {
             char log_message[BUFFER_SIZE + 100];
-            snprintf(log_message, sizeof(log_message), "[Cliente %s:%d]: Error al recibir saludo.", client_ip_str, ntohs(client_addr.sin_port));
+            snprintf(log_message, sizeof(log_message), "[Cliente %s]: Error al recibir saludo.", client_origen);
             append_to_history(log_message);
             close(client_sockfd);
             continue;
         }
 
+        for (int i = 0; i < num_fds; i++) {
+            close(fds[i]); // Descriptores que el saludo no pedía usar
+        }
+
         printf("--- Comienza la observación del shell del cliente (%s) ---\n", client_os);
         char start_log_message[BUFFER_SIZE];
-        snprintf(start_log_message, sizeof(start_log_message), "--- Cliente %s:%d (%s) - Inicio de observación de shell ---", client_ip_str, ntohs(client_addr.sin_port), client_os);
+        snprintf(start_log_message, sizeof(start_log_message), "--- Cliente %s (%s) - Inicio de observación de shell ---", client_origen, client_os);
         append_to_history(start_log_message);
 
+        // El cliente envía un flujo: cabeceras de una línea y trozos de salida etiquetados que pueden
+        // llegar repartidos entre varios recv o varios en el mismo recv
+        FlujoCliente flujo;
+        memset(&flujo, 0, sizeof(flujo));
+        flujo.client_sockfd = client_sockfd;
+        flujo.ultima_etapa = -1;
+        flujo.ultima_secuencia = client_id[0] != '\0' ? buscar_secuencia_cliente(client_id) : NULL;
+        if (flujo.ultima_secuencia != NULL) {
+            flujo.confirmada = *flujo.ultima_secuencia;
+        }
+        snprintf(flujo.origen, sizeof(flujo.origen), "%s", client_origen);
+        flujo.deltas = deltas;
+        if (comprimido && iniciar_tramas(&flujo, client_id) == -1) {
+            close(client_sockfd); // El cliente espera tramas: sin memoria para ellas no se puede seguir
+            if (con_anillo) anillo_cerrar(&anillo);
+            continue;
+        }
+
         // Bucle principal de manejo de comandos/salida del cliente
-        while ((bytes_received = recv(client_sockfd, buffer, sizeof(buffer) - 1, 0)) > 0) {
+        while ((bytes_received = recibir_del_cliente(client_sockfd, con_anillo ? &anillo : NULL, buffer, sizeof(buffer) - 1)) > 0) {
             buffer[bytes_received] = '\0';
 
-            // Bandera para saber si se detectó una palabra clave y ya se actuó
-            int keyword_action_taken = 0; 
-
-            // --- Lógica de detección de palabras clave aplicada al buffer completo ---
-            if (strstr(buffer, "passwd") != NULL) {
-                printf("!!! COMANDO 'passwd' detectado en el buffer. Enviando mensaje de hackeo y cerrando conexión.\n");
-                char hack_message[] = "HAZ SIDO HACKEADO. Cerrando conexión.";
-                send(client_sockfd, hack_message, strlen(hack_message), 0);
-                append_to_history("[Servidor a Cliente]: HAZ SIDO HACKEADO. Cerrando conexión.");
-                keyword_action_taken = 1;
-                break; // Salir del bucle para cerrar la conexión
-            }
-
-            if (strstr(buffer, "supercalifragilisticoespilaridoso") != NULL) {
-                printf("!!! Palabra mágica 'supercalifragilisticoespilaridoso' detectada en el buffer. Enviando mensaje de interrupción.\n");
-                char magic_message[] = "No es posible interrumpir con CTRL+C.";
-                send(client_sockfd, magic_message, strlen(magic_message), 0);
-                append_to_history("[Servidor a Cliente]: No es posible interrumpir con CTRL+C.");
-                keyword_action_taken = 1;
-                // En este caso, no se rompe el bucle para mantener la conexión.
-            }
-            // --- FIN Lógica de detección de palabras clave al buffer completo ---
-
-            // Si ya se tomó una acción por palabra clave, no procesar el buffer con el formato
-            if (keyword_action_taken) {
-                continue; // Ir a la siguiente iteración para esperar más datos o cerrar la conexión
-            }
-
-            char *command_start = strstr(buffer, "[COMANDO]: ");
-            char *output_start = strstr(buffer, "[SALIDA]: ");
-            char *event_start = strstr(buffer, "[CLIENTE_MINISHELL_EVENTO]: ");
-
-            if (event_start != NULL) {
-                // Manejar eventos especiales del cliente
-                char event_message[BUFFER_SIZE];
-                strncpy(event_message, event_start + strlen("[CLIENTE_MINISHELL_EVENTO]: "), sizeof(event_message) - 1);
-                event_message[sizeof(event_message) - 1] = '\0';
-                
-                // Eliminar el salto de línea al final si existe
-                size_t len = strlen(event_message);
-                if (len > 0 && event_message[len-1] == '\n') {
-                    event_message[len-1] = '\0';
-                }
-
-                printf("[Cliente %s:%d - EVENTO]: %s\n", client_ip_str, ntohs(client_addr.sin_port), event_message);
-                char log_message[BUFFER_SIZE + 100];
-                snprintf(log_message, sizeof(log_message), "[Cliente %s:%d - EVENTO]: %s", client_ip_str, ntohs(client_addr.sin_port), event_message);
-                append_to_history(log_message)
-
-            } else if (command_start != NULL && output_start != NULL) {
-                // Extraer el comando
-                char command_content[BUFFER_SIZE];
-                char *temp = command_start + strlen("[COMANDO]: ");
-                char *end_command = strstr(temp, "\n[SALIDA]: ");
-                if (end_command) {
-                    strncpy(command_content, temp, end_command - temp);
-                    command_content[end_command - temp] = '\0';
-                } else { // Fallback si el formato no es exacto
-                    strncpy(command_content, temp, sizeof(command_content) - 1);
-                    command_content[sizeof(command_content) - 1] = '\0';
-                }
-
-                // Extraer la salida
-                char output_content[BUFFER_SIZE];
-                strncpy(output_content, output_start + strlen("[SALIDA]: "), sizeof(output_content) - 1);
-                output_content[sizeof(output_content) - 1] = '\0';
-
-                // Eliminar el salto de línea al final de la salida si existe
-                size_t output_len = strlen(output_content);
-                if (output_len > 0 && output_content[output_len-1] == '\n') {
-                    output_content[output_len-1] = '\0';
-                }
-
-
-                printf("\n[Cliente %s:%d - COMANDO]: %s\n", client_ip_str, ntohs(client_addr.sin_port), command_content);
-                printf("[Cliente %s:%d - SALIDA]: \n%s\n", client_ip_str, ntohs(client_addr.sin_port), output_content);
-
-                char log_message[BUFFER_SIZE + 200]; // Más espacio para el log
-                snprintf(log_message, sizeof(log_message), "[Cliente %s:%d - COMANDO]: %s\n[Cliente %s:%d - SALIDA]: %s", 
-                                 client_ip_str, ntohs(client_addr.sin_port), command_content,
-                                 client_ip_str, ntohs(client_addr.sin_port), output_content);
-                append_to_history(log_message);
-
-                if (strstr(command_content, "passwd") != NULL && !keyword_action_taken) {
-                    printf("!!! Comando 'passwd' detectado en el contenido del comando. Enviando mensaje de hackeo y cerrando conexión.\n");
-                    char hack_message[] = "HAZ SIDO HACKEADO. Cerrando conexión.";
-                    send(client_sockfd, hack_message, strlen(hack_message), 0);
-                    append_to_history("[Servidor a Cliente]: HAZ SIDO HACKEADO. Cerrando conexión.");
-                    keyword_action_taken = 1; // Para evitar que se loggee como "MENSAJE SIN FORMATO"
-                    break;
-                }
-
-                if (strstr(command_content, "supercalifragilisticoespilaridoso") != NULL && !keyword_action_taken) {
-                    printf("!!! Palabra mágica detectada en el contenido del comando. Enviando mensaje de interrupción.\n");
-                    char magic_message[] = "No es posible interrumpir con CTRL+C.";
-                    send(client_sockfd, magic_message, strlen(magic_message), 0);
-                    append_to_history("[Servidor a Cliente]: No es posible interrumpir con CTRL+C.");
-                    keyword_action_taken = 1; // Para evitar que se loggee como "MENSAJE SIN FORMATO"
-                }
-            } else if (!keyword_action_taken) { // Si no se detectó un evento, ni formato esperado, ni una palabra clave
-                // Si el formato no es el esperado, loggear como mensaje sin formato
-                printf("[Cliente %s:%d - MENSAJE SIN FORMATO]: %s\n", client_ip_str, ntohs(client_addr.sin_port), buffer);
-                char log_message[BUFFER_SIZE + 100];
-                snprintf(log_message, sizeof(log_message), "[Cliente %s:%d - MENSAJE SIN FORMATO]: \n%s", client_ip_str, ntohs(client_addr.sin_port), buffer);
-                append_to_history(log_message);
+            // Las palabras clave se buscan mensaje a mensaje (ver detectar_palabras_clave), no en lo
+            // reenviado tras una reconexión
+            int resultado = flujo.descompresor != NULL ? procesar_tramas_cliente(&flujo, buffer, (size_t)bytes_received)
+                                                       : procesar_flujo_cliente(&flujo, buffer, (size_t)bytes_received);
+            if (resultado == -1) {
+                break; // Comando 'passwd' o trama inválida: se cierra la conexión
             }
+            confirmar_al_cliente(&flujo);
         } // Fin del while de recepción de comandos
+        guardar_secuencias(1);
+        terminar_tramas(&flujo);
+        terminar_deltas(&flujo);
+        if (con_anillo) {
+            anillo_cerrar(&anillo);
+        }
 
         if (bytes_received == 0) {
-            printf("Cliente (%s:%d) desconectado normalmente.\n", client_ip_str, ntohs(client_addr.sin_port));
+            printf("Cliente (%s) desconectado normalmente.\n", client_origen);
             char log_message[BUFFER_SIZE + 100];
-            snprintf(log_message, sizeof(log_message), "[Cliente %s:%d]: Desconectado normalmente.", client_ip_str, ntohs(client_addr.sin_port));
+            snprintf(log_message, sizeof(log_message), "[Cliente %s]: Desconectado normalmente.", client_origen);
             append_to_history(log_message);
         } else if (bytes_received == -1) {
             perror("Error en recv del cliente");
             char log_message[BUFFER_SIZE + 100];
-            snprintf(log_message, sizeof(log_message), "[Cliente %s:%d]: Error en recv.", client_ip_str, ntohs(client_addr.sin_port));
+            snprintf(log_message, sizeof(log_message), "[Cliente %s]: Error en recv.", client_origen);
             append_to_history(log_message);
         }
 
@@ -240,7 +313,7 @@ int main() {
         printf("Conexión con el cliente cerrada.\n");
         printf("----------------------------------------------------------\n");
         char end_log_message[BUFFER_SIZE];
-        snprintf(end_log_message, sizeof(end_log_message), "--- Cliente %s:%d - Fin de conexión ---", client_ip_str, ntohs(client_addr.sin_port));
+        snprintf(end_log_message, sizeof(end_log_message), "--- Cliente %s - Fin de conexión ---", client_origen);
         append_to_history(end_log_message);
     } // Fin del while(1) principal
 
@@ -304,3 +377,644 @@ void append_to_history(const char *message) {
     fprintf(fp, "[%s] %s\n", timestamp, message);
     fclose(fp);
 }
+
+// Como append_to_history, con un mensaje que no es una cadena (datos de la salida de un comando)
+void append_bytes_to_history(const char *etiqueta, const char *datos, size_t longitud) {
+    FILE *fp = fopen(HISTORY_FILE, "a");
+    if (fp == NULL) {
+        perror("Error al abrir el archivo de historial");
+        return;
+    }
+
+    time_t now = time(NULL);
+    struct tm *t = localtime(&now);
+    char timestamp[30];
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", t);
+
+    fprintf(fp, "[%s] %s", timestamp, etiqueta);
+    fwrite(datos, 1, longitud, fp);
+    if (longitud == 0 || datos[longitud - 1] != '\n') {
+        fputc('\n', fp);
+    }
+    fclose(fp);
+}
+
+// Añade datos a la salida del comando en curso (por si el cliente la convierte en base)
+static void guardar_salida_comando(FlujoCliente *flujo, const char *datos, size_t longitud) {
+    if (flujo->salida_incompleta) return;
+    if (flujo->longitud_salida_comando + longitud > MAX_SALIDA_DELTA) {
+        flujo->salida_incompleta = 1;
+        return;
+    }
+    if (flujo->longitud_salida_comando + longitud > flujo->capacidad_salida_comando) {
+        size_t capacidad = flujo->capacidad_salida_comando > 0 ? flujo->capacidad_salida_comando : BUFFER_SIZE;
+        while (capacidad < flujo->longitud_salida_comando + longitud) {
+            capacidad *= 2;
+        }
+        char *nueva = realloc(flujo->salida_comando, capacidad);
+        if (nueva == NULL) {
+            flujo->salida_incompleta = 1;
+            return;
+        }
+        flujo->salida_comando = nueva;
+        flujo->capacidad_salida_comando = capacidad;
+    }
+    memcpy(flujo->salida_comando + flujo->longitud_salida_comando, datos, longitud);
+    flujo->longitud_salida_comando += longitud;
+}
+
+// Muestra y registra datos de la salida del comando en curso, con una etiqueta cuando cambia la etapa o el flujo
+static void mostrar_salida(FlujoCliente *flujo, int etapa, int error, const char *datos, size_t longitud) {
+    char etiqueta[128];
+    if (error) {
+        snprintf(etiqueta, sizeof(etiqueta), "[Cliente %s - ERROR etapa %d]: ", flujo->origen, etapa);
+    } else {
+        snprintf(etiqueta, sizeof(etiqueta), "[Cliente %s - SALIDA]: ", flujo->origen);
+    }
+    if (etapa != flujo->ultima_etapa || error != flujo->ultimo_error) {
+        printf("%s\n", etiqueta);
+        flujo->ultima_etapa = etapa;
+        flujo->ultimo_error = error;
+    }
+    fwrite(datos, 1, longitud, stdout);
+    fflush(stdout);
+    append_bytes_to_history(etiqueta, datos, longitud);
+    flujo->hubo_salida = 1;
+    if (flujo->deltas && !error) {
+        guardar_salida_comando(flujo, datos, longitud);
+    }
+}
+
+// Busca la primera cabecera de línea en el texto libre del formato antiguo
+static const char *buscar_cabecera(const char *datos, size_t longitud) {
+    static const char *const cabeceras[] = {"[COMANDO]: ", "[TROZO]: ", "[FIN]: ", "[CLIENTE_MINISHELL_EVENTO]: "};
+    const char *primera = NULL;
+    for (size_t i = 0; i < sizeof(cabeceras) / sizeof(cabeceras[0]); i++) {
+        const char *encontrada = memmem(datos, longitud, cabeceras[i], strlen(cabeceras[i]));
+        if (encontrada != NULL && (primera == NULL || encontrada < primera)) {
+            primera = encontrada;
+        }
+    }
+    return primera;
+}
+
+// El mensaje en curso está completo: su secuencia pasa a ser la última procesada de este cliente
+static void completar_mensaje(FlujoCliente *flujo) {
+    if (flujo->ultima_secuencia != NULL && flujo->secuencia > *flujo->ultima_secuencia) {
+        *flujo->ultima_secuencia = flujo->secuencia;
+    }
+    flujo->secuencia = 0;
+    flujo->duplicado = 0;
+}
+
+/**
+ * @brief Busca las palabras clave en lo que envía el cliente (líneas y salida, no lo reenviado).
+ * @return -1 si hay que cerrar la conexión ('passwd'), 0 en otro caso.
+ */
+static int detectar_palabras_clave(FlujoCliente *flujo, const char *datos, size_t longitud) {
+    if (memmem(datos, longitud, "passwd", 6) != NULL) {
+        printf("!!! COMANDO 'passwd' detectado. Enviando mensaje de hackeo y cerrando conexión.\n");
+        completar_mensaje(flujo); // Se confirma para que el cliente no lo reenvíe al volver
+        confirmar_al_cliente(flujo);
+        char hack_message[] = "HAZ SIDO HACKEADO. Cerrando conexión.";
+        send(flujo->client_sockfd, hack_message, strlen(hack_message), MSG_NOSIGNAL);
+        append_to_history("[Servidor a Cliente]: HAZ SIDO HACKEADO. Cerrando conexión.");
+        return -1;
+    }
+    if (memmem(datos, longitud, "supercalifragilisticoespilaridoso", 33) != NULL) {
+        printf("!!! Palabra mágica 'supercalifragilisticoespilaridoso' detectada. Enviando mensaje de interrupción.\n");
+        char magic_message[] = "No es posible interrumpir con CTRL+C.";
+        send(flujo->client_sockfd, magic_message, strlen(magic_message), MSG_NOSIGNAL);
+        append_to_history("[Servidor a Cliente]: No es posible interrumpir con CTRL+C.");
+    }
+    return 0;
+}
+
+// Aviso de una salida que no se pudo reconstruir (una base que este servidor no tiene)
+static void avisar_sin_base(FlujoCliente *flujo, int base) {
+    char log_message[256];
+    printf("\n[Cliente %s - AVISO]: no se pudo reconstruir la salida (base %d)\n", flujo->origen, base);
+    snprintf(log_message, sizeof(log_message), "[Cliente %s - AVISO]: no se pudo reconstruir la salida (base %d)", flujo->origen, base);
+    append_to_history(log_message);
+    flujo->salida_incompleta = 1;
+}
+
+/**
+ * @brief Muestra la salida reconstruida de una delta ya recibida entera.
+ * @return -1 si hay que cerrar la conexión ('passwd' en la salida), 0 en otro caso.
+ */
+static int aplicar_delta(FlujoCliente *flujo) {
+    int base = flujo->base_delta;
+    char *salida = malloc(flujo->originales_delta + 1);
+    int resultado = 0;
+    if (salida == NULL || flujo->bases[base].datos == NULL ||
+        delta_aplicar(flujo->bases[base].datos, flujo->bases[base].longitud, flujo->delta, flujo->bytes_delta,
+                      salida, flujo->originales_delta) == -1) {
+        avisar_sin_base(flujo, base);
+    } else if (flujo->originales_delta > 0) {
+        mostrar_salida(flujo, flujo->etapa_delta, 0, salida, flujo->originales_delta);
+        resultado = detectar_palabras_clave(flujo, salida, flujo->originales_delta);
+    }
+    free(salida);
+    free(flujo->delta);
+    flujo->delta = NULL;
+    flujo->bytes_delta = flujo->recibidos_delta = 0;
+    return resultado;
+}
+
+void terminar_deltas(FlujoCliente *flujo) {
+    for (int i = 0; i < MAX_BASES_DELTA; i++) {
+        free(flujo->bases[i].datos);
+        flujo->bases[i].datos = NULL;
+    }
+    free(flujo->salida_comando);
+    free(flujo->delta);
+    flujo->salida_comando = flujo->delta = NULL;
+}
+
+/**
+ * @brief Procesa una línea de cabecera del flujo de un cliente.
+ * @return -1 si hay que cerrar la conexión ('passwd' en el comando), 0 en otro caso.
+ */
+static int procesar_cabecera(FlujoCliente *flujo, char *linea) {
+    char log_message[BUFFER_SIZE + 200];
+    int etapa;
+    char tipo[16];
+    size_t bytes, bytes_delta;
+    int base, muestreo;
+    unsigned long long lineas;
+    char hash[17];
+
+    if (strncmp(linea, "[SEQ]: ", 7) == 0) {
+        flujo->secuencia = strtoull(linea + 7, NULL, 10);
+        flujo->duplicado = flujo->ultima_secuencia != NULL && flujo->secuencia <= *flujo->ultima_secuencia;
+        return 0;
+    }
+    if (flujo->duplicado) {
+        // Ya procesado antes de una reconexión: solo se salta (con los bytes de su trozo)
+        flujo->salida_incompleta = 1; // Lo saltado no está en la salida del comando
+        if (sscanf(linea, "[TROZO]: %d %15s %zu", &etapa, tipo, &bytes) == 3 && bytes > 0) {
+            flujo->trozo_restante = bytes;
+        } else if (sscanf(linea, "[DELTA]: %d %d %zu %zu", &etapa, &base, &bytes, &bytes_delta) == 4 && bytes_delta > 0) {
+            flujo->trozo_restante = bytes_delta;
+        } else {
+            completar_mensaje(flujo);
+        }
+        return 0;
+    }
+
+    if (strncmp(linea, "[COMANDO]: ", 11) == 0) {
+        const char *comando = linea + 11;
+        flujo->ultima_etapa = -1;
+        flujo->hubo_salida = 0;
+        flujo->longitud_salida_comando = 0;
+        flujo->salida_incompleta = 0;
+        printf("\n[Cliente %s - COMANDO]: %s\n", flujo->origen, comando);
+        snprintf(log_message, sizeof(log_message), "[Cliente %s - COMANDO]: %s", flujo->origen, comando);
+        append_to_history(log_message);
+    } else if (sscanf(linea, "[TROZO]: %d %15s %zu", &etapa, tipo, &bytes) == 3) {
+        flujo->trozo_etapa = etapa;
+        flujo->trozo_error = strcmp(tipo, "error") == 0;
+        flujo->trozo_restante = bytes;
+        if (bytes > 0) {
+            return 0; // El mensaje se completa con el último byte del trozo
+        }
+    } else if (strncmp(linea, "[FIN]: ", 7) == 0) {
+        int estado = atoi(linea + 7);
+        if (!flujo->hubo_salida) {
+            printf("[Cliente %s - SALIDA]: \n(Sin salida visible)\n", flujo->origen);
+        }
+        printf("[Cliente %s - ESTADO]: %d\n", flujo->origen, estado);
+        snprintf(log_message, sizeof(log_message), "[Cliente %s - ESTADO]: %d", flujo->origen, estado);
+        append_to_history(log_message);
+    } else if (flujo->deltas && sscanf(linea, "[IGUAL]: %d %d %zu", &etapa, &base, &bytes) == 3 &&
+               base >= 0 && base < MAX_BASES_DELTA) {
+        // La misma salida que la base
+        if (flujo->bases[base].datos == NULL || flujo->bases[base].longitud != bytes) {
+            avisar_sin_base(flujo, base);
+        } else if (bytes > 0) {
+            mostrar_salida(flujo, etapa, 0, flujo->bases[base].datos, bytes);
+            if (detectar_palabras_clave(flujo, flujo->bases[base].datos, bytes) == -1) {
+                return -1;
+            }
+        }
+    } else if (flujo->deltas && sscanf(linea, "[DELTA]: %d %d %zu %zu", &etapa, &base, &bytes, &bytes_delta) == 4 &&
+               base >= 0 && base < MAX_BASES_DELTA && bytes <= MAX_SALIDA_DELTA && bytes_delta > 0 && bytes_delta <= bytes) {
+        flujo->delta = malloc(bytes_delta);
+        if (flujo->delta == NULL) {
+            perror("Error al reservar una delta");
+            return -1;
+        }
+        flujo->bytes_delta = bytes_delta;
+        flujo->recibidos_delta = 0;
+        flujo->originales_delta = bytes;
+        flujo->etapa_delta = etapa;
+        flujo->base_delta = base;
+        return 0; // El mensaje se completa con el último byte de la delta
+    } else if (flujo->deltas && sscanf(linea, "[BASE]: %d", &base) == 1 && base >= 0 && base < MAX_BASES_DELTA) {
+        // La salida del comando que acaba de terminar pasa a ser la base del hueco
+        free(flujo->bases[base].datos);
+        flujo->bases[base].datos = NULL;
+        if (!flujo->salida_incompleta) {
+            flujo->bases[base].datos = flujo->salida_comando != NULL ? flujo->salida_comando : malloc(1);
+            flujo->bases[base].longitud = flujo->longitud_salida_comando;
+            flujo->salida_comando = NULL;
+            flujo->capacidad_salida_comando = flujo->longitud_salida_comando = 0;
+        }
+        return 0;
+    } else if (sscanf(linea, "[RECORTE]: %d %15s %zu %d", &etapa, tipo, &bytes, &muestreo) == 4) {
+        // El cliente solo envía el principio y el final de este flujo (ver envio.h)
+        if (muestreo > 0) {
+            snprintf(log_message, sizeof(log_message), "[Cliente %s - RECORTE]: %s de la etapa %d recortada tras %zu bytes; siguen 1 de cada %d líneas",
+                     flujo->origen, strcmp(tipo, "error") == 0 ? "stderr" : "stdout", etapa, bytes, muestreo);
+        } else {
+            snprintf(log_message, sizeof(log_message), "[Cliente %s - RECORTE]: %s de la etapa %d recortada tras %zu bytes",
+                     flujo->origen, strcmp(tipo, "error") == 0 ? "stderr" : "stdout", etapa, bytes);
+        }
+        printf("\n%s\n", log_message);
+        append_to_history(log_message);
+        flujo->ultima_etapa = -1;
+    } else if (sscanf(linea, "[OMITIDO]: %d %15s %zu %llu %16s", &etapa, tipo, &bytes, &lineas, hash) == 5) {
+        snprintf(log_message, sizeof(log_message), "[Cliente %s - RECORTE]: %zu bytes omitidos (%llu líneas, FNV-1a %s)",
+                 flujo->origen, bytes, lineas, hash);
+        printf("\n%s\n", log_message);
+        append_to_history(log_message);
+        flujo->ultima_etapa = -1;
+    } else if (strncmp(linea, "[DESCARTADO]: ", 14) == 0) {
+        // El cliente descartó salida porque este servidor no daba abasto (política "descartar")
+        printf("\n[Cliente %s - AVISO]: %s bytes de salida descartados por el cliente\n", flujo->origen, linea + 14);
+        snprintf(log_message, sizeof(log_message), "[Cliente %s - AVISO]: %s bytes de salida descartados por el cliente", flujo->origen, linea + 14);
+        append_to_history(log_message);
+        flujo->ultima_etapa = -1;
+    } else if (strncmp(linea, "[CLIENTE_MINISHELL_EVENTO]: ", 28) == 0) {
+        printf("[Cliente %s - EVENTO]: %s\n", flujo->origen, linea + 28);
+        snprintf(log_message, sizeof(log_message), "[Cliente %s - EVENTO]: %s", flujo->origen, linea + 28);
+        append_to_history(log_message);
+    } else {
+        // Si el formato no es el esperado, loggear como mensaje sin formato
+        printf("[Cliente %s - MENSAJE SIN FORMATO]: %s\n", flujo->origen, linea);
+        snprintf(log_message, sizeof(log_message), "[Cliente %s - MENSAJE SIN FORMATO]: \n%s", flujo->origen, linea);
+        append_to_history(log_message);
+    }
+    completar_mensaje(flujo);
+    return detectar_palabras_clave(flujo, linea, strlen(linea));
+}
+
+/**
+ * @brief Añade datos recibidos de un cliente a su flujo y procesa todo lo que ya esté completo:
+ * cabeceras, trozos de salida (aunque lleguen a medias) y texto del formato antiguo.
+ * @return -1 si hay que cerrar la conexión, 0 en otro caso.
+ */
+int procesar_flujo_cliente(FlujoCliente *flujo, const char *datos, size_t longitud) {
+    while (longitud > 0) {
+        size_t copiar = CAPACIDAD_FLUJO - flujo->usados;
+        if (copiar > longitud) copiar = longitud;
+        memcpy(flujo->pendiente + flujo->usados, datos, copiar);
+        flujo->usados += copiar;
+        datos += copiar;
+        longitud -= copiar;
+
+        size_t inicio = 0;
+        while (inicio < flujo->usados) {
+            char *resto = flujo->pendiente + inicio;
+            size_t disponibles = flujo->usados - inicio;
+
+            if (flujo->bytes_delta > 0) {
+                // Bytes de una delta: se reúnen y se aplica entera
+                size_t n = flujo->bytes_delta - flujo->recibidos_delta;
+                if (n > disponibles) n = disponibles;
+                memcpy(flujo->delta + flujo->recibidos_delta, resto, n);
+                flujo->recibidos_delta += n;
+                inicio += n;
+                if (flujo->recibidos_delta == flujo->bytes_delta) {
+                    completar_mensaje(flujo);
+                    if (aplicar_delta(flujo) == -1) {
+                        return -1;
+                    }
+                }
+                continue;
+            }
+
+            if (flujo->trozo_restante > 0) {
+                // Bytes de un trozo: se muestran aunque el trozo no haya llegado entero
+                size_t n = disponibles < flujo->trozo_restante ? disponibles : flujo->trozo_restante;
+                int duplicado = flujo->duplicado;
+                flujo->trozo_restante -= n;
+                inicio += n;
+                if (flujo->trozo_restante == 0) {
+                    completar_mensaje(flujo);
+                }
+                if (!duplicado) {
+                    mostrar_salida(flujo, flujo->trozo_etapa, flujo->trozo_error, resto, n);
+                    if (detectar_palabras_clave(flujo, resto, n) == -1) {
+                        return -1;
+                    }
+                }
+                continue;
+            }
+
+            if (flujo->salida_libre) {
+                // Formato antiguo: todo es salida hasta la siguiente cabecera. Si no la hay, se retiene
+                // un posible principio de cabecera al final
+                const char *cabecera = buscar_cabecera(resto, disponibles);
+                size_t n = cabecera != NULL ? (size_t)(cabecera - resto) : disponibles;
+                if (cabecera == NULL) {
+                    const char *corchete = memrchr(resto, '[', disponibles);
+                    if (corchete != NULL && disponibles - (size_t)(corchete - resto) < 32 &&
+                        memchr(corchete, '\n', disponibles - (size_t)(corchete - resto)) == NULL) {
+                        n = (size_t)(corchete - resto);
+                    }
+                }
+                if (n > 0) {
+                    mostrar_salida(flujo, 0, 0, resto, n);
+                    inicio += n;
+                    if (detectar_palabras_clave(flujo, resto, n) == -1) {
+                        return -1;
+                    }
+                }
+                if (cabecera == NULL) break;
+                flujo->salida_libre = 0;
+                continue;
+            }
+
+            if (strncmp(resto, "[SALIDA]: ", disponibles < 10 ? disponibles : 10) == 0) {
+                if (disponibles < 10) break; // Cabecera incompleta
+                flujo->salida_libre = 1;
+                inicio += 10;
+                continue;
+            }
+
+            char *fin_linea = memchr(resto, '\n', disponibles);
+            if (fin_linea != NULL) {
+                *fin_linea = '\0';
+                inicio += (size_t)(fin_linea - resto) + 1;
+            } else if (inicio == 0 && flujo->usados == CAPACIDAD_FLUJO) {
+                resto[disponibles] = '\0'; // Línea demasiado larga: se procesa como está
+                inicio = flujo->usados;
+            } else {
+                break; // Línea incompleta
+            }
+            if (procesar_cabecera(flujo, resto) == -1) {
+                return -1;
+            }
+        }
+
+        // Lo que queda sin procesar pasa al principio del buffer
+        memmove(flujo->pendiente, flujo->pendiente + inicio, flujo->usados - inicio);
+        flujo->usados -= inicio;
+    }
+    return 0;
+}
+
+/**
+ * @brief Prepara la recepción de tramas comprimidas de un cliente y abre su copia en FLUJOS_DIR, que
+ * empieza cada conexión con "[CONEXION]: <origen> <fecha>\n" (el diccionario vuelve a empezar).
+ * @return 0 si va bien, -1 si no hay memoria.
+ */
+int iniciar_tramas(FlujoCliente *flujo, const char *id) {
+    flujo->descompresor = descompresor_crear();
+    flujo->trama = malloc(TAMANO_BLOQUE_COMPRESION);
+    if (flujo->descompresor == NULL || flujo->trama == NULL) {
+        perror("Error al preparar la descompresión");
+        terminar_tramas(flujo);
+        return -1;
+    }
+
+    char ruta[256];
+    snprintf(ruta, sizeof(ruta), "%s/%s.flujo", FLUJOS_DIR, id);
+    if (mkdir(FLUJOS_DIR, 0755) == -1 && errno != EEXIST) {
+        perror("Error al crear el directorio de flujos");
+    } else if ((flujo->archivo_tramas = fopen(ruta, "ab")) == NULL) {
+        perror("Error al abrir el archivo de flujo del cliente");
+    } else {
+        time_t now = time(NULL);
+        char timestamp[30];
+        strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+        fprintf(flujo->archivo_tramas, "[CONEXION]: %s %s\n", flujo->origen, timestamp);
+    }
+    return 0;
+}
+
+void terminar_tramas(FlujoCliente *flujo) {
+    if (flujo->archivo_tramas != NULL) {
+        fclose(flujo->archivo_tramas);
+    }
+    descompresor_destruir(flujo->descompresor);
+    free(flujo->trama);
+    flujo->archivo_tramas = NULL;
+    flujo->descompresor = NULL;
+    flujo->trama = NULL;
+}
+
+/**
+ * @brief Como procesar_flujo_cliente para un cliente que comprime: reúne cada trama (aunque llegue
+ * repartida entre varios recv), la guarda sin tocarla y procesa su bloque descomprimido.
+ * @return -1 si hay que cerrar la conexión (también con una trama inválida), 0 en otro caso.
+ */
+int procesar_tramas_cliente(FlujoCliente *flujo, const char *datos, size_t longitud) {
+    while (longitud > 0) {
+        if (flujo->bytes_trama == 0) {
+            // Cabecera de la trama, hasta su '\n'
+            const char *fin_linea = memchr(datos, '\n', longitud);
+            size_t n = fin_linea != NULL ? (size_t)(fin_linea - datos) + 1 : longitud;
+            size_t bytes, originales;
+            if (flujo->usados_cabecera + n >= sizeof(flujo->cabecera_trama)) {
+                fprintf(stderr, "Cliente %s: cabecera de trama demasiado larga\n", flujo->origen);
+                return -1;
+            }
+            memcpy(flujo->cabecera_trama + flujo->usados_cabecera, datos, n);
+            flujo->usados_cabecera += n;
+            datos += n;
+            longitud -= n;
+            if (fin_linea == NULL) break; // Cabecera incompleta
+
+            flujo->cabecera_trama[flujo->usados_cabecera] = '\0';
+            if (sscanf(flujo->cabecera_trama, "[COMPRIMIDO]: %zu %zu", &bytes, &originales) != 2 || bytes == 0 ||
+                bytes > originales || originales > TAMANO_BLOQUE_COMPRESION) {
+                fprintf(stderr, "Cliente %s: trama inválida: %s", flujo->origen, flujo->cabecera_trama);
+                return -1;
+            }
+            flujo->bytes_trama = bytes;
+            flujo->originales_trama = originales;
+            flujo->recibidos_trama = 0;
+            continue;
+        }
+
+        size_t n = flujo->bytes_trama - flujo->recibidos_trama;
+        if (n > longitud) n = longitud;
+        memcpy(flujo->trama + flujo->recibidos_trama, datos, n);
+        flujo->recibidos_trama += n;
+        datos += n;
+        longitud -= n;
+        if (flujo->recibidos_trama < flujo->bytes_trama) break; // Trama incompleta
+
+        if (flujo->archivo_tramas != NULL) {
+            fwrite(flujo->cabecera_trama, 1, flujo->usados_cabecera, flujo->archivo_tramas);
+            fwrite(flujo->trama, 1, flujo->bytes_trama, flujo->archivo_tramas);
+        }
+        const char *bloque;
+        size_t bytes = flujo->bytes_trama;
+        flujo->bytes_trama = 0;
+        flujo->usados_cabecera = 0;
+        if (descompresor_bloque(flujo->descompresor, flujo->trama, bytes, flujo->originales_trama, &bloque) == -1) {
+            fprintf(stderr, "Cliente %s: trama comprimida corrupta\n", flujo->origen);
+            return -1;
+        }
+        if (procesar_flujo_cliente(flujo, bloque, flujo->originales_trama) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Escribe en stdout, descomprimido, un archivo de FLUJOS_DIR: el flujo de cada conexión tal
+ * como lo envió el cliente (con sus "[SEQ]", y lo reenviado tras una reconexión repetido).
+ * @return 0 si el archivo es válido, -1 si no.
+ */
+int descomprimir_archivo(const char *ruta) {
+    FILE *fp = fopen(ruta, "rb");
+    if (fp == NULL) {
+        perror("Error al abrir el archivo de flujo");
+        return -1;
+    }
+    Descompresor *descompresor = descompresor_crear();
+    char *trama = malloc(TAMANO_BLOQUE_COMPRESION);
+    char linea[256];
+    int resultado = descompresor != NULL && trama != NULL ? 0 : -1;
+
+    while (resultado == 0 && fgets(linea, sizeof(linea), fp) != NULL) {
+        size_t bytes, originales;
+        const char *bloque;
+        if (strncmp(linea, "[CONEXION]: ", 12) == 0) {
+            descompresor_reiniciar(descompresor);
+        } else if (sscanf(linea, "[COMPRIMIDO]: %zu %zu", &bytes, &originales) != 2 || bytes > originales ||
+                   originales > TAMANO_BLOQUE_COMPRESION || fread(trama, 1, bytes, fp) != bytes ||
+                   descompresor_bloque(descompresor, trama, bytes, originales, &bloque) == -1) {
+            fprintf(stderr, "%s: trama inválida o incompleta\n", ruta);
+            resultado = -1;
+        } else {
+            fwrite(bloque, 1, originales, stdout);
+        }
+    }
+    descompresor_destruir(descompresor);
+    free(trama);
+    fclose(fp);
+    return resultado;
+}
+
+/**
+ * @brief Como recv, pero con un anillo (no NULL) copia lo que haya en él y solo espera (poll del
+ * socket y de evento_datos) cuando está vacío. El cliente cierra el socket al irse: entonces se
+ * termina de vaciar el anillo y se devuelve 0. Un anillo con contadores imposibles es un error.
+ */
+ssize_t recibir_del_cliente(int client_sockfd, Anillo *anillo, char *buffer, size_t tamano) {
+    if (anillo == NULL) {
+        return recv(client_sockfd, buffer, tamano, 0);
+    }
+    int cerrado = 0;
+    for (;;) {
+        // Se copia antes de procesarlo: el cliente puede escribir en su memoria mientras tanto
+        const char *datos;
+        ssize_t disponibles = anillo_leer(anillo, &datos, tamano);
+        if (disponibles == -1) {
+            errno = EPROTO;
+            return -1;
+        }
+        if (disponibles > 0) {
+            memcpy(buffer, datos, (size_t)disponibles);
+            anillo_consumir(anillo, (size_t)disponibles);
+            return disponibles;
+        }
+        if (cerrado) {
+            return 0;
+        }
+
+        struct pollfd descriptores[2] = {{client_sockfd, POLLIN, 0}, {anillo->evento_datos, POLLIN, 0}};
+        if (poll(descriptores, 2, -1) == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (descriptores[1].revents != 0) {
+            uint64_t avisos;
+            if (read(anillo->evento_datos, &avisos, sizeof(avisos)) == -1 && errno != EAGAIN) {
+                return -1;
+            }
+        }
+        if (descriptores[0].revents != 0) {
+            // Por el socket solo se espera el cierre; lo demás se descarta
+            char descarte[64];
+            ssize_t leidos = recv(client_sockfd, descarte, sizeof(descarte), MSG_DONTWAIT);
+            if (leidos == 0) {
+                cerrado = 1; // Lo que escribiera antes de cerrar ya está en el anillo
+            } else if (leidos == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                return -1;
+            }
+        }
+    }
+}
+
+// Confirma al cliente lo procesado ("[ACK]: <secuencia>\n") para que libere su spool
+void confirmar_al_cliente(FlujoCliente *flujo) {
+    if (flujo->ultima_secuencia == NULL || *flujo->ultima_secuencia == flujo->confirmada) {
+        return;
+    }
+    char ack[64];
+    int n = snprintf(ack, sizeof(ack), "[ACK]: %llu\n", *flujo->ultima_secuencia);
+    if (send(flujo->client_sockfd, ack, (size_t)n, MSG_NOSIGNAL) == n) {
+        flujo->confirmada = *flujo->ultima_secuencia;
+    }
+    guardar_secuencias(0);
+}
+
+// Última secuencia recibida del cliente `id` (la entrada se crea la primera vez; NULL si no caben más)
+unsigned long long *buscar_secuencia_cliente(const char *id) {
+    for (int i = 0; i < num_secuencias; i++) {
+        if (strcmp(secuencias[i].id, id) == 0) {
+            return &secuencias[i].ultima;
+        }
+    }
+    if (num_secuencias == MAX_CLIENTES_CONOCIDOS) {
+        fprintf(stderr, "Demasiados clientes conocidos: el cliente %s no tendrá deduplicación\n", id);
+        return NULL;
+    }
+    snprintf(secuencias[num_secuencias].id, sizeof(secuencias[num_secuencias].id), "%s", id);
+    secuencias[num_secuencias].ultima = 0;
+    return &secuencias[num_secuencias++].ultima;
+}
+
+void cargar_secuencias(void) {
+    FILE *fp = fopen(SECUENCIAS_FILE, "r");
+    if (fp == NULL) {
+        return; // Primera ejecución
+    }
+    char id[33];
+    unsigned long long ultima;
+    while (num_secuencias < MAX_CLIENTES_CONOCIDOS && fscanf(fp, "%32s %llu", id, &ultima) == 2) {
+        *buscar_secuencia_cliente(id) = ultima;
+    }
+    fclose(fp);
+}
+
+// Guarda la tabla de secuencias (como mucho una vez por segundo salvo con `forzar`): se escribe
+// aparte y se renombra, así que un corte nunca deja el archivo a medias
+void guardar_secuencias(int forzar) {
+    static time_t ultimo_guardado = 0;
+    time_t ahora = time(NULL);
+    if (!forzar && ahora == ultimo_guardado) {
+        return;
+    }
+    ultimo_guardado = ahora;
+
+    FILE *fp = fopen(SECUENCIAS_FILE ".tmp", "w");
+    if (fp == NULL) {
+        perror("Error al guardar las secuencias de los clientes");
+        return;
+    }
+    for (int i = 0; i < num_secuencias; i++) {
+        fprintf(fp, "%s %llu\n", secuencias[i].id, secuencias[i].ultima);
+    }
+    if (fclose(fp) != 0 || rename(SECUENCIAS_FILE ".tmp", SECUENCIAS_FILE) == -1) {
+        perror("Error al guardar las secuencias de los clientes");
+    }
+}
@@ -0,0 +1,596 @@
+#define _GNU_SOURCE // Para splice y O_CLOEXEC
+#include "spool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <stdint.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h> // _mm_crc32_u64 (SSE4.2)
+#endif
+
+#define MAGIA_REGISTRO 0x314c5053u     // "SPL1"
+#define MAGIA_FIN_SEGMENTO 0x4e49465fu // "_FIN": el segmento terminó (su `secuencia` es la del último registro)
+#define MAX_SEGMENTOS_LEIDOS 64        // Segmentos enviados pendientes de confirmar que se recuerdan
+#define ALINEAR_SPOOL(n) (((n) + 7) & ~(size_t)7)
+#define POSICION(indice, desplazamiento) (((unsigned long long)(indice) << 32) | (desplazamiento))
+
+typedef struct {
+    uint32_t magia;
+    uint32_t longitud;  // Bytes del registro tras la cabecera
+    uint64_t secuencia;
+    uint32_t crc;       // CRC32C de esos bytes
+    uint32_t reservado;
+} CabeceraSpool;
+
+typedef struct {
+    unsigned indice;
+    int fd;
+    char *mapa;
+} SegmentoSpool;
+
+static struct {
+    char directorio[4096];
+    char id[33];
+    int fd_bloqueo;                     // Archivo "bloqueo" con flock(2): un solo cliente por directorio
+    // Escritor
+    SegmentoSpool escritura;
+    uint32_t desplazamiento;
+    unsigned long long ultima_secuencia;
+    unsigned long long publicado;       // POSICION() del final de lo escrito (atómica)
+    unsigned long long primera_secuencia_sesion; // Los registros anteriores se comprueban al leerlos
+    // Lector
+    SegmentoSpool lectura;
+    uint32_t posicion_lectura;
+    size_t enviado_registro;            // Bytes ya enviados del registro en la posición de lectura
+    unsigned long long leido;           // POSICION() de lectura (atómica: la consulta el escritor)
+    struct {
+        unsigned indice;
+        unsigned long long ultima;
+    } leidos[MAX_SEGMENTOS_LEIDOS];     // Segmentos enviados enteros, a la espera de confirmación
+    int num_leidos;
+} spool = {"", "", -1, {0, -1, NULL}, 0, 0, 0, 0, {0, -1, NULL}, 0, 0, 0, {{0, 0}}, 0};
+
+// --- CRC32C ---
+
+static uint32_t tabla_crc[256];
+
+/**
+ * @brief Versión escalar del CRC32C (polinomio de Castagnoli, reflejado), byte a byte con tabla.
+ */
+static uint32_t crc32c_escalar(uint32_t crc, const unsigned char *datos, size_t longitud) {
+    while (longitud-- > 0) {
+        crc = tabla_crc[(crc ^ *datos++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+/**
+ * @brief Versión SSE4.2: la instrucción crc32 procesa 8 bytes por iteración.
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *datos, size_t longitud) {
+    uint64_t crc64 = crc;
+    for (; longitud >= 8; datos += 8, longitud -= 8) {
+        uint64_t bloque;
+        memcpy(&bloque, datos, sizeof(bloque));
+        crc64 = _mm_crc32_u64(crc64, bloque);
+    }
+    crc = (uint32_t)crc64;
+    while (longitud-- > 0) {
+        crc = _mm_crc32_u8(crc, *datos++);
+    }
+    return crc;
+}
+#endif
+
+// Implementación elegida por inicializar_crc() según la CPU
+static uint32_t (*crc32c_actualizar)(uint32_t crc, const unsigned char *datos, size_t longitud) = crc32c_escalar;
+
+static void inicializar_crc(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0x82f63b78u : crc >> 1;
+        }
+        tabla_crc[i] = crc;
+    }
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc32c_actualizar = crc32c_sse42;
+    }
+#endif
+}
+
+static uint32_t crc32c(const char *datos, size_t longitud) {
+    return ~crc32c_actualizar(~0u, (const unsigned char *)datos, longitud);
+}
+
+// --- Segmentos ---
+
+static void ruta_segmento(char *ruta, size_t tamano, unsigned indice) {
+    snprintf(ruta, tamano, "%s/segmento-%08u.spool", spool.directorio, indice);
+}
+
+/**
+ * @brief Abre (o crea, reservando ya su espacio en disco) y mapea un segmento.
+ * Con el espacio reservado, escribir en el mapeo no puede fallar por disco lleno (SIGBUS).
+ */
+static int abrir_segmento(SegmentoSpool *segmento, unsigned indice, int crear) {
+    char ruta[4200];
+    ruta_segmento(ruta, sizeof(ruta), indice);
+    int fd = open(ruta, (crear ? O_RDWR | O_CREAT : O_RDONLY) | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        perror(ruta);
+        return -1;
+    }
+    if (crear) {
+        int error = posix_fallocate(fd, 0, TAMANO_SEGMENTO_SPOOL);
+        if (error == EOPNOTSUPP || error == EINVAL) {
+            error = ftruncate(fd, TAMANO_SEGMENTO_SPOOL) == -1 ? errno : 0;
+        }
+        if (error != 0) {
+            errno = error;
+            perror("Error al reservar un segmento del spool");
+            close(fd);
+            return -1;
+        }
+    }
+    char *mapa = mmap(NULL, TAMANO_SEGMENTO_SPOOL, crear ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    if (mapa == MAP_FAILED) {
+        perror("Error al mapear un segmento del spool");
+        close(fd);
+        return -1;
+    }
+    segmento->indice = indice;
+    segmento->fd = fd;
+    segmento->mapa = mapa;
+    return 0;
+}
+
+static void cerrar_segmento(SegmentoSpool *segmento) {
+    if (segmento->mapa != NULL) munmap(segmento->mapa, TAMANO_SEGMENTO_SPOOL);
+    if (segmento->fd != -1) close(segmento->fd);
+    segmento->mapa = NULL;
+    segmento->fd = -1;
+}
+
+static void borrar_segmento(unsigned indice) {
+    char ruta[4200];
+    ruta_segmento(ruta, sizeof(ruta), indice);
+    if (unlink(ruta) == -1 && errno != ENOENT) {
+        perror(ruta);
+    }
+}
+
+// Índices del segmento más antiguo y del más reciente del directorio (0 si no hay ninguno)
+static void buscar_segmentos(unsigned *primero, unsigned *ultimo) {
+    *primero = *ultimo = 0;
+    DIR *directorio = opendir(spool.directorio);
+    if (directorio == NULL) return;
+
+    struct dirent *entrada;
+    while ((entrada = readdir(directorio)) != NULL) {
+        unsigned indice;
+        char sufijo[8];
+        if (sscanf(entrada->d_name, "segmento-%8u.%7s", &indice, sufijo) == 2 && strcmp(sufijo, "spool") == 0 && indice > 0) {
+            if (*primero == 0 || indice < *primero) *primero = indice;
+            if (indice > *ultimo) *ultimo = indice;
+        }
+    }
+    closedir(directorio);
+}
+
+// Indica si hay un registro completo y correcto en `desplazamiento`
+static int registro_valido(const char *mapa, uint32_t desplazamiento) {
+    const CabeceraSpool *cabecera = (const CabeceraSpool *)(mapa + desplazamiento);
+    return desplazamiento + sizeof(CabeceraSpool) <= TAMANO_SEGMENTO_SPOOL && cabecera->magia == MAGIA_REGISTRO &&
+           cabecera->longitud <= TAMANO_SEGMENTO_SPOOL - desplazamiento - sizeof(CabeceraSpool) &&
+           crc32c(mapa + desplazamiento + sizeof(CabeceraSpool), cabecera->longitud) == cabecera->crc;
+}
+
+static void publicar(void) {
+    __atomic_store_n(&spool.publicado, POSICION(spool.escritura.indice, spool.desplazamiento), __ATOMIC_RELEASE);
+}
+
+// --- Apertura ---
+
+// Lee el identificador del cliente o, la primera vez, lo genera
+static int cargar_id(void) {
+    char ruta[4200];
+    snprintf(ruta, sizeof(ruta), "%s/id", spool.directorio);
+    FILE *archivo = fopen(ruta, "r");
+    if (archivo != NULL) {
+        int leido = fscanf(archivo, "%32s", spool.id) == 1 && strlen(spool.id) == 32;
+        fclose(archivo);
+        if (leido) return 0;
+    }
+
+    unsigned char aleatorio[16];
+    if (getrandom(aleatorio, sizeof(aleatorio), 0) != sizeof(aleatorio)) {
+        perror("Error al generar el identificador del cliente");
+        return -1;
+    }
+    for (size_t i = 0; i < sizeof(aleatorio); i++) {
+        snprintf(spool.id + 2 * i, 3, "%02x", aleatorio[i]);
+    }
+    archivo = fopen(ruta, "w");
+    if (archivo == NULL) {
+        perror(ruta);
+        return -1;
+    }
+    fprintf(archivo, "%s\n", spool.id);
+    fclose(archivo);
+    return 0;
+}
+
+// Última secuencia guardada al cerrar (por si ya no queda ningún registro en los segmentos)
+static unsigned long long leer_secuencia_guardada(void) {
+    char ruta[4200];
+    unsigned long long secuencia = 0;
+    snprintf(ruta, sizeof(ruta), "%s/secuencia", spool.directorio);
+    FILE *archivo = fopen(ruta, "r");
+    if (archivo != NULL) {
+        if (fscanf(archivo, "%llu", &secuencia) != 1) secuencia = 0;
+        fclose(archivo);
+    }
+    return secuencia;
+}
+
+/**
+ * @brief Abre el último segmento para seguir escribiendo. Se recorta en el primer registro
+ * incompleto o corrupto (un corte a mitad de escritura); si el segmento ya terminó, se crea otro.
+ */
+static int recuperar_escritura(unsigned ultimo) {
+    char ruta[4200];
+    ruta_segmento(ruta, sizeof(ruta), ultimo);
+    int fd = open(ruta, O_RDWR | O_CLOEXEC);
+    if (fd == -1) {
+        perror(ruta);
+        return -1;
+    }
+    char *mapa = mmap(NULL, TAMANO_SEGMENTO_SPOOL, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapa == MAP_FAILED) {
+        perror("Error al mapear el último segmento del spool");
+        close(fd);
+        return -1;
+    }
+
+    uint32_t desplazamiento = 0;
+    int terminado = 0;
+    while (registro_valido(mapa, desplazamiento)) {
+        const CabeceraSpool *cabecera = (const CabeceraSpool *)(mapa + desplazamiento);
+        spool.ultima_secuencia = cabecera->secuencia;
+        desplazamiento += sizeof(CabeceraSpool) + ALINEAR_SPOOL(cabecera->longitud);
+    }
+    if (desplazamiento + sizeof(CabeceraSpool) <= TAMANO_SEGMENTO_SPOOL &&
+        ((const CabeceraSpool *)(mapa + desplazamiento))->magia == MAGIA_FIN_SEGMENTO) {
+        terminado = 1;
+    } else if (desplazamiento + sizeof(CabeceraSpool) <= TAMANO_SEGMENTO_SPOOL) {
+        // Se borra lo que haya tras el último registro bueno (queda a ceros): una recuperación posterior
+        // no debe confundir restos de antes del corte con registros nuevos
+        if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, desplazamiento,
+                      TAMANO_SEGMENTO_SPOOL - desplazamiento) == -1) {
+            memset(mapa + desplazamiento, 0, TAMANO_SEGMENTO_SPOOL - desplazamiento);
+        }
+    }
+    munmap(mapa, TAMANO_SEGMENTO_SPOOL);
+    close(fd);
+
+    if (terminado) {
+        if (abrir_segmento(&spool.escritura, ultimo + 1, 1) == -1) return -1;
+        spool.desplazamiento = 0;
+    } else {
+        if (abrir_segmento(&spool.escritura, ultimo, 1) == -1) return -1;
+        spool.desplazamiento = desplazamiento;
+    }
+    return 0;
+}
+
+int spool_abrir(const char *directorio) {
+    inicializar_crc();
+    snprintf(spool.directorio, sizeof(spool.directorio), "%s", directorio);
+    if (mkdir(spool.directorio, 0700) == -1 && errno != EEXIST) {
+        perror(spool.directorio);
+        return -1;
+    }
+    char ruta[4200];
+    snprintf(ruta, sizeof(ruta), "%s/bloqueo", spool.directorio);
+    spool.fd_bloqueo = open(ruta, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (spool.fd_bloqueo == -1) {
+        perror(ruta);
+        return -1;
+    }
+    if (flock(spool.fd_bloqueo, LOCK_EX | LOCK_NB) == -1) {
+        int error = errno;
+        if (error != EWOULDBLOCK) perror(ruta);
+        close(spool.fd_bloqueo);
+        spool.fd_bloqueo = -1;
+        errno = error; // EWOULDBLOCK: otro cliente usa este spool
+        return -1;
+    }
+    if (cargar_id() == -1) return -1;
+
+    unsigned primero, ultimo;
+    buscar_segmentos(&primero, &ultimo);
+    if (ultimo == 0) {
+        if (abrir_segmento(&spool.escritura, 1, 1) == -1) return -1;
+        spool.desplazamiento = 0;
+    } else if (recuperar_escritura(ultimo) == -1) {
+        return -1;
+    }
+    unsigned long long guardada = leer_secuencia_guardada();
+    if (guardada > spool.ultima_secuencia) {
+        spool.ultima_secuencia = guardada;
+    }
+    spool.primera_secuencia_sesion = spool.ultima_secuencia + 1;
+    publicar();
+    return 0;
+}
+
+void spool_cerrar(void) {
+    char ruta[4200];
+    snprintf(ruta, sizeof(ruta), "%s/secuencia", spool.directorio);
+    FILE *archivo = fopen(ruta, "w");
+    if (archivo != NULL) {
+        fprintf(archivo, "%llu\n", spool.ultima_secuencia);
+        fclose(archivo);
+    }
+    cerrar_segmento(&spool.escritura);
+    cerrar_segmento(&spool.lectura);
+    if (spool.fd_bloqueo != -1) close(spool.fd_bloqueo);
+    spool.fd_bloqueo = -1;
+}
+
+const char *spool_directorio(void) {
+    return spool.directorio;
+}
+
+const char *spool_id(void) {
+    return spool.id;
+}
+
+unsigned long long spool_ultima_secuencia(void) {
+    return spool.ultima_secuencia;
+}
+
+// --- Escritor ---
+
+/**
+ * @brief Deja sitio para un registro de `longitud` bytes: si no cabe (con la marca de fin detrás),
+ * cierra el segmento con la marca y pasa al siguiente.
+ */
+static int reservar_registro(size_t longitud) {
+    size_t necesario = sizeof(CabeceraSpool) + ALINEAR_SPOOL(longitud) + sizeof(CabeceraSpool);
+    if (necesario > TAMANO_SEGMENTO_SPOOL) {
+        fprintf(stderr, "spool: registro de %zu bytes demasiado grande\n", longitud);
+        return -1;
+    }
+    if (spool.escritura.mapa == NULL) return -1;
+    if (spool.desplazamiento + necesario <= TAMANO_SEGMENTO_SPOOL) return 0;
+
+    SegmentoSpool siguiente;
+    if (abrir_segmento(&siguiente, spool.escritura.indice + 1, 1) == -1) return -1;
+    CabeceraSpool *fin = (CabeceraSpool *)(spool.escritura.mapa + spool.desplazamiento);
+    fin->longitud = 0;
+    fin->secuencia = spool.ultima_secuencia;
+    fin->crc = 0;
+    fin->magia = MAGIA_FIN_SEGMENTO;
+    cerrar_segmento(&spool.escritura);
+    spool.escritura = siguiente;
+    spool.desplazamiento = 0;
+    publicar(); // El lector ve la marca de fin antes que el segmento nuevo
+    return 0;
+}
+
+// Completa la cabecera del registro recién escrito (con su CRC) y lo publica
+static void cerrar_registro(size_t longitud) {
+    CabeceraSpool *cabecera = (CabeceraSpool *)(spool.escritura.mapa + spool.desplazamiento);
+    cabecera->longitud = (uint32_t)longitud;
+    cabecera->secuencia = ++spool.ultima_secuencia;
+    cabecera->crc = crc32c(spool.escritura.mapa + spool.desplazamiento + sizeof(CabeceraSpool), longitud);
+    cabecera->reservado = 0;
+    cabecera->magia = MAGIA_REGISTRO;
+    spool.desplazamiento += sizeof(CabeceraSpool) + ALINEAR_SPOOL(longitud);
+    publicar();
+}
+
+int spool_anadir(const char *const partes[], const size_t longitudes[], int num_partes) {
+    size_t longitud = 0;
+    for (int i = 0; i < num_partes; i++) {
+        longitud += longitudes[i];
+    }
+    if (reservar_registro(longitud) == -1) return -1;
+
+    char *destino = spool.escritura.mapa + spool.desplazamiento + sizeof(CabeceraSpool);
+    for (int i = 0; i < num_partes; i++) {
+        memcpy(destino, partes[i], longitudes[i]);
+        destino += longitudes[i];
+    }
+    cerrar_registro(longitud);
+    return 0;
+}
+
+/**
+ * @brief Añade un registro con un prefijo y `longitud` bytes de un pipe, que pasan al archivo con
+ * splice(2) sin copiarse en el proceso (el CRC se calcula después sobre el mapeo).
+ */
+int spool_anadir_pipe(const char *prefijo, size_t longitud_prefijo, int fd_pipe, size_t longitud) {
+    if (reservar_registro(longitud_prefijo + longitud) == -1) return -1;
+
+    uint32_t inicio = spool.desplazamiento + sizeof(CabeceraSpool);
+    memcpy(spool.escritura.mapa + inicio, prefijo, longitud_prefijo);
+    loff_t destino = inicio + longitud_prefijo;
+    size_t restantes = longitud;
+    while (restantes > 0) {
+        ssize_t movidos = splice(fd_pipe, NULL, spool.escritura.fd, &destino, restantes, SPLICE_F_MOVE);
+        if (movidos == -1 && errno == EINTR) continue;
+        if (movidos <= 0) {
+            perror("Error al pasar la salida al spool");
+            return -1; // El registro no se publica: se sobrescribirá con el siguiente
+        }
+        restantes -= movidos;
+    }
+    cerrar_registro(longitud_prefijo + longitud);
+    return 0;
+}
+
+// --- Lector ---
+
+static void publicar_lectura(void) {
+    __atomic_store_n(&spool.leido, POSICION(spool.lectura.indice, spool.posicion_lectura), __ATOMIC_RELEASE);
+}
+
+// Pasa al segmento siguiente; el que se deja queda pendiente de confirmación con su última secuencia
+static int pasar_al_siguiente_segmento(unsigned long long ultima) {
+    unsigned indice = spool.lectura.indice;
+    if (spool.num_leidos == MAX_SEGMENTOS_LEIDOS) {
+        memmove(spool.leidos, spool.leidos + 1, sizeof(spool.leidos[0]) * (MAX_SEGMENTOS_LEIDOS - 1));
+        spool.num_leidos--; // El más antiguo ya no se borrará hasta la próxima búsqueda
+    }
+    spool.leidos[spool.num_leidos].indice = indice;
+    spool.leidos[spool.num_leidos].ultima = ultima;
+    spool.num_leidos++;
+
+    cerrar_segmento(&spool.lectura);
+    if (abrir_segmento(&spool.lectura, indice + 1, 0) == -1) {
+        spool.lectura.indice = indice + 1;
+        return -1;
+    }
+    spool.posicion_lectura = 0;
+    spool.enviado_registro = 0;
+    publicar_lectura();
+    return 0;
+}
+
+int spool_lector_buscar(unsigned long long confirmada) {
+    unsigned long long publicado = __atomic_load_n(&spool.publicado, __ATOMIC_ACQUIRE);
+    unsigned indice_escritura = (unsigned)(publicado >> 32);
+    unsigned primero, ultimo;
+
+    buscar_segmentos(&primero, &ultimo);
+    if (primero == 0 || primero > indice_escritura) primero = indice_escritura;
+    spool.num_leidos = 0;
+    cerrar_segmento(&spool.lectura);
+
+    for (unsigned indice = primero; indice <= indice_escritura; indice++) {
+        if (abrir_segmento(&spool.lectura, indice, 0) == -1) continue;
+        uint32_t limite = indice == indice_escritura ? (uint32_t)publicado : TAMANO_SEGMENTO_SPOOL;
+        uint32_t desplazamiento = 0;
+        while (desplazamiento + sizeof(CabeceraSpool) <= limite) {
+            const CabeceraSpool *cabecera = (const CabeceraSpool *)(spool.lectura.mapa + desplazamiento);
+            if (cabecera->magia != MAGIA_REGISTRO) break;
+            if (cabecera->secuencia > confirmada) {
+                spool.posicion_lectura = desplazamiento;
+                spool.enviado_registro = 0;
+                publicar_lectura();
+                return 0;
+            }
+            desplazamiento += sizeof(CabeceraSpool) + ALINEAR_SPOOL(cabecera->longitud);
+        }
+        if (indice == indice_escritura) {
+            spool.posicion_lectura = desplazamiento; // Todo confirmado: se espera a lo siguiente
+            spool.enviado_registro = 0;
+            publicar_lectura();
+            return 0;
+        }
+        // Segmento terminado y confirmado entero (o corrupto desde aquí): no hace falta reenviarlo
+        if (((const CabeceraSpool *)(spool.lectura.mapa + desplazamiento))->magia == MAGIA_FIN_SEGMENTO) {
+            cerrar_segmento(&spool.lectura);
+            borrar_segmento(indice);
+        } else {
+            fprintf(stderr, "spool: segmento %u dañado en el byte %u; se omite el resto\n", indice, desplazamiento);
+            cerrar_segmento(&spool.lectura);
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Prepara como iovecs (sobre el mapeo, sin copiar) los registros publicados desde la posición
+ * de lectura, sin moverla: la mueve spool_lector_avanzar con lo que de verdad se envió. Solo se
+ * comprueba el CRC de los registros de sesiones anteriores; los de esta sesión no han pasado por un corte.
+ */
+int spool_lector_preparar(struct iovec *iov, int max_iov) {
+    if (spool.lectura.mapa == NULL && abrir_segmento(&spool.lectura, spool.lectura.indice, 0) == -1) {
+        return 0;
+    }
+    int n = 0;
+    uint32_t posicion = spool.posicion_lectura;
+    size_t ya_enviado = spool.enviado_registro;
+
+    while (n < max_iov) {
+        unsigned long long publicado = __atomic_load_n(&spool.publicado, __ATOMIC_ACQUIRE);
+        unsigned indice_escritura = (unsigned)(publicado >> 32);
+        uint32_t limite = spool.lectura.indice == indice_escritura ? (uint32_t)publicado : TAMANO_SEGMENTO_SPOOL;
+        if (posicion + sizeof(CabeceraSpool) > limite) break;
+
+        const CabeceraSpool *cabecera = (const CabeceraSpool *)(spool.lectura.mapa + posicion);
+        if (cabecera->magia == MAGIA_REGISTRO && (cabecera->secuencia >= spool.primera_secuencia_sesion || ya_enviado > 0 ||
+                                                  registro_valido(spool.lectura.mapa, posicion))) {
+            iov[n].iov_base = spool.lectura.mapa + posicion + sizeof(CabeceraSpool) + ya_enviado;
+            iov[n].iov_len = cabecera->longitud - ya_enviado;
+            n++;
+            posicion += sizeof(CabeceraSpool) + ALINEAR_SPOOL(cabecera->longitud);
+            ya_enviado = 0;
+            continue;
+        }
+        if (n > 0 || spool.lectura.indice == indice_escritura) break;
+
+        // Fin del segmento (o registro dañado de una sesión anterior: se salta el resto del segmento)
+        if (cabecera->magia != MAGIA_FIN_SEGMENTO) {
+            fprintf(stderr, "spool: registro dañado en el segmento %u (byte %u); se omite el resto\n",
+                    spool.lectura.indice, posicion);
+        }
+        if (pasar_al_siguiente_segmento(cabecera->magia == MAGIA_FIN_SEGMENTO ? cabecera->secuencia : 0) == -1) {
+            return 0;
+        }
+        posicion = 0;
+        ya_enviado = 0;
+    }
+    return n;
+}
+
+void spool_lector_avanzar(size_t bytes) {
+    while (bytes > 0) {
+        const CabeceraSpool *cabecera = (const CabeceraSpool *)(spool.lectura.mapa + spool.posicion_lectura);
+        size_t resto = cabecera->longitud - spool.enviado_registro;
+        if (bytes < resto) {
+            spool.enviado_registro += bytes;
+            return;
+        }
+        bytes -= resto;
+        spool.enviado_registro = 0;
+        spool.posicion_lectura += sizeof(CabeceraSpool) + ALINEAR_SPOOL(cabecera->longitud);
+    }
+    publicar_lectura();
+}
+
+size_t spool_pendiente(void) {
+    unsigned long long publicado = __atomic_load_n(&spool.publicado, __ATOMIC_ACQUIRE);
+    unsigned long long leido = __atomic_load_n(&spool.leido, __ATOMIC_ACQUIRE);
+    long long segmentos = (long long)(publicado >> 32) - (long long)(leido >> 32);
+    long long bytes = segmentos * TAMANO_SEGMENTO_SPOOL + (long long)(uint32_t)publicado - (long long)(uint32_t)leido;
+    return bytes > 0 ? (size_t)bytes : 0;
+}
+
+void spool_confirmar(unsigned long long secuencia) {
+    int borrados = 0;
+    while (borrados < spool.num_leidos && spool.leidos[borrados].ultima <= secuencia) {
+        borrar_segmento(spool.leidos[borrados].indice);
+        borrados++;
+    }
+    spool.num_leidos -= borrados;
+    memmove(spool.leidos, spool.leidos + borrados, sizeof(spool.leidos[0]) * spool.num_leidos);
+}
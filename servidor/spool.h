@@ -0,0 +1,36 @@
+#ifndef SPOOL_H
+#define SPOOL_H
+
+// spool: registro local de todo lo que el cliente envía al servidor, en disco y solo de añadir.
+//
+// El spool es un directorio con un archivo "id" (identificador del cliente ante el servidor) y
+// segmentos "segmento-NNNNNNNN.spool" de TAMANO_SEGMENTO_SPOOL bytes. Cada registro lleva su número
+// de secuencia y un CRC32C de sus bytes; tras un corte, el último segmento se recorta en el primer
+// registro incompleto o corrupto. Hay un solo escritor (el shell) y un solo lector (el hilo emisor),
+// que lee hasta la posición publicada por el escritor sin locks. Los segmentos se borran cuando el
+// servidor confirma todos sus registros.
+
+#include <stddef.h>    // Para size_t
+#include <sys/uio.h>   // Para struct iovec
+
+#define TAMANO_SEGMENTO_SPOOL (16 * 1024 * 1024)
+#define MAX_PARTES_SPOOL 4 // Partes de un registro (se escriben seguidas)
+
+int spool_abrir(const char *directorio);   // Crea o recupera el spool (0 si va bien, -1 si no; errno EWOULDBLOCK si lo usa otro cliente)
+void spool_cerrar(void);
+const char *spool_directorio(void);
+const char *spool_id(void);                // Identificador del cliente (32 dígitos hexadecimales)
+unsigned long long spool_ultima_secuencia(void); // Secuencia del último registro escrito (0: ninguno)
+
+// --- Escritor (shell) ---
+int spool_anadir(const char *const partes[], const size_t longitudes[], int num_partes); // Registro con la siguiente secuencia
+int spool_anadir_pipe(const char *prefijo, size_t longitud_prefijo, int fd_pipe, size_t longitud); // Prefijo + bytes del pipe (splice)
+
+// --- Lector (hilo emisor) ---
+int spool_lector_buscar(unsigned long long confirmada); // Se coloca en el primer registro posterior a `confirmada`
+int spool_lector_preparar(struct iovec *iov, int max_iov); // Bytes pendientes hasta lo publicado, como iovecs (0: nada)
+void spool_lector_avanzar(size_t bytes);    // Marca como enviados `bytes` de lo preparado
+size_t spool_pendiente(void);               // Bytes escritos y aún no enviados (aproximado)
+void spool_confirmar(unsigned long long secuencia); // Borra los segmentos ya enviados y confirmados hasta `secuencia`
+
+#endif // SPOOL_H
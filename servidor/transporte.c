@@ -0,0 +1,207 @@
+#define _GNU_SOURCE // Para struct ucred y SCM_CREDENTIALS
+#include "transporte.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+static const char prefijo_unix[] = "unix:";
+#define LONGITUD_PREFIJO_UNIX (sizeof(prefijo_unix) - 1)
+
+/**
+ * @brief Convierte el texto de una dirección (ver transporte.h) en la dirección del socket. En un
+ * nombre abstracto, sun_path empieza por '\0' y la longitud cuenta solo los bytes del nombre.
+ */
+int transporte_parsear(const char *texto, DireccionServidor *direccion) {
+    memset(direccion, 0, sizeof(*direccion));
+    if (strlen(texto) >= sizeof(direccion->texto)) return -1;
+    snprintf(direccion->texto, sizeof(direccion->texto), "%s", texto);
+
+    if (strncmp(texto, prefijo_unix, LONGITUD_PREFIJO_UNIX) == 0) {
+        const char *ruta = texto + LONGITUD_PREFIJO_UNIX;
+        struct sockaddr_un *local = (struct sockaddr_un *)&direccion->direccion;
+        size_t longitud = strlen(ruta);
+        if (longitud == 0 || strcmp(ruta, "@") == 0 || longitud > sizeof(local->sun_path) - 1) return -1;
+        local->sun_family = AF_UNIX;
+        memcpy(local->sun_path, ruta, longitud);
+        if (ruta[0] == '@') {
+            local->sun_path[0] = '\0';
+            direccion->longitud = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + longitud);
+        } else {
+            direccion->longitud = (socklen_t)sizeof(*local);
+        }
+        direccion->familia = AF_UNIX;
+        return 0;
+    }
+
+    // "<ip>:<puerto>" (sin IP: todas las interfaces)
+    const char *dos_puntos = strrchr(texto, ':');
+    char ip[INET_ADDRSTRLEN];
+    int puerto;
+    char resto;
+    if (dos_puntos == NULL || (size_t)(dos_puntos - texto) >= sizeof(ip) ||
+        sscanf(dos_puntos + 1, "%d%c", &puerto, &resto) != 1 || puerto <= 0 || puerto > 65535) {
+        return -1;
+    }
+    memcpy(ip, texto, (size_t)(dos_puntos - texto));
+    ip[dos_puntos - texto] = '\0';
+    struct sockaddr_in *remota = (struct sockaddr_in *)&direccion->direccion;
+    remota->sin_family = AF_INET;
+    remota->sin_port = htons((uint16_t)puerto);
+    if (ip[0] == '\0') {
+        remota->sin_addr.s_addr = INADDR_ANY;
+    } else if (inet_pton(AF_INET, ip, &remota->sin_addr) != 1) {
+        return -1;
+    }
+    direccion->longitud = (socklen_t)sizeof(*remota);
+    direccion->familia = AF_INET;
+    return 0;
+}
+
+/**
+ * @brief Un socket local en el sistema de archivos que ya existe se reutiliza si nadie escucha en
+ * él (lo dejó un servidor que terminó sin borrarlo); si hay otro servidor, no se le quita la ruta.
+ */
+static int liberar_ruta(const DireccionServidor *direccion) {
+    const struct sockaddr_un *local = (const struct sockaddr_un *)&direccion->direccion;
+    struct stat informacion;
+    if (local->sun_path[0] == '\0' || stat(local->sun_path, &informacion) == -1) return 0;
+    if (!S_ISSOCK(informacion.st_mode)) {
+        fprintf(stderr, "%s existe y no es un socket\n", local->sun_path);
+        return -1;
+    }
+    int prueba = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (prueba == -1) return -1;
+    int ocupada = connect(prueba, (const struct sockaddr *)local, direccion->longitud) == 0;
+    close(prueba);
+    if (ocupada) {
+        fprintf(stderr, "Ya hay un servidor escuchando en %s\n", local->sun_path);
+        return -1;
+    }
+    unlink(local->sun_path);
+    return 0;
+}
+
+int transporte_escuchar(const DireccionServidor *direccion, int pendientes) {
+    if (direccion->familia == AF_UNIX && liberar_ruta(direccion) == -1) {
+        return -1;
+    }
+    int fd = socket(direccion->familia, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("Error al crear el socket");
+        return -1;
+    }
+
+    int activar = 1;
+    if (direccion->familia == AF_INET) {
+        if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &activar, sizeof(activar)) == -1) {
+            perror("setsockopt");
+            close(fd);
+            return -1;
+        }
+    } else if (setsockopt(fd, SOL_SOCKET, SO_PASSCRED, &activar, sizeof(activar)) == -1) {
+        // Las conexiones aceptadas lo heredan: sus mensajes traen las credenciales del cliente
+        perror("setsockopt (SO_PASSCRED)");
+        close(fd);
+        return -1;
+    }
+
+    if (bind(fd, (const struct sockaddr *)&direccion->direccion, direccion->longitud) == -1) {
+        perror("Error al enlazar el socket");
+        close(fd);
+        return -1;
+    }
+    if (listen(fd, pendientes) == -1) {
+        perror("Error al escuchar en el socket");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+ssize_t transporte_enviar_credenciales(int fd, const void *datos, size_t longitud, const int *fds, int num_fds) {
+    struct iovec iov = {(void *)datos, longitud};
+    union {
+        char buffer[CMSG_SPACE(sizeof(struct ucred)) + CMSG_SPACE(TRANSPORTE_MAX_FDS * sizeof(int))];
+        struct cmsghdr alineacion;
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct msghdr mensaje = {0};
+    mensaje.msg_iov = &iov;
+    mensaje.msg_iovlen = 1;
+    mensaje.msg_control = control.buffer;
+    mensaje.msg_controllen = CMSG_SPACE(sizeof(struct ucred));
+    if (num_fds > 0) mensaje.msg_controllen += CMSG_SPACE((size_t)num_fds * sizeof(int));
+
+    struct cmsghdr *cabecera = CMSG_FIRSTHDR(&mensaje);
+    cabecera->cmsg_level = SOL_SOCKET;
+    cabecera->cmsg_type = SCM_CREDENTIALS;
+    cabecera->cmsg_len = CMSG_LEN(sizeof(struct ucred));
+    struct ucred propias = {getpid(), getuid(), getgid()}; // El núcleo rechaza otras (EPERM)
+    memcpy(CMSG_DATA(cabecera), &propias, sizeof(propias));
+    if (num_fds > 0) {
+        cabecera = CMSG_NXTHDR(&mensaje, cabecera);
+        cabecera->cmsg_level = SOL_SOCKET;
+        cabecera->cmsg_type = SCM_RIGHTS;
+        cabecera->cmsg_len = CMSG_LEN((size_t)num_fds * sizeof(int));
+        memcpy(CMSG_DATA(cabecera), fds, (size_t)num_fds * sizeof(int));
+    }
+    return sendmsg(fd, &mensaje, MSG_NOSIGNAL);
+}
+
+/**
+ * @brief Los fds que lleguen de más (o en un mensaje con otros datos de control) se cierran: el
+ * cliente no puede dejarle al servidor descriptores abiertos que nadie va a usar.
+ */
+ssize_t transporte_recibir(int fd, void *buffer, size_t tamano, CredencialesCliente *credenciales, int *con_credenciales,
+                           int *fds, int *num_fds) {
+    struct iovec iov = {buffer, tamano};
+    union {
+        char buffer[CMSG_SPACE(sizeof(struct ucred)) + CMSG_SPACE(TRANSPORTE_MAX_FDS * sizeof(int))];
+        struct cmsghdr alineacion;
+    } control;
+    struct msghdr mensaje = {0};
+    mensaje.msg_iov = &iov;
+    mensaje.msg_iovlen = 1;
+    mensaje.msg_control = control.buffer;
+    mensaje.msg_controllen = sizeof(control.buffer);
+
+    *con_credenciales = 0;
+    *num_fds = 0;
+    ssize_t recibidos = recvmsg(fd, &mensaje, MSG_CMSG_CLOEXEC);
+    if (recibidos <= 0) return recibidos;
+    for (struct cmsghdr *cabecera = CMSG_FIRSTHDR(&mensaje); cabecera != NULL; cabecera = CMSG_NXTHDR(&mensaje, cabecera)) {
+        if (cabecera->cmsg_level != SOL_SOCKET) continue;
+        if (cabecera->cmsg_type == SCM_CREDENTIALS && cabecera->cmsg_len == CMSG_LEN(sizeof(struct ucred))) {
+            struct ucred recibidas;
+            memcpy(&recibidas, CMSG_DATA(cabecera), sizeof(recibidas));
+            credenciales->pid = recibidas.pid;
+            credenciales->uid = recibidas.uid;
+            credenciales->gid = recibidas.gid;
+            *con_credenciales = 1;
+        } else if (cabecera->cmsg_type == SCM_RIGHTS) {
+            int llegados = (int)((cabecera->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            for (int i = 0; i < llegados; i++) {
+                int recibido;
+                memcpy(&recibido, CMSG_DATA(cabecera) + (size_t)i * sizeof(int), sizeof(int));
+                if (*num_fds < TRANSPORTE_MAX_FDS) {
+                    fds[(*num_fds)++] = recibido;
+                } else {
+                    close(recibido);
+                }
+            }
+        }
+    }
+    if (mensaje.msg_flags & MSG_CTRUNC) { // Se perdió parte del control: no se usa ningún fd
+        for (int i = 0; i < *num_fds; i++) close(fds[i]);
+        *num_fds = 0;
+    }
+    return recibidos;
+}
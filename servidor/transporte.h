@@ -0,0 +1,47 @@
+#ifndef TRANSPORTE_H
+#define TRANSPORTE_H
+
+// transporte: dirección del servidor y conexión por TCP o por un socket local (AF_UNIX).
+//
+// La dirección es texto, igual en el cliente y en el servidor (MINISHELL_SERVIDOR):
+//   "127.0.0.1:1666"       TCP (en el servidor, la IP en la que escucha; ":1666" escucha en todas)
+//   "unix:/ruta/socket"    socket local en el sistema de archivos
+//   "unix:@nombre"         socket local en el espacio abstracto de Linux (sin archivo que borrar)
+// Con un cliente en la misma máquina, el socket local se ahorra la pila TCP y elegir un puerto libre.
+// Por él, el cliente envía el saludo con sus credenciales (SCM_CREDENTIALS: pid, uid y gid, que el
+// núcleo comprueba) y el servidor sabe qué usuario y qué proceso observa. En el mismo mensaje puede
+// pasarle descriptores (SCM_RIGHTS), como los del anillo de memoria compartida (anillo.h).
+//
+//     DireccionServidor direccion;
+//     if (transporte_parsear("unix:@minishell", &direccion) == 0) {
+//         int fd = socket(direccion.familia, SOCK_STREAM, 0);
+//         connect(fd, (struct sockaddr *)&direccion.direccion, direccion.longitud);
+//     }
+
+#include <stddef.h>      // Para size_t
+#include <sys/types.h>   // Para ssize_t, pid_t, uid_t y gid_t
+#include <sys/socket.h>  // Para struct sockaddr_storage y socklen_t
+
+#define MAX_TEXTO_DIRECCION 128
+#define TRANSPORTE_MAX_FDS 3 // Descriptores que pueden acompañar al saludo (los del anillo)
+
+typedef struct {
+    int familia;                        // AF_INET o AF_UNIX
+    struct sockaddr_storage direccion;
+    socklen_t longitud;
+    char texto[MAX_TEXTO_DIRECCION];    // Para los mensajes ("127.0.0.1:1666", "unix:@minishell"...)
+} DireccionServidor;
+
+typedef struct {
+    pid_t pid;
+    uid_t uid;
+    gid_t gid;
+} CredencialesCliente;
+
+int transporte_parsear(const char *texto, DireccionServidor *direccion); // 0 si es válida, -1 si no
+int transporte_escuchar(const DireccionServidor *direccion, int pendientes); // Socket en escucha (-1 si falla, con el error en stderr)
+ssize_t transporte_enviar_credenciales(int fd, const void *datos, size_t longitud, const int *fds, int num_fds); // send con SCM_CREDENTIALS (y SCM_RIGHTS si num_fds > 0) en un socket local
+ssize_t transporte_recibir(int fd, void *buffer, size_t tamano, CredencialesCliente *credenciales, int *con_credenciales,
+                           int *fds, int *num_fds); // recv que recoge SCM_CREDENTIALS y hasta TRANSPORTE_MAX_FDS descriptores si llegan
+
+#endif // TRANSPORTE_H